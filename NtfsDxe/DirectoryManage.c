@@ -23,7 +23,7 @@ Revision History
 #include "ntfs/list.h"
 #include "ntfs/ntfstime.h"
 /* #include "version.h" */
-#include "logging.h"
+#include "ntfs/logging.h"
 
 
 void ntfs_to_efitime(EFI_TIME *EfiTime, ntfs_time ntfstime)
@@ -42,19 +42,87 @@ void ntfs_to_efitime(EFI_TIME *EfiTime, ntfs_time ntfstime)
 	fsw_efi_decode_time(EfiTime, spec.tv_sec);
 }
 
+static void NtfsFileAttributes(FILE_ATTR_FLAGS flags, BOOLEAN directory, EFI_FILE_INFO *FileInfo)
+{
+	if (directory)
+	{
+		FileInfo->Attribute |= EFI_FILE_DIRECTORY;
+		FileInfo->Attribute |= EFI_FILE_READ_ONLY;
+	}
+	else
+	{
+		//FileInfo->Attribute |= EFI_FILE_ARCHIVE;
+	}
+
+	if (flags & FILE_ATTR_READONLY)
+		FileInfo->Attribute |= EFI_FILE_READ_ONLY;
+
+	if (flags & FILE_ATTR_HIDDEN)
+		FileInfo->Attribute |= EFI_FILE_HIDDEN;
+
+	if (flags & FILE_ATTR_SYSTEM)
+		FileInfo->Attribute |= EFI_FILE_SYSTEM;
+	
+	if (flags & FILE_ATTR_ARCHIVE)
+		FileInfo->Attribute |= EFI_FILE_ARCHIVE;
+}
+
+// describe a directory entry from the copy of its $FILE_NAME index key
+static void NtfsFileInfoFromKey(const ntfs_dir_entry *entry, EFI_FILE_INFO *FileInfo)
+{
+	NtfsFileAttributes(entry->fileAttributes,
+		(entry->fileAttributes & FILE_ATTR_I30_INDEX_PRESENT) != 0, FileInfo);
+
+	if (!(entry->fileAttributes & FILE_ATTR_I30_INDEX_PRESENT))
+	{
+		FileInfo->FileSize = entry->dataSize;
+		FileInfo->PhysicalSize = entry->allocatedSize;
+	}
+
+	ntfs_to_efitime(&FileInfo->CreateTime, entry->creationTime);
+	ntfs_to_efitime(&FileInfo->ModificationTime, entry->lastDataChangeTime);
+	ntfs_to_efitime(&FileInfo->LastAccessTime, entry->lastAccessTime);
+}
+
+// describe a directory entry from its mft record
+static void NtfsFileInfoFromInode(ntfs_inode *inode, EFI_FILE_INFO *FileInfo)
+{
+	ntfs_attr *data_na;
+
+	// check if mft_no is under "FILE_first_user"
+	if (inode->mft_no < FILE_first_user)
+	{
+		FileInfo->Attribute |= EFI_FILE_SYSTEM;	
+		FileInfo->Attribute |= EFI_FILE_READ_ONLY;
+	}
+
+	NtfsFileAttributes(inode->flags,
+		(inode->mrec->flags & MFT_RECORD_IS_DIRECTORY) != 0, FileInfo);
+
+	data_na = ntfs_attr_open(inode, AT_DATA, AT_UNNAMED, 0);
+	if (data_na != NULL)
+	{	// directories have no unnamed data
+		FileInfo->FileSize = data_na->data_size;
+		FileInfo->PhysicalSize = data_na->allocated_size;
+		ntfs_attr_close(data_na);
+	}
+
+	ntfs_to_efitime(&FileInfo->CreateTime, inode->creation_time);
+	ntfs_to_efitime(&FileInfo->ModificationTime, inode->last_data_change_time);
+	ntfs_to_efitime(&FileInfo->LastAccessTime, inode->last_access_time);
+}
+
 EFI_STATUS NtfsReadDirectory(IN NTFS_IFILE *File,
                             IN OUT UINTN *BufferSize,
                             OUT EFI_FILE_INFO *FileInfo)
 {
-	EFI_STATUS Status;
 	NTFS_VOLUME	*Volume = File->Volume;
 	struct _reent r;
 	struct stat filestat;
 	ntfs_dir_state *dir;
 	ntfs_inode *inode;
 	UINTN RequiredSize;
-	ntfs_attr *data_na;
-	UINTN FileNameLength;
+	UINTN FileNameLength, Index;
 
 	ZeroMem(&r, sizeof(struct _reent));
 	
@@ -105,7 +173,7 @@ EFI_STATUS NtfsReadDirectory(IN NTFS_IFILE *File,
 		
 	}
 
-	FileNameLength = strlen(dir->current->name) + 1;
+	FileNameLength = dir->current->nameLen + 1;
 	RequiredSize = sizeof(EFI_FILE_INFO) + (FileNameLength * sizeof(CHAR16));
 
 	if (*BufferSize < RequiredSize)
@@ -116,62 +184,30 @@ EFI_STATUS NtfsReadDirectory(IN NTFS_IFILE *File,
 
 	ZeroMem(FileInfo, RequiredSize);
 
-	inode = ntfs_inode_open(File->Volume->vol, dir->current->mref);	
-	
-	// check if mft_no is under "FILE_first_user"
-	if (inode->mft_no < FILE_first_user)
-	{
-		FileInfo->Attribute |= EFI_FILE_SYSTEM;	
-		FileInfo->Attribute |= EFI_FILE_READ_ONLY;
+	for (Index = 0; Index < FileNameLength; Index++)
+	{	// the entry keeps the name as stored in the index
+		FileInfo->FileName[Index] = le16_to_cpu(dir->current->name[Index]);
 	}
 
-	if (inode->flags & MFT_RECORD_IS_DIRECTORY)
-	{
-		FileInfo->Attribute |= EFI_FILE_DIRECTORY;
-		FileInfo->Attribute |= EFI_FILE_READ_ONLY;
+	if (ntfsDirEntryKeyValid(dir, dir->current))
+	{	// the index key duplicates what we need from the mft record
+		NtfsFileInfoFromKey(dir->current, FileInfo);
 	}
 	else
 	{
-		//FileInfo->Attribute |= EFI_FILE_ARCHIVE;
+		inode = ntfs_inode_open(File->Volume->vol, dir->current->mref);
+		if (inode == NULL)
+		{
+			return EFI_DEVICE_ERROR;
+		}
+		NtfsFileInfoFromInode(inode, FileInfo);
+		// close inode
+		ntfs_inode_close(inode);
 	}
 
-	if (inode->flags & FILE_ATTR_READONLY)
-		FileInfo->Attribute |= EFI_FILE_READ_ONLY;
-
-	if (inode->flags & FILE_ATTR_HIDDEN)
-		FileInfo->Attribute |= EFI_FILE_HIDDEN;
-
-	if (inode->flags & FILE_ATTR_SYSTEM)
-		FileInfo->Attribute |= EFI_FILE_SYSTEM;
-	
-	if (inode->flags & FILE_ATTR_ARCHIVE)
-		FileInfo->Attribute |= EFI_FILE_ARCHIVE;
-
-#ifdef DISABLE_NEW_DEPRECATED_INTERFACES
-	AsciiStrToUnicodeStrS(dir->current->name, FileInfo->FileName, FileNameLength);
-#else
-	AsciiStrToUnicodeStr(dir->current->name, FileInfo->FileName);
-#endif
-	data_na = ntfs_attr_open(inode, AT_DATA, AT_UNNAMED, 0);
-
-	FileInfo->PhysicalSize = inode->allocated_size;
-
-	FileInfo->FileSize = data_na->data_size;
-	FileInfo->PhysicalSize = inode->data_size;
-
-	ntfs_to_efitime(&FileInfo->CreateTime, inode->creation_time);
-	ntfs_to_efitime(&FileInfo->ModificationTime, inode->last_data_change_time);
-	ntfs_to_efitime(&FileInfo->LastAccessTime, inode->last_access_time);
-
-	ntfs_attr_close(data_na);
-
 	FileInfo->Size = RequiredSize;		// required size (Size of the EFI_FILE_INFO structure)
-		
-	//FileInfo->CreateTime = 0;
-	// close inode
-	ntfs_inode_close(inode);
 
-	if (ntfs_dirnext_r(&r, File->state.dir, dir->current->name, &filestat) == -1)
+	if (ntfs_dirnext_r(&r, File->state.dir, NULL, &filestat) == -1)
 		File->Position = -1;	// move to next position!
 	else
 		File->Position++;
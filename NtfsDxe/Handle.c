@@ -14,98 +14,91 @@ Revision History
 #include "Ntfs.h"
 #include "ntfs/ntfsdir.h"
 
-UINTN EFIAPI CreateFileName(CHAR8 *Destination, CHAR8 *Path, CHAR8 *FileName)
-{
-	CHAR8 *Ptr, *ClearPtr;
-	BOOL bReset;
+UINTN
+EFIAPI
+CreateFileName (
+  OUT CHAR16        *Destination,
+  IN  UINTN         DestinationSize,
+  IN  CONST CHAR16  *Path,
+  IN  CONST CHAR16  *FileName
+  )
+/*++
 
-	Ptr = Destination;
-	ClearPtr = Destination;
+Routine Description:
 
-	
-	while(*Path != 0x00)
-	{
-		*Destination++ = *Path++;
-	}
+  Build the normalized absolute path of FileName opened relative to Path.
+  Empty and "." components are dropped and ".." removes the previous one,
+  the result never ends with a separator unless it is the root "\\".
 
-	Destination--;
+Arguments:
 
-	if (AsciiStrCmp(FileName, ".") == 0)
-	{
-		Destination++;
-		goto end;
-	}
+  Destination           - Receives the terminated path.
+  DestinationSize       - Size of Destination in characters.
+  Path                  - Absolute path of the directory FileName is relative to.
+  FileName              - Name given to Open(), absolute when it starts with '\\'.
 
-	if (AsciiStrCmp(FileName, "..") == 0)
-	{	
-		bReset = TRUE;
-		Destination++;
-		*Destination = 0x00;
+Returns:
 
-		while(Destination > Ptr && bReset)
-		{
-			if (*Destination == '\\')
-				bReset = FALSE;
+  The length of the path in characters, 0 when it does not fit in Destination.
 
-			*Destination-- = 0x00;
-		}
-		Destination++;
-		goto end;
-	}
+--*/
+{
+	UINTN Length, Component;
 
-	if (strlen(FileName) > 0)
-		while(*Path == *FileName)
-		{	// skip path
-			Path++;
-			FileName++;
-		}
+	Length = 0;
 
-	if (*Destination == '\\' && *FileName == '\\')
-	{
-		while(*FileName != 0x00)
+	if (*FileName != L'\\')
+	{	// relative name, start from the directory of the handle
+		while (*Path != L'\0')
 		{
-			*Destination++ = *FileName++;
+			if (Length + 1 >= DestinationSize)
+				return 0;
+			Destination[Length++] = *Path++;
 		}
+		while (Length > 0 && Destination[Length - 1] == L'\\')
+			Length--;
 	}
-	else
-	{
-		if (*Destination != '\\' && *FileName != '\\')
-		{
-			Destination++;
-			*Destination = '\\';
 
-		}
+	while (*FileName != L'\0')
+	{
+		while (*FileName == L'\\')
+			FileName++;
 
-		Destination++;
+		for (Component = 0; FileName[Component] != L'\0' && FileName[Component] != L'\\'; Component++)
+			;
 
-		while(*FileName != 0x00)
-		{
-			*Destination++ = *FileName++;
+		if (Component == 0 || (Component == 1 && FileName[0] == L'.'))
+		{	// nothing to add
 		}
-	}
-
-end:
-
-	bReset = FALSE;
-	while(ClearPtr < Destination && *ClearPtr != 0x00)
-	{
-		if (ClearPtr[0] == '\\' && ClearPtr[1] == '\\')
-		{
-			ClearPtr++;
-			ClearPtr[0] = ClearPtr[1];
-			bReset = TRUE;
+		else if (Component == 2 && FileName[0] == L'.' && FileName[1] == L'.')
+		{	// back to the parent, the root is its own parent
+			while (Length > 0 && Destination[Length - 1] != L'\\')
+				Length--;
+			if (Length > 0)
+				Length--;
 		}
 		else
 		{
-			if (bReset)
-			{
-				ClearPtr[0] = ClearPtr[1];
-			}
-			ClearPtr++;
+			if (Length + Component + 2 > DestinationSize)
+				return 0;
+			Destination[Length++] = L'\\';
+			CopyMem(&Destination[Length], FileName, Component * sizeof(CHAR16));
+			Length += Component;
 		}
+
+		FileName += Component;
 	}
 
-	return (UINTN) (Destination - Ptr);
+	if (Length == 0)
+	{	// root directory
+		if (DestinationSize < 2)
+			return 0;
+		Destination[Length++] = L'\\';
+	}
+
+	Destination[Length] = L'\0';
+
+	return Length;
 }
 
 static VOID
@@ -131,7 +124,6 @@ Ntfs_inode_to_FileHandle(
   IN ntfs_inode *inode,
   OUT EFI_FILE **NewFileHandle)
 {
-	EFI_STATUS		Status;
 	NTFS_IFILE		*NewIFile;
 
 	if (inode == NULL)
@@ -147,8 +139,8 @@ Ntfs_inode_to_FileHandle(
 	NewIFile->inode = inode;	//
 	NewIFile->Position = -1;
 
-	memset(NewIFile->FileName, 0, 260);
-	memset(NewIFile->FullPath, 0, 260);
+	ZeroMem(NewIFile->FileName, sizeof(NewIFile->FileName));
+	ZeroMem(NewIFile->FullPath, sizeof(NewIFile->FullPath));
 
 	if ((inode->mrec->flags & MFT_RECORD_IS_DIRECTORY) != 0)
 	{
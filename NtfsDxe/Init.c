@@ -10,23 +10,17 @@ Abstract:
 --*/
 
 #include "Ntfs.h"
+#include "ntfs/ntfs.h"
 #include "ntfs/ntfsinternal.h"
 #include "ntfs/logging.h"
 #include "ntfs/layout.h"
+#include "ntfs/bootsect.h"
 
 EFI_STATUS
 NtfsOpenDevice (
   IN OUT NTFS_VOLUME           *Volume
   );
 
-void DiagnosticSizeOf()
-{
-	ATTR_RECORD *attr_record;
-
-	attr_record = AllocateZeroPool(sizeof(ATTR_RECORD));
-
-}
-
 VOID
 NtfsCreateVolumeName(CHAR8 *RootFileString, UINTN Address)
 {
@@ -42,6 +36,7 @@ EFI_STATUS
 NtfsAllocateVolume (
   IN  EFI_HANDLE                Handle,
   IN  EFI_DISK_IO_PROTOCOL      *DiskIo,
+  IN  EFI_DISK_IO2_PROTOCOL     *DiskIo2,
   IN  EFI_BLOCK_IO_PROTOCOL     *BlockIo
   )
 /*++
@@ -55,6 +50,7 @@ Arguments:
 
   Handle                - The handle of parent device.
   DiskIo                - The DiskIo of parent device.
+  DiskIo2               - The DiskIo2 of parent device, or NULL if not available.
   BlockIo               - The BlockIo of parent devicel
 
 Returns:
@@ -67,7 +63,6 @@ Returns:
 {
   EFI_STATUS  Status;
   NTFS_VOLUME  *Volume;
-  UINT32 MediaId;
 
   ntfsInit();
   //
@@ -85,6 +80,7 @@ Returns:
   Volume->Signature                   = NTFS_VOLUME_SIGNATURE;
   Volume->Handle                      = Handle;
   Volume->DiskIo                      = DiskIo;
+  Volume->DiskIo2                     = DiskIo2;
   Volume->BlockIo                     = BlockIo;
   Volume->MediaId                     = BlockIo->Media->MediaId;
 #ifdef _NTFS_READONLY
@@ -94,14 +90,20 @@ Returns:
 #endif
   Volume->VolumeInterface.Revision    = EFI_SIMPLE_FILE_SYSTEM_PROTOCOL_REVISION;
   Volume->VolumeInterface.OpenVolume  = NtfsOpenVolume;
+  Volume->DiagnosticsInterface.Revision          = NTFS_DIAGNOSTICS_PROTOCOL_REVISION;
+  Volume->DiagnosticsInterface.GetIoStatistics   = NtfsGetIoStatistics;
+  Volume->DiagnosticsInterface.ResetIoStatistics = NtfsResetIoStatistics;
+  Volume->DiagnosticsInterface.GetCacheStatistics = NtfsGetCacheStatistics;
+  Volume->StreamLoadInterface.Revision           = NTFS_STREAM_LOAD_PROTOCOL_REVISION;
+  Volume->StreamLoadInterface.LoadFile           = NtfsStreamLoadFile;
+  Volume->ExtentMapInterface.Revision            = NTFS_EXTENT_MAP_PROTOCOL_REVISION;
+  Volume->ExtentMapInterface.GetExtents          = NtfsGetExtents;
 
   Status = NtfsOpenDevice (Volume);
   if (EFI_ERROR (Status)) {
     goto Done;
   }
 
-  MediaId = BlockIo->Media->MediaId;
-
   Volume->RootFileString[0] = 'n';
   Volume->RootFileString[1] = 't';
   Volume->RootFileString[2] = 'f';
@@ -110,10 +112,13 @@ Returns:
   NtfsCreateVolumeName(Volume->RootFileString, (UINTN) BlockIo);
   
   u32 flags = 0;
+#ifdef _NTFS_FAST_DIR_INFO
+  flags |= NTFS_FAST_DIR_INFO;
+#endif
 #ifdef _NTFS_READONLY
   flags |= NTFS_READ_ONLY;
 #endif
-  Volume->vd = ntfsMount(Volume->RootFileString, Volume, 0, 0, 0, 0, flags);	// 
+  Volume->vd = ntfsMount(Volume->RootFileString, Volume, 0, CACHE_DEFAULT_PAGE_COUNT, CACHE_DEFAULT_PAGE_SIZE, NULL, flags);
   Volume->vol = Volume->vd->vol;
 
   if (Volume->vd == NULL)
@@ -128,6 +133,12 @@ Returns:
                   &Volume->Handle,
                   &gEfiSimpleFileSystemProtocolGuid,
                   &Volume->VolumeInterface,
+                  &gNtfsDiagnosticsProtocolGuid,
+                  &Volume->DiagnosticsInterface,
+                  &gNtfsStreamLoadProtocolGuid,
+                  &Volume->StreamLoadInterface,
+                  &gNtfsExtentMapProtocolGuid,
+                  &Volume->ExtentMapInterface,
                   NULL
                   );
   if (EFI_ERROR (Status)) {
@@ -179,6 +190,12 @@ Returns:
                     Volume->Handle,
                     &gEfiSimpleFileSystemProtocolGuid,
                     &Volume->VolumeInterface,
+                    &gNtfsDiagnosticsProtocolGuid,
+                    &Volume->DiagnosticsInterface,
+                    &gNtfsStreamLoadProtocolGuid,
+                    &Volume->StreamLoadInterface,
+                    &gNtfsExtentMapProtocolGuid,
+                    &Volume->ExtentMapInterface,
                     NULL
                     );
 
@@ -256,8 +273,6 @@ Returns:
 --*/
 {
   EFI_STATUS            Status;
-  UINT32                BlockSize;
-  UINT32                DirtyMask;
   EFI_DISK_IO_PROTOCOL  *DiskIo;
 
   NTFS_BOOT_SECTOR		NtfsBs;
@@ -262,6 +262,7 @@ Returns:
   EFI_STATUS            Status;
   EFI_BLOCK_IO_PROTOCOL *BlockIo;
   EFI_DISK_IO_PROTOCOL  *DiskIo;
+  EFI_DISK_IO2_PROTOCOL *DiskIo2;
   BOOLEAN               LockedByMe;
 
   LockedByMe = FALSE;
@@ -304,11 +305,27 @@ Returns:
   if (EFI_ERROR (Status)) {
     goto Exit;
   }
+
+  //
+  // DiskIo2 is optional, it lets the device layer keep several reads in flight
+  //
+  Status = gBS->OpenProtocol (
+                  ControllerHandle,
+                  &gEfiDiskIo2ProtocolGuid,
+                  (VOID **) &DiskIo2,
+                  This->DriverBindingHandle,
+                  ControllerHandle,
+                  EFI_OPEN_PROTOCOL_BY_DRIVER
+                  );
+  if (EFI_ERROR (Status)) {
+    DiskIo2 = NULL;
+  }
+
   //
   // Allocate Volume structure. In NtfsAllocateVolume(), Resources
   // are allocated with protocol installed and cached initialized
   //
-  Status = NtfsAllocateVolume (ControllerHandle, DiskIo, BlockIo);
+  Status = NtfsAllocateVolume (ControllerHandle, DiskIo, DiskIo2, BlockIo);
 
   //
   // When the media changes on a device it will Reinstall the BlockIo interaface.
@@ -331,6 +348,14 @@ Returns:
              This->DriverBindingHandle,
              ControllerHandle
              );
+      if (DiskIo2 != NULL) {
+        gBS->CloseProtocol (
+               ControllerHandle,
+               &gEfiDiskIo2ProtocolGuid,
+               This->DriverBindingHandle,
+               ControllerHandle
+               );
+      }
     }
   }
 
@@ -400,5 +425,15 @@ Returns:
                   ControllerHandle
                   );
 
+  //
+  // DiskIo2 may not have been opened, ignore the result
+  //
+  gBS->CloseProtocol (
+         ControllerHandle,
+         &gEfiDiskIo2ProtocolGuid,
+         This->DriverBindingHandle,
+         ControllerHandle
+         );
+
   return Status;
 }
@@ -23,12 +23,13 @@ Revision History
 
 #include <Uefi.h>
 
-#ifndef _WINDOWS_APPLICATION
+#if !defined(_WINDOWS_APPLICATION) && !defined(_LINUX_APPLICATION)
 #include <Guid/FileInfo.h>
 #include <Guid/FileSystemInfo.h>
 #include <Guid/FileSystemVolumeLabelInfo.h>
 #include <Protocol/BlockIo.h>
 #include <Protocol/DiskIo.h>
+#include <Protocol/DiskIo2.h>
 #include <Protocol/SimpleFileSystem.h>
 #include <Protocol/UnicodeCollation.h>
 
@@ -41,9 +42,13 @@ Revision History
 #include <Library/UefiDriverEntryPoint.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiRuntimeServicesTableLib.h>
+#include <Library/TimerLib.h>
 #endif
 
 #include "NtfsFileSystem.h"
+#include "NtfsDiagnostics.h"
+#include "NtfsStreamLoad.h"
+#include "NtfsExtentMap.h"
 #include "ntfs/volume.h"
 #include "ntfs/inode.h"
 #include "ntfs/ntfsinternal.h"
@@ -67,6 +72,12 @@ Revision History
 
 #define VOLUME_FROM_VOL_INTERFACE(a) CR (a, NTFS_VOLUME, VolumeInterface, NTFS_VOLUME_SIGNATURE);
 
+#define VOLUME_FROM_DIAG_INTERFACE(a) CR (a, NTFS_VOLUME, DiagnosticsInterface, NTFS_VOLUME_SIGNATURE)
+
+#define VOLUME_FROM_LOAD_INTERFACE(a) CR (a, NTFS_VOLUME, StreamLoadInterface, NTFS_VOLUME_SIGNATURE)
+
+#define VOLUME_FROM_MAP_INTERFACE(a)  CR (a, NTFS_VOLUME, ExtentMapInterface, NTFS_VOLUME_SIGNATURE)
+
 #define ODIR_FROM_DIRCACHELINK(a)    CR (a, NTFS_ODIR, DirCacheLink, NTFS_ODIR_SIGNATURE)
 
 #define OFILE_FROM_CHECKLINK(a)      CR (a, NTFS_OFILE, CheckLink, NTFS_OFILE_SIGNATURE)
@@ -156,8 +167,8 @@ typedef struct {
   } state;
 
   BOOLEAN			 RootDir;
-  CHAR8				FileName[260];			// ""
-  CHAR8				FullPath[260];			// full path
+  CHAR16			FileName[260];			// name given to Open()
+  CHAR16			FullPath[260];			// normalized full path
 } NTFS_IFILE;
 
 //
@@ -213,12 +224,22 @@ typedef struct _NTFS_VOLUME {
 	BOOLEAN                         DiskError;
 
 	EFI_SIMPLE_FILE_SYSTEM_PROTOCOL VolumeInterface;
+	NTFS_DIAGNOSTICS_PROTOCOL       DiagnosticsInterface;
+	NTFS_STREAM_LOAD_PROTOCOL       StreamLoadInterface;
+	NTFS_EXTENT_MAP_PROTOCOL        ExtentMapInterface;
+
+	//
+	// DiskIo counters maintained by the device layer
+	//
+	NTFS_IO_STATISTICS              IoStatistics;
 
 	//
 	// If opened, the parent handle and BlockIo interface
 	//
 	EFI_BLOCK_IO_PROTOCOL           *BlockIo;
 	EFI_DISK_IO_PROTOCOL            *DiskIo;
+	EFI_DISK_IO2_PROTOCOL           *DiskIo2;       // Optional, enables pipelined reads
+	UINT32                          MaxTransferSize; // Largest DiskIo request in bytes, 0 for the default
 	UINT32                          MediaId;
 	BOOLEAN                         ReadOnly;
 
@@ -541,6 +562,7 @@ EFI_STATUS
 NtfsAllocateVolume (
   IN  EFI_HANDLE                Handle,
   IN  EFI_DISK_IO_PROTOCOL      *DiskIo,
+  IN  EFI_DISK_IO2_PROTOCOL     *DiskIo2,
   IN  EFI_BLOCK_IO_PROTOCOL     *BlockIo
   );
 
@@ -590,8 +612,50 @@ NtfsOpenVolume (
   );
 
 
+// NtfsDiagnostics.c
+EFI_STATUS
+EFIAPI
+NtfsGetIoStatistics (
+  IN  NTFS_DIAGNOSTICS_PROTOCOL *This,
+  OUT NTFS_IO_STATISTICS        *Statistics
+  );
+
+EFI_STATUS
+EFIAPI
+NtfsResetIoStatistics (
+  IN  NTFS_DIAGNOSTICS_PROTOCOL *This
+  );
+
+EFI_STATUS
+EFIAPI
+NtfsGetCacheStatistics (
+  IN  NTFS_DIAGNOSTICS_PROTOCOL *This,
+  OUT NTFS_CACHE_STATISTICS     *Statistics
+  );
+
+// NtfsStreamLoad.c
+EFI_STATUS
+EFIAPI
+NtfsStreamLoadFile (
+  IN     NTFS_STREAM_LOAD_PROTOCOL *This,
+  IN     EFI_FILE_PROTOCOL         *File,
+  IN OUT UINTN                     *BufferSize,
+  OUT    VOID                      *Buffer OPTIONAL
+  );
+
+// NtfsExtentMap.c
+EFI_STATUS
+EFIAPI
+NtfsGetExtents (
+  IN     NTFS_EXTENT_MAP_PROTOCOL *This,
+  IN     EFI_FILE_PROTOCOL        *File,
+  IN     CONST CHAR16             *StreamName OPTIONAL,
+  IN OUT UINTN                    *ExtentCount,
+  OUT    NTFS_EXTENT_MAP_ENTRY    *Extents OPTIONAL
+  );
+
 // Handle.c
-UINTN EFIAPI CreateFileName(CHAR8 *Destination, CHAR8 *Path, CHAR8 *FileName);
+UINTN EFIAPI CreateFileName(CHAR16 *Destination, UINTN DestinationSize, CONST CHAR16 *Path, CONST CHAR16 *FileName);
 EFI_STATUS EFIAPI Ntfs_Deallocate(NTFS_IFILE	*IFile);
 
 //
@@ -40,7 +40,7 @@ Returns:
 	EFI_STATUS Status;
 	u8 name_len;
 	ntfs_inode *ni, *dir_ni;
-	CHAR16  *unicode;
+	char    *path;
 
 	IFile = IFILE_FROM_FHAND(FHand);
 
@@ -58,9 +58,17 @@ Returns:
 	if (ni->mft_no < FILE_first_user)	// cannot remove system file!
 		goto free;
 
-	if (ntfsUnlink(IFile->Volume->vd, IFile->FullPath) != 0)
+	path = NULL;
+	if (ntfsUnicodeToLocal((const ntfschar *) IFile->FullPath, (int) StrLen(IFile->FullPath), &path, 0) < 0)
 		goto free;
 
+	if (ntfsUnlink(IFile->Volume->vd, path) != 0)
+	{
+		ntfs_free(path);
+		goto free;
+	}
+	ntfs_free(path);
+
 	Status = EFI_SUCCESS;
 
 /*++
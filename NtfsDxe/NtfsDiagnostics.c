@@ -0,0 +1,216 @@
+/*++
+
+Module Name:
+
+  NtfsDiagnostics.c
+
+Abstract:
+
+  Implementation of the NTFS diagnostics protocol
+
+Revision History
+
+--*/
+
+#include "Ntfs.h"
+#include "ntfs/cache.h"
+
+EFI_GUID gNtfsDiagnosticsProtocolGuid = NTFS_DIAGNOSTICS_PROTOCOL_GUID;
+
+EFI_STATUS
+EFIAPI
+NtfsGetIoStatistics (
+  IN  NTFS_DIAGNOSTICS_PROTOCOL *This,
+  OUT NTFS_IO_STATISTICS        *Statistics
+  )
+/*++
+
+Routine Description:
+
+  Implements GetIoStatistics() of the NTFS diagnostics protocol.
+
+Arguments:
+
+  This                  - Calling context.
+  Statistics            - Receives a snapshot of the volume DiskIo counters.
+
+Returns:
+
+  EFI_SUCCESS           - The snapshot was taken.
+  EFI_INVALID_PARAMETER - Statistics is NULL.
+
+--*/
+{
+  NTFS_VOLUME *Volume;
+  UINTN       Index;
+
+  if (Statistics == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Volume = VOLUME_FROM_DIAG_INTERFACE (This);
+
+  NtfsAcquireLock ();
+  CopyMem (Statistics, &Volume->IoStatistics, sizeof (NTFS_IO_STATISTICS));
+  //
+  // Run reads are counted by the NTFS core, not by the DiskIo layer
+  //
+  if (Volume->vol != NULL && Volume->vol->dev != NULL) {
+    for (Index = 0; Index < NTFS_IO_ORIGIN_COUNT; Index++) {
+      Statistics->RunReads[Index].Transfers = Volume->vol->dev->d_run_reads[Index].transfers;
+      Statistics->RunReads[Index].Runs      = Volume->vol->dev->d_run_reads[Index].runs;
+    }
+  }
+  NtfsReleaseLock ();
+
+  return EFI_SUCCESS;
+}
+
+EFI_STATUS
+EFIAPI
+NtfsResetIoStatistics (
+  IN  NTFS_DIAGNOSTICS_PROTOCOL *This
+  )
+/*++
+
+Routine Description:
+
+  Implements ResetIoStatistics() of the NTFS diagnostics protocol.
+
+Arguments:
+
+  This                  - Calling context.
+
+Returns:
+
+  EFI_SUCCESS           - The counters were reset, the flags are kept.
+
+--*/
+{
+  NTFS_VOLUME *Volume;
+  UINT64      Flags;
+
+  Volume = VOLUME_FROM_DIAG_INTERFACE (This);
+
+  NtfsAcquireLock ();
+  //
+  // The flags describe what the device layer measures, not a counter
+  //
+  Flags = Volume->IoStatistics.Flags;
+  ZeroMem (&Volume->IoStatistics, sizeof (NTFS_IO_STATISTICS));
+  Volume->IoStatistics.Flags = Flags;
+  if (Volume->vol != NULL && Volume->vol->dev != NULL) {
+    ZeroMem (Volume->vol->dev->d_run_reads, sizeof (Volume->vol->dev->d_run_reads));
+  }
+  NtfsReleaseLock ();
+
+  return EFI_SUCCESS;
+}
+
+static
+VOID
+NtfsCopyCacheCounters (
+  IN  const struct CACHE_HEADER *Cache,
+  OUT NTFS_CACHE_COUNTERS       *Counters
+  )
+/*++
+
+Routine Description:
+
+  Copy the counters of one metadata cache, a disabled cache reports zeroes.
+
+Arguments:
+
+  Cache                 - The cache header, may be NULL.
+  Counters              - Receives the counters.
+
+Returns:
+
+  None.
+
+--*/
+{
+  ZeroMem (Counters, sizeof (NTFS_CACHE_COUNTERS));
+  if (Cache == NULL) {
+    return;
+  }
+
+  Counters->Entries         = (UINT32) Cache->item_count;
+  Counters->ProtectedTarget = (UINT32) Cache->protected_target;
+  Counters->Lookups         = Cache->reads;
+  Counters->Hits            = Cache->hits;
+  Counters->Misses          = Cache->misses;
+  Counters->Inserts         = Cache->inserts;
+  Counters->Evictions       = Cache->evicts;
+}
+
+EFI_STATUS
+EFIAPI
+NtfsGetCacheStatistics (
+  IN  NTFS_DIAGNOSTICS_PROTOCOL *This,
+  OUT NTFS_CACHE_STATISTICS     *Statistics
+  )
+/*++
+
+Routine Description:
+
+  Implements GetCacheStatistics() of the NTFS diagnostics protocol.
+
+Arguments:
+
+  This                  - Calling context.
+  Statistics            - Receives a snapshot of the metadata cache counters.
+
+Returns:
+
+  EFI_SUCCESS           - The snapshot was taken.
+  EFI_INVALID_PARAMETER - Statistics is NULL.
+
+--*/
+{
+  NTFS_VOLUME   *Volume;
+  ntfs_volume   *vol;
+
+  if (Statistics == NULL) {
+    return EFI_INVALID_PARAMETER;
+  }
+
+  Volume = VOLUME_FROM_DIAG_INTERFACE (This);
+
+  ZeroMem (Statistics, sizeof (NTFS_CACHE_STATISTICS));
+
+  NtfsAcquireLock ();
+  vol = Volume->vol;
+  if (vol != NULL) {
+#if CACHE_INODE_SIZE
+    NtfsCopyCacheCounters (vol->xinode_cache, &Statistics->Cache[NTFS_CACHE_INODE]);
+#endif
+#if CACHE_NIDATA_SIZE
+    NtfsCopyCacheCounters (vol->nidata_cache, &Statistics->Cache[NTFS_CACHE_NIDATA]);
+#endif
+#if CACHE_LOOKUP_SIZE
+    NtfsCopyCacheCounters (vol->lookup_cache, &Statistics->Cache[NTFS_CACHE_LOOKUP]);
+#endif
+#if CACHE_SECURID_SIZE
+    NtfsCopyCacheCounters (vol->securid_cache, &Statistics->Cache[NTFS_CACHE_SECURID]);
+#endif
+#if CACHE_LEGACY_SIZE
+    NtfsCopyCacheCounters (vol->legacy_cache, &Statistics->Cache[NTFS_CACHE_LEGACY]);
+#endif
+#if CACHE_NEGATIVE_SIZE
+    NtfsCopyCacheCounters (vol->negative_cache, &Statistics->Cache[NTFS_CACHE_NEGATIVE]);
+#endif
+#if CACHE_MFTREC_SIZE
+    NtfsCopyCacheCounters (vol->mftrec_cache, &Statistics->Cache[NTFS_CACHE_MFTREC]);
+#endif
+#if CACHE_INDX_SIZE
+    NtfsCopyCacheCounters (vol->indx_cache, &Statistics->Cache[NTFS_CACHE_INDX]);
+#endif
+#if CACHE_RUNLIST_SIZE
+    NtfsCopyCacheCounters (vol->runlist_cache, &Statistics->Cache[NTFS_CACHE_RUNLIST]);
+#endif
+  }
+  NtfsReleaseLock ();
+
+  return EFI_SUCCESS;
+}
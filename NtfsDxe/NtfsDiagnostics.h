@@ -0,0 +1,173 @@
+/*++
+
+Module Name:
+
+  NtfsDiagnostics.h
+
+Abstract:
+
+  NTFS diagnostics protocol, installed next to the Simple File System protocol
+  on every mounted volume. It publishes the DiskIo statistics gathered by the
+  device layer (ntfs/uefi_io.c) and the counters of the metadata caches of
+  the NTFS core (ntfs/cache.c) so that a shell tool or test harness can
+  snapshot them.
+
+Revision History
+
+--*/
+
+#ifndef _NTFS_DIAGNOSTICS_H_
+#define _NTFS_DIAGNOSTICS_H_
+
+#define NTFS_DIAGNOSTICS_PROTOCOL_GUID \
+  { \
+    0x6a1ee763, 0xd47a, 0x43b4, {0xaa, 0xbe, 0xef, 0x1d, 0xe2, 0xab, 0x56, 0xbb } \
+  }
+
+#define NTFS_DIAGNOSTICS_PROTOCOL_REVISION  0x00010006
+
+typedef struct _NTFS_DIAGNOSTICS_PROTOCOL NTFS_DIAGNOSTICS_PROTOCOL;
+
+//
+// Origin of a DiskIo transfer, matching ntfs_io_origin in ntfs/device.h
+//
+#define NTFS_IO_ORIGIN_OTHER          0
+#define NTFS_IO_ORIGIN_MFT            1
+#define NTFS_IO_ORIGIN_INDEX          2
+#define NTFS_IO_ORIGIN_BITMAP         3
+#define NTFS_IO_ORIGIN_DATA           4
+#define NTFS_IO_ORIGIN_LOGFILE        5
+#define NTFS_IO_ORIGIN_COUNT          6
+
+//
+// Transfer size buckets: bucket i holds transfers of at most 512 << (2 * i)
+// bytes (512, 2K, 8K, 32K, 128K, 512K, 2M), the last one everything larger.
+//
+#define NTFS_IO_SIZE_BUCKETS          8
+
+//
+// Latency buckets: bucket i holds transfers that completed in less than
+// 2^i microseconds, the last one everything slower.
+//
+#define NTFS_IO_LATENCY_BUCKETS       20
+
+typedef struct {
+  UINT64  Calls;                                    // DiskIo/DiskIo2 requests issued
+  UINT64  Bytes;                                    // Bytes transferred by successful requests
+  UINT64  Retries;                                  // Requests re-issued after a failed pipelined read
+  UINT64  Failures;                                 // Requests that returned an error
+  UINT64  LatencyNs;                                // Sum of request latencies (nanoseconds)
+  UINT64  SizeHistogram[NTFS_IO_SIZE_BUCKETS];
+  UINT64  LatencyHistogram[NTFS_IO_LATENCY_BUCKETS];
+} NTFS_IO_COUNTERS;
+
+//
+// Reads of attribute runs: runs adjacent on disk are read by a single
+// transfer, so Runs - Transfers transfers were saved by merging them.
+//
+typedef struct {
+  UINT64  Transfers;                                // Device reads issued for attribute runs
+  UINT64  Runs;                                     // Runs covered by these reads
+} NTFS_RUN_READ_COUNTERS;
+
+//
+// Statistics flags: latencies are only measured when the driver is linked
+// with a TimerLib that has a running performance counter. Without it
+// (the null TimerLib of NtfsPkg.dsc) LatencyNs and LatencyHistogram stay
+// zero and the flag is clear.
+//
+#define NTFS_IO_STATISTICS_LATENCY    0x00000001
+
+typedef struct {
+  NTFS_IO_COUNTERS        Read[NTFS_IO_ORIGIN_COUNT];
+  NTFS_IO_COUNTERS        Write[NTFS_IO_ORIGIN_COUNT];
+  NTFS_RUN_READ_COUNTERS  RunReads[NTFS_IO_ORIGIN_COUNT];
+  UINT64                  Flags;                    // NTFS_IO_STATISTICS_* bits
+} NTFS_IO_STATISTICS;
+
+//
+// Metadata caches of the NTFS core, matching struct CACHE_SIZES in ntfs/cache.h
+//
+#define NTFS_CACHE_INODE              0     // Full path to inode number
+#define NTFS_CACHE_NIDATA             1     // Closed inodes kept open for reuse
+#define NTFS_CACHE_LOOKUP             2     // (Parent, name) to inode number
+#define NTFS_CACHE_SECURID            3
+#define NTFS_CACHE_LEGACY             4
+#define NTFS_CACHE_NEGATIVE           5     // (Parent, name) known to be missing
+#define NTFS_CACHE_MFTREC             6     // Copies of MFT records
+#define NTFS_CACHE_INDX               7     // Copies of directory index blocks
+#define NTFS_CACHE_RUNLIST            8     // Decoded runlists of non-resident attributes
+#define NTFS_CACHE_COUNT              9
+
+typedef struct {
+  UINT32  Entries;                                  // Number of entries (0 when the cache is disabled)
+  UINT32  ProtectedTarget;                          // Current target size of the protected segment
+  UINT64  Lookups;                                  // Fetch requests
+  UINT64  Hits;
+  UINT64  Misses;
+  UINT64  Inserts;                                  // New entries
+  UINT64  Evictions;                                // Entries recycled to make room for new ones
+} NTFS_CACHE_COUNTERS;
+
+typedef struct {
+  NTFS_CACHE_COUNTERS  Cache[NTFS_CACHE_COUNT];
+} NTFS_CACHE_STATISTICS;
+
+/**
+  Copy the I/O statistics of the volume.
+
+  @param  This                  Protocol instance pointer.
+  @param  Statistics            Receives a snapshot of the counters.
+
+  @retval EFI_SUCCESS           The snapshot was taken.
+  @retval EFI_INVALID_PARAMETER Statistics is NULL.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *NTFS_DIAGNOSTICS_GET_IO_STATISTICS)(
+  IN  NTFS_DIAGNOSTICS_PROTOCOL *This,
+  OUT NTFS_IO_STATISTICS        *Statistics
+  );
+
+/**
+  Reset the I/O statistics of the volume to zero, Flags is kept.
+
+  @param  This                  Protocol instance pointer.
+
+  @retval EFI_SUCCESS           The counters were reset.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *NTFS_DIAGNOSTICS_RESET_IO_STATISTICS)(
+  IN  NTFS_DIAGNOSTICS_PROTOCOL *This
+  );
+
+/**
+  Copy the counters of the metadata caches of the volume.
+
+  @param  This                  Protocol instance pointer.
+  @param  Statistics            Receives a snapshot of the counters.
+
+  @retval EFI_SUCCESS           The snapshot was taken.
+  @retval EFI_INVALID_PARAMETER Statistics is NULL.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *NTFS_DIAGNOSTICS_GET_CACHE_STATISTICS)(
+  IN  NTFS_DIAGNOSTICS_PROTOCOL *This,
+  OUT NTFS_CACHE_STATISTICS     *Statistics
+  );
+
+struct _NTFS_DIAGNOSTICS_PROTOCOL {
+  UINT64                                Revision;
+  NTFS_DIAGNOSTICS_GET_IO_STATISTICS    GetIoStatistics;
+  NTFS_DIAGNOSTICS_RESET_IO_STATISTICS  ResetIoStatistics;
+  NTFS_DIAGNOSTICS_GET_CACHE_STATISTICS GetCacheStatistics;
+};
+
+extern EFI_GUID gNtfsDiagnosticsProtocolGuid;
+
+#endif
@@ -0,0 +1,151 @@
+/*++
+
+Module Name:
+
+  NtfsExtentMap.c
+
+Abstract:
+
+  Implementation of the NTFS extent map protocol
+
+Revision History
+
+--*/
+
+#include "Ntfs.h"
+#include "ntfs/ntfsfile.h"
+
+EFI_GUID gNtfsExtentMapProtocolGuid = NTFS_EXTENT_MAP_PROTOCOL_GUID;
+
+EFI_STATUS
+EFIAPI
+NtfsGetExtents (
+  IN     NTFS_EXTENT_MAP_PROTOCOL *This,
+  IN     EFI_FILE_PROTOCOL        *File,
+  IN     CONST CHAR16             *StreamName OPTIONAL,
+  IN OUT UINTN                    *ExtentCount,
+  OUT    NTFS_EXTENT_MAP_ENTRY    *Extents OPTIONAL
+  )
+/*++
+
+Routine Description:
+
+  Implements GetExtents() of the NTFS extent map protocol.
+
+Arguments:
+
+  This                  - Calling context.
+  File                  - File handle opened on this volume.
+  StreamName            - Named data stream to map, NULL or empty for the unnamed one.
+  ExtentCount           - Number of entries of Extents on input, number of extents on output.
+  Extents               - Receives the extents.
+
+Returns:
+
+  EFI_SUCCESS           - The extents were returned.
+  EFI_BUFFER_TOO_SMALL  - Extents is NULL or too small, ExtentCount was updated.
+  EFI_INVALID_PARAMETER - File is not a file opened on this volume.
+  EFI_NOT_FOUND         - The file has no such stream.
+  EFI_OUT_OF_RESOURCES  - No memory for the extent list.
+  EFI_DEVICE_ERROR      - The runlist of the stream could not be read.
+
+--*/
+{
+	NTFS_VOLUME *Volume;
+	NTFS_IFILE *IFile;
+	struct _ntfs_file_state *file;
+	ntfs_attr *na;
+	struct ntfs_extent *Map;
+	EFI_STATUS Status;
+	int Count;
+	int Index;
+
+	if (File == NULL || ExtentCount == NULL)
+		return EFI_INVALID_PARAMETER;
+
+	// Only handles of this driver carry an NTFS_IFILE around the protocol
+	if (File->Open != NtfsOpenFile)
+		return EFI_INVALID_PARAMETER;
+
+	Volume = VOLUME_FROM_MAP_INTERFACE(This);
+	IFile = IFILE_FROM_FHAND(File);
+
+	if (IFile->Volume != Volume || IFile->Type != FSW_EFI_FILE_TYPE_FILE)
+		return EFI_INVALID_PARAMETER;
+
+	file = IFile->state.file;
+	if (file == NULL || file->data_na == NULL)
+		return EFI_DEVICE_ERROR;
+
+	Map = NULL;
+	Status = EFI_SUCCESS;
+
+	NtfsAcquireLock();
+
+	if (StreamName == NULL || StreamName[0] == L'\0')
+	{
+		na = file->data_na;
+	}
+	else
+	{	// CHAR16 and ntfschar are both little endian UTF-16
+		na = ntfs_attr_open(file->ni, AT_DATA, (ntfschar *) StreamName, (u32) StrLen(StreamName));
+		if (na == NULL)
+		{
+			Status = (errno == ENOENT) ? EFI_NOT_FOUND : EFI_DEVICE_ERROR;
+			goto Done;
+		}
+	}
+
+	Count = ntfs_attr_map_extents(na, NULL, 0);
+	if (Count < 0)
+	{
+		Status = EFI_DEVICE_ERROR;
+		goto Close;
+	}
+
+	if (Extents == NULL || *ExtentCount < (UINTN) Count)
+	{
+		*ExtentCount = (UINTN) Count;
+		Status = EFI_BUFFER_TOO_SMALL;
+		goto Close;
+	}
+
+	if (Count > 0)
+	{
+		Map = AllocatePool(Count * sizeof(struct ntfs_extent));
+		if (Map == NULL)
+		{
+			Status = EFI_OUT_OF_RESOURCES;
+			goto Close;
+		}
+
+		// The runlist is already mapped, so this pass cannot fail for lack
+		// of memory and returns the same extents as the counting one
+		if (ntfs_attr_map_extents(na, Map, Count) != Count)
+		{
+			Status = EFI_DEVICE_ERROR;
+			goto Close;
+		}
+	}
+
+	for (Index = 0; Index < Count; Index++)
+	{
+		Extents[Index].Offset = (UINT64) Map[Index].offset;
+		Extents[Index].Physical = (INT64) Map[Index].physical;
+		Extents[Index].Length = (UINT64) Map[Index].length;
+		Extents[Index].Flags = Map[Index].flags;
+	}
+	*ExtentCount = (UINTN) Count;
+
+Close:
+	if (na != file->data_na)
+		ntfs_attr_close(na);
+
+Done:
+	NtfsReleaseLock();
+
+	if (Map != NULL)
+		FreePool(Map);
+
+	return Status;
+}
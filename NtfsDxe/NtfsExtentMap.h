@@ -0,0 +1,87 @@
+/*++
+
+Module Name:
+
+  NtfsExtentMap.h
+
+Abstract:
+
+  NTFS extent map protocol, installed next to the Simple File System
+  protocol on every mounted volume. It reports where the data of a stream
+  of a file opened on the volume is stored, as a list of extents giving
+  for each stretch of the stream its volume byte offset, so that loaders
+  can read a payload with their own block I/O or check its fragmentation.
+
+Revision History
+
+--*/
+
+#ifndef _NTFS_EXTENT_MAP_H_
+#define _NTFS_EXTENT_MAP_H_
+
+#define NTFS_EXTENT_MAP_PROTOCOL_GUID \
+  { \
+    0x01c40c1d, 0x0e2f, 0x4f29, {0xba, 0x6b, 0xe2, 0x5c, 0xb0, 0xfc, 0xa9, 0x27 } \
+  }
+
+#define NTFS_EXTENT_MAP_PROTOCOL_REVISION  0x00010000
+
+typedef struct _NTFS_EXTENT_MAP_PROTOCOL NTFS_EXTENT_MAP_PROTOCOL;
+
+//
+// Extent flags, matching NTFS_EXTENT_* in ntfs/attrib.h
+//
+#define NTFS_EXTENT_MAP_HOLE          0x0001    // Not allocated, reads as zeroes
+#define NTFS_EXTENT_MAP_UNWRITTEN     0x0002    // Beyond the initialized size, reads as zeroes
+#define NTFS_EXTENT_MAP_COMPRESSED    0x0004    // Volume bytes are compressed
+#define NTFS_EXTENT_MAP_ENCRYPTED     0x0008    // Volume bytes are encrypted
+#define NTFS_EXTENT_MAP_RESIDENT      0x0010    // Stored in the MFT record
+
+typedef struct {
+  UINT64  Offset;                                   // Byte offset in the stream
+  INT64   Physical;                                 // Byte offset in the volume, -1 for holes, resident data
+                                                    // and the unallocated tail of a compression unit
+  UINT64  Length;                                   // Length in bytes
+  UINT32  Flags;                                    // NTFS_EXTENT_MAP_*
+} NTFS_EXTENT_MAP_ENTRY;
+
+/**
+  Get the extents of a stream of a file.
+
+  @param  This                  Protocol instance pointer.
+  @param  File                  File handle opened on the volume the protocol
+                                is installed on.
+  @param  StreamName            Name of a named data stream of the file, NULL
+                                or empty for the unnamed data stream.
+  @param  ExtentCount           On input the number of entries of Extents, on
+                                output the number of extents of the stream.
+  @param  Extents               Receives the extents in increasing offset
+                                order, may be NULL to query their number.
+
+  @retval EFI_SUCCESS           The extents were returned.
+  @retval EFI_BUFFER_TOO_SMALL  Extents is NULL or too small, ExtentCount has
+                                been updated.
+  @retval EFI_INVALID_PARAMETER File or ExtentCount is NULL, or File is not
+                                a file opened on this volume.
+  @retval EFI_NOT_FOUND         The file has no stream named StreamName.
+  @retval EFI_DEVICE_ERROR      The runlist of the stream could not be read.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *NTFS_EXTENT_MAP_GET_EXTENTS)(
+  IN     NTFS_EXTENT_MAP_PROTOCOL *This,
+  IN     EFI_FILE_PROTOCOL        *File,
+  IN     CONST CHAR16             *StreamName OPTIONAL,
+  IN OUT UINTN                    *ExtentCount,
+  OUT    NTFS_EXTENT_MAP_ENTRY    *Extents OPTIONAL
+  );
+
+struct _NTFS_EXTENT_MAP_PROTOCOL {
+  UINT64                                Revision;
+  NTFS_EXTENT_MAP_GET_EXTENTS           GetExtents;
+};
+
+extern EFI_GUID gNtfsExtentMapProtocolGuid;
+
+#endif
@@ -179,18 +179,13 @@ GetFileInfo (
 	FILE_NAME_ATTR *attr;
 	ntfs_attr_search_ctx *ctx;
 	int space = 4;
-	CHAR16 *unicode, *ptrU;
-	CHAR8 *rName, *next;
+	CHAR16 *rName;
 
 
-	rName = strrchr(IFile->FullPath, '\\');
-
-	if (rName == NULL)
-	{
-		rName = IFile->FullPath;
-	}
-	else
-		rName++;
+	// The name of the file is the last component of its normalized path
+	rName = IFile->FullPath + StrLen(IFile->FullPath);
+	while (rName > IFile->FullPath && rName[-1] != L'\\')
+		rName--;
 	
 
 	//CpuBreakpoint();
@@ -201,7 +196,7 @@ GetFileInfo (
 	}
 	else
 	{
-		RequiredSize = SIZE_OF_EFI_FILE_INFO + ((AsciiStrLen(rName) + 1) * sizeof(CHAR16));
+		RequiredSize = SIZE_OF_EFI_FILE_INFO + StrSize(rName);
 	}
 
 	if (*BufferSize < RequiredSize) {
@@ -227,21 +222,7 @@ GetFileInfo (
 			Buffer->Attribute |= EFI_FILE_DIRECTORY;
 		}
 	
-		unicode = AllocateZeroPool((AsciiStrLen(rName) + 1) * sizeof(CHAR16));
-
-#ifdef DISABLE_NEW_DEPRECATED_INTERFACES
-		AsciiStrToUnicodeStrS(rName, unicode, (AsciiStrLen(rName) + 1));
-#else
-		AsciiStrToUnicodeStr(rName, unicode);
-#endif
-		ptrU = unicode;
-
-		if (*ptrU == L'\\')
-			ptrU++;
-				
-		CopyMem((UINT8 *) Buffer->FileName, ptrU, StrLen(ptrU) * sizeof(CHAR16));
-
-		FreePool(unicode);
+		CopyMem((UINT8 *) Buffer->FileName, rName, StrLen(rName) * sizeof(CHAR16));
 
 		Buffer->FileSize = inode->data_size;		
 		Buffer->PhysicalSize = inode->allocated_size;
@@ -16,6 +16,52 @@ Revision History
 #include "Ntfs.h"
 #include "ntfs/ntfsdir.h"
 #include "ntfs/ntfsfile.h"
+#include "ntfs/mem_allocate.h"
+
+static
+BOOLEAN
+NtfsIsDescendingName (
+  IN  CONST CHAR16  *FileName
+  )
+/*++
+
+Routine Description:
+
+  Check whether FileName only names entries below the directory it is
+  relative to, so that it can be resolved from that directory's inode.
+
+Arguments:
+
+  FileName              - Name given to Open().
+
+Returns:
+
+  TRUE                  - FileName is relative and has no "." or ".." component.
+  FALSE                 - FileName must be resolved from its full path.
+
+--*/
+{
+	UINTN Component;
+
+	if (*FileName == L'\0' || *FileName == L'\\')
+		return FALSE;
+
+	while (*FileName != L'\0')
+	{
+		for (Component = 0; FileName[Component] != L'\0' && FileName[Component] != L'\\'; Component++)
+			;
+
+		if ((Component == 1 && FileName[0] == L'.') ||
+			(Component == 2 && FileName[0] == L'.' && FileName[1] == L'.'))
+			return FALSE;
+
+		FileName += Component;
+		while (*FileName == L'\\')
+			FileName++;
+	}
+
+	return TRUE;
+}
 
 EFI_STATUS
 EFIAPI
@@ -56,9 +102,10 @@ Returns:
 	ntfs_inode	*inode;
 	NTFS_VOLUME *Volume;
 	struct _reent r;
-	CHAR8	AsciiFileName[260], TempPath[260];
-	int flags, mode, FileNameSize;
-	CHAR8	*LastSeparator;
+	CHAR16	FullPath[260];
+	char	*LocalPath;
+	int flags;
+	UINTN	FullPathSize;
 
 	//
 	// Perform some parameter checking
@@ -69,31 +116,26 @@ Returns:
 
 	IFile = IFILE_FROM_FHAND (FHand);
 
-	memset(AsciiFileName, 0, 260);
-	memset(TempPath, 0, 260);
-
-#ifdef DISABLE_NEW_DEPRECATED_INTERFACES
-	UnicodeStrToAsciiStrS(FileName, TempPath, 260);	// local name
-#else
-	UnicodeStrToAsciiStr(FileName, TempPath);	// local name
-#endif
-	
-	FileNameSize = CreateFileName(AsciiFileName, IFile->FullPath, TempPath);
+	// Names stay in UTF-16 down to the index lookup, CHAR16 is little endian like ntfschar
+	FullPathSize = CreateFileName(FullPath, sizeof(FullPath) / sizeof(CHAR16), IFile->FullPath, FileName);
+	if (FullPathSize == 0) {
+		return EFI_INVALID_PARAMETER;
+	}
  
   //
   // Check for a valid mode
   //
   switch (OpenMode) {
 	  case EFI_FILE_MODE_READ:
-		  flags = O_RDONLY; mode = 0; break;
+		  flags = O_RDONLY; break;
 	  case EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE:
-		  flags = O_RDWR; mode = 0; break;
+		  flags = O_RDWR; break;
 	  case EFI_FILE_MODE_READ | EFI_FILE_MODE_WRITE | EFI_FILE_MODE_CREATE:
-		  flags = O_CREAT | O_RDWR; mode = 0; break;
+		  flags = O_CREAT | O_RDWR; break;
 		break;
 
 	  default:
-		  flags = 0; mode = 0;
+		  flags = 0;
 		return EFI_INVALID_PARAMETER;
   }
   
@@ -120,19 +162,26 @@ Returns:
 	if ((OpenMode & EFI_FILE_MODE_CREATE))
 	{	// Create a directory or a file...
 		unsigned int type = (Attributes & EFI_FILE_DIRECTORY) ? S_IFDIR : S_IFREG;
-		inode = ntfsCreate(IFile->Volume->vd, AsciiFileName, type, NULL);
+
+		LocalPath = NULL;
+		if (ntfsUnicodeToLocal((const ntfschar *) FullPath, (int) FullPathSize, &LocalPath, 0) < 0) {
+			inode = NULL;
+		} else {
+			inode = ntfsCreate(IFile->Volume->vd, LocalPath, type, NULL);
+			ntfs_free(LocalPath);
+		}
 
 		if (inode == NULL && type == S_IFREG) { // file exists.. try to open!
-			inode = ntfsOpenEntry(IFile->Volume->vd, AsciiFileName);
+			inode = ntfsOpenEntryUnicode(IFile->Volume->vd, (const ntfschar *) FullPath, (int) FullPathSize);
 		}
 	}
-	else if ((AsciiStrCmp(AsciiFileName, "\\" ) == 0) || (AsciiStrCmp(AsciiFileName, "/") == 0) || (AsciiStrCmp(AsciiFileName, "") == 0) ||  (AsciiStrCmp(AsciiFileName, ".") == 0))
-	{	// ? we have a pointer to root! why we need to reopen?
-		inode = ntfs_inode_open(Volume->vd->vol, FILE_root);	// access to root!
+	else if (IFile->Type == FSW_EFI_FILE_TYPE_DIR && NtfsIsDescendingName(FileName))
+	{	// only the new components are looked up, starting from the directory of the handle
+		inode = ntfsOpenEntryUnicode(IFile->Volume->vd, (const ntfschar *) FileName, (int) StrLen(FileName));
 	}
 	else
-	{	// try to open ...
-		inode = ntfsOpenEntry(IFile->Volume->vd, AsciiFileName);
+	{	// try to open, the root resolves to itself
+		inode = ntfsOpenEntryUnicode(IFile->Volume->vd, (const ntfschar *) FullPath, (int) FullPathSize);
 	}
 
 	if (inode != NULL)
@@ -141,15 +190,16 @@ Returns:
 
 		NewIFile = IFILE_FROM_FHAND(*NewHandle);
 		
-		CopyMem(NewIFile->FullPath, AsciiFileName, FileNameSize * sizeof(CHAR8));
+		CopyMem(NewIFile->FullPath, FullPath, (FullPathSize + 1) * sizeof(CHAR16));
 
-		if (AsciiStrCmp(TempPath, ".") == 0 || AsciiStrCmp(TempPath, "..") == 0)
+		if (StrCmp(FileName, L".") == 0 || StrCmp(FileName, L"..") == 0 ||
+			StrSize(FileName) > sizeof(NewIFile->FileName))
 		{
-			CopyMem(NewIFile->FileName, AsciiFileName, FileNameSize * sizeof(CHAR8));
+			CopyMem(NewIFile->FileName, FullPath, (FullPathSize + 1) * sizeof(CHAR16));
 		}
 		else
 		{
-			CopyMem(NewIFile->FileName, TempPath, AsciiStrLen(TempPath) * sizeof(CHAR8));
+			CopyMem(NewIFile->FileName, FileName, StrSize(FileName));
 		}
 
 		NewIFile->Position = 0;
@@ -167,7 +217,7 @@ Returns:
 
 			NewIFile->state.file->vd = Volume->vd;	// sete reference
 			NewIFile->state.file->ni = inode;
-			ntfs_open_r(&r, NewIFile->state.file, AsciiFileName, flags, 0);
+			ntfs_open_r(&r, NewIFile->state.file, "", flags, 0);	// inode already resolved
 		}
 		else if (NewIFile->Type == FSW_EFI_FILE_TYPE_DIR)
 		{	//
@@ -179,7 +229,7 @@ Returns:
 	else 
 	{
 		Status = EFI_INVALID_PARAMETER;
-		*NewHandle = INVALID_HANDLE_VALUE;
+		*NewHandle = NULL;
 	}
 	
 	NtfsReleaseLock();
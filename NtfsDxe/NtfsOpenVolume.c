@@ -78,7 +78,7 @@ Returns:
 		IFile->Type = FSW_EFI_FILE_TYPE_DIR;
 		IFile->inode = inode;
 
-		CreateFileName(IFile->FullPath, "\\", "");
+		CreateFileName(IFile->FullPath, sizeof(IFile->FullPath) / sizeof(CHAR16), L"\\", L"");
 
 		Status = EFI_SUCCESS;
 	}
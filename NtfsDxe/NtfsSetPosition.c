@@ -63,6 +63,16 @@ Returns:
 		}
 		//*Position = 0;
 		IFile->Position = 0;
+
+		// restart the directory walk from its first entry
+		if (IFile->state.dir != NULL && IFile->state.dir->ni != NULL)
+		{
+			ZeroMem(&r, sizeof(struct _reent));
+			if (ntfs_dirreset_r(&r, IFile->state.dir) == -1)
+			{
+				return EFI_DEVICE_ERROR;
+			}
+		}
 	}
 
 	return EFI_SUCCESS;
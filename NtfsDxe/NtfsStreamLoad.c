@@ -0,0 +1,111 @@
+/*++
+
+Module Name:
+
+  NtfsStreamLoad.c
+
+Abstract:
+
+  Implementation of the NTFS stream load protocol
+
+Revision History
+
+--*/
+
+#include "Ntfs.h"
+#include "ntfs/ntfsfile.h"
+
+EFI_GUID gNtfsStreamLoadProtocolGuid = NTFS_STREAM_LOAD_PROTOCOL_GUID;
+
+EFI_STATUS
+EFIAPI
+NtfsStreamLoadFile (
+  IN     NTFS_STREAM_LOAD_PROTOCOL *This,
+  IN     EFI_FILE_PROTOCOL         *File,
+  IN OUT UINTN                     *BufferSize,
+  OUT    VOID                      *Buffer OPTIONAL
+  )
+/*++
+
+Routine Description:
+
+  Implements LoadFile() of the NTFS stream load protocol.
+
+Arguments:
+
+  This                  - Calling context.
+  File                  - File handle opened for reading on this volume.
+  BufferSize            - Size of Buffer on input, size of the stream on output.
+  Buffer                - Receives the stream.
+
+Returns:
+
+  EFI_SUCCESS           - The stream was read.
+  EFI_BUFFER_TOO_SMALL  - Buffer is NULL or too small, BufferSize was updated.
+  EFI_BAD_BUFFER_SIZE   - The stream is larger than MAX_UINTN bytes.
+  EFI_INVALID_PARAMETER - File is not a file opened on this volume.
+  EFI_ACCESS_DENIED     - File was not opened for reading.
+  EFI_DEVICE_ERROR      - The stream could not be read.
+
+--*/
+{
+	NTFS_VOLUME *Volume;
+	NTFS_IFILE *IFile;
+	struct _ntfs_file_state *file;
+	EFI_STATUS Status;
+	s64 Size;
+
+	if (File == NULL || BufferSize == NULL)
+		return EFI_INVALID_PARAMETER;
+
+	// Only handles of this driver carry an NTFS_IFILE around the protocol
+	if (File->Open != NtfsOpenFile)
+		return EFI_INVALID_PARAMETER;
+
+	Volume = VOLUME_FROM_LOAD_INTERFACE(This);
+	IFile = IFILE_FROM_FHAND(File);
+
+	if (IFile->Volume != Volume || IFile->Type != FSW_EFI_FILE_TYPE_FILE)
+		return EFI_INVALID_PARAMETER;
+
+	file = IFile->state.file;
+	if (file == NULL || file->data_na == NULL)
+		return EFI_DEVICE_ERROR;
+
+	NtfsAcquireLock();
+
+	// Compared as UINT64: on a 32-bit build a stream of 4 GiB or more does
+	// not fit a UINTN, and no buffer could ever hold it
+	Size = file->data_na->data_size;
+	if ((UINT64) Size > MAX_UINTN)
+	{
+		Status = EFI_BAD_BUFFER_SIZE;
+	}
+	else if (Buffer == NULL || (UINT64) *BufferSize < (UINT64) Size)
+	{
+		*BufferSize = (UINTN) Size;
+		Status = EFI_BUFFER_TOO_SMALL;
+	}
+	else if (!file->read)
+	{
+		Status = EFI_ACCESS_DENIED;
+	}
+	else
+	{	// the whole runlist is mapped once and every extent is read straight
+		// into Buffer, the file position is not involved
+		Size = ntfs_attr_load(file->data_na, Buffer, (s64) *BufferSize);
+		if (Size < 0)
+		{
+			Status = EFI_DEVICE_ERROR;
+		}
+		else
+		{
+			*BufferSize = (UINTN) Size;
+			Status = EFI_SUCCESS;
+		}
+	}
+
+	NtfsReleaseLock();
+
+	return Status;
+}
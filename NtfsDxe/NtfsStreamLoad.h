@@ -0,0 +1,71 @@
+/*++
+
+Module Name:
+
+  NtfsStreamLoad.h
+
+Abstract:
+
+  NTFS stream load protocol, installed next to the Simple File System
+  protocol on every mounted volume. It reads the whole data stream of a
+  file opened on the volume into a caller provided buffer in one call, so
+  that large boot payloads (kernels, initrds, WIM images) are loaded with
+  one device read per extent instead of one read per Read() chunk.
+
+Revision History
+
+--*/
+
+#ifndef _NTFS_STREAM_LOAD_H_
+#define _NTFS_STREAM_LOAD_H_
+
+#define NTFS_STREAM_LOAD_PROTOCOL_GUID \
+  { \
+    0x27ef5a24, 0xf3ea, 0x485f, {0x80, 0x41, 0x04, 0x61, 0x42, 0x16, 0xea, 0xba } \
+  }
+
+#define NTFS_STREAM_LOAD_PROTOCOL_REVISION  0x00010000
+
+typedef struct _NTFS_STREAM_LOAD_PROTOCOL NTFS_STREAM_LOAD_PROTOCOL;
+
+/**
+  Read the whole data stream of a file.
+
+  The file position of File is left unchanged.
+
+  @param  This                  Protocol instance pointer.
+  @param  File                  File handle opened for reading on the volume
+                                the protocol is installed on.
+  @param  BufferSize            On input the size of Buffer, on output the
+                                size of the stream.
+  @param  Buffer                Receives the stream, may be NULL to query
+                                its size.
+
+  @retval EFI_SUCCESS           The stream was read.
+  @retval EFI_BUFFER_TOO_SMALL  Buffer is NULL or smaller than the stream,
+                                BufferSize has been updated.
+  @retval EFI_BAD_BUFFER_SIZE   The stream is larger than MAX_UINTN bytes and
+                                cannot be loaded into memory.
+  @retval EFI_INVALID_PARAMETER File or BufferSize is NULL, or File is not
+                                a file opened on this volume.
+  @retval EFI_ACCESS_DENIED     File was not opened for reading.
+  @retval EFI_DEVICE_ERROR      The stream could not be read.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *NTFS_STREAM_LOAD_FILE)(
+  IN     NTFS_STREAM_LOAD_PROTOCOL *This,
+  IN     EFI_FILE_PROTOCOL         *File,
+  IN OUT UINTN                     *BufferSize,
+  OUT    VOID                      *Buffer OPTIONAL
+  );
+
+struct _NTFS_STREAM_LOAD_PROTOCOL {
+  UINT64                                Revision;
+  NTFS_STREAM_LOAD_FILE                 LoadFile;
+};
+
+extern EFI_GUID gNtfsStreamLoadProtocolGuid;
+
+#endif
@@ -5,11 +5,16 @@
 #ifndef _CONFIG_H_
     #define _CONFIG_H_
 
+#ifdef _MSC_VER
 #pragma warning (disable : 4200)
 #pragma warning (disable : 4341)	// signed value is out of range for enum constant
 #pragma warning (disable : 4309)	// truncation of constant value
 #pragma warning (disable : 4244)	// conversion from x to y possible loss of data
 #pragma warning (disable : 4018)	// signed/unsigned mismatch
+#ifndef __cplusplus
+#define inline __inline				// static inline helpers of the ntfs headers
+#endif
+#endif
 
 // Disk access method
 #define USE_CHS 0x1
@@ -34,11 +39,13 @@
 #define CALC_OFFSET(type, x, y) (type) ((VOID *) (((UINTN) x) + y))
 #define OFFSET(x, y) (void *) (((UINTN) x) + y)
 
+#ifndef _LINUX_APPLICATION
 #define size_t	int
 #define _CRT_SECURE_NO_WARNINGS
 //#define HAVE_SYS_TYPES_H
 #define __LITTLE_ENDIAN	1
 #define __BYTE_ORDER	__LITTLE_ENDIAN
+#endif
 #define HAVE_SYS_STAT_H	1
 #define HAVE_STRING_H	1
 #define HAVE_STDLIB_H	1
@@ -49,11 +56,28 @@
 #define HAVE_LIMITS_H	1
 #define HAVE_STDINT_H	1
 
+#ifndef PATH_MAX
 #define PATH_MAX 255
+#endif
 
 #include <sys/errno.h>
 #include <sys/types.h>
 #include <stdint.h>
 
+// gcc/clang host build on Linux (ntfspkg-test/Makefile): the C library is
+// the host one, only the MSVC types and the BOOL of sys/types.h are missing
+#ifdef _LINUX_APPLICATION
+#include <stdbool.h>
+#define __int8		char
+#define __int16		short
+#define __int32		int
+#define __int64		long long
+#define BOOL		bool
+#define TRUE		1
+#define FALSE		0
+#define HAVE_LINUX_HDREG_H	1
+#define HAVE_CTYPE_H		1
+#endif
+
 #endif
 
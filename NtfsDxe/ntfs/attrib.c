@@ -64,6 +64,7 @@
 #include "logging.h"
 #include "misc.h"
 #include "efs.h"
+#include "cache.h"
 
 
 ntfschar AT_UNNAMED[] = { const_cpu_to_le16('\0') };
@@ -547,6 +548,167 @@ void ntfs_attr_close(ntfs_attr *na)
 	free(na);
 }
 
+#if CACHE_RUNLIST_SIZE
+
+/*
+ *		Comparing for the runlist cache
+ *
+ *	The variable part of a cached entry is the attribute name followed
+ *	by the runlist, the one of a wanted item is just the name.
+ */
+
+static int runlist_cache_compare(const struct CACHED_GENERIC *cached,
+			const struct CACHED_GENERIC *wanted)
+{
+	const struct CACHED_RUNLIST *c = (const struct CACHED_RUNLIST*) cached;
+	const struct CACHED_RUNLIST *w = (const struct CACHED_RUNLIST*) wanted;
+	return (!c->name
+		    || (c->mref != w->mref)
+		    || (c->type != w->type)
+		    || (c->name_len != w->name_len)
+		    || (c->name_len && memcmp(c->name, w->name,
+				c->name_len*sizeof(ntfschar))));
+}
+
+/*
+ *		Runlist cache hashing
+ *
+ *	Based on the inode, the attribute type and all chars of the name
+ */
+
+int ntfs_attr_runlist_hash(const struct CACHED_GENERIC *cached)
+{
+	const struct CACHED_RUNLIST *c = (const struct CACHED_RUNLIST*) cached;
+	unsigned int val;
+	u32 i;
+
+	val = (unsigned int)MREF(c->mref)*31 + le32_to_cpu(c->type);
+	for (i=0; i<c->name_len; i++)
+		val = val*31 + le16_to_cpu(c->name[i]);
+	return (val & 0x7fffffff);
+}
+
+/*
+ *		Set the key of the runlist of an attribute
+ *
+ *	The sequence number of the base inode is part of the key, so that
+ *	the runlists of a deleted file are never found for a new file
+ *	reusing its mft record.
+ */
+
+static void runlist_cache_key(ntfs_attr *na, struct CACHED_RUNLIST *item)
+{
+	ntfs_inode *ni = na->ni;
+
+	if (ni->nr_extents == -1)
+		ni = ni->base_ni;
+	item->mref = MK_MREF(ni->mft_no,
+			le16_to_cpu(ni->mrec->sequence_number));
+	item->type = na->type;
+	item->name_len = na->name_len;
+	item->name = (na->name_len ? na->name : (const ntfschar*)NULL);
+	item->varsize = na->name_len*sizeof(ntfschar);
+}
+
+/*
+ *		Get a copy of the runlist of an attribute from cache
+ *
+ *	Returns TRUE if the attribute is now fully mapped
+ */
+
+static BOOL runlist_cache_fetch(ntfs_attr *na)
+{
+	struct CACHE_HEADER *cache = na->ni->vol->runlist_cache;
+	struct CACHED_RUNLIST item;
+	const struct CACHED_RUNLIST *cached;
+	runlist_element *rl;
+	size_t offset;
+
+	if (!cache || !na->ni->mrec)
+		return (FALSE);
+	runlist_cache_key(na, &item);
+	cached = (const struct CACHED_RUNLIST*)ntfs_fetch_cache(cache,
+			GENERIC(&item), runlist_cache_compare);
+	if (!cached)
+		return (FALSE);
+	offset = CACHED_RUNLIST_OFFSET(cached->name_len);
+	rl = (runlist_element*)ntfs_malloc(cached->varsize - offset);
+	if (!rl)
+		return (FALSE);
+	memcpy(rl, (const char*)cached->name + offset,
+			cached->varsize - offset);
+	na->rl = rl;
+	ntfs_attr_forget_run_index(na);
+	NAttrSetFullyMapped(na);
+	return (TRUE);
+}
+
+/*
+ *		Enter a copy of the runlist of an attribute into cache
+ *
+ *	Only complete runlists just decoded from the mapping pairs are
+ *	entered, so that the cache never holds changes not yet recorded.
+ *	Runlists which are not complete or too long are ignored.
+ */
+
+static void runlist_cache_enter(ntfs_attr *na)
+{
+	struct CACHE_HEADER *cache = na->ni->vol->runlist_cache;
+	struct CACHED_RUNLIST item;
+	const runlist_element *rl;
+	size_t offset, size;
+	char *blob;
+	int count;
+
+	if (!cache || !na->rl || !na->ni->mrec)
+		return;
+	count = 1;
+	for (rl=na->rl; rl->length; rl++) {
+		if ((rl->lcn == (LCN)LCN_RL_NOT_MAPPED)
+		    || (++count > CACHE_RUNLIST_MAX_RUNS))
+			return;
+	}
+	if (rl->lcn == (LCN)LCN_RL_NOT_MAPPED)
+		return;
+	runlist_cache_key(na, &item);
+	offset = CACHED_RUNLIST_OFFSET(na->name_len);
+	size = count*sizeof(runlist_element);
+	blob = (char*)ntfs_malloc(offset + size);
+	if (blob) {
+		memset(blob, 0, offset);
+		if (na->name_len)
+			memcpy(blob, na->name, na->name_len*sizeof(ntfschar));
+		memcpy(blob + offset, na->rl, size);
+		item.name = (const ntfschar*)blob;
+		item.varsize = offset + size;
+		ntfs_enter_cache(cache, GENERIC(&item),
+				runlist_cache_compare);
+		free(blob);
+	}
+}
+
+#endif
+
+/*
+ *		Forget the cached runlist of an attribute
+ *
+ *	To be called before the mapping pairs of the attribute are
+ *	changed or removed.
+ */
+
+static void ntfs_attr_forget_runlist(ntfs_attr *na)
+{
+#if CACHE_RUNLIST_SIZE
+	struct CACHED_RUNLIST item;
+
+	if (na->ni->vol->runlist_cache && na->ni->mrec) {
+		runlist_cache_key(na, &item);
+		ntfs_invalidate_cache(na->ni->vol->runlist_cache,
+			GENERIC(&item), runlist_cache_compare, 0);
+	}
+#endif
+}
+
 /**
  * ntfs_attr_map_runlist - map (a part of) a runlist of an ntfs attribute
  * @na:		ntfs attribute for which to map (part of) a runlist
@@ -568,6 +730,11 @@ int ntfs_attr_map_runlist(ntfs_attr *na, VCN vcn)
 	if (lcn >= 0 || lcn == LCN_HOLE || lcn == LCN_ENOENT)
 		return 0;
 
+#if CACHE_RUNLIST_SIZE
+	if (!na->rl && runlist_cache_fetch(na))
+		return 0;
+#endif
+
 	ctx = ntfs_attr_get_search_ctx(na->ni, NULL);
 	if (!ctx)
 		return -1;
@@ -576,12 +743,26 @@ int ntfs_attr_map_runlist(ntfs_attr *na, VCN vcn)
 	if (!ntfs_attr_lookup(na->type, na->name, na->name_len, CASE_SENSITIVE,
 			vcn, NULL, 0, ctx)) {
 		runlist_element *rl;
+#if CACHE_RUNLIST_SIZE
+		BOOL fresh = !na->rl;
+#endif
 
 		/* Decode the runlist. */
 		rl = ntfs_mapping_pairs_decompress(na->ni->vol, ctx->attr,
 				na->rl);
 		if (rl) {
 			na->rl = rl;
+			ntfs_attr_forget_run_index(na);
+#if CACHE_RUNLIST_SIZE
+			/* a single extent attribute is now fully mapped */
+			if (fresh && !ctx->attr->lowest_vcn
+			    && (sle64_to_cpu(ctx->attr->highest_vcn) + 1
+				>= (na->allocated_size
+					>> na->ni->vol->cluster_size_bits))) {
+				NAttrSetFullyMapped(na);
+				runlist_cache_enter(na);
+			}
+#endif
 			ntfs_attr_put_search_ctx(ctx);
 			return 0;
 		}
@@ -639,6 +820,7 @@ static int ntfs_attr_map_partial_runlist(ntfs_attr *na, VCN vcn)
 					na->rl);
 			if (rl) {
 				na->rl = rl;
+				ntfs_attr_forget_run_index(na);
 				highest_vcn = le64_to_cpu(a->highest_vcn);
 				/* corruption detection */
 				if (((highest_vcn + 1) < last_vcn)
@@ -685,6 +867,9 @@ int ntfs_attr_map_whole_runlist(ntfs_attr *na)
 	ntfs_attr_search_ctx *ctx;
 	ntfs_volume *vol = na->ni->vol;
 	ATTR_RECORD *a;
+#if CACHE_RUNLIST_SIZE
+	BOOL fresh;
+#endif
 	int ret = -1;
 
 	ntfs_log_enter("Entering for inode %llu, attr 0x%x.\n",
@@ -695,6 +880,13 @@ int ntfs_attr_map_whole_runlist(ntfs_attr *na)
 		ret = 0;
 		goto out;
 	}
+#if CACHE_RUNLIST_SIZE
+	fresh = !na->rl;
+	if (fresh && runlist_cache_fetch(na)) {
+		ret = 0;
+		goto out;
+	}
+#endif
 	ctx = ntfs_attr_get_search_ctx(na->ni, NULL);
 	if (!ctx)
 		goto out;
@@ -722,6 +914,7 @@ int ntfs_attr_map_whole_runlist(ntfs_attr *na)
 			if (!rl)
 				goto err_out;
 			na->rl = rl;
+			ntfs_attr_forget_run_index(na);
 		}
 
 		/* Are we in the first extent? */
@@ -770,6 +963,10 @@ int ntfs_attr_map_whole_runlist(ntfs_attr *na)
 	}
 	if (errno == ENOENT) {
 		NAttrSetFullyMapped(na);
+#if CACHE_RUNLIST_SIZE
+		if (fresh)
+			runlist_cache_enter(na);
+#endif
 		ret = 0;
 	}
 err_out:	
@@ -830,6 +1027,60 @@ retry:
 	return lcn;
 }
 
+/*
+ *		Locate the run of @na->rl which contains @vcn
+ *
+ *	The runs are counted once per runlist, then looked up by first
+ *	checking the run found last time and its successor, which is what
+ *	sequential reads need, and by a binary search otherwise.
+ *	The runlist must be mapped at least from its first element.
+ *
+ *	Returns the run containing @vcn, or the terminator if @vcn is
+ *		beyond the last run
+ */
+
+static runlist_element *ntfs_attr_find_run(ntfs_attr *na, const VCN vcn)
+{
+	runlist_element *rl;
+	s32 first, last, mid;
+
+	rl = na->rl;
+	if (na->rl_indexed != rl) {
+		for (last = 0; rl[last].length; last++)
+			;
+		na->rl_indexed = rl;
+		na->rl_runs = last;
+		na->rl_cursor = 0;
+	}
+	first = na->rl_cursor;
+	if ((first < na->rl_runs) && (vcn >= rl[first].vcn)) {
+		if (vcn < rl[first + 1].vcn)
+			return (&rl[first]);
+		first++;
+		if ((first < na->rl_runs) && (vcn < rl[first + 1].vcn)) {
+			na->rl_cursor = first;
+			return (&rl[first]);
+		}
+	}
+	if (!na->rl_runs)
+		return (rl);
+		/* last run starting at or before @vcn */
+	first = 0;
+	last = na->rl_runs - 1;
+	while (first < last) {
+		mid = first + (last - first + 1)/2;
+		if (rl[mid].vcn <= vcn)
+			first = mid;
+		else
+			last = mid - 1;
+	}
+	if (vcn < rl[first + 1].vcn) {
+		na->rl_cursor = first;
+		return (&rl[first]);
+	}
+	return (&rl[na->rl_runs]);
+}
+
 /**
  * ntfs_attr_find_vcn - find a vcn in the runlist of an ntfs attribute
  * @na:		ntfs attribute whose runlist to search
@@ -869,14 +1120,9 @@ retry:
 		goto map_rl;
 	if (vcn < rl[0].vcn)
 		goto map_rl;
-	while (rl->length) {
-		if (vcn < rl[1].vcn) {
-			if (rl->lcn >= (LCN)LCN_HOLE)
-				return rl;
-			break;
-		}
-		rl++;
-	}
+	rl = ntfs_attr_find_run(na, vcn);
+	if (rl->length && (rl->lcn >= (LCN)LCN_HOLE))
+		return rl;
 	switch (rl->lcn) {
 	case (LCN)LCN_RL_NOT_MAPPED:
 		goto map_rl;
@@ -908,15 +1154,42 @@ map_rl:
 	return NULL;
 }
 
+/**
+ * ntfs_attr_io_origin - classify device i/o done on behalf of an attribute
+ * @na:		ntfs attribute being read or written
+ *
+ * Return the ntfs_io_origin the device operations should account the i/o to.
+ */
+static ntfs_io_origin ntfs_attr_io_origin(ntfs_attr *na)
+{
+	switch (na->ni->mft_no) {
+	case FILE_MFT:
+		return (na->type == AT_BITMAP) ? NTFS_IO_BITMAP : NTFS_IO_MFT;
+	case FILE_MFTMirr:
+		return NTFS_IO_MFT;
+	case FILE_LogFile:
+		return NTFS_IO_LOGFILE;
+	case FILE_Bitmap:
+		return NTFS_IO_BITMAP;
+	}
+	if (na->type == AT_INDEX_ALLOCATION || na->type == AT_BITMAP)
+		return NTFS_IO_INDEX;
+	if (na->type == AT_DATA)
+		return NTFS_IO_DATA;
+	return NTFS_IO_OTHER;
+}
+
 /**
  * ntfs_attr_pread_i - see description at ntfs_attr_pread()
  */ 
 static s64 ntfs_attr_pread_i(ntfs_attr *na, const s64 pos, s64 count, void *b)
 {
-	s64 br, to_read, ofs, total, total2, max_read, max_init;
+	s64 br, to_read, ofs, total, total2, max_read, max_init, dev_ofs;
 	ntfs_volume *vol;
 	runlist_element *rl;
+	struct ntfs_run_reads *reads;
 	u16 efs_padding_length;
+	u64 runs;
 
 	/* Sanity checking arguments is done in ntfs_attr_pread(). */
 	
@@ -969,7 +1242,23 @@ static s64 ntfs_attr_pread_i(ntfs_attr *na, const s64 pos, s64 count, void *b)
 	if (!NAttrNonResident(na)) {
 		ntfs_attr_search_ctx *ctx;
 		char *val;
+		u32 val_len;
 
+		/*
+		 * The value found by a previous read is still valid unless
+		 * the mft record has been changed since.
+		 */
+		if (na->resident_value
+		    && (na->resident_changes == na->ni->mrec_changes)) {
+			if ((pos + count) > na->resident_length) {
+				errno = EIO;
+				ntfs_log_perror("%s: Read beyond value", __FUNCTION__);
+				return -1;
+			}
+			memcpy(b, na->resident_value + pos, count);
+			return count;
+		}
+		na->resident_value = (const u8*)NULL;
 		ctx = ntfs_attr_get_search_ctx(na->ni, NULL);
 		if (!ctx)
 			return -1;
@@ -980,14 +1269,23 @@ res_err_out:
 			return -1;
 		}
 		val = (char*)ctx->attr + le16_to_cpu(ctx->attr->value_offset);
-		if (val < (char*)ctx->attr || val +
-				le32_to_cpu(ctx->attr->value_length) >
+		val_len = le32_to_cpu(ctx->attr->value_length);
+		if (val < (char*)ctx->attr || val + val_len >
 				(char*)ctx->mrec + vol->mft_record_size) {
 			errno = EIO;
 			ntfs_log_perror("%s: Sanity check failed", __FUNCTION__);
 			goto res_err_out;
 		}
 		memcpy(b, val + pos, count);
+		/*
+		 * Keep the value for next reads if it is in the base record,
+		 * extent records may be released while the attribute is open.
+		 */
+		if (ctx->ntfs_ino == na->ni) {
+			na->resident_value = (const u8*)val;
+			na->resident_length = val_len;
+			na->resident_changes = na->ni->mrec_changes;
+		}
 		ntfs_attr_put_search_ctx(ctx);
 		return count;
 	}
@@ -1088,12 +1386,32 @@ res_err_out:
 		/* It is a real lcn, read it into @dst. */
 		to_read = min(count, (rl->length << vol->cluster_size_bits) -
 				ofs);
-retry:
+		dev_ofs = (rl->lcn << vol->cluster_size_bits) + ofs;
 		ntfs_log_trace("Reading %l bytes from vcn %l, lcn %l, ofs"
 				" %l.\n", (long long)to_read, (long long)rl->vcn,
 			       (long long )rl->lcn, (long long)ofs);
-		br = ntfs_pread(vol->dev, (rl->lcn << vol->cluster_size_bits) +
-				ofs, to_read, b);
+		/*
+		 * Gather the following runs which are adjacent on disk, so
+		 * that they are read by the same device transfer. Holes and
+		 * unmapped runs end the gathering and are handled above.
+		 */
+		runs = 1;
+		while ((to_read < count)
+		    && rl[1].length
+		    && (rl[1].lcn >= 0)
+		    && (rl[1].lcn == rl->lcn + rl->length)) {
+			rl++;
+			runs++;
+			to_read = min(count, to_read
+					+ (rl->length << vol->cluster_size_bits));
+		}
+		reads = &vol->dev->d_run_reads[vol->dev->d_origin
+				< NTFS_IO_ORIGINS ? vol->dev->d_origin
+				: NTFS_IO_OTHER];
+		reads->transfers++;
+		reads->runs += runs;
+retry:
+		br = ntfs_pread(vol->dev, dev_ofs, to_read, b);
 		/* If everything ok, update progress counters and continue. */
 		if (br > 0) {
 			total += br;
@@ -1142,6 +1460,7 @@ rl_err_out:
  */
 s64 ntfs_attr_pread(ntfs_attr *na, const s64 pos, s64 count, void *b)
 {
+	ntfs_io_origin origin;
 	s64 ret;
 	
 	if (!na || !na->ni || !na->ni->vol || !b || pos < 0 || count < 0) {
@@ -1156,12 +1475,227 @@ s64 ntfs_attr_pread(ntfs_attr *na, const s64 pos, s64 count, void *b)
 		       "%l\n", (unsigned long long)na->ni->mft_no,
 		       na->type, (long long)pos, (long long)count);
 
+	origin = na->ni->vol->dev->d_origin;
+	na->ni->vol->dev->d_origin = ntfs_attr_io_origin(na);
 	ret = ntfs_attr_pread_i(na, pos, count, b);
+	na->ni->vol->dev->d_origin = origin;
 	
 	ntfs_log_leave("\n");
 	return ret;
 }
 
+/**
+ * ntfs_attr_load - read the whole value of an attribute
+ * @na:		ntfs attribute to read
+ * @b:		output data buffer
+ * @size:	size of @b in bytes
+ *
+ * Map the whole runlist of @na once, then read its value into @b. Runs
+ * adjacent on disk are read by a single device transfer straight into @b,
+ * holes and the part beyond the initialized size are zeroed and compressed
+ * ranges are decompressed, as ntfs_attr_pread() does.
+ *
+ * On success return the size of the value. On error return -1 with errno
+ * set to ERANGE if @b is too small for the value, or to the error code of
+ * ntfs_attr_map_whole_runlist() or ntfs_attr_pread().
+ */
+s64 ntfs_attr_load(ntfs_attr *na, void *b, s64 size)
+{
+	s64 total, br;
+
+	if (!na || !na->ni || !na->ni->vol || (!b && size) || (size < 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (size < na->data_size) {
+		errno = ERANGE;
+		return -1;
+	}
+	if (NAttrNonResident(na) && ntfs_attr_map_whole_runlist(na))
+		return -1;
+	for (total = 0; total < na->data_size; total += br) {
+		br = ntfs_attr_pread(na, total, na->data_size - total,
+				(u8*)b + total);
+		if (br <= 0) {
+			if (!br)
+				errno = EIO;
+			return -1;
+		}
+	}
+	return total;
+}
+
+/*
+ *		Append an extent to the map being built by ntfs_attr_map_extents()
+ *
+ *	The extent is merged into the previous one, kept in @last, when they
+ *	are contiguous both in the value and on the volume and have the same
+ *	flags. Only the first @count extents are stored in @extents, but they
+ *	are all counted in @used.
+ */
+
+static void ntfs_attr_add_extent(struct ntfs_extent *extents, int count,
+		int *used, struct ntfs_extent *last,
+		s64 offset, s64 physical, s64 length, u32 flags)
+{
+	if (length <= 0)
+		return;
+	if (*used
+	    && (last->flags == flags)
+	    && (last->offset + last->length == offset)
+	    && ((physical < 0)
+		? (last->physical < 0)
+		: (last->physical + last->length == physical))) {
+		last->length += length;
+	} else {
+		last->offset = offset;
+		last->physical = physical;
+		last->length = length;
+		last->flags = flags;
+		(*used)++;
+	}
+	if (*used <= count)
+		extents[*used - 1] = *last;
+}
+
+/**
+ * ntfs_attr_map_extents - get the layout of an attribute value on the volume
+ * @na:		ntfs attribute to map
+ * @extents:	array receiving the extents, may be NULL if @count is 0
+ * @count:	number of entries of @extents
+ *
+ * Describe the value of @na, up to its data size, as a sequence of extents
+ * in increasing offset order, built from its whole runlist. Runs adjacent
+ * on the volume are reported as a single extent, and extents are split at
+ * the initialized size. A resident value is reported as a single extent
+ * flagged NTFS_EXTENT_RESIDENT.
+ *
+ * Only the first @count extents are stored. Compressed ranges cannot be
+ * told from plain ones without reading them, so every allocated extent of
+ * a compressed attribute is flagged NTFS_EXTENT_COMPRESSED, and so is the
+ * unallocated tail of a compression unit, which has no volume offset. Only
+ * whole compression units left unallocated are holes.
+ *
+ * Return the number of extents of the value, which may be more than @count,
+ * or -1 with errno set if the runlist could not be mapped or is corrupt.
+ */
+int ntfs_attr_map_extents(ntfs_attr *na, struct ntfs_extent *extents,
+		int count)
+{
+	ntfs_volume *vol;
+	runlist_element *rl;
+	struct ntfs_extent last;
+	s64 start, end, split;
+	u32 flags;
+	int used;
+
+	if (!na || !na->ni || !na->ni->vol || (count < 0)
+	    || (!extents && count)) {
+		errno = EINVAL;
+		return -1;
+	}
+	vol = na->ni->vol;
+	used = 0;
+	if (!NAttrNonResident(na)) {
+		ntfs_attr_add_extent(extents, count, &used, &last,
+				0, -1, na->data_size, NTFS_EXTENT_RESIDENT);
+		return (used);
+	}
+	if (ntfs_attr_map_whole_runlist(na))
+		return -1;
+	flags = 0;
+	if (na->data_flags & ATTR_COMPRESSION_MASK)
+		flags |= NTFS_EXTENT_COMPRESSED;
+	if (NAttrEncrypted(na))
+		flags |= NTFS_EXTENT_ENCRYPTED;
+	for (rl = na->rl; rl->length; rl++) {
+		start = rl->vcn << vol->cluster_size_bits;
+		if (start >= na->data_size)
+			break;
+		end = min(start + (rl->length << vol->cluster_size_bits),
+				na->data_size);
+		if (rl->lcn == (LCN)LCN_HOLE) {
+			/*
+			 * A hole starting inside a compression unit is the
+			 * unallocated tail of a unit stored compressed, its
+			 * value comes from the clusters before it
+			 */
+			split = start;
+			if ((flags & NTFS_EXTENT_COMPRESSED)
+			    && na->compression_block_size)
+				split = min((start + na->compression_block_size
+					- 1) & ~(s64)(na->compression_block_size
+					- 1), end);
+			ntfs_attr_add_extent(extents, count, &used, &last,
+				start, -1, split - start, flags);
+			ntfs_attr_add_extent(extents, count, &used, &last,
+				split, -1, end - split,
+				(flags & ~NTFS_EXTENT_COMPRESSED)
+					| NTFS_EXTENT_HOLE);
+			continue;
+		}
+		if (rl->lcn < 0) {
+			errno = EIO;
+			ntfs_log_perror("%s: Bad run (%lld)", __FUNCTION__,
+					(long long)rl->lcn);
+			return -1;
+		}
+		split = min(max(start, na->initialized_size), end);
+		ntfs_attr_add_extent(extents, count, &used, &last,
+				start, rl->lcn << vol->cluster_size_bits,
+				split - start, flags);
+		ntfs_attr_add_extent(extents, count, &used, &last,
+				split, (rl->lcn << vol->cluster_size_bits)
+					+ split - start,
+				end - split, flags | NTFS_EXTENT_UNWRITTEN);
+	}
+	return (used);
+}
+
+/**
+ * ntfs_attr_borrow - borrow a pointer to attribute data held by the device
+ * @na:		ntfs attribute to look at
+ * @pos:	byte position in the attribute of the first byte
+ * @count:	number of bytes the caller will look at
+ *
+ * Zero-copy counterpart of ntfs_attr_pread() for read-only scans of metadata
+ * such as $Bitmap. It only succeeds when the device lends its memory (see
+ * ntfs_device_borrow()) and the whole range is initialized data stored in a
+ * single run of a plain non-resident attribute.
+ *
+ * Return a read-only pointer valid until the device is closed, or NULL if the
+ * range can not be borrowed, in which case the caller falls back to
+ * ntfs_attr_pread().
+ */
+const void *ntfs_attr_borrow(ntfs_attr *na, const s64 pos, s64 count)
+{
+	ntfs_volume *vol;
+	runlist_element *rl;
+	s64 ofs;
+
+	if (!na || !na->ni || !na->ni->vol || pos < 0 || count <= 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	vol = na->ni->vol;
+	if (!vol->dev->d_ops->borrow || !NAttrNonResident(na) ||
+			NAttrCompressed(na) || NAttrEncrypted(na) ||
+			pos + count > na->initialized_size) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+	rl = ntfs_attr_find_vcn(na, pos >> vol->cluster_size_bits);
+	if (!rl || rl->lcn < 0)
+		return NULL;
+	ofs = pos - (rl->vcn << vol->cluster_size_bits);
+	if (ofs + count > (rl->length << vol->cluster_size_bits)) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+	return ntfs_device_borrow(vol->dev,
+			(rl->lcn << vol->cluster_size_bits) + ofs, count);
+}
+
 static int ntfs_attr_fill_zero(ntfs_attr *na, s64 pos, s64 count)
 {
 	char *buf;
@@ -1366,6 +1900,7 @@ static int ntfs_attr_fill_hole(ntfs_attr *na, s64 count, s64 *ofs,
 	}
 	na->unused_runs = 2;
 	na->rl = *rl;
+	ntfs_attr_forget_run_index(na);
 	if ((*update_from == -1) || (from_vcn < *update_from))
 		*update_from = from_vcn;
 	*rl = ntfs_attr_find_vcn(na, cur_vcn);
@@ -1438,6 +1973,8 @@ static int split_compressed_hole(ntfs_attr *na, runlist_element **prl,
 	int cluster_size_bits = na->ni->vol->cluster_size_bits;
 	runlist_element *rl = *prl;
 
+		/* the runs are about to be split */
+	ntfs_attr_forget_run_index(na);
 	compressed_part
 		= na->compression_block_clusters;
 		/* reserve entries in runlist if we have to split */
@@ -1605,6 +2142,8 @@ static int borrow_from_hole(ntfs_attr *na, runlist_element **prl,
 	BOOL undecided;
 	BOOL nothole;
 
+		/* the runs are about to be split or merged */
+	ntfs_attr_forget_run_index(na);
 		/* check whether the compression block is fully allocated */
 	endblock = (((pos + count - 1) >> cluster_size_bits) | (na->compression_block_clusters - 1)) + 1 - rl->vcn;
 	allocated = 0;
@@ -1709,6 +2248,7 @@ static int borrow_from_hole(ntfs_attr *na, runlist_element **prl,
 				zrl->length = endblock - allocated;
 				zrl[1].length -= zrl->length;
 				zrl[1].vcn = zrl->vcn + zrl->length;
+				ntfs_attr_forget_run_index(na);
 			}
 		}
 		if (*prl) {
@@ -1740,26 +2280,8 @@ static int borrow_from_hole(ntfs_attr *na, runlist_element **prl,
 static int ntfs_attr_truncate_i(ntfs_attr *na, const s64 newsize,
 				hole_type holes);
 
-/**
- * ntfs_attr_pwrite - positioned write to an ntfs attribute
- * @na:		ntfs attribute to write to
- * @pos:	position in the attribute to write to
- * @count:	number of bytes to write
- * @b:		data buffer to write to disk
- *
- * This function will write @count bytes from data buffer @b to ntfs attribute
- * @na at position @pos.
- *
- * On success, return the number of successfully written bytes. If this number
- * is lower than @count this means that an error was encountered during the
- * write so that the write is partial. 0 means nothing was written (also return
- * 0 when @count is 0).
- *
- * On error and nothing has been written, return -1 with errno set
- * appropriately to the return code of ntfs_pwrite(), or to EINVAL in case of
- * invalid arguments.
- */
-s64 ntfs_attr_pwrite(ntfs_attr *na, const s64 pos, s64 count, const void *b)
+static s64 ntfs_attr_pwrite_i(ntfs_attr *na, const s64 pos, s64 count,
+		const void *b)
 {
 	s64 written, to_write, ofs, old_initialized_size, old_data_size;
 	s64 total = 0;
@@ -2313,6 +2835,40 @@ errno_set:
 	goto out;
 }
 
+/**
+ * ntfs_attr_pwrite - positioned write to an ntfs attribute
+ * @na:		ntfs attribute to write to
+ * @pos:	position in the attribute to write to
+ * @count:	number of bytes to write
+ * @b:		data buffer to write to disk
+ *
+ * This function will write @count bytes from data buffer @b to ntfs attribute
+ * @na at position @pos.
+ *
+ * On success, return the number of successfully written bytes. If this number
+ * is lower than @count this means that an error was encountered during the
+ * write so that the write is partial. 0 means nothing was written (also return
+ * 0 when @count is 0).
+ *
+ * On error and nothing has been written, return -1 with errno set
+ * appropriately to the return code of ntfs_pwrite(), or to EINVAL in case of
+ * invalid arguments.
+ */
+s64 ntfs_attr_pwrite(ntfs_attr *na, const s64 pos, s64 count, const void *b)
+{
+	ntfs_io_origin origin;
+	s64 ret;
+
+	if (!na || !na->ni || !na->ni->vol)
+		return ntfs_attr_pwrite_i(na, pos, count, b);
+
+	origin = na->ni->vol->dev->d_origin;
+	na->ni->vol->dev->d_origin = ntfs_attr_io_origin(na);
+	ret = ntfs_attr_pwrite_i(na, pos, count, b);
+	na->ni->vol->dev->d_origin = origin;
+	return ret;
+}
+
 int ntfs_attr_pclose(ntfs_attr *na)
 {
 	s64 ofs;
@@ -4409,6 +4965,8 @@ int ntfs_attr_rm(ntfs_attr *na)
 		}
 	}
 
+	ntfs_attr_forget_runlist(na);
+
 	/* Search for attribute extents and remove them all. */
 	ctx = ntfs_attr_get_search_ctx(na->ni, NULL);
 	if (!ctx)
@@ -4758,6 +5316,8 @@ int ntfs_attr_make_non_resident(ntfs_attr *na,
 	if (ntfs_attr_can_be_non_resident(vol, na->type, na->name, na->name_len))
 		return -1;
 
+	ntfs_attr_forget_runlist(na);
+
 	new_allocated_size = (le32_to_cpu(a->value_length) + vol->cluster_size
 			- 1) & ~(vol->cluster_size - 1);
 
@@ -4783,6 +5343,7 @@ int ntfs_attr_make_non_resident(ntfs_attr *na,
 	NAttrSetNonResident(na);
 	NAttrSetBeingNonResident(na);
 	na->rl = rl;
+	ntfs_attr_forget_run_index(na);
 	na->allocated_size = new_allocated_size;
 	na->data_size = na->initialized_size = le32_to_cpu(a->value_length);
 	/*
@@ -4903,6 +5464,7 @@ cluster_free_err_out:
 	NAttrClearFullyMapped(na);
 	na->allocated_size = na->data_size;
 	na->rl = NULL;
+	ntfs_attr_forget_run_index(na);
 	free(rl);
 	errno = err;
 	return -1;
@@ -5251,6 +5813,8 @@ static int ntfs_attr_make_resident(ntfs_attr *na, ntfs_attr_search_ctx *ctx)
 		return -1;
 	}
 
+	ntfs_attr_forget_runlist(na);
+
 	/* Some preliminary sanity checking. */
 	if (!NAttrNonResident(na)) {
 		ntfs_log_trace("Eeek!  Trying to make resident attribute resident.  "
@@ -5380,6 +5944,7 @@ static int ntfs_attr_make_resident(ntfs_attr *na, ntfs_attr_search_ctx *ctx)
 	/* Throw away the now unused runlist. */
 	free(na->rl);
 	na->rl = NULL;
+	ntfs_attr_forget_run_index(na);
 
 	/* Update in-memory struct ntfs_attr. */
 	NAttrClearNonResident(na);
@@ -5548,6 +6113,9 @@ retry:
 	ntfs_log_trace("Entering for inode %llu, attr 0x%x\n", 
 		       (unsigned long long)na->ni->mft_no, na->type);
 
+		/* the mapping pairs are about to change */
+	ntfs_attr_forget_runlist(na);
+
 	if (!NAttrNonResident(na)) {
 		errno = EINVAL;
 		ntfs_log_perror("%s: resident attribute", __FUNCTION__);
@@ -6013,6 +6581,7 @@ static int ntfs_non_resident_attr_shrink(ntfs_attr *na, const s64 newsize)
 		}
 
 		/* Truncate the runlist itself. */
+		ntfs_attr_forget_run_index(na);
 		if (ntfs_rl_truncate(&na->rl, first_free_vcn)) {
 			/*
 			 * Failed to truncate the runlist, so just throw it
@@ -6238,6 +6807,7 @@ static int ntfs_non_resident_attr_expand_i(ntfs_attr *na, const s64 newsize,
 			return -1;
 		}
 		na->rl = rln;
+		ntfs_attr_forget_run_index(na);
 
 		/* Prepare to mapping pairs update. */
 		na->allocated_size = first_free_vcn << vol->cluster_size_bits;
@@ -6313,6 +6883,7 @@ rollback:
 		ntfs_log_perror("Leaking clusters");
 	}
 	/* Now, truncate the runlist itself. */
+	ntfs_attr_forget_run_index(na);
 	if (ntfs_rl_truncate(&na->rl, org_alloc_size >>
 			vol->cluster_size_bits)) {
 		/*
@@ -6783,22 +7354,29 @@ s64 ntfs_attr_get_free_bits(ntfs_attr *na)
 		goto out;
 
 	while (1) {
-		u32 *p;
-		br = ntfs_attr_pread(na, total, 65536, buf);
+		const u8 *data;
+		const u32 *p;
+		/* Scan the bitmap in place when the device lends its memory */
+		br = MIN(65536, na->data_size - total);
+		data = (br > 0) ? (const u8 *)ntfs_attr_borrow(na, total, br) : NULL;
+		if (!data) {
+			br = ntfs_attr_pread(na, total, 65536, buf);
+			data = buf;
+		}
 		if (br <= 0)
 			break;
 		total += br;
-		p = (u32 *)buf + br / 4 - 1;
-		for (; (u8 *)p >= buf; p--) {
+		p = (const u32 *)data + br / 4 - 1;
+		for (; (const u8 *)p >= data; p--) {
 			nr_free += lut[ *p        & 255] + 
 			           lut[(*p >>  8) & 255] + 
 			           lut[(*p >> 16) & 255] + 
 			           lut[(*p >> 24)      ];
 		}
 		switch (br % 4) {
-			case 3:  nr_free += lut[*(buf + br - 3)];
-			case 2:  nr_free += lut[*(buf + br - 2)];
-			case 1:  nr_free += lut[*(buf + br - 1)];
+			case 3:  nr_free += lut[*(data + br - 3)];
+			case 2:  nr_free += lut[*(data + br - 2)];
+			case 1:  nr_free += lut[*(data + br - 1)];
 		}
 	}
 	free(buf);
@@ -133,7 +133,7 @@ extern ATTR_DEF *ntfs_attr_find_in_attrdef(const ntfs_volume *vol,
  *		// Ooops. An error occurred! You should handle this case.
  *	// Now finished with all attributes in the inode.
  */
-static int ntfs_attrs_walk(ntfs_attr_search_ctx *ctx)
+static inline int ntfs_attrs_walk(ntfs_attr_search_ctx *ctx)
 {
 	return ntfs_attr_lookup(AT_UNUSED, NULL, 0, CASE_SENSITIVE, 0,
 			NULL, 0, ctx);
@@ -197,8 +197,22 @@ struct _ntfs_attr {
 	u8 compression_block_size_bits; /* 0x40 */
 	u8 compression_block_clusters;  /* 0x41 */
 	s8 unused_runs; /* pre-reserved entries available */
+	runlist_element *rl_indexed;	/* @rl when the two below were set */
+	s32 rl_runs;		/* runs of @rl before its terminator */
+	s32 rl_cursor;		/* run last found by ntfs_attr_find_vcn() */
+	const u8 *resident_value;	/* value of a resident attribute
+					   in the base mft record */
+	u32 resident_length;	/* its length */
+	u32 resident_changes;	/* ni->mrec_changes when it was found */
 };
 
+/*
+ * Forget the run index of ntfs_attr_find_vcn() once @na->rl has been, or is
+ * about to be, changed or replaced.
+ */
+#define ntfs_attr_forget_run_index(na) \
+	((na)->rl_indexed = (runlist_element*)NULL)
+
 /**
  * enum ntfs_attr_state_bits - bits for the state field in the ntfs_attr
  * structure
@@ -292,6 +306,34 @@ extern void ntfs_attr_close(ntfs_attr *na);
 
 extern s64 ntfs_attr_pread(ntfs_attr *na, const s64 pos, s64 count,
 		void *b);
+extern s64 ntfs_attr_load(ntfs_attr *na, void *b, s64 size);
+
+/**
+ * struct ntfs_extent - a stretch of an attribute value and where it is stored
+ *
+ * Returned by ntfs_attr_map_extents(). @physical is a byte offset from the
+ * start of the volume, or -1 when the data is not stored on its own on the
+ * volume (holes, resident values and the unallocated tail of a compression
+ * unit).
+ */
+struct ntfs_extent {
+	s64 offset;		/* Byte offset in the attribute value. */
+	s64 physical;		/* Byte offset in the volume, or -1. */
+	s64 length;		/* Length in bytes. */
+	u32 flags;		/* NTFS_EXTENT_* */
+};
+
+#define NTFS_EXTENT_HOLE	0x0001	/* Not allocated, reads as zeroes */
+#define NTFS_EXTENT_UNWRITTEN	0x0002	/* Beyond the initialized size,
+					   reads as zeroes */
+#define NTFS_EXTENT_COMPRESSED	0x0004	/* Part of a compressed attribute,
+					   the volume bytes are not the value */
+#define NTFS_EXTENT_ENCRYPTED	0x0008	/* Part of an encrypted attribute */
+#define NTFS_EXTENT_RESIDENT	0x0010	/* Stored in the mft record */
+
+extern int ntfs_attr_map_extents(ntfs_attr *na, struct ntfs_extent *extents,
+		int count);
+extern const void *ntfs_attr_borrow(ntfs_attr *na, const s64 pos, s64 count);
 extern s64 ntfs_attr_pwrite(ntfs_attr *na, const s64 pos, s64 count,
 		const void *b);
 extern int ntfs_attr_pclose(ntfs_attr *na);
@@ -304,6 +346,10 @@ extern s64 ntfs_attr_mst_pread(ntfs_attr *na, const s64 pos,
 extern s64 ntfs_attr_mst_pwrite(ntfs_attr *na, const s64 pos,
 		s64 bk_cnt, const u32 bk_size, void *src);
 
+struct CACHED_GENERIC;
+
+extern int ntfs_attr_runlist_hash(const struct CACHED_GENERIC *cached);
+
 extern int ntfs_attr_map_runlist(ntfs_attr *na, VCN vcn);
 extern int ntfs_attr_map_whole_runlist(ntfs_attr *na);
 
@@ -40,7 +40,7 @@ extern int ntfs_attrlist_entry_rm(ntfs_attr_search_ctx *ctx);
  *
  * This function cannot fail.
  */
-static void ntfs_attrlist_mark_dirty(ntfs_inode *ni)
+static inline void ntfs_attrlist_mark_dirty(ntfs_inode *ni)
 {
 	if (ni->nr_extents == -1)
 		NInoAttrListSetDirty(ni->base_ni);
@@ -33,6 +33,7 @@
 #include "types.h"
 #include "security.h"
 #include "cache.h"
+#include "mft.h"
 #include "misc.h"
 #include "logging.h"
 
@@ -52,8 +53,207 @@
  *	shortage of memory, data is simply not cached.
  *	When there is a hashing bug, hashing is dropped, and sequential
  *	searches are used.
+ *
+ *	The replacement policy is a segmented LRU : new entries are put
+ *	on probation, and only move to the protected segment when they
+ *	are fetched again, so that a one-off scan (such as a directory
+ *	listing) cannot flush the entries which are actually reused.
+ *	The size of the protected segment adapts to the workload : when
+ *	an entry is entered again soon after being evicted (detected
+ *	through a "ghost" mark, the full hash value of the evicted entry,
+ *	left in its hash slot), the protected segment grows if the entry
+ *	had been fetched before, and shrinks if it had not.
+ *	An entry which had been fetched before being evicted or removed
+ *	(such as an inode taken out of the nidata cache while open) goes
+ *	straight back to the protected segment.
+ */
+
+enum {
+	SEGMENT_NONE,
+	SEGMENT_PROBATION,	/* entered, never fetched since */
+	SEGMENT_DEMOTED,	/* on probation, but fetched before */
+	SEGMENT_PROTECTED
+} ;
+
+enum {
+	GHOST_NONE,
+	GHOST_EVICTED,		/* evicted, never fetched */
+	GHOST_EVICTED_REUSED,	/* evicted, fetched before */
+	GHOST_REMOVED_REUSED	/* removed by owner, fetched before */
+} ;
+
+/*
+ *		Get the hash slot of an entry, or -1 if it cannot be hashed
+ */
+
+static int hashindex(const struct CACHE_HEADER *cache,
+			const struct CACHED_GENERIC *current)
+{
+	int h;
+
+	h = cache->dohash(current);
+	if (h >= 0)
+		h %= cache->max_hash;
+	return (h);
+}
+
+/*
+ *		Get the segment marker of an entry
+ */
+
+static unsigned char *segmentof(const struct CACHE_HEADER *cache,
+			const struct CACHED_GENERIC *current)
+{
+	return (&cache->segment[((const char*)current
+			- (const char*)cache->entry) / cache->full_item_size]);
+}
+
+/*
+ *		Leave a ghost mark for an entry about to be evicted
+ *	or removed
+ */
+
+static void markghost(struct CACHE_HEADER *cache,
+			const struct CACHED_GENERIC *current, BOOL evicted)
+{
+	int full;
+	int h;
+
+	full = cache->dohash(current);
+	if (full >= 0) {
+		h = full % cache->max_hash;
+		if (*segmentof(cache, current) == SEGMENT_PROBATION)
+			cache->ghost[h] = (evicted ? GHOST_EVICTED : GHOST_NONE);
+		else
+			cache->ghost[h] = (evicted ? GHOST_EVICTED_REUSED
+						: GHOST_REMOVED_REUSED);
+		cache->ghost_hash[h] = full;
+	}
+}
+
+/*
+ *		Unlink an entry from the LRU list
+ */
+
+static void unlinkentry(struct CACHE_HEADER *cache,
+			struct CACHED_GENERIC *current)
+{
+	unsigned char *segment;
+
+	segment = segmentof(cache, current);
+	if (*segment == SEGMENT_PROTECTED) {
+		cache->protected_count--;
+		if (cache->protected_tail == current)
+			cache->protected_tail = current->previous;
+	}
+	*segment = SEGMENT_NONE;
+	if (current->next)
+		current->next->previous = current->previous;
+	else
+		cache->oldest_entry = current->previous;
+	if (current->previous)
+		current->previous->next = current->next;
+	else
+		cache->most_recent_entry = current->next;
+}
+
+/*
+ *		Link an entry as head of the protected segment
+ *
+ *	The oldest protected entries beyond the target size are moved
+ *	back to probation.
+ */
+
+static void linkprotected(struct CACHE_HEADER *cache,
+			struct CACHED_GENERIC *current)
+{
+	struct CACHED_GENERIC *tail;
+
+	current->previous = (struct CACHED_GENERIC*)NULL;
+	current->next = cache->most_recent_entry;
+	if (current->next)
+		current->next->previous = current;
+	else
+		cache->oldest_entry = current;
+	cache->most_recent_entry = current;
+	*segmentof(cache, current) = SEGMENT_PROTECTED;
+	if (!cache->protected_tail)
+		cache->protected_tail = current;
+	cache->protected_count++;
+	while (cache->protected_count > cache->protected_target) {
+		tail = cache->protected_tail;
+		*segmentof(cache, tail) = SEGMENT_DEMOTED;
+		cache->protected_tail = tail->previous;
+		cache->protected_count--;
+	}
+}
+
+/*
+ *		Link an entry as head of the probation segment
+ */
+
+static void linkprobation(struct CACHE_HEADER *cache,
+			struct CACHED_GENERIC *current)
+{
+	struct CACHED_GENERIC *before;
+
+	before = cache->protected_tail;
+	current->previous = before;
+	if (before)
+		current->next = before->next;
+	else
+		current->next = cache->most_recent_entry;
+	if (current->next)
+		current->next->previous = current;
+	else
+		cache->oldest_entry = current;
+	if (before)
+		before->next = current;
+	else
+		cache->most_recent_entry = current;
+	*segmentof(cache, current) = SEGMENT_PROBATION;
+}
+
+/*
+ *		Check whether a new entry matches the ghost of a recently
+ *	evicted or removed one, and adapt the protected segment size
+ *
+ *	Returns TRUE if the entry had been fetched before, and should
+ *	be entered into the protected segment
  */
 
+static BOOL checkghost(struct CACHE_HEADER *cache,
+			const struct CACHED_GENERIC *item)
+{
+	BOOL reused;
+	int full;
+	int h;
+
+	reused = FALSE;
+	full = cache->dohash(item);
+	h = (full >= 0 ? full % cache->max_hash : -1);
+	if ((h >= 0) && (cache->ghost_hash[h] == full)) {
+		switch (cache->ghost[h]) {
+		case GHOST_EVICTED :
+			if (cache->protected_target > 1)
+				cache->protected_target--;
+			break;
+		case GHOST_EVICTED_REUSED :
+			if (cache->protected_target < (cache->item_count - 1))
+				cache->protected_target++;
+			reused = TRUE;
+			break;
+		case GHOST_REMOVED_REUSED :
+			reused = TRUE;
+			break;
+		default :
+			break;
+		}
+		cache->ghost[h] = GHOST_NONE;
+	}
+	return (reused);
+}
+
 /*
  *		Enter a new hash index, after a new record has been inserted
  *
@@ -68,8 +268,8 @@ static void inserthashindex(struct CACHE_HEADER *cache,
 	struct HASH_ENTRY *first;
 
 	if (cache->dohash) {
-		h = cache->dohash(current);
-		if ((h >= 0) && (h < cache->max_hash)) {
+		h = hashindex(cache, current);
+		if (h >= 0) {
 			/* get a free link and insert at top of hash list */
 			link = cache->free_hash;
 			if (link) {
@@ -148,7 +348,6 @@ struct CACHED_GENERIC *ntfs_fetch_cache(struct CACHE_HEADER *cache,
 		const struct CACHED_GENERIC *wanted, cache_compare compare)
 {
 	struct CACHED_GENERIC *current;
-	struct CACHED_GENERIC *previous;
 	struct HASH_ENTRY *link;
 	int h;
 
@@ -159,8 +358,11 @@ struct CACHED_GENERIC *ntfs_fetch_cache(struct CACHE_HEADER *cache,
 			 * When possible, use the hash table to
 			 * locate the entry if present
 			 */
-			h = cache->dohash(wanted);
-		        link = cache->first_hash[h];
+			h = hashindex(cache, wanted);
+			if (h >= 0)
+				link = cache->first_hash[h];
+			else
+				link = (struct HASH_ENTRY*)NULL;
 			while (link && compare(link->entry, wanted))
 				link = link->next;
 			if (link)
@@ -178,32 +380,77 @@ struct CACHED_GENERIC *ntfs_fetch_cache(struct CACHE_HEADER *cache,
 				}
 		}
 		if (current) {
-			previous = current->previous;
 			cache->hits++;
-			if (previous) {
+			if ((current != cache->most_recent_entry)
+			    || (*segmentof(cache, current)
+					!= SEGMENT_PROTECTED)) {
 			/*
 			 * found and not at head of list, unlink from current
-			 * position and relink as head of list
+			 * position and relink as head of list, this promotes
+			 * an entry on probation to the protected segment
 			 */
-				previous->next = current->next;
-				if (current->next)
-					current->next->previous
-						= current->previous;
-				else
-					cache->oldest_entry
-						= current->previous;
-				current->next = cache->most_recent_entry;
-				current->previous
-						= (struct CACHED_GENERIC*)NULL;
-				cache->most_recent_entry->previous = current;
-				cache->most_recent_entry = current;
+				unlinkentry(cache, current);
+				linkprotected(cache, current);
 			}
-		}
+		} else
+			cache->misses++;
 		cache->reads++;
 	}
 	return (current);
 }
 
+/*
+ *		Check whether an entry is in cache
+ *
+ *	Unlike ntfs_fetch_cache(), neither the position of the entry in
+ *	the LRU list nor the statistics are changed, so that a caller
+ *	filling the cache ahead of need does not disturb them.
+ */
+
+BOOL ntfs_probe_cache(struct CACHE_HEADER *cache,
+		const struct CACHED_GENERIC *wanted, cache_compare compare)
+{
+	struct CACHED_GENERIC *current;
+	struct HASH_ENTRY *link;
+	int h;
+
+	if (!cache)
+		return (FALSE);
+	if (cache->dohash) {
+		h = hashindex(cache, wanted);
+		if (h < 0)
+			return (FALSE);
+		for (link=cache->first_hash[h]; link; link=link->next)
+			if (!compare(link->entry, wanted))
+				return (TRUE);
+		return (FALSE);
+	}
+	for (current=cache->most_recent_entry; current;
+				current=current->next)
+		if (!compare(current, wanted))
+			return (TRUE);
+	return (FALSE);
+}
+
+/*
+ *		Move an entry to the head of the protected segment
+ *
+ *	For entries known to be needed often, such as the upper levels
+ *	of a tree, which should not have to prove their worth on
+ *	probation. No read is counted.
+ */
+
+void ntfs_protect_cache(struct CACHE_HEADER *cache,
+		struct CACHED_GENERIC *item)
+{
+	if (cache && item
+	    && ((item != cache->most_recent_entry)
+		|| (*segmentof(cache, item) != SEGMENT_PROTECTED))) {
+		unlinkentry(cache, item);
+		linkprotected(cache, item);
+	}
+}
+
 /*
  *		Enter an inode number into cache
  *	returns the cache entry or NULL if not possible
@@ -214,8 +461,8 @@ struct CACHED_GENERIC *ntfs_enter_cache(struct CACHE_HEADER *cache,
 			cache_compare compare)
 {
 	struct CACHED_GENERIC *current;
-	struct CACHED_GENERIC *before;
 	struct HASH_ENTRY *link;
+	BOOL reused;
 	int h;
 
 	current = (struct CACHED_GENERIC*)NULL;
@@ -225,8 +472,11 @@ struct CACHED_GENERIC *ntfs_enter_cache(struct CACHE_HEADER *cache,
 			 * When possible, use the hash table to
 			 * find out whether the entry if present
 			 */
-			h = cache->dohash(item);
-		        link = cache->first_hash[h];
+			h = hashindex(cache, item);
+			if (h >= 0)
+				link = cache->first_hash[h];
+			else
+				link = (struct HASH_ENTRY*)NULL;
 			while (link && compare(link->entry, item))
 				link = link->next;
 			if (link) {
@@ -249,77 +499,69 @@ struct CACHED_GENERIC *ntfs_enter_cache(struct CACHE_HEADER *cache,
 
 		if (!current) {
 			/*
-			 * Not in list, get a free entry or reuse the
-			 * last entry, and relink as head of list
-			 * Note : we assume at least three entries, so
-			 * before, previous and first are different when
-			 * an entry is reused.
+			 * Not in list, get a free entry or evict the
+			 * oldest entry (on probation unless all entries
+			 * are protected), and relink as head of the
+			 * probation segment, or of the protected one
+			 * if the entry is known to be reused.
 			 */
 
+			reused = (cache->dohash ? checkghost(cache, item)
+					: FALSE);
 			if (cache->free_entry) {
 				current = cache->free_entry;
 				cache->free_entry = cache->free_entry->next;
-				if (item->varsize) {
-					current->variable = ntfs_malloc(
-						item->varsize);
-				} else
-					current->variable = (void*)NULL;
-				current->varsize = item->varsize;
-				if (!cache->oldest_entry)
-					cache->oldest_entry = current;
+				current->varsize = 0;
 			} else {
 				/* reusing the oldest entry */
 				current = cache->oldest_entry;
-				before = current->previous;
-				before->next = (struct CACHED_GENERIC*)NULL;
-				if (cache->dohash)
+				if (cache->dohash) {
+					markghost(cache, current, TRUE);
 					drophashindex(cache,current,
-						cache->dohash(current));
+						hashindex(cache,current));
+				}
 				if (cache->dofree)
 					cache->dofree(current);
-				cache->oldest_entry = current->previous;
-				if (item->varsize) {
-					if (current->varsize)
-						current->variable = realloc(
-							current->variable,
-							item->varsize);
-					else
-						current->variable = ntfs_malloc(
-							item->varsize);
-				} else {
-					if (current->varsize)
-						free(current->variable);
-					current->variable = (void*)NULL;
-				}
-				current->varsize = item->varsize;
+				unlinkentry(cache, current);
+				cache->evicts++;
 			}
-			current->next = cache->most_recent_entry;
-			current->previous = (struct CACHED_GENERIC*)NULL;
-			if (cache->most_recent_entry)
-				cache->most_recent_entry->previous = current;
-			cache->most_recent_entry = current;
-			memcpy(current->payload, item->payload, cache->fixed_size);
 			if (item->varsize) {
-				if (current->variable) {
-					memcpy(current->variable,
-						item->variable, item->varsize);
-				} else {
-					/*
-					 * no more memory for variable part
-					 * recycle entry in free list
-					 * not an error, just uncacheable
-					 */
-					cache->most_recent_entry = current->next;
-					current->next = cache->free_entry;
-					cache->free_entry = current;
-					current = (struct CACHED_GENERIC*)NULL;
-				}
+				if (current->varsize)
+					current->variable = realloc(
+						current->variable,
+						item->varsize);
+				else
+					current->variable = ntfs_malloc(
+						item->varsize);
 			} else {
+				if (current->varsize)
+					free(current->variable);
 				current->variable = (void*)NULL;
+			}
+			current->varsize = item->varsize;
+			memcpy(current->payload, item->payload, cache->fixed_size);
+			if (item->varsize && !current->variable) {
+				/*
+				 * no more memory for variable part
+				 * recycle entry in free list
+				 * not an error, just uncacheable
+				 */
 				current->varsize = 0;
+				current->next = cache->free_entry;
+				cache->free_entry = current;
+				current = (struct CACHED_GENERIC*)NULL;
+			} else {
+				if (item->varsize)
+					memcpy(current->variable,
+						item->variable, item->varsize);
+				if (reused)
+					linkprotected(cache, current);
+				else
+					linkprobation(cache, current);
+				if (cache->dohash)
+					inserthashindex(cache,current);
+				cache->inserts++;
 			}
-			if (cache->dohash && current)
-				inserthashindex(cache,current);
 		}
 		cache->writes++;
 	}
@@ -335,22 +577,12 @@ struct CACHED_GENERIC *ntfs_enter_cache(struct CACHE_HEADER *cache,
 static void do_invalidate(struct CACHE_HEADER *cache,
 		struct CACHED_GENERIC *current, int flags)
 {
-	struct CACHED_GENERIC *previous;
-
-	previous = current->previous;
 	if ((flags & CACHE_FREE) && cache->dofree)
 		cache->dofree(current);
 	/*
 	 * Relink into free list
 	 */
-	if (current->next)
-		current->next->previous = current->previous;
-	else
-		cache->oldest_entry = current->previous;
-	if (previous)
-		previous->next = current->next;
-	else
-		cache->most_recent_entry = current->next;
+	unlinkentry(cache, current);
 	current->next = cache->free_entry;
 	cache->free_entry = current;
 	if (current->variable)
@@ -389,8 +621,11 @@ int ntfs_invalidate_cache(struct CACHE_HEADER *cache,
 			 * When possible, use the hash table to
 			 * find out whether the entry if present
 			 */
-			h = cache->dohash(item);
-		        link = cache->first_hash[h];
+			h = hashindex(cache, item);
+			if (h >= 0)
+				link = cache->first_hash[h];
+			else
+				link = (struct HASH_ENTRY*)NULL;
 			while (link) {
 				if (compare(link->entry, item))
 					link = link->next;
@@ -416,7 +651,7 @@ int ntfs_invalidate_cache(struct CACHE_HEADER *cache,
 					next = current->next;
 					if (cache->dohash)
 						drophashindex(cache,current,
-						    cache->dohash(current));
+						    hashindex(cache,current));
 					do_invalidate(cache,current,flags);
 					current = next;
 					count++;
@@ -429,6 +664,13 @@ int ntfs_invalidate_cache(struct CACHE_HEADER *cache,
 	return (count);
 }
 
+/*
+ *		Remove an entry the caller has taken over
+ *
+ *	A ghost is left, so that the entry goes back to the protected
+ *	segment if it is entered again soon.
+ */
+
 int ntfs_remove_cache(struct CACHE_HEADER *cache,
 		struct CACHED_GENERIC *item, int flags)
 {
@@ -436,8 +678,10 @@ int ntfs_remove_cache(struct CACHE_HEADER *cache,
 
 	count = 0;
 	if (cache) {
-		if (cache->dohash)
-			drophashindex(cache,item,cache->dohash(item));
+		if (cache->dohash) {
+			markghost(cache, item, FALSE);
+			drophashindex(cache,item,hashindex(cache,item));
+		}
 		do_invalidate(cache,item,flags);
 		count++;
 	}
@@ -483,10 +727,12 @@ static struct CACHE_HEADER *ntfs_create_cache(const char *name,
 	size_t size;
 	int i;
 
-	size = sizeof(struct CACHE_HEADER) + item_count*full_item_size;
+	size = sizeof(struct CACHE_HEADER) + item_count*full_item_size
+			+ item_count;
 	if (max_hash)
 		size += item_count*sizeof(struct HASH_ENTRY)
-			 + max_hash*sizeof(struct HASH_ENTRY*);
+			 + max_hash*(sizeof(struct HASH_ENTRY*) + sizeof(int)
+				+ 1);
 	cache = (struct CACHE_HEADER*)ntfs_malloc(size);
 	if (cache) {
 				/* header */
@@ -499,13 +745,30 @@ static struct CACHE_HEADER *ntfs_create_cache(const char *name,
 			cache->dohash = (cache_hash)NULL;
 			cache->max_hash = 0;
 		}
-		cache->fixed_size = full_item_size - sizeof(struct CACHED_GENERIC);
+		/*
+		 * The fixed part starts at the payload, which is declared
+		 * with one element (not zero) so the fields after it must
+		 * not be cut off by sizeof(struct CACHED_GENERIC)
+		 */
+		cache->fixed_size = full_item_size
+				- offsetof(struct CACHED_GENERIC, payload);
+		cache->full_item_size = full_item_size;
+		cache->item_count = item_count;
 		cache->reads = 0;
 		cache->writes = 0;
 		cache->hits = 0;
+		cache->misses = 0;
+		cache->inserts = 0;
+		cache->evicts = 0;
+			/* start with a protected segment of 3/4 of entries */
+		cache->protected_count = 0;
+		cache->protected_target = item_count - item_count/4;
+		if (cache->protected_target >= item_count)
+			cache->protected_target = item_count - 1;
 		/* chain the data entries, and mark an invalid entry */
 		cache->most_recent_entry = (struct CACHED_GENERIC*)NULL;
 		cache->oldest_entry = (struct CACHED_GENERIC*)NULL;
+		cache->protected_tail = (struct CACHED_GENERIC*)NULL;
 		cache->free_entry = &cache->entry[0];
 		pc = &cache->entry[0];
 		for (i=0; i<(item_count - 1); i++) {
@@ -539,48 +802,182 @@ static struct CACHE_HEADER *ntfs_create_cache(const char *name,
 			cache->first_hash = px;
 			for (i=0; i<max_hash; i++)
 				px[i] = (struct HASH_ENTRY*)NULL;
+				/* the ghost marks follow the hash indexes */
+			cache->ghost_hash = (int*)&px[max_hash];
+			cache->ghost = (unsigned char*)&cache->ghost_hash[max_hash];
+			memset(cache->ghost, SEGMENT_NONE, max_hash);
+			cache->segment = &cache->ghost[max_hash];
 		} else {
 			cache->free_hash = (struct HASH_ENTRY*)NULL;
 			cache->first_hash = (struct HASH_ENTRY**)NULL;
+			cache->ghost = (unsigned char*)NULL;
+			cache->ghost_hash = (int*)NULL;
+			cache->segment = ((unsigned char*)pc) + full_item_size;
 		}
+		memset(cache->segment, SEGMENT_NONE, item_count);
 	}
 	return (cache);
 }
 
+/*
+ *		Create a cache with a number of entries fixed at mount time
+ *
+ *	The hash table gets twice as many slots as there are entries.
+ */
+
+static struct CACHE_HEADER *ntfs_create_sized_cache(const char *name,
+			cache_free dofree, cache_hash dohash,
+			int full_item_size, int item_count)
+{
+	if (item_count <= 0)
+		return ((struct CACHE_HEADER*)NULL);
+		/* the LRU list handling needs at least three entries */
+	if (item_count < 3)
+		item_count = 3;
+	return (ntfs_create_cache(name, dofree, dohash, full_item_size,
+			item_count, (dohash ? 2*item_count : 0)));
+}
+
+/*
+ *		Create a Bloom filter for a set of item_count items
+ *
+ *	Sixteen bits per item with two probes keep false positives
+ *	around 1.4% when the set is full.
+ *
+ *	Returns NULL if the filter could not be created
+ */
+
+struct BLOOM_FILTER *ntfs_create_bloom(int item_count)
+{
+	struct BLOOM_FILTER *filter;
+	unsigned int bits;
+
+	bits = 64;
+	while ((bits < 16*(unsigned int)item_count) && (bits < 0x100000))
+		bits <<= 1;
+	filter = (struct BLOOM_FILTER*)ntfs_malloc(
+			sizeof(struct BLOOM_FILTER) + bits/8);
+	if (filter) {
+		filter->mask = bits - 1;
+		ntfs_clear_bloom(filter);
+	}
+	return (filter);
+}
+
+void ntfs_clear_bloom(struct BLOOM_FILTER *filter)
+{
+	memset(filter->bits, 0, (filter->mask + 1)/8);
+	filter->entered = 0;
+}
+
+	/*
+	 * The second probe is derived from the hash by a multiplicative
+	 * scramble, so that callers only have to provide one hash value
+	 */
+
+#define BLOOM_SECOND(hash) (((hash)*2654435761U) >> 11)
+
+void ntfs_enter_bloom(struct BLOOM_FILTER *filter, unsigned int hash)
+{
+	unsigned int bit;
+
+	bit = hash & filter->mask;
+	filter->bits[bit >> 3] |= 1 << (bit & 7);
+	bit = BLOOM_SECOND(hash) & filter->mask;
+	filter->bits[bit >> 3] |= 1 << (bit & 7);
+	filter->entered++;
+}
+
+BOOL ntfs_test_bloom(const struct BLOOM_FILTER *filter, unsigned int hash)
+{
+	unsigned int bit;
+
+	bit = hash & filter->mask;
+	if (!(filter->bits[bit >> 3] & (1 << (bit & 7))))
+		return (FALSE);
+	bit = BLOOM_SECOND(hash) & filter->mask;
+	return ((filter->bits[bit >> 3] & (1 << (bit & 7))) != 0);
+}
+
 /*
  *		Create all LRU caches
  *
+ *	The sizes default to the ones defined in param.h when @sizes
+ *	is NULL.
+ *
  *	No error return, if creation is not possible, cacheing will
  *	just be not available
  */
 
-void ntfs_create_lru_caches(ntfs_volume *vol)
+void ntfs_create_lru_caches(ntfs_volume *vol, const struct CACHE_SIZES *sizes)
 {
+	static const struct CACHE_SIZES defaults = {
+		CACHE_INODE_SIZE, CACHE_NIDATA_SIZE, CACHE_LOOKUP_SIZE,
+		CACHE_SECURID_SIZE, CACHE_LEGACY_SIZE, CACHE_NEGATIVE_SIZE,
+		CACHE_MFTREC_SIZE, CACHE_INDX_SIZE, CACHE_RUNLIST_SIZE
+	} ;
+
+	if (!sizes)
+		sizes = &defaults;
 #if CACHE_INODE_SIZE
 		 /* inode cache */
-	vol->xinode_cache = ntfs_create_cache("inode",(cache_free)NULL,
+	vol->xinode_cache = ntfs_create_sized_cache("inode",(cache_free)NULL,
 		ntfs_dir_inode_hash, sizeof(struct CACHED_INODE),
-		CACHE_INODE_SIZE, 2*CACHE_INODE_SIZE);
+		sizes->inode);
 #endif
 #if CACHE_NIDATA_SIZE
 		 /* idata cache */
-	vol->nidata_cache = ntfs_create_cache("nidata",
+	vol->nidata_cache = ntfs_create_sized_cache("nidata",
 		ntfs_inode_nidata_free, ntfs_inode_nidata_hash,
-		sizeof(struct CACHED_NIDATA),
-		CACHE_NIDATA_SIZE, 2*CACHE_NIDATA_SIZE);
+		sizeof(struct CACHED_NIDATA), sizes->nidata);
 #endif
 #if CACHE_LOOKUP_SIZE
 		 /* lookup cache */
-	vol->lookup_cache = ntfs_create_cache("lookup",
+	vol->lookup_cache = ntfs_create_sized_cache("lookup",
 		(cache_free)NULL, ntfs_dir_lookup_hash,
-		sizeof(struct CACHED_LOOKUP),
-		CACHE_LOOKUP_SIZE, 2*CACHE_LOOKUP_SIZE);
+		sizeof(struct CACHED_LOOKUP), sizes->lookup);
+#endif
+#if CACHE_NEGATIVE_SIZE
+		 /* negative lookup cache, with its filter */
+	vol->negative_cache = ntfs_create_sized_cache("negative",
+		(cache_free)NULL, ntfs_dir_negative_hash,
+		sizeof(struct CACHED_NEGATIVE), sizes->negative);
+	if (vol->negative_cache) {
+		vol->negative_filter = ntfs_create_bloom(
+				vol->negative_cache->item_count);
+		if (!vol->negative_filter) {
+			ntfs_free_cache(vol->negative_cache);
+			vol->negative_cache = (struct CACHE_HEADER*)NULL;
+		}
+	} else
+		vol->negative_filter = (struct BLOOM_FILTER*)NULL;
+#endif
+#if CACHE_MFTREC_SIZE
+		 /* mft record cache */
+	vol->mftrec_cache = ntfs_create_sized_cache("mftrec",
+		(cache_free)NULL, ntfs_mft_record_hash,
+		sizeof(struct CACHED_MFTREC), sizes->mftrec);
+#endif
+#if CACHE_INDX_SIZE
+		 /* directory index block cache */
+	vol->indx_cache = ntfs_create_sized_cache("indx",
+		(cache_free)NULL, ntfs_index_block_hash,
+		sizeof(struct CACHED_INDX), sizes->indx);
+#endif
+#if CACHE_RUNLIST_SIZE
+		 /* decoded runlist cache */
+	vol->runlist_cache = ntfs_create_sized_cache("runlist",
+		(cache_free)NULL, ntfs_attr_runlist_hash,
+		sizeof(struct CACHED_RUNLIST), sizes->runlist);
+#endif
+#if CACHE_SECURID_SIZE
+	vol->securid_cache = ntfs_create_sized_cache("securid",(cache_free)NULL,
+		(cache_hash)NULL,sizeof(struct CACHED_SECURID), sizes->securid);
 #endif
-	vol->securid_cache = ntfs_create_cache("securid",(cache_free)NULL,
-		(cache_hash)NULL,sizeof(struct CACHED_SECURID), CACHE_SECURID_SIZE, 0);
 #if CACHE_LEGACY_SIZE
-	vol->legacy_cache = ntfs_create_cache("legacy",(cache_free)NULL,
-		(cache_hash)NULL, sizeof(struct CACHED_PERMISSIONS_LEGACY), CACHE_LEGACY_SIZE, 0);
+	vol->legacy_cache = ntfs_create_sized_cache("legacy",(cache_free)NULL,
+		(cache_hash)NULL, sizeof(struct CACHED_PERMISSIONS_LEGACY),
+		sizes->legacy);
 #endif
 }
 
@@ -599,7 +996,22 @@ void ntfs_free_lru_caches(ntfs_volume *vol)
 #if CACHE_LOOKUP_SIZE
 	ntfs_free_cache(vol->lookup_cache);
 #endif
+#if CACHE_NEGATIVE_SIZE
+	ntfs_free_cache(vol->negative_cache);
+	free(vol->negative_filter);
+#endif
+#if CACHE_MFTREC_SIZE
+	ntfs_free_cache(vol->mftrec_cache);
+#endif
+#if CACHE_INDX_SIZE
+	ntfs_free_cache(vol->indx_cache);
+#endif
+#if CACHE_RUNLIST_SIZE
+	ntfs_free_cache(vol->runlist_cache);
+#endif
+#if CACHE_SECURID_SIZE
 	ntfs_free_cache(vol->securid_cache);
+#endif
 #if CACHE_LEGACY_SIZE
 	ntfs_free_cache(vol->legacy_cache);
 #endif
@@ -35,11 +35,12 @@ struct CACHED_GENERIC {
 struct CACHED_INODE {
 	struct CACHED_INODE *next;
 	struct CACHED_INODE *previous;
-	const char *pathname;
+	const ntfschar *pathname;	/* not terminated, see varsize */
 	size_t varsize;
 	union ALIGNMENT payload[1];
 		/* above fields must match "struct CACHED_GENERIC" */
 	u64 inum;
+	u64 parent;	/* directory the path starts from */
 } ;
 
 struct CACHED_NIDATA {
@@ -64,6 +65,64 @@ struct CACHED_LOOKUP {
 	u64 inum;
 } ;
 
+struct CACHED_NEGATIVE {
+	struct CACHED_NEGATIVE *next;
+	struct CACHED_NEGATIVE *previous;
+	const ntfschar *name;	/* name as searched for, not upcased */
+	size_t namesize;
+	union ALIGNMENT payload[1];
+		/* above fields must match "struct CACHED_GENERIC" */
+	u64 parent;
+} ;
+
+struct CACHED_MFTREC {
+	struct CACHED_MFTREC *next;
+	struct CACHED_MFTREC *previous;
+	const MFT_RECORD *record;	/* mst deprotected copy */
+	size_t recsize;
+	union ALIGNMENT payload[1];
+		/* above fields must match "struct CACHED_GENERIC" */
+	u64 inum;
+} ;
+
+struct CACHED_INDX {
+	struct CACHED_INDX *next;
+	struct CACHED_INDX *previous;
+	const INDEX_BLOCK *block;	/* mst deprotected copy */
+	size_t blocksize;
+	union ALIGNMENT payload[1];
+		/* above fields must match "struct CACHED_GENERIC" */
+	u64 mref;	/* directory, with sequence number */
+	s64 pos;	/* position of the block in $I30 allocation */
+} ;
+
+struct CACHED_RUNLIST {
+	struct CACHED_RUNLIST *next;
+	struct CACHED_RUNLIST *previous;
+	const ntfschar *name;	/* attribute name, then the runlist */
+	size_t varsize;
+	union ALIGNMENT payload[1];
+		/* above fields must match "struct CACHED_GENERIC" */
+	u64 mref;	/* base inode, with sequence number */
+	ATTR_TYPES type;
+	u32 name_len;
+} ;
+
+	/* offset of the runlist in the variable part of a runlist entry */
+#define CACHED_RUNLIST_OFFSET(name_len) \
+		(((name_len)*sizeof(ntfschar) + 7) & ~(size_t)7)
+
+	/*
+	 * A Bloom filter tells when an item is definitely not in a set.
+	 * Items cannot be removed, the owner rebuilds the filter from
+	 * scratch when too many stale items have accumulated.
+	 */
+struct BLOOM_FILTER {
+	unsigned int mask;	/* number of bits - 1, a power of two */
+	int entered;		/* items set since the filter was cleared */
+	unsigned char bits[1];
+} ;
+
 enum {
 	CACHE_FREE = 1,
 	CACHE_NOHASH = 2
@@ -72,6 +131,10 @@ enum {
 typedef int (*cache_compare)(const struct CACHED_GENERIC *cached,
 				const struct CACHED_GENERIC *item);
 typedef void (*cache_free)(const struct CACHED_GENERIC *cached);
+	/*
+	 * A hash function returns a non-negative value (or -1 for a bad
+	 * entry), it is reduced to the size of the hash table by the cache
+	 */
 typedef int (*cache_hash)(const struct CACHED_GENERIC *cached);
 
 struct HASH_ENTRY {
@@ -79,29 +142,68 @@ struct HASH_ENTRY {
 	struct CACHED_GENERIC *entry;
 } ;
 
+	/*
+	 * The LRU list is split in two segments : the protected entries
+	 * (fetched at least once since they were entered) come first, up
+	 * to protected_tail, followed by the probation entries. New entries
+	 * are entered at the head of the probation segment, so that a scan
+	 * through entries never used again only recycles probation entries.
+	 */
 struct CACHE_HEADER {
 	const char *name;
 	struct CACHED_GENERIC *most_recent_entry;
 	struct CACHED_GENERIC *oldest_entry;
 	struct CACHED_GENERIC *free_entry;
+	struct CACHED_GENERIC *protected_tail;
 	struct HASH_ENTRY *free_hash;
 	struct HASH_ENTRY **first_hash;
+	unsigned char *segment;	/* segment of each entry */
+	unsigned char *ghost;	/* segment of the last entry evicted per slot */
+	int *ghost_hash;	/* full hash value of this entry */
 	cache_free dofree;
 	cache_hash dohash;
 	unsigned long reads;
 	unsigned long writes;
 	unsigned long hits;
+	unsigned long misses;
+	unsigned long inserts;
+	unsigned long evicts;
 	int fixed_size;
+	int full_item_size;
+	int item_count;
+	int protected_count;
+	int protected_target;	/* adapted on hits in ghost entries */
 	int max_hash;
 	struct CACHED_GENERIC entry[0];
 } ;
 
+	/*
+	 * Number of entries in each cache, fixed when the volume is mounted
+	 * (see ntfs_create_lru_caches()), zero disables a cache
+	 */
+struct CACHE_SIZES {
+	int inode;	/* full path to inode number */
+	int nidata;	/* closed inodes kept open for reuse */
+	int lookup;	/* (parent, name) to inode number */
+	int securid;	/* security id of (uid, gid, mode) */
+	int legacy;	/* permissions of files with no security id */
+	int negative;	/* (parent, name) known to be missing */
+	int mftrec;	/* copies of mft records */
+	int indx;	/* copies of directory index blocks */
+	int runlist;	/* decoded runlists of non-resident attributes */
+} ;
+
 	/* cast to generic, avoiding gcc warnings */
 #define GENERIC(pstr) ((const struct CACHED_GENERIC*)(const void*)(pstr))
 
 struct CACHED_GENERIC *ntfs_fetch_cache(struct CACHE_HEADER *cache,
 			const struct CACHED_GENERIC *wanted,
 			cache_compare compare);
+BOOL ntfs_probe_cache(struct CACHE_HEADER *cache,
+			const struct CACHED_GENERIC *wanted,
+			cache_compare compare);
+void ntfs_protect_cache(struct CACHE_HEADER *cache,
+			struct CACHED_GENERIC *item);
 struct CACHED_GENERIC *ntfs_enter_cache(struct CACHE_HEADER *cache,
 			const struct CACHED_GENERIC *item,
 			cache_compare compare);
@@ -111,7 +213,13 @@ int ntfs_invalidate_cache(struct CACHE_HEADER *cache,
 int ntfs_remove_cache(struct CACHE_HEADER *cache,
 			struct CACHED_GENERIC *item, int flags);
 
-void ntfs_create_lru_caches(ntfs_volume *vol);
+struct BLOOM_FILTER *ntfs_create_bloom(int item_count);
+void ntfs_clear_bloom(struct BLOOM_FILTER *filter);
+void ntfs_enter_bloom(struct BLOOM_FILTER *filter, unsigned int hash);
+BOOL ntfs_test_bloom(const struct BLOOM_FILTER *filter, unsigned int hash);
+
+void ntfs_create_lru_caches(ntfs_volume *vol,
+			const struct CACHE_SIZES *sizes);
 void ntfs_free_lru_caches(ntfs_volume *vol);
 
 #endif /* _NTFS_CACHE_H_ */
@@ -0,0 +1,332 @@
+/*
+ cache2.c
+ The NTFS_CACHE is not visible to the user. It should be flushed
+ when any file is closed or changes are made to the filesystem.
+
+ This NTFS_CACHE implements a least-used-page replacement policy. This will
+ distribute sectors evenly over the pages, so if less than the maximum
+ pages are used at once, they should all eventually remain in the NTFS_CACHE.
+ This also has the benefit of throwing out old sectors, so as not to keep
+ too many stale pages around.
+
+ Copyright (c) 2006 Michael "Chishm" Chisholm
+ Copyright (c) 2009 shareese, rodries
+
+ Redistribution and use in source and binary forms, with or without modification,
+ are permitted provided that the following conditions are met:
+
+  1. Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+  2. Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation and/or
+     other materials provided with the distribution.
+  3. The name of the author may not be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+ THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR IMPLIED
+ WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+ AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE
+ LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "types.h"
+#include "logging.h"
+#include "gekko_io.h"
+#include "cache2.h"
+#include "mem_allocate.h"
+
+#define CACHE_FREE                  ((sec_t) -1)
+#define CACHE_MIN_PAGE_COUNT        4
+#define CACHE_MIN_SECTORS_PER_PAGE  8
+
+NTFS_CACHE* _NTFS_cache_constructor (unsigned int numberOfPages, unsigned int sectorsPerPage, struct _uefi_fd* disc, sec_t endOfPartition, sec_t sectorSize)
+{
+	NTFS_CACHE* cache;
+	unsigned int i;
+	NTFS_CACHE_ENTRY* cacheEntries;
+
+	if (numberOfPages == 0 || sectorsPerPage == 0)
+		return NULL;
+
+	if (numberOfPages < CACHE_MIN_PAGE_COUNT)
+		numberOfPages = CACHE_MIN_PAGE_COUNT;
+
+	if (sectorsPerPage < CACHE_MIN_SECTORS_PER_PAGE)
+		sectorsPerPage = CACHE_MIN_SECTORS_PER_PAGE;
+
+	cache = (NTFS_CACHE*) ntfs_alloc (sizeof(NTFS_CACHE));
+	if (cache == NULL)
+		return NULL;
+
+	cache->disc = disc;
+	cache->endOfPartition = endOfPartition;
+	cache->numberOfPages = numberOfPages;
+	cache->sectorsPerPage = sectorsPerPage;
+	cache->sectorSize = sectorSize;
+	cache->accessCounter = 0;
+
+	cacheEntries = (NTFS_CACHE_ENTRY*) ntfs_alloc (sizeof(NTFS_CACHE_ENTRY) * numberOfPages);
+	if (cacheEntries == NULL) {
+		ntfs_free (cache);
+		return NULL;
+	}
+
+	for (i = 0; i < numberOfPages; i++) {
+		cacheEntries[i].sector = CACHE_FREE;
+		cacheEntries[i].count = 0;
+		cacheEntries[i].last_access = 0;
+		cacheEntries[i].dirty = false;
+		cacheEntries[i].cache = (u8*) ntfs_align ((size_t) (sectorsPerPage * sectorSize));
+		if (cacheEntries[i].cache == NULL) {
+			while (i-- > 0)
+				ntfs_align_free (cacheEntries[i].cache);
+			ntfs_free (cacheEntries);
+			ntfs_free (cache);
+			return NULL;
+		}
+	}
+
+	cache->cacheEntries = cacheEntries;
+
+	ntfs_log_debug("cache: %u pages of %u sectors\n", numberOfPages, sectorsPerPage);
+
+	return cache;
+}
+
+void _NTFS_cache_destructor (NTFS_CACHE* cache)
+{
+	unsigned int i;
+
+	if (cache == NULL)
+		return;
+
+	// Clear out cache before destroying it
+	_NTFS_cache_flush (cache);
+
+	// Free memory in reverse allocation order
+	for (i = 0; i < cache->numberOfPages; i++) {
+		ntfs_align_free (cache->cacheEntries[i].cache);
+	}
+	ntfs_free (cache->cacheEntries);
+	ntfs_free (cache);
+}
+
+static u64 _NTFS_cache_accessTime (NTFS_CACHE* cache)
+{
+	return ++cache->accessCounter;
+}
+
+/*
+Find the page holding a sector, or evict the least recently used page
+(writing it back first if dirty) and load the page covering the sector.
+*/
+static NTFS_CACHE_ENTRY* _NTFS_cache_getPage (NTFS_CACHE* cache, sec_t sector)
+{
+	unsigned int i;
+	NTFS_CACHE_ENTRY* cacheEntries = cache->cacheEntries;
+	unsigned int numberOfPages = cache->numberOfPages;
+	unsigned int sectorsPerPage = cache->sectorsPerPage;
+	bool foundFree = false;
+	unsigned int oldUsed = 0;
+	u64 oldAccess = (u64) -1;
+	sec_t next_page;
+
+	// No page covers a sector past the end of the media
+	if (sector >= cache->endOfPartition)
+		return NULL;
+
+	for (i = 0; i < numberOfPages; i++) {
+		if (cacheEntries[i].sector != CACHE_FREE &&
+		    sector >= cacheEntries[i].sector &&
+		    sector < (cacheEntries[i].sector + cacheEntries[i].count)) {
+			cacheEntries[i].last_access = _NTFS_cache_accessTime (cache);
+			return &(cacheEntries[i]);
+		}
+
+		if (foundFree == false && (cacheEntries[i].sector == CACHE_FREE || cacheEntries[i].last_access < oldAccess)) {
+			if (cacheEntries[i].sector == CACHE_FREE)
+				foundFree = true;
+			oldUsed = i;
+			oldAccess = cacheEntries[i].last_access;
+		}
+	}
+
+	if (foundFree == false && cacheEntries[oldUsed].dirty == true) {
+		if (!ntfs_device_uefi_io_writedisk (cache->disc, cacheEntries[oldUsed].sector, cacheEntries[oldUsed].count, cacheEntries[oldUsed].cache))
+			return NULL;
+		cacheEntries[oldUsed].dirty = false;
+	}
+
+	// Align base sector to page size
+	sector = (sector / sectorsPerPage) * sectorsPerPage;
+	next_page = sector + sectorsPerPage;
+	if (next_page > cache->endOfPartition)
+		next_page = cache->endOfPartition;
+
+	if (!ntfs_device_uefi_io_readdisk (cache->disc, sector, next_page - sector, cacheEntries[oldUsed].cache)) {
+		cacheEntries[oldUsed].sector = CACHE_FREE;
+		cacheEntries[oldUsed].count = 0;
+		return NULL;
+	}
+
+	cacheEntries[oldUsed].sector = sector;
+	cacheEntries[oldUsed].count = (unsigned int) (next_page - sector);
+	cacheEntries[oldUsed].last_access = _NTFS_cache_accessTime (cache);
+
+	return &(cacheEntries[oldUsed]);
+}
+
+/*
+Compute the overlap between a sector range and a cache page.
+Returns false if they do not intersect.
+*/
+static bool _NTFS_cache_overlap (NTFS_CACHE_ENTRY* entry, sec_t sector, sec_t numSectors, sec_t* first, sec_t* last)
+{
+	if (entry->sector == CACHE_FREE)
+		return false;
+
+	*first = MAX(sector, entry->sector);
+	*last = MIN(sector + numSectors, entry->sector + (sec_t) entry->count);
+
+	return (*first < *last);
+}
+
+bool _NTFS_cache_readSectors (NTFS_CACHE* cache, sec_t sector, sec_t numSectors, void* buffer)
+{
+	sec_t sec;
+	sec_t secs_to_read;
+	sec_t first, last;
+	unsigned int i;
+	NTFS_CACHE_ENTRY* entry;
+	u8* dest = (u8*) buffer;
+
+	// Large reads go straight to the disc; only dirty pages can be newer
+	if (numSectors > cache->sectorsPerPage) {
+		if (!ntfs_device_uefi_io_readdisk (cache->disc, sector, numSectors, buffer))
+			return false;
+
+		for (i = 0; i < cache->numberOfPages; i++) {
+			entry = &cache->cacheEntries[i];
+			if (entry->dirty && _NTFS_cache_overlap (entry, sector, numSectors, &first, &last)) {
+				memcpy (dest + ((first - sector) * cache->sectorSize),
+					entry->cache + ((first - entry->sector) * cache->sectorSize),
+					(size_t) ((last - first) * cache->sectorSize));
+			}
+		}
+		return true;
+	}
+
+	while (numSectors > 0) {
+		entry = _NTFS_cache_getPage (cache, sector);
+		if (entry == NULL)
+			return false;
+
+		sec = sector - entry->sector;
+		secs_to_read = entry->count - sec;
+		if (secs_to_read > numSectors)
+			secs_to_read = numSectors;
+
+		memcpy (dest, entry->cache + (sec * cache->sectorSize), (size_t) (secs_to_read * cache->sectorSize));
+
+		dest += (secs_to_read * cache->sectorSize);
+		sector += secs_to_read;
+		numSectors -= secs_to_read;
+	}
+
+	return true;
+}
+
+bool _NTFS_cache_writeSectors (NTFS_CACHE* cache, sec_t sector, sec_t numSectors, const void* buffer)
+{
+	sec_t sec;
+	sec_t secs_to_write;
+	sec_t first, last;
+	unsigned int i;
+	NTFS_CACHE_ENTRY* entry;
+	const u8* src = (const u8*) buffer;
+
+	// Large writes go straight to the disc; refresh any cached copies
+	if (numSectors > cache->sectorsPerPage) {
+		if (!ntfs_device_uefi_io_writedisk (cache->disc, sector, numSectors, buffer))
+			return false;
+
+		for (i = 0; i < cache->numberOfPages; i++) {
+			entry = &cache->cacheEntries[i];
+			if (_NTFS_cache_overlap (entry, sector, numSectors, &first, &last)) {
+				memcpy (entry->cache + ((first - entry->sector) * cache->sectorSize),
+					src + ((first - sector) * cache->sectorSize),
+					(size_t) ((last - first) * cache->sectorSize));
+			}
+		}
+		return true;
+	}
+
+	while (numSectors > 0) {
+		entry = _NTFS_cache_getPage (cache, sector);
+		if (entry == NULL)
+			return false;
+
+		sec = sector - entry->sector;
+		secs_to_write = entry->count - sec;
+		if (secs_to_write > numSectors)
+			secs_to_write = numSectors;
+
+		memcpy (entry->cache + (sec * cache->sectorSize), src, (size_t) (secs_to_write * cache->sectorSize));
+
+		src += (secs_to_write * cache->sectorSize);
+		sector += secs_to_write;
+		numSectors -= secs_to_write;
+
+		entry->dirty = true;
+	}
+
+	return true;
+}
+
+bool _NTFS_cache_flush (NTFS_CACHE* cache)
+{
+	unsigned int i;
+
+	if (cache == NULL)
+		return true;
+
+	for (i = 0; i < cache->numberOfPages; i++) {
+		if (cache->cacheEntries[i].dirty) {
+			if (!ntfs_device_uefi_io_writedisk (cache->disc, cache->cacheEntries[i].sector, cache->cacheEntries[i].count, cache->cacheEntries[i].cache)) {
+				ntfs_log_perror("cache flush failure @ sector %d\n", cache->cacheEntries[i].sector);
+				return false;
+			}
+		}
+		cache->cacheEntries[i].dirty = false;
+	}
+
+	return true;
+}
+
+void _NTFS_cache_invalidate (NTFS_CACHE* cache)
+{
+	unsigned int i;
+
+	if (cache == NULL)
+		return;
+
+	for (i = 0; i < cache->numberOfPages; i++) {
+		cache->cacheEntries[i].sector = CACHE_FREE;
+		cache->cacheEntries[i].count = 0;
+		cache->cacheEntries[i].last_access = 0;
+		cache->cacheEntries[i].dirty = false;
+	}
+}
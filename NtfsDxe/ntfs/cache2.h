@@ -37,17 +37,11 @@
 #ifndef _CACHE2_H
 #define _CACHE2_H
 
-//#include "common.h"
-//#include "disc.h"
-
-//#include <stddef.h>
-#include <stdint.h>
-//#include <gctypes.h>
-//#include <ogc/disc_io.h>
-//#include <gccore.h>
+#include "types.h"
 
 #define sec_t __int64
-#define f64 __int64
+
+struct _uefi_fd;
 
 typedef struct {
 	sec_t           sector;
@@ -58,70 +52,34 @@ typedef struct {
 } NTFS_CACHE_ENTRY;
 
 typedef struct {
-	const DISC_INTERFACE* disc;
+	struct _uefi_fd*      disc;
 	sec_t		          endOfPartition;
 	unsigned int          numberOfPages;
 	unsigned int          sectorsPerPage;
 	sec_t                 sectorSize;
+	u64                   accessCounter;
 	NTFS_CACHE_ENTRY*     cacheEntries;
 } NTFS_CACHE;
 
-/*
-Read data from a sector in the NTFS_CACHE
-If the sector is not in the NTFS_CACHE, it will be swapped in
-offset is the position to start reading from
-size is the amount of data to read
-Precondition: offset + size <= BYTES_PER_READ
-*/
-//bool _NTFS_cache_readPartialSector (NTFS_CACHE* NTFS_CACHE, void* buffer, sec_t sector, unsigned int offset, size_t size);
-
-//bool _NTFS_cache_readLittleEndianValue (NTFS_CACHE* NTFS_CACHE, uint32_t *value, sec_t sector, unsigned int offset, int num_bytes);
-
-/*
-Write data to a sector in the NTFS_CACHE
-If the sector is not in the NTFS_CACHE, it will be swapped in.
-When the sector is swapped out, the data will be written to the disc
-offset is the position to start writing to
-size is the amount of data to write
-Precondition: offset + size <= BYTES_PER_READ
-*/
-//bool _NTFS_cache_writePartialSector (NTFS_CACHE* NTFS_CACHE, const void* buffer, sec_t sector, unsigned int offset, size_t size);
-
-//bool _NTFS_cache_writeLittleEndianValue (NTFS_CACHE* NTFS_CACHE, const uint32_t value, sec_t sector, unsigned int offset, int num_bytes);
-
-/*
-Write data to a sector in the NTFS_CACHE, zeroing the sector first
-If the sector is not in the NTFS_CACHE, it will be swapped in.
-When the sector is swapped out, the data will be written to the disc
-offset is the position to start writing to
-size is the amount of data to write
-Precondition: offset + size <= BYTES_PER_READ
-*/
-//bool _NTFS_cache_eraseWritePartialSector (NTFS_CACHE* NTFS_CACHE, const void* buffer, sec_t sector, unsigned int offset, size_t size);
-
 /*
 Read several sectors from the NTFS_CACHE
+If a sector is not in the NTFS_CACHE, its page will be swapped in.
+Reads spanning more than one page bypass the NTFS_CACHE and are
+overlaid with any dirty pages they intersect.
 */
-//bool _NTFS_cache_readSectors (NTFS_CACHE* NTFS_CACHE, sec_t sector, sec_t numSectors, void* buffer);
+bool _NTFS_cache_readSectors (NTFS_CACHE* NTFS_CACHE, sec_t sector, sec_t numSectors, void* buffer);
 
 /*
-Read a full sector from the NTFS_CACHE
+Write several sectors to the NTFS_CACHE
+If a sector is not in the NTFS_CACHE, its page will be swapped in.
+When the page is swapped out, the data will be written to the disc.
+Writes spanning more than one page go straight to the disc and
+refresh any cached pages they intersect.
 */
-//static inline bool _NTFS_cache_readSector (NTFS_CACHE* NTFS_CACHE, void* buffer, sec_t sector) {
-//	return _NTFS_cache_readPartialSector (NTFS_CACHE, buffer, sector, 0, BYTES_PER_READ);
-//}
-
-/*
-Write a full sector to the NTFS_CACHE
-*/
-//static inline bool _NTFS_cache_writeSector (NTFS_CACHE* NTFS_CACHE, const void* buffer, sec_t sector) {
-//	return _NTFS_cache_writePartialSector (NTFS_CACHE, buffer, sector, 0, BYTES_PER_READ);
-//}
-
 bool _NTFS_cache_writeSectors (NTFS_CACHE* NTFS_CACHE, sec_t sector, sec_t numSectors, const void* buffer);
 
 /*
-Write any dirty sectors back to disc and clear out the contents of the NTFS_CACHE
+Write any dirty sectors back to disc, keeping the NTFS_CACHE contents
 */
 bool _NTFS_cache_flush (NTFS_CACHE* NTFS_CACHE);
 
@@ -130,9 +88,8 @@ Clear out the contents of the NTFS_CACHE without writing any dirty sectors first
 */
 void _NTFS_cache_invalidate (NTFS_CACHE* NTFS_CACHE);
 
-NTFS_CACHE* _NTFS_cache_constructor (unsigned int numberOfPages, unsigned int sectorsPerPage, const DISC_INTERFACE* discInterface, sec_t endOfPartition, sec_t sectorSize);
+NTFS_CACHE* _NTFS_cache_constructor (unsigned int numberOfPages, unsigned int sectorsPerPage, struct _uefi_fd* disc, sec_t endOfPartition, sec_t sectorSize);
 
 void _NTFS_cache_destructor (NTFS_CACHE* NTFS_CACHE);
 
-#endif // _CACHE_H
-
+#endif // _CACHE2_H
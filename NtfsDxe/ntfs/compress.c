@@ -1089,6 +1089,8 @@ static int ntfs_compress_overwr_free(ntfs_attr *na, runlist_element *rl,
 
 	vol = na->ni->vol;
 	res = 0;
+		/* the runs are about to be reshaped */
+	ntfs_attr_forget_run_index(na);
 	freelcn = rl->lcn + usedcnt;
 	freevcn = rl->vcn + usedcnt;
 	freelength = rl->length - usedcnt;
@@ -1302,6 +1304,8 @@ static int ntfs_compress_free(ntfs_attr *na, runlist_element *rl,
 
 	res = -1; /* default return */
 	vol = na->ni->vol;
+		/* the runs are about to be reshaped */
+	ntfs_attr_forget_run_index(na);
 	freecnt = (reserved - used) >> vol->cluster_size_bits;
 	usedcnt = (reserved >> vol->cluster_size_bits) - freecnt;
 	if (rl->vcn < *update_from)
@@ -1,9 +1,11 @@
 //#include "../config.h"
 
+#ifndef _LINUX_APPLICATION
 #define size_t int
 #define PATH_MAX 255
 
 extern int errno;
+#endif
 
 
 /* config.h.in.  Generated from configure.ac by autoheader.  */
@@ -385,8 +387,12 @@ extern int errno;
 /* Define to `__inline__' or `__inline' if that's what the C compiler
    calls it, or to nothing if 'inline' is not supported under any name.  */
 #ifndef __cplusplus
+#ifdef _MSC_VER
+#define inline __inline
+#else
 #define inline __inline__
 #endif
+#endif
 
 /* Define to `long int' if <sys/types.h> does not define. */
 //#undef off_t
@@ -398,7 +404,10 @@ extern int errno;
 //#define HAVE_MATH_H 1
 
 //// VC2008 COMPILATION!
-#if (_MSC_VER == 1500)
+#if defined(_LINUX_APPLICATION)
+	// gcc/clang host build, the C library is the host one
+#include <stdbool.h>
+#elif (_MSC_VER == 1500)
 	// visual studio 2008!
 #define bool	char
 #define true	1
@@ -418,3 +427,12 @@ extern int errno;
 #endif
 
 #undef HAVE_MATH_H
+
+//// gcc/clang host build on Linux, see ntfspkg-test/Makefile
+#ifdef _LINUX_APPLICATION
+#define HAVE_ENDIAN_H 1
+#define HAVE_LINUX_HDREG_H 1
+#define HAVE_CTYPE_H 1
+#undef WORDS_BIGENDIAN
+#define WORDS_LITTLEENDIAN 1
+#endif
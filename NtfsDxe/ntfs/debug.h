@@ -33,7 +33,7 @@ struct _runlist_element;
 #ifdef DEBUG
 extern void ntfs_debug_runlist_dump(const struct _runlist_element *rl);
 #else
-static void ntfs_debug_runlist_dump(const struct _runlist_element *rl ) {}
+static inline void ntfs_debug_runlist_dump(const struct _runlist_element *rl ) {}
 #endif
 
 #define NTFS_BUG(msg)							\
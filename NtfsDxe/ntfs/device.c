@@ -128,6 +128,8 @@ struct ntfs_device *ntfs_device_alloc(const char *name, const long state,
 		dev->d_ops = dops;
 		dev->d_state = state;
 		dev->d_private = priv_data;
+		dev->d_origin = NTFS_IO_OTHER;
+		memset(dev->d_run_reads, 0, sizeof(dev->d_run_reads));
 	}
 	return dev;
 }
@@ -177,6 +179,34 @@ int ntfs_device_sync(struct ntfs_device *dev)
 	return ret;
 }
 
+/**
+ * ntfs_device_borrow - borrow a pointer into the device backing memory
+ * @dev:	device to borrow from
+ * @pos:	position in device of the first byte
+ * @count:	number of bytes the caller will look at
+ *
+ * Devices that keep the whole volume in memory (e.g. a mapped image) can lend
+ * a read-only pointer to it, letting metadata readers skip the copy done by
+ * ntfs_pread(). The pointer remains valid until the device is closed.
+ *
+ * Return the pointer, or NULL with errno set to EOPNOTSUPP if the device does
+ * not lend memory or to EINVAL if the range is invalid. Callers must fall
+ * back to ntfs_pread() in that case.
+ */
+const void *ntfs_device_borrow(struct ntfs_device *dev, const s64 pos,
+		s64 count)
+{
+	if (!dev || pos < 0 || count <= 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!dev->d_ops->borrow) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+	return dev->d_ops->borrow(dev, pos, count);
+}
+
 /**
  * ntfs_pread - positioned read from disk
  * @dev:	device to read from
@@ -74,14 +74,49 @@ typedef enum {
  * The ntfs device structure defining all operations needed to access the low
  * level device underlying the ntfs volume.
  */
+/**
+ * enum ntfs_io_origin -
+ *
+ * What the device i/o currently in progress is for, so that the device
+ * operations can attribute their statistics. The values match the
+ * NTFS_IO_ORIGIN_* indices of the diagnostics protocol.
+ */
+typedef enum {
+	NTFS_IO_OTHER = 0,
+	NTFS_IO_MFT,
+	NTFS_IO_INDEX,
+	NTFS_IO_BITMAP,
+	NTFS_IO_DATA,
+	NTFS_IO_LOGFILE,
+	NTFS_IO_ORIGINS,
+} ntfs_io_origin;
+
+/**
+ * struct ntfs_run_reads -
+ *
+ * Reads of attribute runs: ntfs_attr_pread() issues a single device read
+ * for runs which are adjacent on disk, so @runs - @transfers reads were
+ * saved by merging.
+ */
+struct ntfs_run_reads {
+	u64 transfers;				/* Device reads issued. */
+	u64 runs;				/* Runs covered by these reads. */
+};
+
 struct ntfs_device {
 	struct ntfs_device_operations *d_ops;	/* Device operations. */
 	UINTN d_state;			/* State of the device. */
 	char *d_name;				/* Name of device. */
 	void *d_private;			/* Private data used by the
 						   device operations. */
+	ntfs_io_origin d_origin;		/* Origin of the i/o in progress. */
+	struct ntfs_run_reads d_run_reads[NTFS_IO_ORIGINS];
+						/* Run reads per origin. */
 };
 
+#ifdef _LINUX_APPLICATION
+#include <sys/stat.h>
+#else
 #define ino_t int
 #define nlink_t int
 #define blksize_t int
@@ -105,6 +140,7 @@ struct stat {
 	time_t    st_mtime;   /* time of last modification */
 	time_t    st_ctime;   /* time of last status change */
 };
+#endif
 /**
  * struct ntfs_device_operations -
  *
@@ -123,12 +159,16 @@ struct ntfs_device_operations {
 	int (*sync)(struct ntfs_device *dev);
 	int (*stat)(struct ntfs_device *dev, struct stat *buf);
 	int (*ioctl)(struct ntfs_device *dev, int request, void *argp);
+	/* Optional, NULL unless the device can lend its backing memory. */
+	const void *(*borrow)(struct ntfs_device *dev, s64 offset, s64 count);
 };
 
 extern struct ntfs_device *ntfs_device_alloc(const char *name, const long state,
 		struct ntfs_device_operations *dops, void *priv_data);
 extern int ntfs_device_free(struct ntfs_device *dev);
 extern int ntfs_device_sync(struct ntfs_device *dev);
+extern const void *ntfs_device_borrow(struct ntfs_device *dev, const s64 pos,
+		s64 count);
 
 extern s64 ntfs_pread(struct ntfs_device *dev, const s64 pos, s64 count,
 		void *b);
@@ -91,44 +91,58 @@ ntfschar NTFS_INDEX_R[3] = { const_cpu_to_le16('$'), const_cpu_to_le16('R'),
 /*
  *		Pathname hashing
  *
- *	Based on first char and second char (which may be '\0')
+ *	Based on the starting directory and all chars of the path, so
+ *	that the hash table stays balanced whatever the size of the cache
  */
 
 int ntfs_dir_inode_hash(const struct CACHED_GENERIC *cached)
 {
-	const char *path;
-	const unsigned char *name;
+	const ntfschar *name;
+	unsigned int val;
+	size_t i;
 
-	path = (const char*)cached->variable;
-	if (!path) {
+	name = (const ntfschar*)cached->variable;
+	if (!name) {
 		ntfs_log_error("Bad inode cache entry\n");
 		return (-1);
 	}
-	name = (const unsigned char*)strrchr(path,'/');
-	if (!name)
-		name = (const unsigned char*)path;
-	return (((name[0] << 1) + name[1] + strlen((const char*)name))
-				% (2*CACHE_INODE_SIZE));
+	val = (unsigned int)((const struct CACHED_INODE*)cached)->parent;
+	for (i=0; i<cached->varsize/sizeof(ntfschar); i++)
+		val = val*31 + le16_to_cpu(name[i]);
+	return (val & 0x7fffffff);
 }
 
 /*
  *		Pathname comparing for entering/fetching from cache
+ *
+ *	The cache maps a path relative to a directory (the root for
+ *	absolute paths) to the inode it designates, so that a warm path
+ *	is resolved with a single probe, whatever its depth.
+ *	Paths are little endian Unicode, not terminated.
  */
 
 static int inode_cache_compare(const struct CACHED_GENERIC *cached,
 			const struct CACHED_GENERIC *wanted)
 {
 	return (!cached->variable
-		    || strcmp((const char *) cached->variable, (const char *) wanted->variable));
+		    || (((const struct CACHED_INODE*)cached)->parent
+			!= ((const struct CACHED_INODE*)wanted)->parent)
+		    || (cached->varsize != wanted->varsize)
+		    || memcmp(cached->variable, wanted->variable,
+				cached->varsize));
 }
 
 /*
  *		Pathname comparing for invalidating entries in cache
  *
- *	A partial path is compared in order to invalidate all paths
- *	related to a renamed directory
- *	inode numbers are also checked, as deleting a long name may
- *	imply deleting a short name and conversely
+ *	Entries designating the removed inode are invalidated whatever
+ *	their path, as deleting a long name may imply deleting a short
+ *	name and conversely.
+ *	When a directory name is removed (or renamed), which is signalled
+ *	by a null parent, all the entries resolved through a directory
+ *	are invalidated too : the removed name may be on their path,
+ *	possibly spelled with another case, and the inode number of the
+ *	directory may be reused.
  *
  *	Only use associated with a CACHE_NOHASH flag
  */
@@ -136,23 +150,25 @@ static int inode_cache_compare(const struct CACHED_GENERIC *cached,
 static int inode_cache_inv_compare(const struct CACHED_GENERIC *cached,
 			const struct CACHED_GENERIC *wanted)
 {
-	int len;
 	BOOL different;
 	const struct CACHED_INODE *w;
 	const struct CACHED_INODE *c;
+	size_t i;
 
 	w = (const struct CACHED_INODE*)wanted;
 	c = (const struct CACHED_INODE*)cached;
-	if (w->pathname) {
-		len = strlen(w->pathname);
-		different = !cached->variable
-			|| ((w->inum != MREF(c->inum))
-			   && (strncmp(c->pathname, w->pathname, len)
-				|| ((c->pathname[len] != '\0')
-				   && (c->pathname[len] != '/'))));
-	} else
-		different = !c->pathname
-			|| (w->inum != MREF(c->inum));
+	different = !c->pathname
+		|| (w->inum != MREF(c->inum));
+	if (different && !w->parent) {
+			/* keep the single names relative to the root */
+		i = 0;
+		if (c->parent == FILE_root)
+			while ((i < c->varsize/sizeof(ntfschar))
+			    && (c->pathname[i] != const_cpu_to_le16(PATH_SEP)))
+				i++;
+		different = (c->parent == FILE_root)
+			&& (i >= c->varsize/sizeof(ntfschar));
+	}
 	return (different);
 }
 
@@ -196,7 +212,7 @@ static int lookup_cache_inv_compare(const struct CACHED_GENERIC *cached,
 /*
  *		Lookup hashing
  *
- *	Based on first, second and and last char
+ *	Based on the parent directory and all chars of the name
  */
 
 int ntfs_dir_lookup_hash(const struct CACHED_GENERIC *cached)
@@ -211,12 +227,206 @@ int ntfs_dir_lookup_hash(const struct CACHED_GENERIC *cached)
 		ntfs_log_error("Bad lookup cache entry\n");
 		return (-1);
 	}
-	val = (name[0] << 2) + (name[1] << 1) + name[count - 1] + count;
-	return (val % (2*CACHE_LOOKUP_SIZE));
+	val = (unsigned int)((const struct CACHED_LOOKUP*)cached)->parent;
+	while (count--)
+		val = val*31 + *name++;
+	return (val & 0x7fffffff);
 }
 
 #endif
 
+#if CACHE_NEGATIVE_SIZE
+
+/*
+ *		Name comparing for entering/fetching from negative cache
+ *
+ *	Names are compared as searched for, so that a miss never hides
+ *	a name which would only match with another case.
+ */
+
+static int negative_cache_compare(const struct CACHED_GENERIC *cached,
+			const struct CACHED_GENERIC *wanted)
+{
+	const struct CACHED_NEGATIVE *c = (const struct CACHED_NEGATIVE*) cached;
+	const struct CACHED_NEGATIVE *w = (const struct CACHED_NEGATIVE*) wanted;
+	return (!c->name
+		    || (c->parent != w->parent)
+		    || (c->namesize != w->namesize)
+		    || memcmp(c->name, w->name, c->namesize));
+}
+
+/*
+ *		Directory comparing for invalidating negative cache
+ *
+ *	Only use associated with a CACHE_NOHASH flag
+ */
+
+static int negative_cache_inv_compare(const struct CACHED_GENERIC *cached,
+			const struct CACHED_GENERIC *wanted)
+{
+	const struct CACHED_NEGATIVE *c = (const struct CACHED_NEGATIVE*) cached;
+	const struct CACHED_NEGATIVE *w = (const struct CACHED_NEGATIVE*) wanted;
+	return (!c->name || (c->parent != w->parent));
+}
+
+/*
+ *		Negative lookup hashing
+ *
+ *	Based on the parent directory and all chars of the name, the
+ *	same value feeds the Bloom filter in front of the cache
+ */
+
+int ntfs_dir_negative_hash(const struct CACHED_GENERIC *cached)
+{
+	const ntfschar *name;
+	int count;
+	unsigned int val;
+
+	name = (const ntfschar*)cached->variable;
+	count = cached->varsize/sizeof(ntfschar);
+	if (!name || !count) {
+		ntfs_log_error("Bad negative cache entry\n");
+		return (-1);
+	}
+	val = (unsigned int)((const struct CACHED_NEGATIVE*)cached)->parent;
+	while (count--)
+		val = val*31 + le16_to_cpu(*name++);
+	return (val & 0x7fffffff);
+}
+
+/*
+ *		Filter key of a directory, telling whether a directory
+ *	may have entries in the negative cache
+ */
+
+static unsigned int negative_dir_key(u64 parent)
+{
+	return ((unsigned int)(parent*0x9e3779b97f4a7c15ULL >> 32));
+}
+
+/*
+ *		Rebuild the negative filter from the names still in cache
+ *
+ *	Names cannot be removed from a Bloom filter, so the ones evicted
+ *	or invalidated accumulate as false positives until the filter
+ *	is rebuilt, which is done when twice as many names as the cache
+ *	can hold have been entered.
+ */
+
+static void negative_rebuild_filter(ntfs_volume *vol)
+{
+	struct CACHED_GENERIC *entry;
+
+	ntfs_clear_bloom(vol->negative_filter);
+	for (entry=vol->negative_cache->most_recent_entry; entry;
+				entry=entry->next) {
+		if (entry->variable) {
+			ntfs_enter_bloom(vol->negative_filter,
+					ntfs_dir_negative_hash(entry));
+			ntfs_enter_bloom(vol->negative_filter, negative_dir_key(
+				((struct CACHED_NEGATIVE*)entry)->parent));
+		}
+	}
+}
+
+/*
+ *		Check whether a name is known to be missing from a directory
+ *
+ *	Names which were never missed are rejected by the filter without
+ *	searching the cache.
+ */
+
+static BOOL negative_lookup(ntfs_inode *dir_ni, const ntfschar *uname,
+			int uname_len)
+{
+	ntfs_volume *vol = dir_ni->vol;
+	struct CACHED_NEGATIVE item;
+
+	if (!vol->negative_cache)
+		return (FALSE);
+	item.name = uname;
+	item.namesize = uname_len*sizeof(ntfschar);
+	item.parent = dir_ni->mft_no;
+	if (!ntfs_test_bloom(vol->negative_filter,
+				ntfs_dir_negative_hash(GENERIC(&item))))
+		return (FALSE);
+	return (ntfs_fetch_cache(vol->negative_cache, GENERIC(&item),
+			negative_cache_compare) != (struct CACHED_GENERIC*)NULL);
+}
+
+/*
+ *		Record a name missing from a directory
+ */
+
+static void negative_enter(ntfs_inode *dir_ni, const ntfschar *uname,
+			int uname_len)
+{
+	ntfs_volume *vol = dir_ni->vol;
+	struct CACHED_NEGATIVE item;
+
+	if (!vol->negative_cache)
+		return;
+	item.name = uname;
+	item.namesize = uname_len*sizeof(ntfschar);
+	item.parent = dir_ni->mft_no;
+	if (ntfs_enter_cache(vol->negative_cache, GENERIC(&item),
+			negative_cache_compare)) {
+		if (vol->negative_filter->entered
+				>= 4*vol->negative_cache->item_count)
+			negative_rebuild_filter(vol);
+		ntfs_enter_bloom(vol->negative_filter,
+				ntfs_dir_negative_hash(GENERIC(&item)));
+		ntfs_enter_bloom(vol->negative_filter,
+				negative_dir_key(item.parent));
+	}
+}
+
+#endif
+
+/*
+ *		Forget the names known to be missing from a directory
+ *
+ *	To be called before a name is added to the index of the directory.
+ *	The lookup cache also records names not found, they are dropped
+ *	as well.
+ */
+
+void ntfs_inode_invalidate_misses(ntfs_inode *dir_ni)
+{
+#if CACHE_NEGATIVE_SIZE
+	struct CACHED_NEGATIVE item;
+#endif
+#if CACHE_LOOKUP_SIZE
+	struct CACHED_LOOKUP lkitem;
+#endif
+#if CACHE_NEGATIVE_SIZE | CACHE_LOOKUP_SIZE
+	ntfs_volume *vol = dir_ni->vol;
+#endif
+
+#if CACHE_NEGATIVE_SIZE
+		/* the filter tells whether the directory had any miss */
+	if (vol->negative_cache
+	    && ntfs_test_bloom(vol->negative_filter,
+				negative_dir_key(dir_ni->mft_no))) {
+		item.name = (const ntfschar*)NULL;
+		item.namesize = 0;
+		item.parent = dir_ni->mft_no;
+		ntfs_invalidate_cache(vol->negative_cache, GENERIC(&item),
+				negative_cache_inv_compare, CACHE_NOHASH);
+	}
+#endif
+#if CACHE_LOOKUP_SIZE
+	if (vol->lookup_cache) {
+		lkitem.name = (const char*)NULL;
+		lkitem.namesize = 0;
+		lkitem.parent = dir_ni->mft_no;
+		lkitem.inum = (u64)-1;
+		ntfs_invalidate_cache(vol->lookup_cache, GENERIC(&lkitem),
+				lookup_cache_inv_compare, CACHE_NOHASH);
+	}
+#endif
+}
+
 /**
  * ntfs_inode_lookup_by_name - find an inode in a directory given its name
  * @dir_ni:	ntfs inode of the directory in which to search for the name
@@ -267,6 +477,13 @@ u64 ntfs_inode_lookup_by_name(ntfs_inode *dir_ni,
 		return -1;
 	}
 
+#if CACHE_NEGATIVE_SIZE
+	if (negative_lookup(dir_ni, uname, uname_len)) {
+		errno = ENOENT;
+		return -1;
+	}
+#endif
+
 	ctx = ntfs_attr_get_search_ctx(dir_ni, NULL);
 	if (!ctx)
 		return -1;
@@ -357,6 +574,9 @@ u64 ntfs_inode_lookup_by_name(ntfs_inode *dir_ni,
 		if (mref)
 			return mref;
 		ntfs_log_debug("Entry not found - between root entries.\n");
+#if CACHE_NEGATIVE_SIZE
+		negative_enter(dir_ni, uname, uname_len);
+#endif
 		errno = ENOENT;
 		return -1;
 	} /* Child node present, descend into it. */
@@ -389,7 +609,7 @@ u64 ntfs_inode_lookup_by_name(ntfs_inode *dir_ni,
 descend_into_child_node:
 
 	/* Read the index block starting at vcn. */
-	br = ntfs_attr_mst_pread(ia_na, vcn << index_vcn_size_bits, 1,
+	br = ntfs_index_block_pread(ia_na, vcn << index_vcn_size_bits,
 			index_block_size, ia);
 	if (br != 1) {
 		if (br != -1)
@@ -515,6 +735,9 @@ descend_into_child_node:
 	if (mref)
 		return mref;
 	ntfs_log_debug("Entry not found.\n");
+#if CACHE_NEGATIVE_SIZE
+	negative_enter(dir_ni, uname, uname_len);
+#endif
 	errno = ENOENT;
 	return -1;
 put_err_out:
@@ -649,87 +872,103 @@ void ntfs_inode_update_mbsname(ntfs_inode *dir_ni, const char *name, u64 inum)
 }
 
 /**
- * ntfs_pathname_to_inode - Find the inode which represents the given pathname
+ * ntfs_upathname_to_inode - Find the inode which represents a Unicode pathname
  * @vol:       An ntfs volume obtained from ntfs_mount
  * @parent:    A directory inode to begin the search (may be NULL)
- * @pathname:  Pathname to be located
+ * @upath:     Little endian Unicode pathname to be located, not terminated
+ * @upath_len: Length of @upath in Unicode characters
  *
- * Take an ASCII pathname and find the inode that represents it.  The function
- * splits the path and then descends the directory tree.  If @parent is NULL,
- * then the root directory '.' will be used as the base for the search.
+ * Find the inode that represents @upath. The path is split in place and
+ * each name is looked up in its directory as it is, so there is neither
+ * any conversion nor any copy of the path. If @parent is NULL, then the
+ * root directory is used as the base for the search.
+ *
+ * Every resolved prefix of the path is entered into the inode cache, keyed
+ * by the base directory, so that a later search starts from the longest
+ * prefix already known (the whole path on a warm hit).
  *
  * Return:  inode  Success, the pathname was valid
  *	    NULL   Error, the pathname was invalid, or some other error occurred
  */
-ntfs_inode *ntfs_pathname_to_inode(ntfs_volume *vol, ntfs_inode *parent,
-		const char *pathname)
+ntfs_inode *ntfs_upathname_to_inode(ntfs_volume *vol, ntfs_inode *parent,
+		const ntfschar *upath, int upath_len)
 {
 	u64 inum;
-	int len, err = 0;
-	char *p, *q;
+	int p, q, end, err = 0;
 	ntfs_inode *ni;
 	ntfs_inode *result = NULL;
-	ntfschar *unicode = NULL;
-	char *ascii = NULL;
 #if CACHE_INODE_SIZE
 	struct CACHED_INODE item;
 	struct CACHED_INODE *cached;
-	char *fullname;
+	int start;
 #endif
 
-	if (!vol || !pathname) {
+	if (!vol || !upath || (upath_len < 0)) {
 		errno = EINVAL;
 		return NULL;
 	}
-	
-	//ntfs_log_trace("path: '%s'\n", pathname);
-	
-	ascii = strdup(pathname);
-	if (!ascii) {
-		ntfs_log_error("Out of memory.\n");
-		err = ENOMEM;
-		goto out;
-	}
 
-	p = ascii;
-	/* Remove leading /'s. */
-	while (p && *p && *p == PATH_SEP)
+	/* Remove leading and trailing separators. */
+	p = 0;
+	while ((p < upath_len) && (upath[p] == const_cpu_to_le16(PATH_SEP)))
 		p++;
+	end = upath_len;
+	while ((end > p) && (upath[end - 1] == const_cpu_to_le16(PATH_SEP)))
+		end--;
 #if CACHE_INODE_SIZE
-	fullname = p;
-	if (p[0] && (p[strlen(p)-1] == PATH_SEP))
-		ntfs_log_error("Unnormalized path %s\n",ascii);
-#endif
-	if (parent) {
-		ni = parent;
-	} else {
-#if CACHE_INODE_SIZE
+	start = p;
+	item.parent = (parent ? parent->mft_no : (u64)FILE_root);
+	item.pathname = &upath[start];
+	cached = (struct CACHED_INODE*)NULL;
+	q = end;
+	if (end > start) {
 			/*
-			 * fetch inode for full path from cache
+			 * fetch inode for full path from cache, or else
+			 * for its longest cached prefix, so that the
+			 * directories above it need not be opened
 			 */
-		if (*fullname) {
-			item.pathname = fullname;
-			item.varsize = strlen(fullname) + 1;
-			cached = (struct CACHED_INODE*)ntfs_fetch_cache(
-				vol->xinode_cache, GENERIC(&item),
-				inode_cache_compare);
-		} else
-			cached = (struct CACHED_INODE*)NULL;
-		if (cached) {
+		item.varsize = (end - start)*sizeof(ntfschar);
+		cached = (struct CACHED_INODE*)ntfs_fetch_cache(
+			vol->xinode_cache, GENERIC(&item),
+			inode_cache_compare);
+		while (!cached && (q > start)) {
+			do
+				q--;
+			while ((q > start)
+			    && (upath[q] != const_cpu_to_le16(PATH_SEP)));
+			if (q > start) {
+				item.varsize = (q - start)*sizeof(ntfschar);
+				cached = (struct CACHED_INODE*)ntfs_fetch_cache(
+					vol->xinode_cache, GENERIC(&item),
+					inode_cache_compare);
+			}
+		}
+	}
+	if (cached) {
+		inum = MREF(cached->inum);
+		ni = ntfs_inode_open(vol, inum);
+		if (!ni) {
+			ntfs_log_debug("Cannot open inode %llu.\n",
+					(unsigned long long)inum);
+			err = EIO;
+			goto out;
+		}
+		if (q >= end) {
 			/*
 			 * return opened inode if found in cache
 			 */
-			inum = MREF(cached->inum);
-			ni = ntfs_inode_open(vol, inum);
-			if (!ni) {
-				ntfs_log_debug("Cannot open inode %llu: %s.\n",
-						(unsigned long long)inum, p);
-				err = EIO;
-			}
 			result = ni;
 			goto out;
 		}
+			/* resume after the cached prefix */
+		p = q;
+		while ((p < end) && (upath[p] == const_cpu_to_le16(PATH_SEP)))
+			p++;
+	} else
 #endif
+	if (parent) {
+		ni = parent;
+	} else {
 		ni = ntfs_inode_open(vol, FILE_root);
 		if (!ni) {
 			ntfs_log_debug("Couldn't open the inode of the root "
@@ -740,66 +979,31 @@ ntfs_inode *ntfs_pathname_to_inode(ntfs_volume *vol, ntfs_inode *parent,
 		}
 	}
 
-	while (p && *p) {
+	while (p < end) {
 		/* Find the end of the first token. */
-		q = (char *) strchr(p, PATH_SEP);
-		if (q != NULL) {
-			*q = '\0';
+		q = p;
+		while ((q < end) && (upath[q] != const_cpu_to_le16(PATH_SEP)))
+			q++;
+		if ((q - p) > NTFS_MAX_NAME_LEN) {
+			err = ENAMETOOLONG;
+			goto close;
 		}
+		inum = ntfs_inode_lookup_by_name(ni, &upath[p], q - p);
 #if CACHE_INODE_SIZE
-			/*
-			 * fetch inode for partial path from cache
-			 */
-		cached = (struct CACHED_INODE*)NULL;
-		if (!parent) {
-			item.pathname = fullname;
-			item.varsize = strlen(fullname) + 1;
-			cached = (struct CACHED_INODE*)ntfs_fetch_cache(
-					vol->xinode_cache, GENERIC(&item),
+			/* insert the partial path into cache if found */
+		if (inum != (u64) -1) {
+			item.pathname = &upath[start];
+			item.varsize = (q - start)*sizeof(ntfschar);
+			item.inum = inum;
+			ntfs_enter_cache(vol->xinode_cache,
+					GENERIC(&item),
 					inode_cache_compare);
-			if (cached) {
-				inum = cached->inum;
-			}
-		}
-			/*
-			 * if not in cache, translate, search, then
-			 * insert into cache if found
-			 */
-		if (!cached) {
-			len = ntfs_mbstoucs(p, &unicode);
-			if (len < 0) {
-				ntfs_log_perror("Could not convert filename to Unicode:"
-					" '%s'", p);
-				err = errno;
-				goto close;
-			} else if (len > NTFS_MAX_NAME_LEN) {
-				err = ENAMETOOLONG;
-				goto close;
-			}
-			inum = ntfs_inode_lookup_by_name(ni, unicode, len);
-			if (!parent && (inum != (u64) -1)) {
-				item.inum = inum;
-				ntfs_enter_cache(vol->xinode_cache,
-						GENERIC(&item),
-						inode_cache_compare);
-			}
-		}
-#else
-		len = ntfs_mbstoucs(p, &unicode);
-		if (len < 0) {
-			ntfs_log_perror("Could not convert filename to Unicode:"
-					" '%s'", p);
-			err = errno;
-			goto close;
-		} else if (len > NTFS_MAX_NAME_LEN) {
-			err = ENAMETOOLONG;
-			goto close;
 		}
-		inum = ntfs_inode_lookup_by_name(ni, unicode, len);
 #endif
 		if (inum == (u64) -1) {
-			ntfs_log_debug("Couldn't find name '%s' in pathname "
-					"'%s'.\n", p, pathname);
+			ntfs_log_debug("Couldn't find a name in directory "
+					"%llu.\n",
+					(unsigned long long)ni->mft_no);
 			err = ENOENT;
 			goto close;
 		}
@@ -813,18 +1017,14 @@ ntfs_inode *ntfs_pathname_to_inode(ntfs_volume *vol, ntfs_inode *parent,
 		inum = MREF(inum);
 		ni = ntfs_inode_open(vol, inum);
 		if (!ni) {
-			ntfs_log_debug("Cannot open inode %llu: %s.\n",
-					(unsigned long long)inum, p);
+			ntfs_log_debug("Cannot open inode %llu.\n",
+					(unsigned long long)inum);
 			err = EIO;
 			goto close;
 		}
-	
-		free(unicode);
-		unicode = NULL;
 
-		if (q) *q++ = PATH_SEP; /* JPA */
 		p = q;
-		while (p && *p && *p == PATH_SEP)
+		while ((p < end) && (upath[p] == const_cpu_to_le16(PATH_SEP)))
 			p++;
 	}
 
@@ -835,18 +1035,49 @@ close:
 		if (ntfs_inode_close(ni) && !err)
 			err = errno;
 out:
-
-	ntfs_log_debug("ntfs_pathname_to_inode leaving... %x (MFT no %x)\n\r", result, (ni != NULL) ? (UINTN) ni->mft_no : 0);
-	ntfs_log_debug("free(ascii)\n\r");
-	free(ascii);
-	ntfs_log_debug("free(unicode)\n\r");
-	free(unicode);
 	if (err)
 		errno = err;
-	ntfs_log_debug("return\n\r");
 	return result;
 }
 
+/**
+ * ntfs_pathname_to_inode - Find the inode which represents the given pathname
+ * @vol:       An ntfs volume obtained from ntfs_mount
+ * @parent:    A directory inode to begin the search (may be NULL)
+ * @pathname:  Pathname to be located
+ *
+ * Take an ASCII pathname and find the inode that represents it. The
+ * pathname is converted to Unicode once and then resolved by
+ * ntfs_upathname_to_inode().
+ *
+ * Return:  inode  Success, the pathname was valid
+ *	    NULL   Error, the pathname was invalid, or some other error occurred
+ */
+ntfs_inode *ntfs_pathname_to_inode(ntfs_volume *vol, ntfs_inode *parent,
+		const char *pathname)
+{
+	ntfschar *unicode = NULL;
+	ntfs_inode *ni;
+	int len, eo;
+
+	if (!vol || !pathname) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	len = ntfs_mbstoucs(pathname, &unicode);
+	if (len < 0) {
+		ntfs_log_perror("Could not convert pathname to Unicode:"
+				" '%s'", pathname);
+		return NULL;
+	}
+	ni = ntfs_upathname_to_inode(vol, parent, unicode, len);
+	eo = errno;
+	free(unicode);
+	errno = eo;
+	return ni;
+}
+
 /*
  * The little endian Unicode string ".." for ntfs_readdir().
  */
@@ -967,13 +1198,19 @@ static u32 ntfs_dir_entry_type(ntfs_inode *dir_ni, MFT_REF mref,
  * @ie:		current index entry
  * @dirent:	context for filldir callback supplied by the caller
  * @filldir:	filldir callback supplied by the caller
+ * @filldir_key: filldir callback also getting the index key, if @filldir
+ *		is NULL
  *
  * Pass information specifying the current directory entry @ie to the @filldir
  * callback.
+ *
+ * With @filldir_key, the type of the entry is only derived from the index
+ * key, so that no inode has to be opened.
  */
 static int ntfs_filldir(ntfs_inode *dir_ni, s64 *pos, u8 ivcn_bits,
 		const INDEX_TYPE index_type, index_union *iu, INDEX_ENTRY *ie,
-		void *dirent, ntfs_filldir_t filldir)
+		void *dirent, ntfs_filldir_t filldir,
+		ntfs_filldir_key_t filldir_key)
 {
 	FILE_NAME_ATTR *fn = &ie->key.file_name;
 	unsigned dt_type;
@@ -1000,7 +1237,7 @@ static int ntfs_filldir(ntfs_inode *dir_ni, s64 *pos, u8 ivcn_bits,
 	}
 	if ((ie->key.file_name.file_attributes
 		     & (FILE_ATTR_REPARSE_POINT | FILE_ATTR_SYSTEM))
-	    && !metadata)
+	    && !metadata && !filldir_key)
 		dt_type = ntfs_dir_entry_type(dir_ni, mref,
 					ie->key.file_name.file_attributes);
 	else if (ie->key.file_name.file_attributes
@@ -1015,7 +1252,13 @@ static int ntfs_filldir(ntfs_inode *dir_ni, s64 *pos, u8 ivcn_bits,
             || (NVolShowSysFiles(dir_ni->vol) && (NVolShowHidFiles(dir_ni->vol)
 				|| metadata))) {
 		if (NVolCaseSensitive(dir_ni->vol)) {
-			res = filldir(dirent, fn->file_name,
+			if (filldir_key)
+				res = filldir_key(dirent, fn->file_name,
+					fn->file_name_length,
+					fn->file_name_type, *pos,
+					mref, dt_type, fn);
+			else
+				res = filldir(dirent, fn->file_name,
 					fn->file_name_length,
 					fn->file_name_type, *pos,
 					mref, dt_type);
@@ -1027,10 +1270,16 @@ static int ntfs_filldir(ntfs_inode *dir_ni, s64 *pos, u8 ivcn_bits,
 				ntfs_name_locase(loname, fn->file_name_length,
 					dir_ni->vol->locase,
 					dir_ni->vol->upcase_len);
-				res = filldir(dirent, loname,
-					fn->file_name_length,
-					fn->file_name_type, *pos,
-					mref, dt_type);
+				if (filldir_key)
+					res = filldir_key(dirent, loname,
+						fn->file_name_length,
+						fn->file_name_type, *pos,
+						mref, dt_type, fn);
+				else
+					res = filldir(dirent, loname,
+						fn->file_name_length,
+						fn->file_name_type, *pos,
+						mref, dt_type);
 				free(loname);
 			} else
 				res = -1;
@@ -1105,24 +1354,14 @@ err_out:
 	return ERR_MREF(-1);
 }
 
-/**
- * ntfs_readdir - read the contents of an ntfs directory
- * @dir_ni:	ntfs inode of current directory
- * @pos:	current position in directory
- * @dirent:	context for filldir callback supplied by the caller
- * @filldir:	filldir callback supplied by the caller
- *
- * Parse the index root and the index blocks that are marked in use in the
- * index bitmap and hand each found directory entry to the @filldir callback
- * supplied by the caller.
- *
- * Return 0 on success or -1 on error with errno set to the error code.
- *
- * Note: Index blocks are parsed in ascending vcn order, from which follows
- * that the directory entries are not returned sorted.
+/*
+ *		Read the contents of an ntfs directory, handing the entries
+ *	to either @filldir or @filldir_key
  */
-int ntfs_readdir(ntfs_inode *dir_ni, s64 *pos,
-		void *dirent, ntfs_filldir_t filldir)
+
+static int ntfs_readdir_i(ntfs_inode *dir_ni, s64 *pos,
+		void *dirent, ntfs_filldir_t filldir,
+		ntfs_filldir_key_t filldir_key)
 {
 	s64 i_size, br, ia_pos, bmp_pos, ia_start;
 	ntfs_volume *vol;
@@ -1141,7 +1380,7 @@ int ntfs_readdir(ntfs_inode *dir_ni, s64 *pos,
 
 	ntfs_log_trace("Entering.\n");
 
-	if (!dir_ni || !pos || !filldir) {
+	if (!dir_ni || !pos || (!filldir && !filldir_key)) {
 		errno = EINVAL;
 		return -1;
 	}
@@ -1177,7 +1416,13 @@ int ntfs_readdir(ntfs_inode *dir_ni, s64 *pos,
 
 	/* Emulate . and .. for all directories. */
 	if (!*pos) {
-		rc = filldir(dirent, dotdot, 1, FILE_NAME_POSIX, *pos,
+		if (filldir_key)
+			rc = filldir_key(dirent, dotdot, 1, FILE_NAME_POSIX,
+				*pos, MK_MREF(dir_ni->mft_no,
+				le16_to_cpu(dir_ni->mrec->sequence_number)),
+				NTFS_DT_DIR, (const FILE_NAME_ATTR*)NULL);
+		else
+			rc = filldir(dirent, dotdot, 1, FILE_NAME_POSIX, *pos,
 				MK_MREF(dir_ni->mft_no,
 				le16_to_cpu(dir_ni->mrec->sequence_number)),
 				NTFS_DT_DIR);
@@ -1194,7 +1439,12 @@ int ntfs_readdir(ntfs_inode *dir_ni, s64 *pos,
 			goto dir_err_out;
 		}
 
-		rc = filldir(dirent, dotdot, 2, FILE_NAME_POSIX, *pos,
+		if (filldir_key)
+			rc = filldir_key(dirent, dotdot, 2, FILE_NAME_POSIX,
+				*pos, parent_mref, NTFS_DT_DIR,
+				(const FILE_NAME_ATTR*)NULL);
+		else
+			rc = filldir(dirent, dotdot, 2, FILE_NAME_POSIX, *pos,
 				parent_mref, NTFS_DT_DIR);
 		if (rc)
 			goto err_out;
@@ -1277,7 +1527,8 @@ int ntfs_readdir(ntfs_inode *dir_ni, s64 *pos,
 		// fix (index_union *) ir modified in iu.ir = ir; (index_union *) &iu
 		iu.ir = ir;
 		rc = ntfs_filldir(dir_ni, pos, index_vcn_size_bits,
-				INDEX_TYPE_ROOT, (index_union *) &iu, ie, dirent, filldir);
+				INDEX_TYPE_ROOT, (index_union *) &iu, ie, dirent,
+				filldir, filldir_key);
 		if (rc) {
 			ntfs_attr_put_search_ctx(ctx);
 			ctx = NULL;
@@ -1333,7 +1584,11 @@ skip_index_root:
 		goto err_out;
 	}
 
-	bmp_buf_pos = 0;
+	/*
+	 * The bitmap was read from the byte holding bmp_pos, which is not its
+	 * first bit when the walk resumes from a saved position.
+	 */
+	bmp_buf_pos = bmp_pos & 7;
 	/* If the index block is not in use find the next one that is. */
 	while (!(bmp[bmp_buf_pos >> 3] & (1 << (bmp_buf_pos & 7)))) {
 find_next_index_buffer:
@@ -1361,7 +1616,7 @@ find_next_index_buffer:
 	ntfs_log_debug("Handling index block 0x%lx.\n", (long long)bmp_pos);
 	
 	/* Read the index block starting at bmp_pos. */
-	br = ntfs_attr_mst_pread(ia_na, bmp_pos << index_block_size_bits, 1,
+	br = ntfs_index_block_pread(ia_na, bmp_pos << index_block_size_bits,
 			index_block_size, ia);
 	if (br != 1) {
 		if (br != -1)
@@ -1439,7 +1694,8 @@ find_next_index_buffer:
 		iu.ia = ia;
 
 		rc = ntfs_filldir(dir_ni, pos, index_vcn_size_bits,
-				INDEX_TYPE_ALLOCATION, (index_union *) &iu, ie, dirent, filldir);
+				INDEX_TYPE_ALLOCATION, (index_union *) &iu, ie, dirent,
+				filldir, filldir_key);
 		if (rc)
 		{
 			goto err_out;
@@ -1475,6 +1731,51 @@ err_out:
 	return -1;
 }
 
+/**
+ * ntfs_readdir - read the contents of an ntfs directory
+ * @dir_ni:	ntfs inode of current directory
+ * @pos:	current position in directory
+ * @dirent:	context for filldir callback supplied by the caller
+ * @filldir:	filldir callback supplied by the caller
+ *
+ * Parse the index root and the index blocks that are marked in use in the
+ * index bitmap and hand each found directory entry to the @filldir callback
+ * supplied by the caller.
+ *
+ * Return 0 on success or -1 on error with errno set to the error code.
+ *
+ * Note: Index blocks are parsed in ascending vcn order, from which follows
+ * that the directory entries are not returned sorted.
+ */
+int ntfs_readdir(ntfs_inode *dir_ni, s64 *pos,
+		void *dirent, ntfs_filldir_t filldir)
+{
+	return (ntfs_readdir_i(dir_ni, pos, dirent, filldir,
+			(ntfs_filldir_key_t)NULL));
+}
+
+/**
+ * ntfs_readdir_keys - read the contents of an ntfs directory with index keys
+ * @dir_ni:	ntfs inode of current directory
+ * @pos:	current position in directory
+ * @dirent:	context for filldir callback supplied by the caller
+ * @filldir:	filldir callback supplied by the caller
+ *
+ * Same as ntfs_readdir(), but the $FILE_NAME key of each index entry
+ * is also handed to @filldir (NULL for "." and ".."), so that the
+ * caller may use the sizes, times and attributes duplicated in the key
+ * instead of opening the inode. The type of the entries is only derived
+ * from the key.
+ *
+ * Return 0 on success or -1 on error with errno set to the error code.
+ */
+int ntfs_readdir_keys(ntfs_inode *dir_ni, s64 *pos,
+		void *dirent, ntfs_filldir_key_t filldir)
+{
+	return (ntfs_readdir_i(dir_ni, pos, dirent, (ntfs_filldir_t)NULL,
+			filldir));
+}
+
 
 /**
  * __ntfs_create - create object on ntfs volume
@@ -1894,7 +2195,6 @@ int ntfs_delete(ntfs_volume *vol, const char *pathname,
 #endif
 #if CACHE_INODE_SIZE
 	struct CACHED_INODE item;
-	const char *p;
 	u64 inum = (u64)-1;
 	int count;
 #endif
@@ -2036,21 +2336,17 @@ search:
 #endif
 #if CACHE_INODE_SIZE
 	inum = ni->mft_no;
-	if (pathname) {
-			/* invalide cache entry, even if there was an error */
-		/* Remove leading /'s. */
-		p = pathname;
-		while (*p == PATH_SEP)
-			p++;
-		if (p[0] && (p[strlen(p)-1] == PATH_SEP))
-			ntfs_log_error("Unnormalized path %s\n",pathname);
-		item.pathname = p;
-		item.varsize = strlen(p);
-	} else {
-		item.pathname = (const char*)NULL;
-		item.varsize = 0;
-	}
+		/*
+		 * invalidate cache entries, even if there was an error,
+		 * entries are selected by inode, not by path
+		 */
+	item.pathname = (const ntfschar*)NULL;
+	item.varsize = 0;
 	item.inum = inum;
+	if (ni->mrec->flags & MFT_RECORD_IS_DIRECTORY)
+		item.parent = 0;
+	else
+		item.parent = FILE_root;
 	count = ntfs_invalidate_cache(vol->xinode_cache, GENERIC(&item),
 				inode_cache_inv_compare, CACHE_NOHASH);
 	if (pathname && !count)
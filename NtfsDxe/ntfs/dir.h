@@ -64,9 +64,12 @@ extern u64 ntfs_inode_lookup_by_name(ntfs_inode *dir_ni,
 extern u64 ntfs_inode_lookup_by_mbsname(ntfs_inode *dir_ni, const char *name);
 extern void ntfs_inode_update_mbsname(ntfs_inode *dir_ni, const char *name,
 				u64 inum);
+extern void ntfs_inode_invalidate_misses(ntfs_inode *dir_ni);
 
 extern ntfs_inode *ntfs_pathname_to_inode(ntfs_volume *vol, ntfs_inode *parent,
 		const char *pathname);
+extern ntfs_inode *ntfs_upathname_to_inode(ntfs_volume *vol,
+		ntfs_inode *parent, const ntfschar *upath, int upath_len);
 extern ntfs_inode *ntfs_create(ntfs_inode *dir_ni, le32 securid,
 		const ntfschar *name, u8 name_len, mode_t type);
 extern ntfs_inode *ntfs_create_device(ntfs_inode *dir_ni, le32 securid,
@@ -108,6 +111,18 @@ typedef int (*ntfs_filldir_t)(void *dirent, const ntfschar *name,
 extern int ntfs_readdir(ntfs_inode *dir_ni, s64 *pos,
 		void *dirent, ntfs_filldir_t filldir);
 
+/*
+ * Same as "ntfs_filldir" with the $FILE_NAME key of the index entry
+ * (NULL for "." and ".."), used by ntfs_readdir_keys().
+ */
+typedef int (*ntfs_filldir_key_t)(void *dirent, const ntfschar *name,
+		const int name_len, const int name_type, const s64 pos,
+		const MFT_REF mref, const unsigned dt_type,
+		const FILE_NAME_ATTR *fn);
+
+extern int ntfs_readdir_keys(ntfs_inode *dir_ni, s64 *pos,
+		void *dirent, ntfs_filldir_key_t filldir);
+
 ntfs_inode *ntfs_dir_parent_inode(ntfs_inode *ni);
 
 int ntfs_get_ntfs_dos_name(ntfs_inode *ni, ntfs_inode *dir_ni,
@@ -122,6 +137,7 @@ struct CACHED_GENERIC;
 
 extern int ntfs_dir_inode_hash(const struct CACHED_GENERIC *cached);
 extern int ntfs_dir_lookup_hash(const struct CACHED_GENERIC *cached);
+extern int ntfs_dir_negative_hash(const struct CACHED_GENERIC *cached);
 
 #endif
 
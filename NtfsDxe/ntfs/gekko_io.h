@@ -26,39 +26,87 @@
 #endif
 
 #include "types.h"
-//#include "cache2.h"
+#include "cache2.h"
+#include "readahead.h"
 //#include <gccore.h>
 //#include <ogc/disc_io.h>
 
 
+#ifndef _LINUX_APPLICATION
 #define size_t		int
+#endif
 
 #define MAX_SECTOR_SIZE     4096
 
-#define NTFS_CACHE	void
+#ifndef UEFI_IO_DEFAULT_MAX_TRANSFER
+#define UEFI_IO_DEFAULT_MAX_TRANSFER    0x100000    /* Largest single DiskIo request (in bytes) */
+#endif
+#ifndef UEFI_IO_DEFAULT_PIPELINE_CHUNK
+#define UEFI_IO_DEFAULT_PIPELINE_CHUNK  0x20000     /* Size of each pipelined DiskIo2 request (in bytes) */
+#endif
+#ifndef UEFI_IO_DEFAULT_QUEUE_DEPTH
+#define UEFI_IO_DEFAULT_QUEUE_DEPTH     4           /* DiskIo2 requests kept in flight (1 disables pipelining) */
+#endif
+#ifndef UEFI_IO_POLL_INTERVAL
+#define UEFI_IO_POLL_INTERVAL           10          /* Stall between two polls of a DiskIo2 token (in microseconds) */
+#endif
+#ifndef UEFI_IO_TOKEN_TIMEOUT
+#define UEFI_IO_TOKEN_TIMEOUT           5000000     /* Longest wait for a DiskIo2 token before it is cancelled (in microseconds) */
+#endif
+#define UEFI_IO_MAX_QUEUE_DEPTH         16
+#define UEFI_IO_MAX_PHYSICAL_BLOCK      0x10000     /* Largest physical block honoured for write planning */
 
 struct _NTFS_VOLUME;
+struct _uefi_pipeline;
 /**
  * gekko_fd - Gekko device driver descriptor
  */
 struct _uefi_fd {
     struct _NTFS_VOLUME * interface;        /* Device disc interface */
+    struct ntfs_device *dev;                /* Owning device (tells the origin of the i/o in progress) */
     sec_t startSector;                      /* LBA of partition start */
     sec_t hiddenSectors;                    /* LBA offset to true partition start (as described by boot sector) */
     u16 sectorSize;                         /* Device sector size (in bytes) */
     u64 sectorCount;                        /* Total number of sectors in partition */
+    u64 mediaSectors;                       /* Sectors addressable through DiskIo (the partition may end past the volume) */
     u64 pos;                                /* Current position within the partition (in bytes) */
     u64 len;                                /* Total length of partition (in bytes) */
     ino_t ino;                              /* Device identifier */
     NTFS_CACHE *cache;                      /* Cache */
     u32 cachePageCount;                     /* The number of pages in the cache */
     u32 cachePageSize;                      /* The number of sectors per cache page */
+    NTFS_READAHEAD *readahead;              /* Sequential readahead windows */
+    u32 readaheadStreams;                   /* The number of sequential streams to track */
+    u32 maxTransferSectors;                 /* The largest number of sectors per DiskIo request */
+    u32 pipelineSectors;                    /* The number of sectors per pipelined DiskIo2 request */
+    u32 queueDepth;                         /* The number of DiskIo2 requests kept in flight */
+    struct _uefi_pipeline *pipeline;        /* DiskIo2 tokens of the read pipeline (created on first use) */
+    bool pipelineOff;                       /* True once a DiskIo2 token could not be waited for */
+    u32 ioAlign;                            /* Buffer alignment required by the media */
+    u32 physicalSectors;                    /* The number of sectors per physical block */
+    u32 optimalSectors;                     /* The optimal transfer granularity (in sectors) */
+    bool timed;                             /* True if the performance counter runs (latencies are measured) */
+    u8 *scratch;                            /* Single sector bounce buffer for unaligned head/tail I/O */
+    u8 *block;                              /* Physical block bounce buffer for reads that start or end inside a block */
+    u8 *pending;                            /* Physical block accumulating partial writes before they reach the disc */
+    sec_t pendingSector;                    /* First sector held in the pending buffer */
+    sec_t pendingCount;                     /* The number of sectors held in the pending buffer */
+    bool pendingValid;                      /* True if the pending buffer holds pendingSector */
+    bool pendingDirty;                      /* True if the pending buffer must be written back */
 };
 
 /* Forward declarations */
 struct ntfs_device_operations;
 
+/* Backing sector access, used by the readahead windows and the device cache */
+bool ntfs_device_uefi_io_readcached(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, void *buffer);
+bool ntfs_device_uefi_io_readdisk(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, void *buffer);
+bool ntfs_device_uefi_io_writedisk(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, const void *buffer);
+
 /* Gekko device driver i/o operations */
 //extern struct ntfs_device_operations ntfs_device_gekko_io_ops;
 
+/* UEFI DiskIo device driver i/o operations */
+extern struct ntfs_device_operations ntfs_device_uefi_io_ops;
+
 #endif /* _GEKKO_IO_H */
@@ -0,0 +1,797 @@
+/**
+ * image_io.c - Host image file disk io functions.
+ *
+ * This program/include file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program/include file is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "types.h"
+#include "logging.h"
+#include "layout.h"
+#include "device.h"
+#include "bootsect.h"
+#include "ntfsinternal.h"
+#include "ntfs.h"
+#include "image_io.h"
+#include "mem_allocate.h"
+
+#define IMAGE_FD(dev) ((struct _image_fd *)dev->d_private)
+
+#ifndef O_BINARY
+#define O_BINARY    0
+#endif
+#ifndef O_ACCMODE
+#define O_ACCMODE   (O_RDONLY | O_WRONLY | O_RDWR)
+#endif
+
+#ifdef _WIN32
+#define image_open      _open
+#define image_close     _close
+#define image_fsync     _commit
+#else
+#define image_open      open
+#define image_close     close
+#define image_fsync     fsync
+#endif
+
+/**
+ * Positioned read from the host file, retrying short and interrupted reads.
+ */
+static s64 ntfs_device_image_io_preadfull(int hfd, void *buf, s64 count, s64 offset)
+{
+    s64 total = 0;
+
+    while (total < count) {
+#ifdef _WIN32
+        int chunk = (int) MIN(count - total, 0x40000000);
+        int br;
+        if (_lseeki64(hfd, offset + total, SEEK_SET) < 0)
+            return -1;
+        br = _read(hfd, (u8 *) buf + total, chunk);
+#else
+        ssize_t br = pread(hfd, (u8 *) buf + total, (count - total), (off_t) (offset + total));
+#endif
+        if (br < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (br == 0)
+            break;
+        total += br;
+    }
+
+    return total;
+}
+
+/**
+ * Positioned write to the host file, retrying short and interrupted writes.
+ */
+static s64 ntfs_device_image_io_pwritefull(int hfd, const void *buf, s64 count, s64 offset)
+{
+    s64 total = 0;
+
+    while (total < count) {
+#ifdef _WIN32
+        int chunk = (int) MIN(count - total, 0x40000000);
+        int bw;
+        if (_lseeki64(hfd, offset + total, SEEK_SET) < 0)
+            return -1;
+        bw = _write(hfd, (const u8 *) buf + total, chunk);
+#else
+        ssize_t bw = pwrite(hfd, (const u8 *) buf + total, (count - total), (off_t) (offset + total));
+#endif
+        if (bw < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (bw == 0) {
+            errno = EIO;
+            return -1;
+        }
+        total += bw;
+    }
+
+    return total;
+}
+
+/**
+ *
+ */
+static int ntfs_device_image_io_open(struct ntfs_device *dev, int flags)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    NTFS_BOOT_SECTOR *boot;
+    int hflags;
+
+    ntfs_log_trace("dev %p, flags %i\n", dev, flags);
+
+    // Get the device driver descriptor
+    if (!fd) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Check that the device isn't already open (used by another volume?)
+    if (NDevOpen(dev)) {
+        ntfs_log_perror("device is busy (already open)\n");
+        errno = EBUSY;
+        return -1;
+    }
+
+    // Open the image file on the host
+    hflags = (((flags & O_ACCMODE) == O_RDONLY) ? O_RDONLY : O_RDWR) | O_BINARY;
+    fd->fd = image_open(fd->path, hflags);
+    if (fd->fd < 0) {
+        ntfs_log_perror("failed to open image \"%s\"\n", fd->path);
+        return -1;
+    }
+
+    // Check that there is a valid NTFS boot sector at the start of the image
+    boot = (NTFS_BOOT_SECTOR *) ntfs_alloc(sizeof(NTFS_BOOT_SECTOR));
+    if (boot == NULL) {
+        image_close(fd->fd);
+        fd->fd = -1;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (ntfs_device_image_io_preadfull(fd->fd, boot, sizeof(NTFS_BOOT_SECTOR), 0) != sizeof(NTFS_BOOT_SECTOR)) {
+        ntfs_log_perror("read failure @ boot sector\n");
+        ntfs_free(boot);
+        image_close(fd->fd);
+        fd->fd = -1;
+        errno = EIO;
+        return -1;
+    }
+
+    if (!ntfs_boot_sector_is_ntfs(boot)) {
+        ntfs_free(boot);
+        image_close(fd->fd);
+        fd->fd = -1;
+        errno = EINVALPART;
+        return -1;
+    }
+
+    // Parse the boot sector
+    fd->sectorSize = le16_to_cpu(boot->bpb.bytes_per_sector);
+    fd->sectorCount = sle64_to_cpu(boot->number_of_sectors);
+    fd->pos = 0;
+    fd->len = (fd->sectorCount * fd->sectorSize);
+    fd->ino = le64_to_cpu(boot->volume_serial_number);
+
+    // Free memory for boot sector
+    ntfs_free(boot);
+
+    // Mark the device as read-only (if required)
+    if ((flags & O_ACCMODE) == O_RDONLY) {
+        NDevSetReadOnly(dev);
+    }
+
+    // Mark the device as open
+    NDevSetBlock(dev);
+    NDevSetOpen(dev);
+
+    return 0;
+}
+
+/**
+ *
+ */
+static int ntfs_device_image_io_close(struct ntfs_device *dev)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    ntfs_log_trace("dev %p\n", dev);
+
+    // Get the device driver descriptor
+    if (!fd) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Check that the device is actually open
+    if (!NDevOpen(dev)) {
+        ntfs_log_perror("device is not open\n");
+        errno = EIO;
+        return -1;
+    }
+
+    // Mark the device as closed
+    NDevClearOpen(dev);
+    NDevClearBlock(dev);
+
+    // Flush the image (if dirty and not read-only)
+    if (NDevDirty(dev) && !NDevReadOnly(dev)) {
+        ntfs_log_debug("device is dirty, will now sync\n");
+
+        if (image_fsync(fd->fd))
+            ntfs_log_perror("image sync failed on close\n");
+
+        // Mark the device as clean
+        NDevClearDirty(dev);
+    }
+
+    // Close the image file
+    if (fd->fd >= 0)
+        image_close(fd->fd);
+    fd->fd = -1;
+
+    // Free the device driver private data (the path is stored inline)
+    ntfs_free(dev->d_private);
+    dev->d_private = NULL;
+
+    return 0;
+}
+
+/**
+ *
+ */
+static s64 ntfs_device_image_io_seek(struct ntfs_device *dev, s64 offset, int whence)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    ntfs_log_trace("dev %p, offset %li, whence %i\n", dev, offset, whence);
+
+    // Get the device driver descriptor
+    if (!fd) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Set the current position on the device (in bytes)
+    switch(whence) {
+        case SEEK_SET: fd->pos = MIN(MAX(offset, 0), fd->len); break;
+        case SEEK_CUR: fd->pos = MIN(MAX(fd->pos + offset, 0), fd->len); break;
+        case SEEK_END: fd->pos = MIN(MAX(fd->len + offset, 0), fd->len); break;
+    }
+
+    return 0;
+}
+
+/**
+ *
+ */
+static s64 ntfs_device_image_io_pread(struct ntfs_device *dev, void *buf, s64 count, s64 offset)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    ntfs_log_trace("dev %p, offset %lli, count %lli\n", dev, offset, count);
+
+    // Get the device driver descriptor
+    if (!fd) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Check that the read is within the volume
+    if (offset < 0 || count < 0 || offset + count > fd->len) {
+        ntfs_log_perror("read out of range (offset %lli, count %lli)\n", offset, count);
+        errno = EINVAL;
+        return -1;
+    }
+
+    return ntfs_device_image_io_preadfull(fd->fd, buf, count, offset);
+}
+
+/**
+ *
+ */
+static s64 ntfs_device_image_io_pwrite(struct ntfs_device *dev, const void *buf, s64 count, s64 offset)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    s64 ret;
+    ntfs_log_trace("dev %p, offset %lli, count %lli\n", dev, offset, count);
+
+    // Get the device driver descriptor
+    if (!fd) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Check that the device can be written to
+    if (NDevReadOnly(dev)) {
+        errno = EROFS;
+        return -1;
+    }
+
+    // Check that the write is within the volume
+    if (offset < 0 || count < 0 || offset + count > fd->len) {
+        ntfs_log_perror("write out of range (offset %lli, count %lli)\n", offset, count);
+        errno = EINVAL;
+        return -1;
+    }
+
+    ret = ntfs_device_image_io_pwritefull(fd->fd, buf, count, offset);
+
+    // Mark the device as dirty (if we actually wrote anything)
+    if (ret > 0)
+        NDevSetDirty(dev);
+
+    return ret;
+}
+
+/**
+ *
+ */
+static s64 ntfs_device_image_io_read(struct ntfs_device *dev, void *buf, s64 count)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    s64 ret = ntfs_device_image_io_pread(dev, buf, count, fd->pos);
+
+    if (ret > 0)
+        fd->pos += ret;
+
+    return ret;
+}
+
+/**
+ *
+ */
+static s64 ntfs_device_image_io_write(struct ntfs_device *dev, const void *buf, s64 count)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    s64 ret = ntfs_device_image_io_pwrite(dev, buf, count, fd->pos);
+
+    if (ret > 0)
+        fd->pos += ret;
+
+    return ret;
+}
+
+/**
+ *
+ */
+static int ntfs_device_image_io_sync(struct ntfs_device *dev)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    ntfs_log_trace("dev %p\n", dev);
+
+    // Check that the device can be written to
+    if (NDevReadOnly(dev)) {
+        errno = EROFS;
+        return -1;
+    }
+
+    // Flush the image file to stable storage
+    if (image_fsync(fd->fd)) {
+        errno = EIO;
+        return -1;
+    }
+
+    // Mark the device as clean
+    NDevClearDirty(dev);
+    NDevClearSync(dev);
+
+    return 0;
+}
+
+/**
+ *
+ */
+static int ntfs_device_image_io_stat(struct ntfs_device *dev, struct stat *buf)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    mode_t mode;
+
+    ntfs_log_trace("dev %p, buf %p\n", dev, buf);
+
+    // Get the device driver descriptor
+    if (!fd) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Short circuit cases were we don't actually have to do anything
+    if (!buf)
+        return 0;
+
+    // Build the device mode
+    mode = (S_IFBLK) |
+                  (S_IRUSR | S_IRGRP | S_IROTH) |
+                  ((!NDevReadOnly(dev)) ? (S_IWUSR | S_IWGRP | S_IWOTH) : 0);
+
+    // Zero out the stat buffer
+    memset(buf, 0, sizeof(struct stat));
+
+    // Build the device stats
+    buf->st_ino = fd->ino;
+    buf->st_mode = mode;
+    buf->st_blksize = fd->sectorSize;
+    buf->st_blocks = fd->sectorCount;
+
+    return 0;
+}
+
+/**
+ *
+ */
+static int ntfs_device_image_io_ioctl(struct ntfs_device *dev, int request, void *argp)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    ntfs_log_trace("dev %p, request %i, argp %p\n", dev, request, argp);
+
+    // Get the device driver descriptor
+    if (!fd) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Figure out which i/o control was requested
+    switch (request) {
+
+        // Get block device size (sectors)
+        #if defined(BLKGETSIZE)
+        case BLKGETSIZE: {
+            *(u32*)argp = fd->sectorCount;
+            return 0;
+        }
+        #endif
+
+        // Get block device size (bytes)
+        #if defined(BLKGETSIZE64)
+        case BLKGETSIZE64: {
+            *(u64*)argp = (fd->sectorCount * fd->sectorSize);
+            return 0;
+        }
+        #endif
+
+        // Get block device sector size (bytes)
+        #if defined(BLKSSZGET)
+        case BLKSSZGET: {
+            *(int*)argp = fd->sectorSize;
+            return 0;
+        }
+        #endif
+
+        // Unimplemented ioctrl
+        default: {
+            ntfs_log_perror("Unimplemented ioctrl %i\n", request);
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+
+    }
+
+    return 0;
+}
+
+/**
+ * Device operations for working with raw volume images on the host.
+ */
+struct ntfs_device_operations ntfs_device_image_io_ops = {
+    ntfs_device_image_io_open,
+    ntfs_device_image_io_close,
+    ntfs_device_image_io_seek,
+    ntfs_device_image_io_read,
+    ntfs_device_image_io_write,
+    ntfs_device_image_io_pread,
+    ntfs_device_image_io_pwrite,
+    ntfs_device_image_io_sync,
+    ntfs_device_image_io_stat,
+    ntfs_device_image_io_ioctl,
+};
+
+/**
+ * Size of the image file on the host (in bytes).
+ */
+static s64 ntfs_device_image_io_size(int hfd)
+{
+#ifdef _WIN32
+    return _filelengthi64(hfd);
+#else
+    struct stat st;
+    if (fstat(hfd, &st))
+        return -1;
+    return st.st_size;
+#endif
+}
+
+/**
+ * Map the volume of an open image, read-only unless the device is writable.
+ */
+static bool ntfs_device_image_mmap_io_map(struct ntfs_device *dev)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    bool ro = NDevReadOnly(dev);
+
+#ifdef _WIN32
+    fd->mapHandle = CreateFileMapping((HANDLE) _get_osfhandle(fd->fd), NULL, ro ? PAGE_READONLY : PAGE_READWRITE, 0, 0, NULL);
+    if (!fd->mapHandle)
+        return false;
+    fd->map = (u8 *) MapViewOfFile(fd->mapHandle, ro ? FILE_MAP_READ : FILE_MAP_WRITE, 0, 0, (SIZE_T) fd->len);
+    if (!fd->map) {
+        CloseHandle(fd->mapHandle);
+        fd->mapHandle = NULL;
+        return false;
+    }
+#else
+    void *map = mmap(NULL, (size_t) fd->len, PROT_READ | (ro ? 0 : PROT_WRITE), MAP_SHARED, fd->fd, 0);
+    if (map == MAP_FAILED)
+        return false;
+    fd->map = (u8 *) map;
+#endif
+
+    return true;
+}
+
+/**
+ * Flush and drop the mapping of an image.
+ */
+static void ntfs_device_image_mmap_io_unmap(struct ntfs_device *dev)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+
+    if (!fd->map)
+        return;
+
+#ifdef _WIN32
+    if (NDevDirty(dev))
+        FlushViewOfFile(fd->map, 0);
+    UnmapViewOfFile(fd->map);
+    CloseHandle(fd->mapHandle);
+    fd->mapHandle = NULL;
+#else
+    if (NDevDirty(dev))
+        msync(fd->map, (size_t) fd->len, MS_SYNC);
+    munmap(fd->map, (size_t) fd->len);
+#endif
+    fd->map = NULL;
+}
+
+/**
+ *
+ */
+static int ntfs_device_image_mmap_io_open(struct ntfs_device *dev, int flags)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+
+    // Open the image and parse the boot sector
+    if (ntfs_device_image_io_open(dev, flags))
+        return -1;
+
+    // Map the whole volume (the image must not be shorter than the volume it describes)
+    if (ntfs_device_image_io_size(fd->fd) < fd->len || !ntfs_device_image_mmap_io_map(dev)) {
+        ntfs_log_perror("failed to map image \"%s\"\n", fd->path);
+        NDevClearOpen(dev);
+        NDevClearBlock(dev);
+        NDevClearReadOnly(dev);
+        image_close(fd->fd);
+        fd->fd = -1;
+        errno = EIO;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ *
+ */
+static int ntfs_device_image_mmap_io_close(struct ntfs_device *dev)
+{
+    ntfs_log_trace("dev %p\n", dev);
+
+    // Get the device driver descriptor
+    if (!IMAGE_FD(dev)) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Write back and drop the mapping, then close the image as usual
+    ntfs_device_image_mmap_io_unmap(dev);
+
+    return ntfs_device_image_io_close(dev);
+}
+
+/**
+ *
+ */
+static s64 ntfs_device_image_mmap_io_pread(struct ntfs_device *dev, void *buf, s64 count, s64 offset)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    ntfs_log_trace("dev %p, offset %lli, count %lli\n", dev, offset, count);
+
+    // Check that the read is within the mapping
+    if (!fd || !fd->map || offset < 0 || count < 0 || offset + count > fd->len) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memcpy(buf, fd->map + offset, (size_t) count);
+
+    return count;
+}
+
+/**
+ *
+ */
+static s64 ntfs_device_image_mmap_io_pwrite(struct ntfs_device *dev, const void *buf, s64 count, s64 offset)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    ntfs_log_trace("dev %p, offset %lli, count %lli\n", dev, offset, count);
+
+    // Check that the device can be written to
+    if (NDevReadOnly(dev)) {
+        errno = EROFS;
+        return -1;
+    }
+
+    // Check that the write is within the mapping
+    if (!fd || !fd->map || offset < 0 || count < 0 || offset + count > fd->len) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memcpy(fd->map + offset, buf, (size_t) count);
+
+    // Mark the device as dirty
+    if (count > 0)
+        NDevSetDirty(dev);
+
+    return count;
+}
+
+/**
+ *
+ */
+static s64 ntfs_device_image_mmap_io_read(struct ntfs_device *dev, void *buf, s64 count)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    s64 ret = ntfs_device_image_mmap_io_pread(dev, buf, count, fd->pos);
+
+    if (ret > 0)
+        fd->pos += ret;
+
+    return ret;
+}
+
+/**
+ *
+ */
+static s64 ntfs_device_image_mmap_io_write(struct ntfs_device *dev, const void *buf, s64 count)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    s64 ret = ntfs_device_image_mmap_io_pwrite(dev, buf, count, fd->pos);
+
+    if (ret > 0)
+        fd->pos += ret;
+
+    return ret;
+}
+
+/**
+ *
+ */
+static int ntfs_device_image_mmap_io_sync(struct ntfs_device *dev)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+    ntfs_log_trace("dev %p\n", dev);
+
+    // Check that the device can be written to
+    if (NDevReadOnly(dev)) {
+        errno = EROFS;
+        return -1;
+    }
+
+    // Write back the mapping before syncing the file itself
+#ifdef _WIN32
+    if (!FlushViewOfFile(fd->map, 0)) {
+#else
+    if (msync(fd->map, (size_t) fd->len, MS_SYNC)) {
+#endif
+        errno = EIO;
+        return -1;
+    }
+
+    return ntfs_device_image_io_sync(dev);
+}
+
+/**
+ *
+ */
+static const void *ntfs_device_image_mmap_io_borrow(struct ntfs_device *dev, s64 offset, s64 count)
+{
+    struct _image_fd *fd = IMAGE_FD(dev);
+
+    // Check that the range is within the mapping
+    if (!fd || !fd->map || offset < 0 || count < 0 || offset + count > fd->len) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    return fd->map + offset;
+}
+
+/**
+ * Device operations for working with memory mapped raw volume images on the host.
+ */
+struct ntfs_device_operations ntfs_device_image_mmap_io_ops = {
+    ntfs_device_image_mmap_io_open,
+    ntfs_device_image_mmap_io_close,
+    ntfs_device_image_io_seek,
+    ntfs_device_image_mmap_io_read,
+    ntfs_device_image_mmap_io_write,
+    ntfs_device_image_mmap_io_pread,
+    ntfs_device_image_mmap_io_pwrite,
+    ntfs_device_image_mmap_io_sync,
+    ntfs_device_image_io_stat,
+    ntfs_device_image_io_ioctl,
+    ntfs_device_image_mmap_io_borrow,
+};
+
+static ntfs_vd *ntfsMountImageOps (const char *name, const char *path, struct ntfs_device_operations *ops, const struct CACHE_SIZES *cacheSizes, u32 flags)
+{
+    struct _image_fd *fd = NULL;
+    int pathLen;
+
+    // Sanity check
+    if (!name || !path) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Allocate the device driver descriptor, with the image path stored after it
+    pathLen = (int) strlen(path);
+    fd = (struct _image_fd *) ntfs_alloc(sizeof(struct _image_fd) + pathLen + 1);
+    if (!fd) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // Setup the device driver descriptor
+    memset(fd, 0, sizeof(struct _image_fd));
+    fd->path = (char *) (fd + 1);
+    memcpy(fd->path, path, pathLen + 1);
+    fd->fd = -1;
+    fd->sectorSize = 0x200;
+
+    // Mount the volume through the image device driver
+    return ntfsMountOps(name, ops, fd, cacheSizes, flags);
+}
+
+ntfs_vd *ntfsMountImage (const char *name, const char *path, const struct CACHE_SIZES *cacheSizes, u32 flags)
+{
+    return ntfsMountImageOps(name, path, &ntfs_device_image_io_ops, cacheSizes, flags);
+}
+
+ntfs_vd *ntfsMountImageMapped (const char *name, const char *path, const struct CACHE_SIZES *cacheSizes, u32 flags)
+{
+    return ntfsMountImageOps(name, path, &ntfs_device_image_mmap_io_ops, cacheSizes, flags);
+}
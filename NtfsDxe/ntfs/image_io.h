@@ -0,0 +1,81 @@
+/*
+ * image_io.h - Host image file device io.
+ *
+ * This program/include file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program/include file is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _IMAGE_IO_H
+#define _IMAGE_IO_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "types.h"
+
+/**
+ * image_fd - Host image file device driver descriptor
+ */
+struct _image_fd {
+    char *path;                             /* Path of the image file on the host */
+    int fd;                                 /* Host file descriptor (-1 when closed) */
+    u16 sectorSize;                         /* Volume sector size (in bytes) */
+    u64 sectorCount;                        /* Total number of sectors in the volume */
+    s64 pos;                                /* Current position within the image (in bytes) */
+    s64 len;                                /* Total length of the volume (in bytes) */
+    ino_t ino;                              /* Device identifier */
+    u8 *map;                                /* Mapping of the volume (mapped device only) */
+    void *mapHandle;                        /* Host mapping object (Windows only) */
+};
+
+/* Forward declarations */
+struct ntfs_device_operations;
+struct CACHE_SIZES;
+struct _ntfs_vd;
+
+/* Host image file device driver i/o operations */
+extern struct ntfs_device_operations ntfs_device_image_io_ops;
+extern struct ntfs_device_operations ntfs_device_image_mmap_io_ops;
+
+/**
+ * Mount a NTFS image file from the host file system.
+ *
+ * @param NAME The name to mount the device under (can then be accessed as "NAME:/")
+ * @param PATH The path of the raw volume image on the host
+ * @param CACHESIZES The number of entries of the metadata caches, or NULL for the defaults (see cache.h)
+ * @param FLAGS Additional mounting flags (see ntfs.h)
+ *
+ * @return The volume descriptor, or NULL if an error occurred (see errno)
+ * @note Unmount with ntfsUnmount() as for any other volume
+ */
+extern struct _ntfs_vd *ntfsMountImage (const char *name, const char *path, const struct CACHE_SIZES *cacheSizes, u32 flags);
+
+/**
+ * Mount a NTFS image file from the host file system through a memory mapping.
+ *
+ * Reads and writes become plain memory copies and metadata scans borrow
+ * pointers straight into the mapping (see ntfs_device_borrow()), which gives
+ * an upper bound for the filesystem logic with I/O cost taken out.
+ *
+ * @param NAME The name to mount the device under (can then be accessed as "NAME:/")
+ * @param PATH The path of the raw volume image on the host
+ * @param CACHESIZES The number of entries of the metadata caches, or NULL for the defaults (see cache.h)
+ * @param FLAGS Additional mounting flags (see ntfs.h)
+ *
+ * @return The volume descriptor, or NULL if an error occurred (see errno)
+ */
+extern struct _ntfs_vd *ntfsMountImageMapped (const char *name, const char *path, const struct CACHE_SIZES *cacheSizes, u32 flags);
+
+#endif /* _IMAGE_IO_H */
@@ -47,6 +47,7 @@
 #include "bitmap.h"
 #include "reparse.h"
 #include "misc.h"
+#include "cache.h"
 
 /**
  * ntfs_index_entry_mark_dirty - mark an index entry dirty
@@ -80,14 +81,156 @@ static VCN ntfs_ib_pos_to_vcn(ntfs_index_context *icx, s64 pos)
 	return pos >> icx->vcn_size_bits;
 }
 
+#if CACHE_INDX_SIZE
+
+/*
+ *		Comparing for the index block cache
+ */
+
+static int indx_cache_compare(const struct CACHED_GENERIC *cached,
+			const struct CACHED_GENERIC *wanted)
+{
+	const struct CACHED_INDX *c = (const struct CACHED_INDX*) cached;
+	const struct CACHED_INDX *w = (const struct CACHED_INDX*) wanted;
+	return (!c->block
+		    || (c->mref != w->mref)
+		    || (c->pos != w->pos));
+}
+
+/*
+ *		Index block cache hashing
+ *
+ *	Based on the directory and the position of the block
+ */
+
+int ntfs_index_block_hash(const struct CACHED_GENERIC *cached)
+{
+	const struct CACHED_INDX *c = (const struct CACHED_INDX*) cached;
+
+	return ((int)(MREF(c->mref)*31 + (c->pos >> NTFS_BLOCK_SIZE_BITS))
+			& 0x7fffffff);
+}
+
+/*
+ *		Set the key of the block at @pos of a directory
+ *
+ *	Only $I30 blocks are cached. The sequence number of the directory
+ *	is part of the key, so that the blocks of a deleted directory are
+ *	never found for a new directory reusing its mft record.
+ *
+ *	Returns FALSE if the block cannot be cached
+ */
+
+static BOOL indx_cache_key(ntfs_attr *ia_na, s64 pos, struct CACHED_INDX *item)
+{
+	ntfs_inode *ni = ia_na->ni;
+
+	if (!ni->vol->indx_cache
+	    || (ia_na->type != AT_INDEX_ALLOCATION)
+	    || (ia_na->name_len != 4)
+	    || memcmp(ia_na->name, NTFS_INDEX_I30, 4*sizeof(ntfschar))
+	    || !ni->mrec)
+		return (FALSE);
+	item->mref = MK_MREF(ni->mft_no,
+			le16_to_cpu(ni->mrec->sequence_number));
+	item->pos = pos;
+	item->block = (const INDEX_BLOCK*)NULL;
+	item->blocksize = 0;
+	return (TRUE);
+}
+
+/*
+ *		Enter a copy of an index block into cache
+ *
+ *	Internal nodes are walked through by every lookup in the directory,
+ *	they go straight to the protected segment.
+ */
+
+static void indx_cache_enter(ntfs_attr *ia_na, struct CACHED_INDX *item,
+			u32 block_size, const INDEX_BLOCK *ib)
+{
+	struct CACHE_HEADER *cache = ia_na->ni->vol->indx_cache;
+	struct CACHED_GENERIC *cached;
+
+	if (ntfs_is_indx_record(ib->magic)) {
+		item->block = ib;
+		item->blocksize = block_size;
+		cached = ntfs_enter_cache(cache, GENERIC(item),
+				indx_cache_compare);
+		if (cached && ((ib->index.ih_flags & NODE_MASK) == INDEX_NODE))
+			ntfs_protect_cache(cache, cached);
+	}
+}
+
+#endif
+
+/**
+ * ntfs_index_block_pread - read an index block
+ * @ia_na:	opened index allocation attribute
+ * @pos:	position of the block in the index allocation
+ * @block_size:	size of an index block
+ * @ib:		buffer receiving the block
+ *
+ * Read the index block at @pos and mst deprotect it, like a single record
+ * ntfs_attr_mst_pread() does. Directory ($I30) blocks are read through the
+ * index block cache, so that lookups stop reading the upper levels of the
+ * B+tree again and again.
+ *
+ * Return 1 if the block was read, otherwise the result of
+ * ntfs_attr_mst_pread(), 0 or -1 with errno set.
+ */
+s64 ntfs_index_block_pread(ntfs_attr *ia_na, s64 pos, u32 block_size,
+		INDEX_BLOCK *ib)
+{
+	s64 br;
+#if CACHE_INDX_SIZE
+	struct CACHED_INDX item;
+	const struct CACHED_INDX *cached;
+	BOOL cacheable;
+
+	cacheable = indx_cache_key(ia_na, pos, &item);
+	if (cacheable) {
+		cached = (const struct CACHED_INDX*)ntfs_fetch_cache(
+				ia_na->ni->vol->indx_cache, GENERIC(&item),
+				indx_cache_compare);
+		if (cached && (cached->blocksize == block_size)) {
+			memcpy(ib, cached->block, block_size);
+			return 1;
+		}
+	}
+#endif
+	br = ntfs_attr_mst_pread(ia_na, pos, 1, block_size, ib);
+#if CACHE_INDX_SIZE
+	if ((br == 1) && cacheable)
+		indx_cache_enter(ia_na, &item, block_size, ib);
+#endif
+	return br;
+}
+
 static int ntfs_ib_write(ntfs_index_context *icx, INDEX_BLOCK *ib)
 {
 	s64 ret, vcn = sle64_to_cpu(ib->index_block_vcn);
+#if CACHE_INDX_SIZE
+	struct CACHED_INDX item;
+	BOOL cacheable;
+#endif
 	
 	ntfs_log_trace("vcn: %l\n", (long long)vcn);
 	
+#if CACHE_INDX_SIZE
+		/* write through : drop the old copy, enter the new one */
+	cacheable = indx_cache_key(icx->ia_na, ntfs_ib_vcn_to_pos(icx, vcn),
+			&item);
+	if (cacheable)
+		ntfs_invalidate_cache(icx->ni->vol->indx_cache,
+			GENERIC(&item), indx_cache_compare, 0);
+#endif
 	ret = ntfs_attr_mst_pwrite(icx->ia_na, ntfs_ib_vcn_to_pos(icx, vcn),
 				   1, icx->block_size, ib);
+#if CACHE_INDX_SIZE
+	if ((ret == 1) && cacheable)
+		indx_cache_enter(icx->ia_na, &item, icx->block_size, ib);
+#endif
 	if (ret != 1) {
 		ntfs_log_perror("Failed to write index block %l, inode %llu",
 			(long long)vcn, (unsigned long long)icx->ni->mft_no);
@@ -595,7 +738,7 @@ static int ntfs_ib_read(ntfs_index_context *icx, VCN vcn, INDEX_BLOCK *dst)
 	
 	pos = ntfs_ib_vcn_to_pos(icx, vcn);
 
-	ret = ntfs_attr_mst_pread(icx->ia_na, pos, 1, icx->block_size, (u8 *)dst);
+	ret = ntfs_index_block_pread(icx->ia_na, pos, icx->block_size, dst);
 	if (ret != 1) {
 		if (ret == -1)
 			ntfs_log_perror("Failed to read index block");
@@ -1548,6 +1691,8 @@ int ntfs_index_add_filename(ntfs_inode *ni, FILE_NAME_ATTR *fn, MFT_REF mref)
 	if (!icx)
 		goto out;
 	
+		/* names recorded as missing may no longer be */
+	ntfs_inode_invalidate_misses(ni);
 	ret = ntfs_ie_add(icx, ie);
 	err = errno;
 	ntfs_index_ctx_put(icx);
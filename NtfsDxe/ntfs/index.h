@@ -149,6 +149,13 @@ extern int ntfs_index_add_filename(ntfs_inode *ni, FILE_NAME_ATTR *fn,
 extern int ntfs_index_remove(ntfs_inode *dir_ni, ntfs_inode *ni,
 		const void *key, const int keylen);
 
+extern s64 ntfs_index_block_pread(ntfs_attr *ia_na, s64 pos, u32 block_size,
+		INDEX_BLOCK *ib);
+
+struct CACHED_GENERIC;
+
+extern int ntfs_index_block_hash(const struct CACHED_GENERIC *cached);
+
 extern INDEX_ROOT *ntfs_index_root_get(ntfs_inode *ni, ATTR_RECORD *attr);
 
 extern VCN ntfs_ie_get_vcn(INDEX_ENTRY *ie);
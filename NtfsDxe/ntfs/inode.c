@@ -413,8 +413,7 @@ void ntfs_inode_nidata_free(const struct CACHED_GENERIC *cached)
 
 int ntfs_inode_nidata_hash(const struct CACHED_GENERIC *item)
 {
-	return (((const struct CACHED_NIDATA*)item)->inum
-			% (2*CACHE_NIDATA_SIZE));
+	return (((const struct CACHED_NIDATA*)item)->inum & 0x7fffffff);
 }
 
 /*
@@ -505,6 +504,7 @@ int ntfs_inode_close(ntfs_inode *ni)
 #if CACHE_NIDATA_SIZE
 	BOOL dirty;
 	struct CACHED_NIDATA item;
+	struct CACHED_NIDATA *cached;
 
 	if (ni) {
 		debug_double_inode(ni->mft_no,0);
@@ -530,8 +530,15 @@ int ntfs_inode_close(ntfs_inode *ni)
 				item.pathname = (const char*)NULL;
 				item.varsize = 0;
 				debug_cached_inode(ni);
-				ntfs_enter_cache(ni->vol->nidata_cache,
+				cached = (struct CACHED_NIDATA*)ntfs_enter_cache(
+					ni->vol->nidata_cache,
 					GENERIC(&item), idata_cache_compare);
+					/*
+					 * if the inode was opened twice, the
+					 * copy already cached is kept
+					 */
+				if (!cached || (cached->ni != ni))
+					res = ntfs_inode_real_close(ni);
 			}
 		} else {
 			/* cache not ready or system file, really close */
@@ -1137,6 +1144,7 @@ int ntfs_inode_add_attrlist(ntfs_inode *ni)
 	while (!ntfs_attr_lookup(AT_UNUSED, NULL, 0, 0, 0, NULL, 0, ctx)) {
 		
 		int ale_size;
+		int ale_ofs;
 		
 		if (ctx->attr->type == AT_ATTRIBUTE_LIST) {
 			err = EIO;
@@ -1148,13 +1156,14 @@ int ntfs_inode_add_attrlist(ntfs_inode *ni)
 					ctx->attr->name_length + 7) & ~7;
 		al_len += ale_size;
 		
+		ale_ofs = (u8 *)ale - al;
 		aln = (u8 *) realloc(al, al_len);
 		if (!aln) {
 			err = errno;
 			ntfs_log_perror("Failed to realloc %d bytes", al_len);
 			goto put_err_out;
 		}
-		ale = (ATTR_LIST_ENTRY *)(aln + ((u8 *)ale - al));
+		ale = (ATTR_LIST_ENTRY *)(aln + ale_ofs);
 		al = aln;
 		
 		memset(ale, 0, ale_size);
@@ -64,7 +64,8 @@ typedef enum {
 				 test_and_clear_bit(flag, (ni)->state)
 
 #define NInoDirty(ni)				  test_nino_flag(ni, NI_Dirty)
-#define NInoSetDirty(ni)			   set_nino_flag(ni, NI_Dirty)
+#define NInoSetDirty(ni)			   ((ni)->mrec_changes++, \
+					    set_nino_flag(ni, NI_Dirty))
 #define NInoClearDirty(ni)			 clear_nino_flag(ni, NI_Dirty)
 #define NInoTestAndSetDirty(ni)		  test_and_set_nino_flag(ni, NI_Dirty)
 #define NInoTestAndClearDirty(ni)	test_and_clear_nino_flag(ni, NI_Dirty)
@@ -130,6 +131,9 @@ struct _ntfs_inode {
 		ntfs_inode *base_ni;	/* For nr_extents == -1, the ntfs
 					   inode of the base mft record. */
 	};
+	u32 mrec_changes;	/* Bumped whenever the mft record is marked
+				   dirty, so that pointers into it can be
+				   checked for staleness. */
 
 	/* Below fields are valid only for base inode. */
 
@@ -318,8 +318,7 @@ int ntfs_log_redirect(const char *function, const char *file,
 	int line, u32 level, void *data, const char *format, ...)
 {
 	int olderr = errno;
-	int ret;
-	va_list args;
+	int ret = 0;
 
 	/*if (!(ntfs_log.levels & level))		/* Don't log this message */
 	//	return 0;
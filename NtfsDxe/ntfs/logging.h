@@ -93,19 +93,19 @@ int ntfs_log_redirect(const char *function, const char *file, int line,
  * but not displayed.
  */
 #ifdef DEBUG
-#define ntfs_log_critical(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_CRITICAL,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_error(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_ERROR,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_info(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_INFO,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_perror(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_PERROR,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_progress(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_PROGRESS,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_quiet(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_QUIET,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_verbose(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_VERBOSE,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_warning(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_WARNING,NULL,FORMAT,__VA_ARGS__)
-
-#define ntfs_log_debug(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_DEBUG,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_trace(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_TRACE,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_enter(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_ENTER,NULL,FORMAT,__VA_ARGS__)
-#define ntfs_log_leave(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_LEAVE,NULL,FORMAT,__VA_ARGS__)
+#define ntfs_log_critical(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_CRITICAL,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_error(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_ERROR,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_info(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_INFO,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_perror(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_PERROR,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_progress(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_PROGRESS,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_quiet(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_QUIET,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_verbose(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_VERBOSE,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_warning(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_WARNING,NULL,FORMAT,##__VA_ARGS__)
+
+#define ntfs_log_debug(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_DEBUG,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_trace(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_TRACE,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_enter(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_ENTER,NULL,FORMAT,##__VA_ARGS__)
+#define ntfs_log_leave(FORMAT, ...) ntfs_log_redirect(__FUNCTION__,__FILE__,__LINE__,NTFS_LOG_LEVEL_LEAVE,NULL,FORMAT,##__VA_ARGS__)
 #else
 #define ntfs_log_debug(FORMAT, ...) do {} while (0)
 #define ntfs_log_trace(FORMAT, ...) do {} while (0)
@@ -1,5 +1,10 @@
 //#include "mem_allocate.h"
+#ifdef _LINUX_APPLICATION
+#include <stdlib.h>
+#else
 #include <mem.h>
+#endif
+#include "mem_allocate.h"
 void* ntfs_alloc (size_t size)
 {
 	return malloc(size);
@@ -7,10 +12,26 @@ void* ntfs_alloc (size_t size)
 
 void* ntfs_align (size_t size)
 {
-    return malloc(size);
+    UINTN mem = (UINTN) malloc(size + NTFS_ALIGNMENT + sizeof(void*));
+    UINTN aligned;
+
+    if (!mem)
+        return NULL;
+
+    // Keep the real allocation just below the aligned block
+    aligned = (mem + sizeof(void*) + NTFS_ALIGNMENT - 1) & ~((UINTN) NTFS_ALIGNMENT - 1);
+    ((void**) aligned)[-1] = (void*) mem;
+
+    return (void*) aligned;
 }
 
 void ntfs_free (void* mem)
 {
     free(mem);
-}
\ No newline at end of file
+}
+
+void ntfs_align_free (void* mem)
+{
+    if (mem)
+        free(((void**) mem)[-1]);
+}
@@ -24,8 +24,13 @@
 
 //#include <malloc.h>
 
+#ifndef NTFS_ALIGNMENT
+#define NTFS_ALIGNMENT  4096    /* Alignment of ntfs_align buffers (covers BlockIo IoAlign) */
+#endif
+
 extern void* ntfs_alloc (size_t size);
 extern void* ntfs_align (size_t size);
 extern void ntfs_free (void* mem);
+extern void ntfs_align_free (void* mem);
 
 #endif /* _MEM_ALLOCATE_H */
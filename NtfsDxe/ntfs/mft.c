@@ -56,6 +56,109 @@
 #include "mft.h"
 #include "logging.h"
 #include "misc.h"
+#include "cache.h"
+
+#if CACHE_MFTREC_SIZE
+
+/*
+ *		Record number comparing for the mft record cache
+ */
+
+static int mftrec_cache_compare(const struct CACHED_GENERIC *cached,
+			const struct CACHED_GENERIC *wanted)
+{
+	return (((const struct CACHED_MFTREC*)cached)->inum
+			!= ((const struct CACHED_MFTREC*)wanted)->inum);
+}
+
+/*
+ *		Mft record cache hashing
+ *
+ *	Consecutive records get consecutive hash indexes
+ */
+
+int ntfs_mft_record_hash(const struct CACHED_GENERIC *cached)
+{
+	return ((int)((const struct CACHED_MFTREC*)cached)->inum
+			& 0x7fffffff);
+}
+
+/*
+ *		Enter a copy of a record into the mft record cache
+ *
+ *	Only FILE records are kept, free or damaged ones are read again
+ *	when needed so that the usual checks apply to them.
+ */
+
+static void mftrec_enter(const ntfs_volume *vol, VCN m, const MFT_RECORD *b)
+{
+	struct CACHED_MFTREC item;
+
+	if (ntfs_is_file_record(b->magic)) {
+		item.inum = m;
+		item.record = b;
+		item.recsize = vol->mft_record_size;
+		ntfs_enter_cache(vol->mftrec_cache, GENERIC(&item),
+				mftrec_cache_compare);
+	}
+}
+
+/*
+ *		Read a single mft record through the mft record cache
+ *
+ *	On a miss, the aligned batch of records around the wanted one is
+ *	read in a single transfer and entered into cache, neighbouring
+ *	records being likely to be opened soon (files created together,
+ *	entries of the same directory). If the batch cannot be read, the
+ *	wanted record is read alone.
+ *
+ *	Returns 0 if the record was copied to @b, 1 if it has to be read
+ *	by the caller.
+ */
+
+static int mftrec_read(const ntfs_volume *vol, VCN m, MFT_RECORD *b)
+{
+	struct CACHED_MFTREC item;
+	const struct CACHED_MFTREC *cached;
+	u8 *buf;
+	VCN first;
+	s64 count, br;
+
+	item.inum = m;
+	item.record = (const MFT_RECORD*)NULL;
+	item.recsize = 0;
+	cached = (const struct CACHED_MFTREC*)ntfs_fetch_cache(
+			vol->mftrec_cache, GENERIC(&item),
+			mftrec_cache_compare);
+	if (cached) {
+		memcpy(b, cached->record, vol->mft_record_size);
+		return (0);
+	}
+	first = m - m % MFT_READ_BATCH;
+	count = (vol->mft_na->initialized_size >> vol->mft_record_size_bits)
+			- first;
+	if (count > MFT_READ_BATCH)
+		count = MFT_READ_BATCH;
+	buf = (u8*)ntfs_malloc(count << vol->mft_record_size_bits);
+	if (!buf)
+		return (1);
+	br = ntfs_attr_mst_pread(vol->mft_na,
+			first << vol->mft_record_size_bits,
+			count, vol->mft_record_size, buf);
+	if (br <= m - first) {
+		free(buf);
+		return (1);
+	}
+	for (count=0; count<br; count++)
+		mftrec_enter(vol, first + count, (const MFT_RECORD*)
+			&buf[count << vol->mft_record_size_bits]);
+	memcpy(b, &buf[(m - first) << vol->mft_record_size_bits],
+			vol->mft_record_size);
+	free(buf);
+	return (0);
+}
+
+#endif
 
 /**
  * ntfs_mft_records_read - read records from the mft from disk
@@ -103,6 +206,10 @@ int ntfs_mft_records_read(const ntfs_volume *vol, const MFT_REF mref,
 				vol->mft_record_size_bits);
 		return -1;
 	}
+#if CACHE_MFTREC_SIZE
+	if ((count == 1) && vol->mftrec_cache && !mftrec_read(vol, m, b))
+		return 0;
+#endif
 	br = ntfs_attr_mst_pread(vol->mft_na, m << vol->mft_record_size_bits,
 			count, vol->mft_record_size, b);
 	if (br != count) {
@@ -164,6 +271,21 @@ int ntfs_mft_records_write(const ntfs_volume *vol, const MFT_REF mref,
 				vol->mft_record_size_bits);
 		return -1;
 	}
+#if CACHE_MFTREC_SIZE
+		/* drop the cached copies, even if the write fails */
+	if (vol->mftrec_cache) {
+		struct CACHED_MFTREC item;
+		s64 i;
+
+		item.record = (const MFT_RECORD*)NULL;
+		item.recsize = 0;
+		for (i=0; i<count; i++) {
+			item.inum = m + i;
+			ntfs_invalidate_cache(vol->mftrec_cache,
+				GENERIC(&item), mftrec_cache_compare, 0);
+		}
+	}
+#endif
 	if (m < vol->mftmirr_size) {
 		if (!vol->mftmirr_na) {
 			errno = EINVAL;
@@ -210,6 +332,86 @@ int ntfs_mft_records_write(const ntfs_volume *vol, const MFT_REF mref,
 	return -1;
 }
 
+/**
+ * ntfs_mft_records_prefetch - read mft records ahead of their use
+ * @vol:	volume to read from
+ * @mrefs:	mft references, sorted by increasing record number
+ * @count:	number of references in @mrefs
+ *
+ * Enter the mft records referenced by @mrefs into the mft record cache, so
+ * that the inodes can be opened later without reading from the device. The
+ * records not already cached are read by runs of neighbouring records, a
+ * run being one transfer of at most MFT_PREFETCH_MAX records. Records are
+ * read in the order of @mrefs, which is also the order of the mft on disk.
+ *
+ * Only as many records as the cache can hold are prefetched, callers
+ * dealing with more records should prefetch them by smaller groups just
+ * before use.
+ *
+ * Return the number of records read and entered into cache. Reading ahead
+ * is only a hint, the records which could not be read are read again
+ * when they are used, so there is no error return.
+ */
+int ntfs_mft_records_prefetch(ntfs_volume *vol, const MFT_REF *mrefs,
+		int count)
+{
+	int entered = 0;
+#if CACHE_MFTREC_SIZE
+	struct CACHED_MFTREC item;
+	u8 *buf;
+	VCN first, last, limit;
+	s64 br;
+	int i, j, k;
+
+	if (!vol || !vol->mft_na || !vol->mftrec_cache || !mrefs || count <= 0)
+		return 0;
+	if (count > vol->mftrec_cache->item_count)
+		count = vol->mftrec_cache->item_count;
+	buf = (u8*)ntfs_malloc(MFT_PREFETCH_MAX << vol->mft_record_size_bits);
+	if (!buf)
+		return 0;
+	limit = vol->mft_na->initialized_size >> vol->mft_record_size_bits;
+	item.record = (const MFT_RECORD*)NULL;
+	item.recsize = 0;
+	i = 0;
+	while (i < count) {
+		first = MREF(mrefs[i]);
+		item.inum = first;
+		if ((first >= limit) || ntfs_probe_cache(vol->mftrec_cache,
+				GENERIC(&item), mftrec_cache_compare)) {
+			i++;
+			continue;
+		}
+			/* extend the run over the next uncached records */
+		last = first;
+		for (j=i+1; j<count; j++) {
+			item.inum = MREF(mrefs[j]);
+			if (((VCN)item.inum >= limit)
+			    || ((VCN)item.inum - last > MFT_PREFETCH_GAP)
+			    || ((VCN)item.inum - first >= MFT_PREFETCH_MAX))
+				break;
+			if (!ntfs_probe_cache(vol->mftrec_cache,
+					GENERIC(&item), mftrec_cache_compare))
+				last = item.inum;
+		}
+		br = ntfs_attr_mst_pread(vol->mft_na,
+				first << vol->mft_record_size_bits,
+				last - first + 1, vol->mft_record_size, buf);
+		for (k=i; (k<j) && (br > 0); k++) {
+			if ((VCN)MREF(mrefs[k]) - first < br) {
+				mftrec_enter(vol, MREF(mrefs[k]),
+				    (const MFT_RECORD*)&buf[(MREF(mrefs[k])
+				    - first) << vol->mft_record_size_bits]);
+				entered++;
+			}
+		}
+		i = j;
+	}
+	free(buf);
+#endif
+	return entered;
+}
+
 int ntfs_mft_record_check(const ntfs_volume *vol, const MFT_REF mref, 
 			  MFT_RECORD *m)
 {			  
@@ -432,7 +634,9 @@ out:
 	return ret;
 }
 
+#ifdef DEBUG
 static const char *es = "  Leaving inconsistent metadata.  Run chkdsk.";
+#endif
 
 /**
  * ntfs_ffz - Find the first unset (zero) bit in a word
@@ -694,6 +898,7 @@ static int ntfs_mft_bitmap_extend_allocation_i(ntfs_volume *vol)
 		return STATUS_ERROR;
 	}
 	mftbmp_na->rl = rl;
+	ntfs_attr_forget_run_index(mftbmp_na);
 	ntfs_log_debug("Adding one run to mft bitmap.\n");
 	/* Find the last run in the new runlist. */
 	for (; rl[1].length; rl++)
@@ -810,6 +1015,7 @@ undo_alloc:
 	lcn = rl->lcn;
 	rl->lcn = rl[1].lcn;
 	rl->length = 0;
+	ntfs_attr_forget_run_index(mftbmp_na);
 	
 	/* FIXME: use an ntfs_cluster_free_* function */
 	if (ntfs_bitmap_clear_bit(vol->lcnbmp_na, lcn))
@@ -1046,6 +1252,7 @@ static int ntfs_mft_data_extend_allocation(ntfs_volume *vol)
 		goto out;
 	}
 	mft_na->rl = rl;
+	ntfs_attr_forget_run_index(mft_na);
 	
 	/* Find the last run in the new runlist. */
 	for (; rl[1].length; rl++)
@@ -1164,6 +1371,7 @@ undo_alloc:
 	if (ntfs_cluster_free(vol, mft_na, old_last_vcn, -1) < 0)
 		ntfs_log_error("Failed to free clusters from mft data "
 				"attribute.%s\n", es);
+	ntfs_attr_forget_run_index(mft_na);
 	if (ntfs_rl_truncate(&mft_na->rl, old_last_vcn))
 		ntfs_log_error("Failed to truncate mft data attribute "
 				"runlist.%s\n", es);
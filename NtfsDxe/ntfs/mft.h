@@ -47,7 +47,7 @@ extern int ntfs_mft_records_read(const ntfs_volume *vol, const MFT_REF mref,
  *
  * NOTE: @b has to be at least of size vol->mft_record_size.
  */
-static int ntfs_mft_record_read(const ntfs_volume *vol,
+static inline int ntfs_mft_record_read(const ntfs_volume *vol,
 		const MFT_REF mref, MFT_RECORD *b)
 {
 	int ret; 
@@ -58,6 +58,9 @@ static int ntfs_mft_record_read(const ntfs_volume *vol,
 	return ret;
 }
 
+extern int ntfs_mft_records_prefetch(ntfs_volume *vol, const MFT_REF *mrefs,
+		int count);
+
 extern int ntfs_mft_record_check(const ntfs_volume *vol, const MFT_REF mref, 
 		MFT_RECORD *m);
 
@@ -82,7 +85,7 @@ extern int ntfs_mft_records_write(const ntfs_volume *vol, const MFT_REF mref,
  *
  * NOTE: @b has to be at least of size vol->mft_record_size.
  */
-static int ntfs_mft_record_write(const ntfs_volume *vol,
+static inline int ntfs_mft_record_write(const ntfs_volume *vol,
 		const MFT_REF mref, MFT_RECORD *b)
 {
 	int ret; 
@@ -109,7 +112,7 @@ static int ntfs_mft_record_write(const ntfs_volume *vol,
  * non-existent (don't know if Windows' NTFS driver/chkdsk wouldn't view this
  * as corruption in itself though).
  */
-static u32 ntfs_mft_record_get_data_size(const MFT_RECORD *m)
+static inline u32 ntfs_mft_record_get_data_size(const MFT_RECORD *m)
 {
 	if (!m || !ntfs_is_mft_record(m->magic))
 		return 0;
@@ -128,5 +131,13 @@ extern int ntfs_mft_record_free(ntfs_volume *vol, ntfs_inode *ni);
 
 extern int ntfs_mft_usn_dec(MFT_RECORD *mrec);
 
+#if CACHE_MFTREC_SIZE
+
+struct CACHED_GENERIC;
+
+extern int ntfs_mft_record_hash(const struct CACHED_GENERIC *cached);
+
+#endif
+
 #endif /* defined _NTFS_MFT_H */
 
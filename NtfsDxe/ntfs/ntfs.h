@@ -38,8 +38,12 @@ extern "C" {
 #define EHIBERNATED                     3003 /* Volume is hibernated and NTFS_IGNORE_HIBERFILE was not specified during mount */
 
 /* NTFS cache options */
-#define CACHE_DEFAULT_PAGE_COUNT        8   /* The default number of pages in the cache */
-#define CACHE_DEFAULT_PAGE_SIZE         128 /* The default number of sectors per cache page */
+#ifndef CACHE_DEFAULT_PAGE_COUNT
+#define CACHE_DEFAULT_PAGE_COUNT        32  /* The default number of pages in the cache */
+#endif
+#ifndef CACHE_DEFAULT_PAGE_SIZE
+#define CACHE_DEFAULT_PAGE_SIZE         16  /* The default number of sectors per cache page */
+#endif
 
 /* NTFS mount flags */
 #define NTFS_DEFAULT                    0x00000000 /* Standard mount, expects a clean, non-hibernated volume */
@@ -50,6 +54,7 @@ extern "C" {
 #define NTFS_IGNORE_HIBERFILE           0x00000010 /* Mount even if volume is hibernated */
 #define NTFS_READ_ONLY                  0x00000020 /* Mount in read only mode */
 #define NTFS_IGNORE_CASE                0x00000040 /* Ignore case sensitivity. Everything must be and  will be provided in lowercase. */
+#define NTFS_FAST_DIR_INFO              0x00000080 /* Describe directory entries from their index key instead of their mft record */
 #define NTFS_SU                         NTFS_SHOW_HIDDEN_FILES | NTFS_SHOW_SYSTEM_FILES
 #define NTFS_FORCE                      NTFS_RECOVER | NTFS_IGNORE_HIBERFILE
 
@@ -110,14 +115,16 @@ extern int ntfsMountDevice (struct _NTFS_VOLUME *interface, ntfs_md **mounts, u3
  * @param STARTSECTOR The sector the partition begins at (see @ntfsFindPartitions)
  * @param CACHEPAGECOUNT The total number of pages in the device cache
  * @param CACHEPAGESIZE The number of sectors per cache page
+ * @param CACHESIZES The number of entries of the metadata caches, or NULL for the defaults (see cache.h)
  * @param FLAGS Additional mounting flags (see above)
  *
  * @return True if mount was successful, false if no partition was found or an error occurred (see errno)
  * @note ntfsFindPartitions should be used first to locate the partitions start sector
  */
 struct _ntfs_fd;
+struct CACHE_SIZES;
 
-extern struct _ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t startSector, u32 cachePageCount, u32 cachePageSize, u32 flags);
+extern struct _ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t startSector, u32 cachePageCount, u32 cachePageSize, const struct CACHE_SIZES *cacheSizes, u32 flags);
 
 /**
  * Unmount a NTFS partition.
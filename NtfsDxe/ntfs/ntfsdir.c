@@ -43,27 +43,58 @@
 #include <sys/statfs.h>	// O_RDONLY
 #include "ntfsinternal.h"
 #include "ntfsdir.h"
+#include "ntfsfile.h"
 #include "device.h"
 #include "mem_allocate.h"
+#include "mft.h"
 
 //#include <sys/dir.h>
 
 #define STATE(x)    (x)
 #define MAX_PATH	260
 
-void ntfsCloseDir (ntfs_dir_state *dir)
-{
-    // Sanity check
-    if (!dir || !dir->vd)
-        return;
+#define NTFS_DIR_PREFETCH   64  /* Entries read from the index at a time, their mft records are read ahead together */
+#define NTFS_DIR_SEEN_MIN   256 /* Initial number of slots of the set of listed inodes */
 
-    // Free the directory entries (if any)
+/**
+ * PRIVATE: Free the entries of the current batch
+ */
+static void ntfs_readdir_free_batch (ntfs_dir_state *dir)
+{
     while (dir->first) {
         ntfs_dir_entry *next = dir->first->next;
         ntfs_free(dir->first->name);
         ntfs_free(dir->first);
         dir->first = next;
     }
+    dir->current = NULL;
+    dir->last = NULL;
+    dir->batchCount = 0;
+}
+
+/**
+ * PRIVATE: Rewind the index walk to the start of the directory
+ */
+static void ntfs_readdir_rewind (ntfs_dir_state *dir)
+{
+    ntfs_readdir_free_batch(dir);
+    ntfs_free(dir->seen);
+    dir->seen = NULL;
+    dir->seenSize = 0;
+    dir->seenCount = 0;
+    dir->position = 0;
+    dir->batchFull = FALSE;
+    dir->eod = FALSE;
+}
+
+void ntfsCloseDir (ntfs_dir_state *dir)
+{
+    // Sanity check
+    if (!dir || !dir->vd)
+        return;
+
+    // Free the directory entries and the index walk state (if any)
+    ntfs_readdir_rewind(dir);
 
     // Close the directory (if open)
     if (dir->ni)
@@ -71,8 +102,6 @@ void ntfsCloseDir (ntfs_dir_state *dir)
 
     // Reset the directory state
     dir->ni = NULL;
-    dir->first = NULL;
-    dir->current = NULL;
 
     return;
 }
@@ -386,34 +415,94 @@ int ntfs_statvfs_r (struct _reent *r, const char *path, struct statvfs *buf)
 }
 
 /**
- * PRIVATE: check if a reference is in list!
+ * PRIVATE: Slot of an inode in the set of listed inodes
+ *
+ * The set is open addressed with linear probing, a slot holds the inode
+ * number plus one so that a zeroed slot is free.
  */
-int ntfs_readdir_exists(ntfs_dir_state *dir, ntfs_dir_entry *entry)
+static u32 ntfs_readdir_seen_slot (const u64 *seen, u32 size, u64 key)
 {
-	ntfs_dir_entry *cursor = dir->first;
-	
-	while(cursor != NULL)
-	{
-		if (cursor->mref == entry->mref)
-			return 1;	// found!
+    u32 slot = (u32)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (size - 1);
 
-		cursor = cursor->next;	// move on next!
-	}
+    while (seen[slot] && seen[slot] != key)
+        slot = (slot + 1) & (size - 1);
+    return slot;
+}
 
-	return 0;	// element not in list!
+/**
+ * PRIVATE: Check if an inode has already been listed (hard links and DOS names)
+ */
+static BOOL ntfs_readdir_seen (const ntfs_dir_state *dir, u64 mref)
+{
+    if (!dir->seen)
+        return FALSE;
+    return (dir->seen[ntfs_readdir_seen_slot(dir->seen, dir->seenSize, mref + 1)] != 0);
+}
+
+/**
+ * PRIVATE: Add an inode to the set of listed inodes, doubling the set when half full
+ */
+static int ntfs_readdir_see (ntfs_dir_state *dir, u64 mref)
+{
+    u64 *seen;
+    u32 size, i;
+
+    if (2 * (dir->seenCount + 1) > dir->seenSize) {
+        size = (dir->seenSize ? 2 * dir->seenSize : NTFS_DIR_SEEN_MIN);
+        seen = (u64 *) ntfs_alloc(size * sizeof(u64));
+        if (!seen)
+            return -1;
+        memset(seen, 0, size * sizeof(u64));
+        for (i = 0; i < dir->seenSize; i++) {
+            if (dir->seen[i])
+                seen[ntfs_readdir_seen_slot(seen, size, dir->seen[i])] = dir->seen[i];
+        }
+        ntfs_free(dir->seen);
+        dir->seen = seen;
+        dir->seenSize = size;
+    }
+
+    dir->seen[ntfs_readdir_seen_slot(dir->seen, dir->seenSize, mref + 1)] = mref + 1;
+    dir->seenCount++;
+
+    return 0;
+}
+
+/**
+ * Check whether the fields of a directory entry copied from its index key can be trusted
+ *
+ * Metadata files and files of dirty volumes are never described from their
+ * key, nor are keys whose sizes do not add up. The key of a file open for
+ * writing is only updated when it is closed.
+ */
+bool ntfsDirEntryKeyValid (ntfs_dir_state *dir, const ntfs_dir_entry *entry)
+{
+    ntfs_file_state *file;
+
+    if (!entry->keyValid)
+        return false;
+
+    for (file = dir->vd->firstOpenFile; file; file = file->nextOpenFile) {
+        if (file->write && file->ni && file->ni->mft_no == entry->mref)
+            return false;
+    }
+
+    return true;
 }
 
 /**
  * PRIVATE: Callback for directory walking
+ *
+ * Entries are appended to the current batch until it holds NTFS_DIR_PREFETCH
+ * of them, the walk is then stopped and ntfs_readdir_keys hands the same entry
+ * again when resumed from the saved position.
  */
 int ntfs_readdir_filler (ntfs_dir_state *dirState, const ntfschar *name, const int name_len, const int name_type,
-                         const s64 pos, const MFT_REF mref, const unsigned dt_type)
+                         const s64 pos, const MFT_REF mref, const unsigned dt_type, const FILE_NAME_ATTR *fn)
 {
     ntfs_dir_state *dir = STATE(dirState);
     ntfs_dir_entry *entry = NULL;
-    char *entry_name = NULL;
-	MFT_REF lmref;
-	UINT8 f, i;
+    ntfschar *entry_name = NULL;
 
     // Sanity check
     if (!dir || !dir->vd) {
@@ -421,97 +510,196 @@ int ntfs_readdir_filler (ntfs_dir_state *dirState, const ntfschar *name, const i
         return -1;
     }
 
-    // Ignore DOS file names
+    // Ignore DOS file names: the long name of the same file is listed instead,
+    // and the DOS alias must not win the link dedup below when it sorts first
     if (name_type == FILE_NAME_DOS) {
-		// accept name!
-		//        return 0;
+        return 0;
     }
 
-	if (*name >= 0x100) {
-		// unicode name.. UNSUPPORTED!
-		return 0;
-	}
-
     // Preliminary check that this entry can be enumerated (as described by the volume descriptor)
     if (MREF(mref) == FILE_root || MREF(mref) >= FILE_first_user || dir->vd->showSystemFiles) {
-		//if (ntfs_ucstombs(name, name_len, &entry_name, MAX_PATH) < 0) {
-        // Convert the entry name to our current local
 
-        if (ntfsUnicodeToLocal(name, name_len, &entry_name, 0) < 0) {
-            return -1;
+		if (ntfs_readdir_seen(dir, MREF(mref)))
+		{	// skip link!
+			return 0;
+		}
+
+        // Stop the walk here once the batch is full
+        if (dir->batchCount >= NTFS_DIR_PREFETCH) {
+            dir->batchFull = TRUE;
+            return 1;
         }
 
-		if(dir->first && dir->first->mref == FILE_root &&
-           MREF(mref) == FILE_root && strcmp(entry_name, "..") == 0)
+		if(dir->ni->mft_no == FILE_root &&
+           MREF(mref) == FILE_root && name_len == 2 &&
+           name[0] == const_cpu_to_le16('.') && name[1] == const_cpu_to_le16('.'))
         {	// root directory.. there are no parent inode
-			free(entry_name);
             return 0;
         }
 
+        // Keep the entry name as it is in the index, it is handed over in Unicode
+        entry_name = (ntfschar *) ntfs_alloc((name_len + 1) * sizeof(ntfschar));
+        if (!entry_name)
+            return -1;
+        memcpy(entry_name, name, name_len * sizeof(ntfschar));
+        entry_name[name_len] = const_cpu_to_le16('\0');
 
-        // If this is not the parent or self directory reference
-        if ((strcmp(entry_name, ".") != 0) && (strcmp(entry_name, "..") != 0)) {
-
-            // Open the entry
-            ntfs_inode *ni = //ntfs_pathname_to_inode(dir->vd->vol, dir->ni, entry_name);
-				ntfs_inode_open(dir->vd->vol, MREF(mref));
-
-            if (!ni)
-			{
-				free(entry_name);
-                return -1;
-			}
-
-            // Double check that this entry can be emuerated (as described by the volume descriptor)
-            if (((ni->flags & FILE_ATTR_HIDDEN) && !dir->vd->showHiddenFiles) ||
-                ((ni->flags & FILE_ATTR_SYSTEM) && !dir->vd->showSystemFiles)) {
-                ntfs_inode_close(ni);
-				free(entry_name);
-                return 0;
-            }
 
-            // Close the entry
-            ntfs_inode_close(ni);
-
-        }
+        // The hidden and system flags of the entry are checked once the
+        // whole batch has been read (see ntfs_readdir_filter)
 
         // Allocate a new directory entry
         entry = (ntfs_dir_entry *) ntfs_alloc(sizeof(ntfs_dir_entry));
-        if (!entry)
+        if (!entry || ntfs_readdir_see(dir, MREF(mref)))
 		{
+			ntfs_free(entry);
+			ntfs_free(entry_name);
 			            return -1;
 		}
 
 		        // Setup the entry
         entry->name = entry_name;
+        entry->nameLen = name_len;
         entry->next = NULL;
         entry->mref = MREF(mref);
 
-		if (ntfs_readdir_exists(dir, entry))
-		{	// skip link!
-			free(entry->name);
-			free(entry);
-			return 0;
-		}
+        // Keep what the index key duplicates from the mft record. A data size
+        // past the allocated size can only come from a stale key.
+        entry->keyValid = (dir->vd->fastDirInfo && fn && MREF(mref) >= FILE_first_user &&
+                           sle64_to_cpu(fn->data_size) >= 0 &&
+                           sle64_to_cpu(fn->data_size) <= sle64_to_cpu(fn->allocated_size));
+        if (fn) {
+            entry->fileAttributes = fn->file_attributes;
+            entry->allocatedSize = sle64_to_cpu(fn->allocated_size);
+            entry->dataSize = sle64_to_cpu(fn->data_size);
+            entry->creationTime = fn->creation_time;
+            entry->lastDataChangeTime = fn->last_data_change_time;
+            entry->lastAccessTime = fn->last_access_time;
+        }
 
-        // Link the entry to the directory
-        if (!dir->first) {
+        // Link the entry to the batch
+        if (!dir->first)
             dir->first = entry;
-        } else {
-            ntfs_dir_entry *last = dir->first;
-            while (last->next) last = last->next;
-            last->next = entry;
-        }
+        else
+            dir->last->next = entry;
+        dir->last = entry;
+        dir->batchCount++;
 
     }
 
 	    return 0;
 }
 
+/**
+ * PRIVATE: check if an entry is the parent or self directory reference
+ */
+static int ntfs_readdir_is_dots (const ntfs_dir_entry *entry)
+{
+    return (entry->nameLen == 1 || entry->nameLen == 2) &&
+           (entry->name[0] == const_cpu_to_le16('.')) &&
+           (entry->nameLen == 1 || entry->name[1] == const_cpu_to_le16('.'));
+}
+
+/**
+ * PRIVATE: Drop the entries of the batch that cannot be enumerated (as described by the volume descriptor)
+ *
+ * The hidden and system flags are taken from the index key when it can be
+ * trusted, otherwise they are only known once the inode is opened. The mft
+ * records of the entries to open are prefetched in mft order before the
+ * inodes of the group are opened one by one, turning one random read per
+ * entry into a few sequential ones.
+ */
+static int ntfs_readdir_filter (ntfs_dir_state *dir)
+{
+    MFT_REF mrefs[NTFS_DIR_PREFETCH];
+    ntfs_dir_entry **link = &dir->first;
+    ntfs_dir_entry *entry;
+    ntfs_inode *ni;
+    FILE_ATTR_FLAGS flags;
+    MFT_REF mref;
+    int count, opens, i, j;
+
+    dir->last = NULL;
+    while (*link) {
+
+        // Sort the references of the next group (insertion sort, the group is small)
+        count = opens = 0;
+        for (entry = *link; entry && count < NTFS_DIR_PREFETCH; entry = entry->next) {
+            count++;
+            if (ntfs_readdir_is_dots(entry) || ntfsDirEntryKeyValid(dir, entry))
+                continue;
+            mref = entry->mref;
+            for (j = opens; j > 0 && mrefs[j - 1] > mref; j--)
+                mrefs[j] = mrefs[j - 1];
+            mrefs[j] = mref;
+            opens++;
+        }
+        if (opens)
+            ntfs_mft_records_prefetch(dir->vd->vol, mrefs, opens);
+
+        // Check the entries of the group in directory order
+        for (i = 0; i < count; i++) {
+            entry = *link;
+            if (!ntfs_readdir_is_dots(entry)) {
+                if (ntfsDirEntryKeyValid(dir, entry)) {
+                    flags = entry->fileAttributes;
+                } else {
+                    ni = ntfs_inode_open(dir->vd->vol, entry->mref);
+                    if (!ni)
+                        return -1;
+                    flags = ni->flags;
+                    ntfs_inode_close(ni);
+                }
+
+                if (((flags & FILE_ATTR_HIDDEN) && !dir->vd->showHiddenFiles) ||
+                    ((flags & FILE_ATTR_SYSTEM) && !dir->vd->showSystemFiles)) {
+                    *link = entry->next;
+                    ntfs_free(entry->name);
+                    ntfs_free(entry);
+                    dir->batchCount--;
+                    continue;
+                }
+            }
+            dir->last = entry;
+            link = &entry->next;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * PRIVATE: Read the next batch of entries from the directory index
+ *
+ * The index is walked from the saved position until a batch is full or the
+ * end of the directory is reached, so the cost of opening or advancing a
+ * directory does not depend on its size. Batches left empty by the filter
+ * are skipped.
+ */
+static int ntfs_readdir_fill (ntfs_dir_state *dir)
+{
+    ntfs_readdir_free_batch(dir);
+
+    while (!dir->first && !dir->eod) {
+        dir->batchFull = FALSE;
+        if (ntfs_readdir_keys(dir->ni, &dir->position, dir, (ntfs_filldir_key_t)ntfs_readdir_filler) &&
+            !dir->batchFull)
+            return -1;
+        if (!dir->batchFull)
+            dir->eod = TRUE;
+        if (ntfs_readdir_filter(dir))
+            return -1;
+    }
+
+    // Move to the first entry of the batch
+    dir->current = dir->first;
+
+    return 0;
+}
+
 ntfs_dir_state *ntfs_diropen_r (struct _reent *r, ntfs_dir_state *dirState, const char *path)
 {
 	    ntfs_dir_state* dir = STATE(dirState);
-    s64 position = 0;
 
     ntfs_log_trace("dirState %p, path %s\n", dirState, path);
 
@@ -526,18 +714,17 @@ ntfs_dir_state *ntfs_diropen_r (struct _reent *r, ntfs_dir_state *dirState, cons
         return NULL;
     }
 
-    // Read the directory
-    dir->first = dir->current = NULL;
-    if (ntfs_readdir(dir->ni, &position, dirState, (ntfs_filldir_t)ntfs_readdir_filler)) {
+    // Read the first batch of the directory
+    dir->first = dir->current = dir->last = NULL;
+    dir->seen = NULL;
+    ntfs_readdir_rewind(dir);
+    if (ntfs_readdir_fill(dir)) {
         ntfsCloseDir(dir);
         ntfsUnlock(dir->vd);
         r->_errno = errno;
         return NULL;
     }
 
-    // Move to the first entry in the directory
-    dir->current = dir->first;
-
     // Update directory times
     ntfsUpdateTimes(dir->vd, dir->ni, NTFS_UPDATE_ATIME);
 
@@ -573,8 +760,13 @@ int ntfs_dirreset_r (struct _reent *r, ntfs_dir_state *dirState)
     // Lock
     ntfsLock(dir->vd);
 
-    // Move to the first entry in the directory
-    dir->current = dir->first;
+    // Walk the directory again from its first entry
+    ntfs_readdir_rewind(dir);
+    if (ntfs_readdir_fill(dir)) {
+        ntfsUnlock(dir->vd);
+        r->_errno = errno;
+        return -1;
+    }
 
     // Update directory times
     ntfsUpdateTimes(dir->vd, dir->ni, NTFS_UPDATE_ATIME);
@@ -588,7 +780,6 @@ int ntfs_dirreset_r (struct _reent *r, ntfs_dir_state *dirState)
 int ntfs_dirnext_r (struct _reent *r, ntfs_dir_state *dirState, char *filename, struct stat *filestat)
 {
 	    ntfs_dir_state* dir = STATE(dirState);
-    ntfs_inode *ni = NULL;
 
     ntfs_log_trace("dirState %p, filename %p, filestat %p\n", dirState, filename, filestat);
 
@@ -627,7 +818,13 @@ int ntfs_dirnext_r (struct _reent *r, ntfs_dir_state *dirState, char *filename,
     //    }
     //}
 
+    // Move on, reading the next batch when the current one is exhausted
     dir->current = dir->current->next;
+    if (!dir->current && ntfs_readdir_fill(dir)) {
+        ntfsUnlock(dir->vd);
+        r->_errno = errno;
+        return -1;
+    }
 
     // Update directory times
     ntfsUpdateTimes(dir->vd, dir->ni, NTFS_UPDATE_ATIME);
@@ -25,6 +25,8 @@
 #include "ntfsinternal.h"
 //#include <sys/reent.h>
 
+struct statvfs;
+
 typedef struct _DIR_ITER {
 	void *dummy;
 	void *dirStruct;
@@ -35,9 +37,17 @@ typedef struct _DIR_ITER {
  * ntfs_dir_entry - Directory entry
  */
 typedef struct _ntfs_dir_entry {
-    char *name;
+    ntfschar *name;                         /* Little endian Unicode name, terminated */
+    int nameLen;                            /* Length of the name in Unicode characters */
 	u64 mref;
     struct _ntfs_dir_entry *next;
+    bool keyValid;                          /* The fields below were copied from the $FILE_NAME index key */
+    FILE_ATTR_FLAGS fileAttributes;
+    s64 allocatedSize;
+    s64 dataSize;
+    ntfs_time creationTime;
+    ntfs_time lastDataChangeTime;
+    ntfs_time lastAccessTime;
 } ntfs_dir_entry;
 
 /**
@@ -46,8 +56,16 @@ typedef struct _ntfs_dir_entry {
 struct _ntfs_dir_state {
     ntfs_vd *vd;                            /* Volume this directory belongs to */
     ntfs_inode *ni;                         /* Directory descriptor */
-    ntfs_dir_entry *first;                  /* The first entry in the directory */
+    ntfs_dir_entry *first;                  /* The first entry of the current batch */
     ntfs_dir_entry *current;                /* The current entry in the directory */
+    ntfs_dir_entry *last;                   /* The last entry of the current batch */
+    int batchCount;                         /* Number of entries in the current batch */
+    BOOL batchFull;                         /* The index walk stopped because the batch is full */
+    BOOL eod;                               /* The index walk reached the end of the directory */
+    s64 position;                           /* Index walk cursor, as used by ntfs_readdir */
+    u64 *seen;                              /* Open addressed set of the inodes already listed (mref + 1, 0 if free) */
+    u32 seenSize;                           /* Number of slots of the set, a power of two */
+    u32 seenCount;                          /* Number of inodes in the set */
     struct _ntfs_dir_state *prevOpenDir;    /* The previous entry in a double-linked FILO list of open directories */
     struct _ntfs_dir_state *nextOpenDir;    /* The next entry in a double-linked FILO list of open directories */
 
@@ -57,6 +75,7 @@ typedef struct _ntfs_dir_state ntfs_dir_state;
 
 /* Directory state routines */
 void ntfsCloseDir (ntfs_dir_state *file);
+bool ntfsDirEntryKeyValid (ntfs_dir_state *dir, const ntfs_dir_entry *entry);
 
 /* Gekko devoptab directory routines for NTFS-based devices */
 extern int ntfs_stat_r (struct _reent *r, const char *path, struct stat *st);
@@ -225,7 +225,7 @@ int ntfs_open_r (struct _reent *r, void *fileStruct, const char *path, int flags
     // Unlock
     ntfsUnlock(file->vd);
 
-    return (int)fileStruct;
+    return (int)(UINTN)fileStruct;
 }
 
 int ntfs_close_r (struct _reent *r, UINTN fd)
@@ -335,6 +335,41 @@ ntfs_inode *ntfsParseEntry (ntfs_vd *vd, const char *path, int reparseLevel)
     return ni;
 }
 
+ntfs_inode *ntfsOpenEntryUnicode (ntfs_vd *vd, const ntfschar *path, int path_len)
+{
+    ntfs_inode *ni = NULL;
+    char *local = NULL;
+
+    // Sanity check
+    if (!vd) {
+        errno = ENODEV;
+        return NULL;
+    }
+    if (!path || path_len < 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Find the entry, taking into account our current directory (if any)
+    if (path_len && path[0] == const_cpu_to_le16(PATH_SEP))
+        ni = ntfs_upathname_to_inode(vd->vol, NULL, path, path_len);
+    else
+        ni = ntfs_upathname_to_inode(vd->vol, vd->cwd_ni, path, path_len);
+
+    // Symbolic links and directory junctions are rare, resolve their true
+    // location through the local path like ntfsParseEntry does
+    if (ni && (ni->flags & FILE_ATTR_REPARSE_POINT) && ntfs_possible_symlink(ni)) {
+        ntfsCloseEntry(vd, ni);
+        ni = NULL;
+        if (ntfsUnicodeToLocal(path, path_len, &local, 0) > 0) {
+            ni = ntfsParseEntry(vd, local, 1);
+            ntfs_free(local);
+        }
+    }
+
+    return ni;
+}
+
 void ntfsCloseEntry (ntfs_vd *vd, ntfs_inode *ni)
 {
     // Sanity check
@@ -65,6 +65,7 @@
 /* Forward declarations */
 struct _ntfs_file_state;
 struct _ntfs_dir_state;
+struct CACHE_SIZES;
 
 #define __attribute__(x)
 #define __packed__
@@ -144,6 +145,7 @@ typedef struct _ntfs_vd {
     ntfs_atime_t atime;                     /* Entry access time update strategy */
     bool showHiddenFiles;                   /* If true, show hidden files when enumerating directories */
     bool showSystemFiles;                   /* If true, show system files when enumerating directories */
+    bool fastDirInfo;                       /* If true, describe directory entries from their index key */
     ntfs_inode *cwd_ni;                     /* Current directory */
     struct _ntfs_dir_state *firstOpenDir;   /* The start of a FILO linked list of currently opened directories */
     struct _ntfs_file_state *firstOpenFile; /* The start of a FILO linked list of currently opened files */
@@ -198,6 +200,7 @@ typedef struct devoptab_ {
 
 
 /* Gekko device related routines */
+void ntfsInit (void);
 int ntfsAddDevice (const char *name, void *deviceData);
 void ntfsRemoveDevice (const char *path);
 const devoptab_t *ntfsGetDevice (const char *path, bool useDefaultDevice);
@@ -209,6 +212,7 @@ void ntfsDeinitVolume (ntfs_vd *vd);
 ntfs_vd *ntfsGetVolume (const char *path);
 ntfs_inode *ntfsOpenEntry (ntfs_vd *vd, const char *path);
 ntfs_inode *ntfsParseEntry (ntfs_vd *vd, const char *path, int reparseLevel);
+ntfs_inode *ntfsOpenEntryUnicode (ntfs_vd *vd, const ntfschar *path, int path_len);
 void ntfsCloseEntry (ntfs_vd *vd, ntfs_inode *ni);
 ntfs_inode *ntfsCreate (ntfs_vd *vd, const char *path, mode_t type, const char *target);
 int ntfsLink (ntfs_vd *vd, const char *old_path, const char *new_path);
@@ -220,6 +224,9 @@ void ntfsUpdateTimes (ntfs_vd *vd, ntfs_inode *ni, ntfs_time_update_flags mask);
 const char *ntfsRealPath (const char *path);
 int ntfsUnicodeToLocal (const ntfschar *ins, const int ins_len, char **outs, int outs_len);
 int ntfsLocalToUnicode (const char *ins, ntfschar **outs);
-ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t startSector, u32 cachePageCount, u32 cachePageSize, u32 flags);
+ntfs_vd *ntfsMountOps (const char *name, struct ntfs_device_operations *ops, void *priv, const struct CACHE_SIZES *cacheSizes, u32 flags);
+
+struct _NTFS_VOLUME;
+ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t startSector, u32 cachePageCount, u32 cachePageSize, const struct CACHE_SIZES *cacheSizes, u32 flags);
 
 #endif /* _NTFSINTERNAL_H */
@@ -65,7 +65,7 @@ typedef sle64 ntfs_time;
  *
  * Return:  A Unix time (number of seconds since 1970, and nanoseconds)
  */
-static struct timespec ntfs2timespec(ntfs_time ntfstime)
+static inline struct timespec ntfs2timespec(ntfs_time ntfstime)
 {
 	struct timespec spec;
 	s64 cputime;
@@ -96,7 +96,7 @@ static struct timespec ntfs2timespec(ntfs_time ntfstime)
  *
  * Return:  An NTFS time (100ns units since Jan 1601)
  */
-static ntfs_time timespec2ntfs(struct timespec spec)
+static inline ntfs_time timespec2ntfs(struct timespec spec)
 {
 	s64 units;
 
@@ -109,7 +109,7 @@ static ntfs_time timespec2ntfs(struct timespec spec)
  *		Return the current time in ntfs format
  */
 
-static ntfs_time ntfs_current_time(void)
+static inline ntfs_time ntfs_current_time(void)
 {
 	struct timespec now;
 
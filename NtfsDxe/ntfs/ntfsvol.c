@@ -408,14 +408,13 @@ void ntfsInit (void)
 //    return 0;
 //}
 
-ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t startSector, u32 cachePageCount, u32 cachePageSize, u32 flags)
+ntfs_vd *ntfsMountOps (const char *name, struct ntfs_device_operations *ops, void *priv, const struct CACHE_SIZES *cacheSizes, u32 flags)
 {
     ntfs_vd *vd = NULL;
-    struct _uefi_fd *fd = NULL;
 	const devoptab_t *mnt;
 
 	// Sanity check
-    if (!name || !interface)
+    if (!name || !ops || !priv)
     {
         errno = EINVAL;
         return NULL;
@@ -428,6 +427,7 @@ ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t star
 
     // Check that the requested mount name is free
     if (mnt) {
+        ntfs_free(priv);
 	    errno = 99; //EADDRINUSE;
 	
 		return (ntfs_vd*) mnt->deviceData;	// previous mnt data!
@@ -438,6 +438,7 @@ ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t star
     vd = (ntfs_vd*)ntfs_alloc(sizeof(ntfs_vd));
     if (!vd)
     {
+        ntfs_free(priv);
         errno = ENOMEM;
         return NULL;
     }
@@ -452,31 +453,15 @@ ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t star
     vd->atime = ((flags & NTFS_UPDATE_ACCESS_TIMES) ? ATIME_ENABLED : ATIME_DISABLED);
     vd->showHiddenFiles = (flags & NTFS_SHOW_HIDDEN_FILES);
     vd->showSystemFiles = (flags & NTFS_SHOW_SYSTEM_FILES);
-
-    // Allocate the device driver descriptor
-    fd = (struct _uefi_fd *)ntfs_alloc(sizeof(struct _uefi_fd));
-    if (!fd)
-    {
-		ntfs_free(vd);
-        errno = ENOMEM;
-        return false;
-    }
-
-    // Setup the device driver descriptor
-    fd->interface = interface;
-    fd->startSector = startSector;
-    fd->sectorSize = 0x200;
-	fd->sectorCount = 0x200;
-    fd->cachePageCount = cachePageCount;
-    fd->cachePageSize = cachePageSize;
+    vd->fastDirInfo = (flags & NTFS_FAST_DIR_INFO);
 
     // Allocate the device driver
-    vd->dev = ntfs_device_alloc(name, 0, &ntfs_device_uefi_io_ops, fd);
+    vd->dev = ntfs_device_alloc(name, 0, ops, priv);
     if (!vd->dev)
     {
-        ntfs_free(fd);
+        ntfs_free(priv);
         ntfs_free(vd);
-        return false;
+        return NULL;
     }
 	
     // Build the mount flags
@@ -509,6 +494,15 @@ ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t star
 	if (flags & NTFS_IGNORE_CASE)
 		ntfs_set_ignore_case(vd->vol);
 
+    // The index keys may not have been updated if Windows did not close the volume
+    if (vd->fastDirInfo && (vd->vol->flags & VOLUME_IS_DIRTY)) {
+        ntfs_log_debug("Volume \"%s\" is dirty, not trusting index keys\n", name);
+        vd->fastDirInfo = false;
+    }
+
+    // Create the metadata caches (inode, lookup, ...) with the requested sizes
+    ntfs_create_lru_caches(vd->vol, cacheSizes);
+
     // Initialise the volume descriptor
     if (ntfsInitVolume(vd)) {
         ntfs_umount(vd->vol, true);
@@ -527,6 +521,48 @@ ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t star
     return vd;
 }
 
+ntfs_vd *ntfsMount (const char *name, struct _NTFS_VOLUME *interface, sec_t startSector, u32 cachePageCount, u32 cachePageSize, const struct CACHE_SIZES *cacheSizes, u32 flags)
+{
+    struct _uefi_fd *fd = NULL;
+
+	// Sanity check
+    if (!name || !interface)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Allocate the device driver descriptor
+    fd = (struct _uefi_fd *)ntfs_alloc(sizeof(struct _uefi_fd));
+    if (!fd)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // Setup the device driver descriptor
+    fd->interface = interface;
+    fd->dev = NULL;
+    fd->startSector = startSector;
+    fd->sectorSize = 0x200;
+	fd->sectorCount = 0x200;
+    fd->cachePageCount = cachePageCount;
+    fd->cachePageSize = cachePageSize;
+    fd->readaheadStreams = READAHEAD_DEFAULT_STREAMS;
+    fd->maxTransferSectors = 0;
+    fd->queueDepth = UEFI_IO_DEFAULT_QUEUE_DEPTH;
+    fd->pipeline = NULL;
+    fd->pipelineOff = false;
+    fd->scratch = NULL;
+    fd->block = NULL;
+    fd->pending = NULL;
+    fd->pendingValid = false;
+    fd->pendingDirty = false;
+
+    // Mount the volume through the UEFI DiskIo device driver
+    return ntfsMountOps(name, &ntfs_device_uefi_io_ops, fd, cacheSizes, flags);
+}
+
 void ntfsUnmount (const char *name, bool force)
 {
     ntfs_vd *vd = NULL;
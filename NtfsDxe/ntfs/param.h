@@ -22,11 +22,58 @@
 #ifndef _NTFS_PARAM_H
 #define _NTFS_PARAM_H
 
-#define CACHE_INODE_SIZE 32	/* inode cache, zero or >= 3 and not too big */
-#define CACHE_NIDATA_SIZE 64	/* idata cache, zero or >= 3 and not too big */
-#define CACHE_LOOKUP_SIZE 64	/* lookup cache, zero or >= 3 and not too big */
-#define CACHE_SECURID_SIZE 16    /* securid cache, zero or >= 3 and not too big */
-#define CACHE_LEGACY_SIZE 8    /* legacy cache size, zero or >= 3 and not too big */
+	/*
+	 * Default number of entries of the LRU caches, which may be
+	 * changed when mounting (see struct CACHE_SIZES). Zero leaves a
+	 * cache out of the build, other values must be >= 3.
+	 */
+#ifndef CACHE_INODE_SIZE
+#define CACHE_INODE_SIZE 256	/* inode cache */
+#endif
+#ifndef CACHE_NIDATA_SIZE
+#define CACHE_NIDATA_SIZE 128	/* idata cache */
+#endif
+#ifndef CACHE_LOOKUP_SIZE
+#define CACHE_LOOKUP_SIZE 256	/* lookup cache */
+#endif
+#ifndef CACHE_NEGATIVE_SIZE
+#define CACHE_NEGATIVE_SIZE 128	/* names known to be missing */
+#endif
+#ifndef CACHE_MFTREC_SIZE
+#define CACHE_MFTREC_SIZE 256	/* mft record cache */
+#endif
+#ifndef CACHE_INDX_SIZE
+#define CACHE_INDX_SIZE 64	/* directory index block cache */
+#endif
+#ifndef CACHE_RUNLIST_SIZE
+#define CACHE_RUNLIST_SIZE 32	/* decoded runlist cache */
+#endif
+#ifndef CACHE_RUNLIST_MAX_RUNS
+#define CACHE_RUNLIST_MAX_RUNS 4096	/* longest runlist kept in cache */
+#endif
+#ifndef CACHE_SECURID_SIZE
+#define CACHE_SECURID_SIZE 16    /* securid cache */
+#endif
+#ifndef CACHE_LEGACY_SIZE
+#define CACHE_LEGACY_SIZE 8    /* legacy cache size */
+#endif
+
+	/*
+	 * Reading mft records : a record missing from the mft record cache
+	 * is read together with its neighbours in an aligned batch of
+	 * MFT_READ_BATCH records. A prefetch reads runs of requested records
+	 * up to MFT_PREFETCH_MAX records long, also transferring unrequested
+	 * records when they fill gaps shorter than MFT_PREFETCH_GAP.
+	 */
+#ifndef MFT_READ_BATCH
+#define MFT_READ_BATCH 8
+#endif
+#ifndef MFT_PREFETCH_MAX
+#define MFT_PREFETCH_MAX 64
+#endif
+#ifndef MFT_PREFETCH_GAP
+#define MFT_PREFETCH_GAP 8
+#endif
 
 #define FORCE_FORMAT_v1x 0	/* Insert security data as in NTFS v1.x */
 #define OWNERFROMACL 1		/* Get the owner from ACL (not Windows owner) */
@@ -0,0 +1,194 @@
+/**
+ * readahead.c - Sequential readahead for the device layer.
+ *
+ * Each device tracks a handful of streams. A read that starts where a
+ * stream left off is treated as sequential: the stream window doubles
+ * (up to a maximum) and the whole window is read in one request, so the
+ * following reads are served from memory. Any other read starts a new
+ * stream in the least recently used slot and goes straight to the disc.
+ *
+ * This program/include file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program/include file is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "types.h"
+#include "logging.h"
+#include "gekko_io.h"
+#include "readahead.h"
+#include "mem_allocate.h"
+
+NTFS_READAHEAD* _NTFS_readahead_constructor (unsigned int numberOfStreams, u32 minWindow, u32 maxWindow, struct _uefi_fd* disc, sec_t endOfPartition, sec_t sectorSize)
+{
+	NTFS_READAHEAD* ra;
+	unsigned int i;
+
+	if (numberOfStreams == 0 || maxWindow < sectorSize)
+		return NULL;
+
+	ra = (NTFS_READAHEAD*) ntfs_alloc (sizeof(NTFS_READAHEAD));
+	if (ra == NULL)
+		return NULL;
+
+	ra->streams = (NTFS_READAHEAD_STREAM*) ntfs_alloc (sizeof(NTFS_READAHEAD_STREAM) * numberOfStreams);
+	if (ra->streams == NULL) {
+		ntfs_free (ra);
+		return NULL;
+	}
+
+	ra->disc = disc;
+	ra->endOfPartition = endOfPartition;
+	ra->sectorSize = sectorSize;
+	ra->maxWindow = maxWindow / sectorSize;
+	ra->minWindow = MIN(MAX(minWindow / sectorSize, 1), ra->maxWindow);
+	ra->numberOfStreams = numberOfStreams;
+	ra->accessCounter = 0;
+	memset (&ra->stats, 0, sizeof(NTFS_READAHEAD_STATS));
+
+	for (i = 0; i < numberOfStreams; i++) {
+		ra->streams[i].nextSector = -1;
+		ra->streams[i].bufSector = 0;
+		ra->streams[i].bufCount = 0;
+		ra->streams[i].consumed = 0;
+		ra->streams[i].window = 0;
+		ra->streams[i].last_access = 0;
+		ra->streams[i].buf = NULL;	// allocated on first prefetch
+	}
+
+	return ra;
+}
+
+/*
+Forget the window of a stream, accounting for whatever was never read
+*/
+static void _NTFS_readahead_drop (NTFS_READAHEAD* ra, NTFS_READAHEAD_STREAM* s)
+{
+	if (s->bufCount > s->consumed)
+		ra->stats.wastedBytes += (u64) ((s->bufCount - s->consumed) * ra->sectorSize);
+
+	s->bufCount = 0;
+	s->consumed = 0;
+}
+
+void _NTFS_readahead_destructor (NTFS_READAHEAD* ra)
+{
+	unsigned int i;
+
+	if (ra == NULL)
+		return;
+
+	for (i = 0; i < ra->numberOfStreams; i++) {
+		_NTFS_readahead_drop (ra, &ra->streams[i]);
+		if (ra->streams[i].buf)
+			ntfs_align_free (ra->streams[i].buf);
+	}
+
+	ntfs_log_debug("readahead: %llu hits, %llu misses, %llu bytes prefetched, %llu bytes wasted\n",
+		ra->stats.hits, ra->stats.misses, ra->stats.prefetchBytes, ra->stats.wastedBytes);
+
+	ntfs_free (ra->streams);
+	ntfs_free (ra);
+}
+
+void _NTFS_readahead_invalidate (NTFS_READAHEAD* ra, sec_t sector, sec_t numSectors)
+{
+	unsigned int i;
+	NTFS_READAHEAD_STREAM* s;
+
+	if (ra == NULL)
+		return;
+
+	for (i = 0; i < ra->numberOfStreams; i++) {
+		s = &ra->streams[i];
+		if (s->bufCount && sector < s->bufSector + s->bufCount && s->bufSector < sector + numSectors)
+			_NTFS_readahead_drop (ra, s);
+	}
+}
+
+bool _NTFS_readahead_readSectors (NTFS_READAHEAD* ra, sec_t sector, sec_t numSectors, void* buffer)
+{
+	unsigned int i;
+	NTFS_READAHEAD_STREAM* s;
+	NTFS_READAHEAD_STREAM* seq = NULL;
+	NTFS_READAHEAD_STREAM* lru = NULL;
+	sec_t count;
+
+	for (i = 0; i < ra->numberOfStreams; i++) {
+		s = &ra->streams[i];
+
+		// Served entirely from a prefetch window
+		if (s->bufCount && sector >= s->bufSector && sector + numSectors <= s->bufSector + s->bufCount) {
+			memcpy (buffer, s->buf + ((sector - s->bufSector) * ra->sectorSize), (size_t) (numSectors * ra->sectorSize));
+			s->consumed = MAX(s->consumed, sector + numSectors - s->bufSector);
+			s->nextSector = sector + numSectors;
+			s->last_access = ++ra->accessCounter;
+			ra->stats.hits++;
+			return true;
+		}
+
+		// Continuation of a known stream (possibly running off the end of its window)
+		if (seq == NULL && (s->nextSector == sector ||
+		    (s->bufCount && sector >= s->bufSector && sector < s->bufSector + s->bufCount)))
+			seq = s;
+
+		if (lru == NULL || s->last_access < lru->last_access)
+			lru = s;
+	}
+
+	ra->stats.misses++;
+
+	if (seq == NULL) {
+		// Random access, start tracking a new stream
+		_NTFS_readahead_drop (ra, lru);
+		lru->nextSector = sector + numSectors;
+		lru->window = 0;
+		lru->last_access = ++ra->accessCounter;
+		return ntfs_device_uefi_io_readcached (ra->disc, sector, numSectors, buffer);
+	}
+
+	s = seq;
+	_NTFS_readahead_drop (ra, s);
+	s->last_access = ++ra->accessCounter;
+	s->window = (s->window) ? MIN(s->window * 2, ra->maxWindow) : ra->minWindow;
+	s->nextSector = sector + numSectors;
+
+	count = MIN(s->window, ra->endOfPartition - sector);
+
+	if (s->buf == NULL)
+		s->buf = (u8*) ntfs_align ((size_t) (ra->maxWindow * ra->sectorSize));
+
+	// Nothing to gain, or no memory for a window
+	if (numSectors >= count || s->buf == NULL)
+		return ntfs_device_uefi_io_readcached (ra->disc, sector, numSectors, buffer);
+
+	if (!ntfs_device_uefi_io_readcached (ra->disc, sector, count, s->buf))
+		return false;
+
+	s->bufSector = sector;
+	s->bufCount = count;
+	s->consumed = numSectors;
+	ra->stats.prefetches++;
+	ra->stats.prefetchBytes += (u64) ((count - numSectors) * ra->sectorSize);
+
+	memcpy (buffer, s->buf, (size_t) (numSectors * ra->sectorSize));
+
+	return true;
+}
@@ -0,0 +1,94 @@
+/**
+ * readahead.h - Sequential readahead for the device layer.
+ *
+ * This program/include file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program/include file is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _READAHEAD_H
+#define _READAHEAD_H
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "types.h"
+
+#define sec_t __int64
+
+#ifndef READAHEAD_DEFAULT_STREAMS
+#define READAHEAD_DEFAULT_STREAMS       4           /* Number of sequential streams tracked per device */
+#endif
+#ifndef READAHEAD_DEFAULT_MIN_WINDOW
+#define READAHEAD_DEFAULT_MIN_WINDOW    0x10000     /* Initial prefetch window (in bytes) */
+#endif
+#ifndef READAHEAD_DEFAULT_MAX_WINDOW
+#define READAHEAD_DEFAULT_MAX_WINDOW    0x100000    /* Largest prefetch window (in bytes) */
+#endif
+
+struct _uefi_fd;
+
+/**
+ * NTFS_READAHEAD_STATS - Readahead counters
+ */
+typedef struct {
+	u64             hits;               /* Reads served entirely from a prefetch window */
+	u64             misses;             /* Reads that had to go to the backing store */
+	u64             prefetches;         /* Prefetch windows issued */
+	u64             prefetchBytes;      /* Bytes read ahead of demand */
+	u64             wastedBytes;        /* Prefetched bytes dropped without being read */
+} NTFS_READAHEAD_STATS;
+
+/**
+ * NTFS_READAHEAD_STREAM - One detected sequential stream
+ */
+typedef struct {
+	sec_t           nextSector;         /* Sector a sequential reader will ask for next */
+	sec_t           bufSector;          /* First sector held in buf */
+	sec_t           bufCount;           /* Number of sectors held in buf */
+	sec_t           consumed;           /* Sectors of buf returned to a reader */
+	sec_t           window;             /* Current prefetch window (in sectors) */
+	u64             last_access;
+	u8*             buf;
+} NTFS_READAHEAD_STREAM;
+
+typedef struct {
+	struct _uefi_fd*        disc;
+	sec_t                   endOfPartition;
+	sec_t                   sectorSize;
+	sec_t                   minWindow;
+	sec_t                   maxWindow;
+	unsigned int            numberOfStreams;
+	u64                     accessCounter;
+	NTFS_READAHEAD_STREAM*  streams;
+	NTFS_READAHEAD_STATS    stats;
+} NTFS_READAHEAD;
+
+/*
+Read several sectors, serving them from a prefetch window when possible.
+A read that continues a known stream refills that stream's window, which
+doubles each time up to the maximum.
+*/
+bool _NTFS_readahead_readSectors (NTFS_READAHEAD* ra, sec_t sector, sec_t numSectors, void* buffer);
+
+/*
+Drop any prefetched copy of a sector range (called on writes)
+*/
+void _NTFS_readahead_invalidate (NTFS_READAHEAD* ra, sec_t sector, sec_t numSectors);
+
+NTFS_READAHEAD* _NTFS_readahead_constructor (unsigned int numberOfStreams, u32 minWindow, u32 maxWindow, struct _uefi_fd* disc, sec_t endOfPartition, sec_t sectorSize);
+
+void _NTFS_readahead_destructor (NTFS_READAHEAD* ra);
+
+#endif /* _READAHEAD_H */
@@ -139,7 +139,7 @@ static u64 ntfs_fix_file_name(ntfs_inode *dir_ni, ntfschar *uname,
 	
 	struct _find {
 		FILE_NAME_ATTR attr;
-		//ntfschar file_name[NTFS_MAX_NAME_LEN + 1];
+		ntfschar file_name[NTFS_MAX_NAME_LEN + 1];
 	} find;
 
 	mref = (u64)-1; /* default return (not found) */
@@ -158,9 +158,9 @@ static u64 ntfs_fix_file_name(ntfs_inode *dir_ni, ntfschar *uname,
 			 */
 			if ((cpuchar < vol->upcase_len)
 			    && (le16_to_cpu(vol->upcase[cpuchar]) < cpuchar))
-				find.attr.file_name[i] = vol->upcase[cpuchar];
+				find.file_name[i] = vol->upcase[cpuchar];
 			else
-				find.attr.file_name[i] = uname[i];
+				find.file_name[i] = uname[i];
 		}
 		olderrno = errno;
 		lkup = ntfs_index_lookup((char*)&find, uname_len, icx);
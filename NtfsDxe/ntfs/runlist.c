@@ -128,6 +128,8 @@ runlist_element *ntfs_rl_extend(ntfs_attr *na, runlist_element *rl,
 	int irl;
 
 	if (na->rl && rl) {
+			/* the caller is about to change the runlist */
+		ntfs_attr_forget_run_index(na);
 		irl = (int)(rl - na->rl);
 		last = irl;
 		while (na->rl[last].length)
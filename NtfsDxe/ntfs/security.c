@@ -341,7 +341,7 @@ char *ntfs_sid_to_mbs(const SID *sid, char *sid_str, size_t sid_str_size)
 	if (!sid->identifier_authority.high_part)
 		i = snprintf(s, cnt, "%lu", (unsigned long)u);
 	else
-		i = snprintf(s, cnt, "0x%lx", (unsigned long long)u);
+		i = snprintf(s, cnt, "0x%llx", (unsigned long long)u);
 	if (i < 0 || i >= cnt)
 		goto err_out;
 	s += i;
@@ -3259,11 +3259,12 @@ int ntfs_set_mode(struct SECURITY_CONTEXT *scx, ntfs_inode *ni, mode_t mode)
 int ntfs_sd_add_everyone(ntfs_inode *ni)
 {
 	/* JPA SECURITY_DESCRIPTOR_ATTR *sd; */
-	SECURITY_DESCRIPTOR_RELATIVE *sd;
-	ACL *acl;
-	ACCESS_ALLOWED_ACE *ace;
-	SID *sid;
-	int ret, sd_len;
+	//SECURITY_DESCRIPTOR_RELATIVE *sd;
+	//ACL *acl;
+	//ACCESS_ALLOWED_ACE *ace;
+	//SID *sid;
+	//int sd_len;
+	int ret;
 	unsigned char SID_EVERYONE[80] = {
 	0x01, 0x00, 0x04, 0x80, 0x14, 0x00, 0x00, 0x00, 0x24, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 
 	0x34, 0x00, 0x00, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x20, 0x00, 0x00, 0x00, 
@@ -3955,49 +3956,6 @@ le32 ntfs_inherited_id(struct SECURITY_CONTEXT *scx,
 	return (securid);
 }
 
-/*
- *		Link a group to a member of group
- *
- *	Returns 0 if OK, -1 (and errno set) if error
- */
-
-static int link_single_group(struct MAPPING *usermapping, struct passwd *user,
-			gid_t gid)
-{
-	//struct group *group;
-	char **grmem;
-	int grcnt;
-	//gid_t *groups;
-	int res;
-
-	res = 0;
-	/*group = getgrgid(gid);
-	if (group && group->gr_mem) {
-		grcnt = usermapping->grcnt;
-		groups = usermapping->groups;
-		grmem = group->gr_mem;
-		while (*grmem && strcmp(user->pw_name, *grmem))
-			grmem++;
-		if (*grmem) {
-			if (!grcnt)
-				groups = (gid_t*)malloc(sizeof(gid_t));
-			else
-				groups = (gid_t*)realloc(groups,
-					(grcnt+1)*sizeof(gid_t));
-			if (groups)
-				groups[grcnt++]	= gid;
-			else {
-				res = -1;
-				errno = ENOMEM;
-			}
-		}
-		usermapping->grcnt = grcnt;
-		usermapping->groups = groups;
-	}*/
-	return (res);
-}
-
-
 /*
  *		Statically link group to users
  *	This is based on groups defined in /etc/group and does not take
@@ -4192,7 +4150,7 @@ int ntfs_build_mapping(struct SECURITY_CONTEXT *scx, const char *usermap_path,
 	struct MAPPING *usermapping;
 	struct MAPPING *groupmapping;
 	ntfs_inode *ni;
-	int fd;
+	int fd = -1;
 	static struct {
 		u8 revision;
 		u8 levels;
@@ -5198,7 +5156,7 @@ struct SECURITY_API *ntfs_initialize_file_security(const char *device,
 	scapi = (struct SECURITY_API*)NULL;
 	mnt = ntfs_check_if_mounted(device, &mntflag);
 	if (!mnt && !(mntflag & NTFS_MF_MOUNTED) /*&& !getuid()*/) {
-		vol = ntfs_mount(device, flags);
+		vol = ntfs_mount(device, flags, NULL);
 		if (vol) {
 			scapi = (struct SECURITY_API*)
 				ntfs_malloc(sizeof(struct SECURITY_API));
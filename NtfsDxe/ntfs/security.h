@@ -233,7 +233,7 @@ extern char *ntfs_guid_to_mbs(const GUID *guid, char *guid_str);
  *
  * Return TRUE if it is valid and FALSE otherwise.
  */
-static BOOL ntfs_sid_is_valid(const SID *sid)
+static inline BOOL ntfs_sid_is_valid(const SID *sid)
 {
 	if (!sid || sid->revision != SID_REVISION ||
 			sid->sub_authority_count > SID_MAX_SUB_AUTHORITIES)
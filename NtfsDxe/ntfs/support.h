@@ -39,7 +39,7 @@
  * Generic macro to convert pointers to values for comparison purposes.
  */
 #ifndef p2n
-#define p2n(p)		((int) p)
+#define p2n(p)		((UINTN) (p))
 #endif
 
 /*
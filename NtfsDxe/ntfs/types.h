@@ -78,6 +78,7 @@ typedef sle64 leLSN;
 
 
 
+#ifndef _LINUX_APPLICATION
 #ifndef off_t
 #define off_t int
 
@@ -95,6 +96,7 @@ typedef sle64 leLSN;
 #define uid_t int
 #define pid_t int
 
+#endif
 #endif
 /**
  * enum IGNORE_CASE_BOOL -
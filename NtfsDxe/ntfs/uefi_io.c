@@ -62,18 +62,137 @@
 #include "device_io.h"
 #include "gekko_io.h"
 #include "cache.h"
+#include "cache2.h"
+#include "readahead.h"
 #include "device.h"
 #include "bootsect.h"
 #include "mem_allocate.h"
 
 #define DEV_FD(dev) ((struct _uefi_fd *)dev->d_private)
 
+/**
+ * DiskIo2 tokens of the read pipeline. They belong to the fd rather than to
+ * a single read, so a token the lower driver has not given back is never
+ * released while it may still be signalled.
+ */
+struct _uefi_pipeline {
+	UINT32 depth;                                   /* Tokens with an event */
+	UINT32 stranded;                                /* Tokens still pending after a cancel */
+	bool busy[UEFI_IO_MAX_QUEUE_DEPTH];             /* True while the lower driver owns the token */
+	UINT64 issued[UEFI_IO_MAX_QUEUE_DEPTH];         /* Submission time of each request */
+	UINT64 sizes[UEFI_IO_MAX_QUEUE_DEPTH];          /* Size of each request (in bytes) */
+	EFI_DISK_IO2_TOKEN tokens[UEFI_IO_MAX_QUEUE_DEPTH];
+};
+
 
 /* Prototypes */
 static s64 ntfs_device_uefi_io_readbytes(struct ntfs_device *dev, s64 offset, s64 count, void *buf);
 static bool ntfs_device_uefi_io_readsectors(struct ntfs_device *dev, sec_t sector, sec_t numSectors, void* buffer);
 static s64 ntfs_device_uefi_io_writebytes(struct ntfs_device *dev, s64 offset, s64 count, const void *buf);
 static bool ntfs_device_uefi_io_writesectors(struct ntfs_device *dev, sec_t sector, sec_t numSectors, const void* buffer);
+static bool ntfs_device_uefi_io_writepartial(struct ntfs_device *dev, s64 pos, u32 count, const void* buffer);
+static bool ntfs_device_uefi_io_pendingoverlap(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, sec_t *first, sec_t *last);
+static bool ntfs_device_uefi_io_flushpending(struct ntfs_device *dev);
+static bool ntfs_device_uefi_io_readdisk_raw(struct _uefi_fd *fd, UINT64 offset, UINT64 size, void *buffer);
+static void ntfs_device_uefi_io_pipeline_free(struct _uefi_fd *fd);
+
+/**
+ * Size of a physical block of the media in bytes (a logical block on 512n
+ * and 4Kn media, 4K on 512e media), 0 if BlockIo does not tell
+ */
+static u32 ntfs_device_uefi_io_physicalblock(EFI_BLOCK_IO_PROTOCOL *BlockIo)
+{
+    u32 size;
+
+    if (!BlockIo || !BlockIo->Media || !BlockIo->Media->BlockSize)
+        return 0;
+
+    size = BlockIo->Media->BlockSize;
+    if (BlockIo->Revision >= EFI_BLOCK_IO_PROTOCOL_REVISION2 && BlockIo->Media->LogicalBlocksPerPhysicalBlock > 1)
+        size *= BlockIo->Media->LogicalBlocksPerPhysicalBlock;
+
+    return MIN(size, UEFI_IO_MAX_PHYSICAL_BLOCK);
+}
+
+/**
+ * True if the TimerLib the driver is linked with has a running performance
+ * counter. The null TimerLib does not fill the counter range in, and its
+ * counter reads 0, so every request would land in the first latency bucket.
+ */
+static bool ntfs_device_uefi_io_timed(void)
+{
+    UINT64 first = 0, last = 0;
+
+    if (!GetPerformanceCounterProperties(&first, &last))
+        return false;
+
+    return first != last;
+}
+
+/**
+ * Derive the transfer plan from the BlockIo media geometry. Reads and
+ * writes are planned in physical blocks (so 512e media never sees a partial
+ * physical block, nor 4Kn media a 512 byte NTFS sector), and transfer,
+ * pipeline and cache page sizes are rounded to the optimal transfer
+ * granularity.
+ */
+static void ntfs_device_uefi_io_geometry(struct _uefi_fd *fd)
+{
+    EFI_BLOCK_IO_PROTOCOL *BlockIo = fd->interface->BlockIo;
+    u32 logicalSize = fd->sectorSize;
+    u32 granularity;
+
+    fd->ioAlign = 1;
+    fd->physicalSectors = 1;
+    fd->optimalSectors = 1;
+    fd->mediaSectors = 0;
+
+    if (BlockIo && BlockIo->Media) {
+        if (BlockIo->Media->BlockSize)
+            logicalSize = BlockIo->Media->BlockSize;
+        if (BlockIo->Media->IoAlign > 1)
+            fd->ioAlign = BlockIo->Media->IoAlign;
+        if (ntfs_device_uefi_io_physicalblock(BlockIo) > fd->sectorSize)
+            fd->physicalSectors = ntfs_device_uefi_io_physicalblock(BlockIo) / fd->sectorSize;
+        if (BlockIo->Revision >= EFI_BLOCK_IO_PROTOCOL_REVISION3 && BlockIo->Media->OptimalTransferLengthGranularity > 1)
+            fd->optimalSectors = (BlockIo->Media->OptimalTransferLengthGranularity * logicalSize) / fd->sectorSize;
+        fd->mediaSectors = ((BlockIo->Media->LastBlock + 1) * logicalSize) / fd->sectorSize;
+    }
+
+    // The partition holds at least the volume
+    fd->mediaSectors = MAX(fd->mediaSectors, fd->startSector + fd->sectorCount);
+
+    if (fd->ioAlign > NTFS_ALIGNMENT)
+        ntfs_log_debug("IoAlign %u exceeds buffer alignment %u\n", fd->ioAlign, NTFS_ALIGNMENT);
+
+    // Sanity: a physical block is at most UEFI_IO_MAX_PHYSICAL_BLOCK bytes
+    fd->physicalSectors = MIN(MAX(fd->physicalSectors, 1), MAX(UEFI_IO_MAX_PHYSICAL_BLOCK / fd->sectorSize, 1));
+    fd->optimalSectors = MAX(fd->optimalSectors, fd->physicalSectors);
+    granularity = fd->optimalSectors;
+
+    // Bound the size of a single DiskIo request (0 means use the default), in
+    // optimal transfer units, or in physical blocks below the optimal size
+    if (!fd->maxTransferSectors && fd->interface->MaxTransferSize)
+        fd->maxTransferSectors = MAX(fd->interface->MaxTransferSize / fd->sectorSize, 1);
+    if (!fd->maxTransferSectors)
+        fd->maxTransferSectors = UEFI_IO_DEFAULT_MAX_TRANSFER / fd->sectorSize;
+    if (fd->maxTransferSectors >= granularity)
+        fd->maxTransferSectors -= fd->maxTransferSectors % granularity;
+    else
+        fd->maxTransferSectors = MAX(fd->maxTransferSectors - (fd->maxTransferSectors % fd->physicalSectors), fd->physicalSectors);
+
+    // Size of each request kept in flight when DiskIo2 is available
+    fd->pipelineSectors = MAX(UEFI_IO_DEFAULT_PIPELINE_CHUNK / fd->sectorSize, 1);
+    fd->pipelineSectors = MAX(fd->pipelineSectors - (fd->pipelineSectors % granularity), granularity);
+    fd->pipelineSectors = MIN(fd->pipelineSectors, fd->maxTransferSectors);
+
+    // Cache pages cover whole physical blocks, so write-back never splits one
+    if (fd->cachePageSize % fd->physicalSectors)
+        fd->cachePageSize += fd->physicalSectors - (fd->cachePageSize % fd->physicalSectors);
+
+    ntfs_log_debug("geometry: sector %u, physical %u, optimal %u, align %u\n",
+        fd->sectorSize, fd->physicalSectors * fd->sectorSize, fd->optimalSectors * fd->sectorSize, fd->ioAlign);
+}
 
 /**
  *
@@ -83,6 +202,7 @@ static int ntfs_device_uefi_io_open(struct ntfs_device *dev, int flags)
 	NTFS_BOOT_SECTOR *boot;
 	EFI_DISK_IO_PROTOCOL *DiskIo;
 	NTFS_VOLUME *Volume;
+	u32 bootSize;
 
 	struct _uefi_fd *fd = DEV_FD(dev);
 	Volume = fd->interface;
@@ -98,6 +218,14 @@ static int ntfs_device_uefi_io_open(struct ntfs_device *dev, int flags)
 
     // Get the device interface
 	DiskIo = Volume->DiskIo;
+	fd->dev = dev;
+
+    // Latencies are only measured with a running performance counter
+    fd->timed = ntfs_device_uefi_io_timed();
+    if (fd->timed)
+        Volume->IoStatistics.Flags |= NTFS_IO_STATISTICS_LATENCY;
+    else
+        Volume->IoStatistics.Flags &= ~NTFS_IO_STATISTICS_LATENCY;
 
     if (!DiskIo) {
         errno = ENODEV;
@@ -114,15 +242,15 @@ static int ntfs_device_uefi_io_open(struct ntfs_device *dev, int flags)
     }
 
     // Check that there is a valid NTFS boot sector at the start of the device
-    boot = (NTFS_BOOT_SECTOR *) ntfs_alloc(MAX_SECTOR_SIZE);
+    // (read in a whole physical block, the geometry is not planned yet)
+    bootSize = MAX(ntfs_device_uefi_io_physicalblock(Volume->BlockIo), sizeof(NTFS_BOOT_SECTOR));
+    boot = (NTFS_BOOT_SECTOR *) ntfs_alloc(bootSize);
     if(boot == NULL) {
         errno = ENOMEM;
         return -1;
     }
 
-	 
-	
-	 if (DiskIo->ReadDisk(DiskIo, Volume->MediaId, 0, sizeof(NTFS_BOOT_SECTOR), boot) != EFI_SUCCESS) {
+	 if (!ntfs_device_uefi_io_readdisk_raw(fd, 0, bootSize, boot)) {
 		ntfs_log_perror("read failure @ sector %x\n", fd->startSector);
         errno = EIO;
         ntfs_free(boot);
@@ -146,14 +274,54 @@ static int ntfs_device_uefi_io_open(struct ntfs_device *dev, int flags)
     // Free memory for boot sector
     ntfs_free(boot);
 
+    // Plan transfers around the media geometry
+    ntfs_device_uefi_io_geometry(fd);
+
+    // Allocate the scratch sector used for unaligned head/tail transfers
+    fd->scratch = (u8 *) ntfs_align(MAX_SECTOR_SIZE);
+    if (!fd->scratch) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // Allocate the physical block used to merge partial writes before they reach the disc
+    fd->pending = (u8 *) ntfs_align(fd->physicalSectors * fd->sectorSize);
+    if (!fd->pending) {
+        ntfs_align_free(fd->scratch);
+        fd->scratch = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // Allocate the physical block reads inside a block are widened to (one sector needs none)
+    fd->block = NULL;
+    if (fd->physicalSectors > 1) {
+        fd->block = (u8 *) ntfs_align(fd->physicalSectors * fd->sectorSize);
+        if (!fd->block) {
+            ntfs_align_free(fd->pending);
+            ntfs_align_free(fd->scratch);
+            fd->pending = NULL;
+            fd->scratch = NULL;
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+    fd->pendingSector = 0;
+    fd->pendingCount = 0;
+    fd->pendingValid = false;
+    fd->pendingDirty = false;
+
     // Mark the device as read-only (if required)
     if (flags & O_RDONLY) {
         NDevSetReadOnly(dev);
     }
 
-    // cache disabled!
-    fd->cache = NULL;
-		//_NTFS_cache_constructor(fd->cachePageCount, fd->cachePageSize, interface, fd->startSector + fd->sectorCount, fd->sectorSize);
+    // Create the sector cache (a zero page count or size leaves it disabled);
+    // it reaches the end of the media, the backup boot sector lies past the volume
+    fd->cache = _NTFS_cache_constructor(fd->cachePageCount, fd->cachePageSize, fd, fd->mediaSectors, fd->sectorSize);
+
+    // Create the sequential readahead tracker (a zero stream count leaves it disabled)
+    fd->readahead = _NTFS_readahead_constructor(fd->readaheadStreams, READAHEAD_DEFAULT_MIN_WINDOW, READAHEAD_DEFAULT_MAX_WINDOW, fd, fd->mediaSectors, fd->sectorSize);
 
     // Mark the device as open
     NDevSetBlock(dev);
@@ -170,7 +338,6 @@ static int ntfs_device_uefi_io_close(struct ntfs_device *dev)
 	struct _uefi_fd *fd = DEV_FD(dev);
     ntfs_log_trace("dev %p\n", dev);
 
-	("ntfs_device_uefi_io_close\n\r");
     // Get the device driver descriptor
     
     if (!fd) {
@@ -193,17 +360,27 @@ static int ntfs_device_uefi_io_close(struct ntfs_device *dev)
     if (NDevDirty(dev) && !NDevReadOnly(dev)) {
         ntfs_log_debug("device is dirty, will now sync\n");
 
-        // ...?
+        if (!ntfs_device_uefi_io_flushpending(dev))
+            ntfs_log_perror("pending sector flush failed on close\n");
+
+        if (fd->cache && !_NTFS_cache_flush(fd->cache))
+            ntfs_log_perror("cache flush failed on close\n");
 
         // Mark the device as clean
         NDevClearDirty(dev);
 
     }
 
+    // Destroy the readahead windows (if required)
+    if (fd->readahead) {
+        _NTFS_readahead_destructor(fd->readahead);
+        fd->readahead = NULL;
+    }
+
     // Flush and destroy the cache (if required)
     if (fd->cache) {
-        //_NTFS_cache_flush(fd->cache);
-        //_NTFS_cache_destructor(fd->cache);
+        _NTFS_cache_destructor(fd->cache);
+        fd->cache = NULL;
     }
 
     // Shutdown the device interface
@@ -212,6 +389,23 @@ static int ntfs_device_uefi_io_close(struct ntfs_device *dev)
         interface->shutdown();
     }*/
 
+    // Release the DiskIo2 tokens (unless the lower driver still owns some)
+    ntfs_device_uefi_io_pipeline_free(fd);
+
+    // Free the scratch sector, pending block and bounce block
+    if (fd->scratch) {
+        ntfs_align_free(fd->scratch);
+        fd->scratch = NULL;
+    }
+    if (fd->pending) {
+        ntfs_align_free(fd->pending);
+        fd->pending = NULL;
+    }
+    if (fd->block) {
+        ntfs_align_free(fd->block);
+        fd->block = NULL;
+    }
+
     // Free the device driver private data
     ntfs_free(dev->d_private);
     dev->d_private = NULL;
@@ -284,7 +478,6 @@ static s64 ntfs_device_uefi_io_readbytes(struct ntfs_device *dev, s64 offset, s6
     sec_t sec_start = (sec_t) fd->startSector;
     sec_t sec_count = 1;
     u32 buffer_offset = (u32) (offset % fd->sectorSize);
-    u8 *buffer = NULL;
 
 	//const DISC_INTERFACE* interface;
 
@@ -331,31 +524,55 @@ static s64 ntfs_device_uefi_io_readbytes(struct ntfs_device *dev, s64 offset, s6
             return -1;
         }
 
-    // Else read into a buffer and copy over only what was requested
+    // Else read the partial head and tail sectors through the scratch sector
+    // and the aligned middle straight into the destination buffer
     }
     else
 	{
-
-        // Allocate a buffer to hold the read data
-        buffer = (u8*)ntfs_alloc(sec_count * fd->sectorSize);
-        if (!buffer) {
-            errno = ENOMEM;
-            return -1;
+        u8 *dst = (u8 *) buf;
+        s64 left = count;
+        s64 chunk;
+        sec_t sec = sec_start;
+
+        ntfs_log_trace("split read from sector %d (%d sector(s) long)\n", sec_start, sec_count);
+
+        // Unaligned head
+        if (buffer_offset != 0) {
+            chunk = MIN(left, (s64) (fd->sectorSize - buffer_offset));
+            if (!ntfs_device_uefi_io_readsectors(dev, sec, 1, fd->scratch)) {
+                ntfs_log_perror("head read failure @ sector %d\n", sec);
+                errno = EIO;
+                return -1;
+            }
+            memcpy(dst, fd->scratch + buffer_offset, (size_t) chunk);
+            dst += chunk;
+            left -= chunk;
+            sec++;
         }
 
-        // Read from the device
-        ntfs_log_trace("buffered read from sector %d (%d sector(s) long)\n", sec_start, sec_count);
-        ntfs_log_trace("count: %d  sec_count:%d  fd->sectorSize: %d )\n", (u32)count, (u32)sec_count,(u32)fd->sectorSize);
-        if (!ntfs_device_uefi_io_readsectors(dev, sec_start, sec_count, buffer)) {
-            ntfs_log_perror("buffered read failure @ sector %d (%d sector(s) long)\n", sec_start, sec_count);
-            ntfs_free(buffer);
-            errno = EIO;
-            return -1;
+        // Aligned middle
+        if (left >= fd->sectorSize) {
+            sec_t middle = (sec_t) (left / fd->sectorSize);
+            if (!ntfs_device_uefi_io_readsectors(dev, sec, middle, dst)) {
+                ntfs_log_perror("direct read failure @ sector %d (%d sector(s) long)\n", sec, middle);
+                errno = EIO;
+                return -1;
+            }
+            chunk = middle * fd->sectorSize;
+            dst += chunk;
+            left -= chunk;
+            sec += middle;
         }
 
-        // Copy what was requested to the destination buffer
-        memcpy(buf, buffer + buffer_offset, count);
-        ntfs_free(buffer);
+        // Unaligned tail
+        if (left > 0) {
+            if (!ntfs_device_uefi_io_readsectors(dev, sec, 1, fd->scratch)) {
+                ntfs_log_perror("tail read failure @ sector %d\n", sec);
+                errno = EIO;
+                return -1;
+            }
+            memcpy(dst, fd->scratch, (size_t) left);
+        }
 
     }
 
@@ -371,7 +588,8 @@ static s64 ntfs_device_uefi_io_writebytes(struct ntfs_device *dev, s64 offset, s
 	sec_t sec_start;
     sec_t sec_count;
     u32 buffer_offset;
-    u8 *buffer;
+    u32 block_size;
+    s64 pos;
 
     ntfs_log_trace("dev %p, offset %l, count %l\n", dev, offset, count);
 
@@ -403,25 +621,18 @@ static s64 ntfs_device_uefi_io_writebytes(struct ntfs_device *dev, s64 offset, s
     if(count == 0)
         return 0;
 
-    sec_start = (sec_t) fd->startSector;
-    sec_count = 1;
-    buffer_offset = (u32) (offset % fd->sectorSize);
-    buffer = NULL;
+    // Writes are planned in physical blocks, so the device never has to
+    // read-modify-write (a physical block is one sector on 512n/4Kn media)
+    block_size = fd->physicalSectors * fd->sectorSize;
+    pos = (s64) (fd->startSector * fd->sectorSize) + offset;
+    buffer_offset = (u32) (pos % block_size);
 
-    // Determine the range of sectors required for this write
-    if (offset > 0) {
-        sec_start += (sec_t) offset / fd->sectorSize;
-    }
-    if ((buffer_offset+count) > fd->sectorSize) {
-        sec_count = (sec_t) ((buffer_offset+count) / fd->sectorSize);
-
-		if (((buffer_offset+count) % fd->sectorSize) != 0)
-			sec_count++;
-    }
-
-    // If this write happens to be on the sector boundaries then do the write straight to disc
-    if((buffer_offset == 0) && (count % fd->sectorSize == 0))
+    // If this write happens to be on the block boundaries then do the write straight to disc
+    if((buffer_offset == 0) && (count % block_size == 0))
     {
+        sec_start = (sec_t) (pos / fd->sectorSize);
+        sec_count = (sec_t) (count / fd->sectorSize);
+
         // Write to the device
         ntfs_log_trace("direct write to sector %d (%d sector(s) long)\n", sec_start, sec_count);
         if (!ntfs_device_uefi_io_writesectors(dev, sec_start, sec_count, buf)) {
@@ -429,52 +640,53 @@ static s64 ntfs_device_uefi_io_writebytes(struct ntfs_device *dev, s64 offset, s
             errno = EIO;
             return -1;
         }
-    // Else write from a buffer aligned to the sector boundaries
+    // Else merge the partial head and tail blocks into the pending block
+    // and write the aligned middle straight to disc
     }
     else
     {
-        // Allocate a buffer to hold the write data
-        buffer = (u8 *) ntfs_alloc(sec_count * fd->sectorSize);
-        if (!buffer) {
-            errno = ENOMEM;
-            return -1;
-        }
-        // Read the first and last sectors of the buffer from disc (if required)
-        // NOTE: This is done because the data does not line up with the sector boundaries,
-        //       we just read in the buffer edges where the data overlaps with the rest of the disc
-        if(buffer_offset != 0)
-        {
-            if (!ntfs_device_uefi_io_readsectors(dev, sec_start, 1, buffer)) {
-                ntfs_log_perror("read failure @ sector %d\n", sec_start);
-                ntfs_free(buffer);
+        const u8 *src = (const u8 *) buf;
+        s64 left = count;
+        s64 chunk;
+
+        ntfs_log_trace("split write @ %lld (%lld bytes long)\n", pos, count);
+
+        // Unaligned head
+        if (buffer_offset != 0) {
+            chunk = MIN(left, (s64) (block_size - buffer_offset));
+            if (!ntfs_device_uefi_io_writepartial(dev, pos, (u32) chunk, src)) {
+                ntfs_log_perror("head write failure @ %lld\n", pos);
                 errno = EIO;
                 return -1;
             }
+            src += chunk;
+            left -= chunk;
+            pos += chunk;
         }
-        if((buffer_offset+count) % fd->sectorSize != 0)
-        {
-            if (!ntfs_device_uefi_io_readsectors(dev, sec_start + sec_count - 1, 1, buffer + ((sec_count-1) * fd->sectorSize))) {
-                ntfs_log_perror("read failure @ sector %d\n", sec_start + sec_count - 1);
-                ntfs_free(buffer);
+
+        // Aligned middle
+        if (left >= block_size) {
+            chunk = left - (left % block_size);
+            sec_start = (sec_t) (pos / fd->sectorSize);
+            sec_count = (sec_t) (chunk / fd->sectorSize);
+            if (!ntfs_device_uefi_io_writesectors(dev, sec_start, sec_count, src)) {
+                ntfs_log_perror("direct write failure @ sector %d (%d sector(s) long)\n", sec_start, sec_count);
                 errno = EIO;
                 return -1;
             }
+            src += chunk;
+            left -= chunk;
+            pos += chunk;
         }
 
-        // Copy the data into the write buffer
-        memcpy(buffer + buffer_offset, buf, count);
-
-        // Write to the device
-        ntfs_log_trace("buffered write to sector %d (%d sector(s) long)\n", sec_start, sec_count);
-        if (!ntfs_device_uefi_io_writesectors(dev, sec_start, sec_count, buffer)) {
-            ntfs_log_perror("buffered write failure @ sector %d\n", sec_start);
-            ntfs_free(buffer);
-            errno = EIO;
-            return -1;
+        // Unaligned tail
+        if (left > 0) {
+            if (!ntfs_device_uefi_io_writepartial(dev, pos, (u32) left, src)) {
+                ntfs_log_perror("tail write failure @ %lld\n", pos);
+                errno = EIO;
+                return -1;
+            }
         }
-
-        // Free the buffer
-        ntfs_free(buffer);
     }
 
     // Mark the device as dirty (if we actually wrote anything)
@@ -487,48 +699,37 @@ static bool ntfs_device_uefi_io_readsectors(struct ntfs_device *dev, sec_t secto
 {
     // Get the device driver descriptor
     struct _uefi_fd *fd = DEV_FD(dev);
-	EFI_DISK_IO_PROTOCOL *DiskIo = fd->interface->DiskIo;
-	UINT64 _sectorStart, _bufferSize;
+	sec_t first, last;
 
 	ntfs_log_trace("ntfs_device_uefi_io_readsectors {%x,%d,%d}", dev, sector, numSectors);
     if (!fd) {
         errno = EBADF;
         return false;
     }
-    // Read the sectors from disc (or cache, if enabled)
-	if (fd->cache) {
-		ntfs_log_trace("ntfs_device_uefi_io_readsectors cache enabled?!?!");
-	}
-    else
-	{
-		while(numSectors > 0)
-		{
-			_sectorStart = sector * fd->sectorSize;
-			_bufferSize = fd->sectorSize;
 
-			if (DiskIo->ReadDisk(DiskIo, fd->interface->MediaId, _sectorStart, _bufferSize, buffer) != EFI_SUCCESS)
-			{
-    			ntfs_log_trace("failed I/O!");
-				return false;
-			}
-
-			numSectors--;	// decrease sector count
-			sector++;		// increase sector start
-			buffer = CALC_OFFSET(void *, buffer, fd->sectorSize);	// move ptr!
-		}
+    // Read the sectors through the readahead windows (if enabled)
+	if (fd->readahead) {
+		if (!_NTFS_readahead_readSectors(fd->readahead, sector, numSectors, buffer))
+			return false;
+	} else {
+		if (!ntfs_device_uefi_io_readcached(fd, sector, numSectors, buffer))
+			return false;
 	}
 
-    return true;
+	// The pending block holds merged partial writes newer than the disc
+	if (fd->pendingDirty && ntfs_device_uefi_io_pendingoverlap(fd, sector, numSectors, &first, &last))
+		memcpy((u8 *) buffer + ((first - sector) * fd->sectorSize),
+		       fd->pending + ((first - fd->pendingSector) * fd->sectorSize),
+		       (size_t) ((last - first) * fd->sectorSize));
+
+	return true;
 }
 
 static bool ntfs_device_uefi_io_writesectors(struct ntfs_device *dev, sec_t sector, sec_t numSectors, const void* buffer)
 {
     // Get the device driver descriptor
     struct _uefi_fd *fd = DEV_FD(dev);
-	UINT64	_sectorStart;
-	UINT64	_bufferSize;
-
-	EFI_DISK_IO_PROTOCOL *DiskIo = fd->interface->DiskIo;
+	sec_t first, last;
 
 	ntfs_log_trace("ntfs_device_uefi_io_writesectors\n\r");
 
@@ -537,30 +738,504 @@ static bool ntfs_device_uefi_io_writesectors(struct ntfs_device *dev, sec_t sect
         return false;
     }
 
+    // Keep the pending block in step with sectors written around it
+	if (fd->pendingValid && ntfs_device_uefi_io_pendingoverlap(fd, sector, numSectors, &first, &last)) {
+		if (first == fd->pendingSector && last == fd->pendingSector + fd->pendingCount) {
+			fd->pendingValid = false;
+			fd->pendingDirty = false;
+		} else {
+			memcpy(fd->pending + ((first - fd->pendingSector) * fd->sectorSize),
+			       (const u8 *) buffer + ((first - sector) * fd->sectorSize),
+			       (size_t) ((last - first) * fd->sectorSize));
+		}
+	}
+
+	_NTFS_readahead_invalidate(fd->readahead, sector, numSectors);
+
     // Write the sectors to disc (or cache, if enabled)
-	if (fd->cache) {
-        //return _NTFS_cache_writeSectors(fd->cache, sector, numSectors, buffer);
-		ntfs_log_perror("ntfs_device_uefi_io_writesectors cache enabled?!?!");
+	if (fd->cache)
+		return _NTFS_cache_writeSectors(fd->cache, sector, numSectors, buffer);
+
+	return ntfs_device_uefi_io_writedisk(fd, sector, numSectors, buffer);
+}
+
+/**
+ * Intersect a sector range with the pending block
+ */
+static bool ntfs_device_uefi_io_pendingoverlap(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, sec_t *first, sec_t *last)
+{
+	*first = MAX(sector, fd->pendingSector);
+	*last = MIN(sector + numSectors, fd->pendingSector + fd->pendingCount);
+
+	return (*first < *last);
+}
+
+/**
+ * Merge a partial block write into the pending block. Consecutive
+ * partial writes to the same physical block only cost one read and one
+ * write; the block reaches the disc when another block is partially
+ * written, or on sync and close.
+ */
+static bool ntfs_device_uefi_io_writepartial(struct ntfs_device *dev, s64 pos, u32 count, const void* buffer)
+{
+    struct _uefi_fd *fd = DEV_FD(dev);
+	sec_t sector = (sec_t) (pos / fd->sectorSize);
+	sec_t block = sector - (sector % fd->physicalSectors);
+
+	if (!fd->pendingValid || fd->pendingSector != block) {
+		if (!ntfs_device_uefi_io_flushpending(dev))
+			return false;
+
+		fd->pendingValid = false;
+		fd->pendingCount = (sec_t) MIN((u64) fd->physicalSectors, (u64) (fd->mediaSectors - block));
+		if (!ntfs_device_uefi_io_readsectors(dev, block, fd->pendingCount, fd->pending))
+			return false;
+
+		fd->pendingSector = block;
+		fd->pendingValid = true;
 	}
-    else
+
+	memcpy(fd->pending + (pos - (s64) (block * fd->sectorSize)), buffer, count);
+	fd->pendingDirty = true;
+
+	return true;
+}
+
+/**
+ * Write the pending block out (if dirty)
+ */
+static bool ntfs_device_uefi_io_flushpending(struct ntfs_device *dev)
+{
+    struct _uefi_fd *fd = DEV_FD(dev);
+	bool ok;
+
+	if (!fd->pendingDirty)
+		return true;
+
+	_NTFS_readahead_invalidate(fd->readahead, fd->pendingSector, fd->pendingCount);
+
+	if (fd->cache)
+		ok = _NTFS_cache_writeSectors(fd->cache, fd->pendingSector, fd->pendingCount, fd->pending);
+	else
+		ok = ntfs_device_uefi_io_writedisk(fd, fd->pendingSector, fd->pendingCount, fd->pending);
+
+	if (ok)
+		fd->pendingDirty = false;
+
+	return ok;
+}
+
+/**
+ * Read sectors from the cache (if enabled) or the DiskIo interface
+ */
+bool ntfs_device_uefi_io_readcached(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, void *buffer)
+{
+	if (fd->cache)
+		return _NTFS_cache_readSectors(fd->cache, sector, numSectors, buffer);
+
+	return ntfs_device_uefi_io_readdisk(fd, sector, numSectors, buffer);
+}
+
+/**
+ * Counters of the volume statistics the i/o in progress is accounted to
+ */
+static NTFS_IO_COUNTERS *ntfs_device_uefi_io_counters(struct _uefi_fd *fd, bool write)
+{
+	NTFS_IO_COUNTERS *_counters = write ? fd->interface->IoStatistics.Write : fd->interface->IoStatistics.Read;
+
+	if (fd->dev && fd->dev->d_origin < NTFS_IO_ORIGINS)
+		return _counters + fd->dev->d_origin;
+
+	return _counters + NTFS_IO_OTHER;
+}
+
+/**
+ * Performance counter at the start of a DiskIo request, 0 when not timed
+ */
+static UINT64 ntfs_device_uefi_io_now(struct _uefi_fd *fd)
+{
+	return fd->timed ? GetPerformanceCounter() : 0;
+}
+
+/**
+ * Nanoseconds elapsed since the performance counter read @start
+ */
+static UINT64 ntfs_device_uefi_io_elapsed(UINT64 start)
+{
+	UINT64 _now = GetPerformanceCounter();
+	UINT64 _first, _last;
+
+	GetPerformanceCounterProperties(&_first, &_last);
+
+	return GetTimeInNanoSecond((_last >= _first) ? (_now - start) : (start - _now));
+}
+
+/**
+ * Account one DiskIo request issued at performance counter @start
+ */
+static void ntfs_device_uefi_io_account(struct _uefi_fd *fd, bool write, UINT64 size, UINT64 start, EFI_STATUS status)
+{
+	NTFS_IO_COUNTERS *_counters = ntfs_device_uefi_io_counters(fd, write);
+	UINT64 _latency;
+	UINT64 _us;
+	UINT32 i;
+
+	_counters->Calls++;
+	if (EFI_ERROR(status))
+		_counters->Failures++;
+	else
+		_counters->Bytes += size;
+
+	for (i = 0; i < NTFS_IO_SIZE_BUCKETS - 1 && size > (512ULL << (2 * i)); i++)
+		;
+	_counters->SizeHistogram[i]++;
+
+	if (!fd->timed)
+		return;
+
+	_latency = ntfs_device_uefi_io_elapsed(start);
+	_us = _latency / 1000;
+	_counters->LatencyNs += _latency;
+	for (i = 0; i < NTFS_IO_LATENCY_BUCKETS - 1 && _us >= (1ULL << i); i++)
+		;
+	_counters->LatencyHistogram[i]++;
+}
+
+/**
+ * Read bytes straight from the DiskIo interface in a single accounted request
+ */
+static bool ntfs_device_uefi_io_readdisk_raw(struct _uefi_fd *fd, UINT64 offset, UINT64 size, void *buffer)
+{
+	EFI_DISK_IO_PROTOCOL *DiskIo = fd->interface->DiskIo;
+	UINT64 _start = ntfs_device_uefi_io_now(fd);
+	EFI_STATUS _status;
+
+	_status = DiskIo->ReadDisk(DiskIo, fd->interface->MediaId, offset, (UINTN) size, buffer);
+	ntfs_device_uefi_io_account(fd, false, size, _start, _status);
+
+	return !EFI_ERROR(_status);
+}
+
+/**
+ * Write bytes straight to the DiskIo interface in a single accounted request
+ */
+static bool ntfs_device_uefi_io_writedisk_raw(struct _uefi_fd *fd, UINT64 offset, UINT64 size, const void *buffer)
+{
+	EFI_DISK_IO_PROTOCOL *DiskIo = fd->interface->DiskIo;
+	UINT64 _start = ntfs_device_uefi_io_now(fd);
+	EFI_STATUS _status;
+
+	_status = DiskIo->WriteDisk(DiskIo, fd->interface->MediaId, offset, (UINTN) size, (VOID *) buffer);
+	ntfs_device_uefi_io_account(fd, true, size, _start, _status);
+
+	return !EFI_ERROR(_status);
+}
+
+/**
+ * Wait for the event of a DiskIo2 token, stalling between polls. Returns
+ * EFI_SUCCESS once it is signalled, EFI_TIMEOUT if it is still pending after
+ * UEFI_IO_TOKEN_TIMEOUT, or whatever else CheckEvent() returned.
+ */
+static EFI_STATUS ntfs_device_uefi_io_waittoken(EFI_DISK_IO2_TOKEN *token)
+{
+	EFI_STATUS _status;
+	UINT64 _waited = 0;
+
+	while ((_status = gBS->CheckEvent(token->Event)) == EFI_NOT_READY) {
+		if (_waited >= UEFI_IO_TOKEN_TIMEOUT)
+			return EFI_TIMEOUT;
+		gBS->Stall(UEFI_IO_POLL_INTERVAL);
+		_waited += UEFI_IO_POLL_INTERVAL;
+	}
+
+	return _status;
+}
+
+/**
+ * Create the DiskIo2 tokens of the pipeline on first use, one event each
+ * up to fd->queueDepth. Returns NULL if no event could be created.
+ */
+static struct _uefi_pipeline *ntfs_device_uefi_io_pipeline(struct _uefi_fd *fd)
+{
+	struct _uefi_pipeline *pipe = fd->pipeline;
+	UINT32 _depth = MIN(MAX(fd->queueDepth, 1), UEFI_IO_MAX_QUEUE_DEPTH);
+
+	if (pipe)
+		return pipe;
+
+	pipe = (struct _uefi_pipeline *) ntfs_alloc(sizeof(struct _uefi_pipeline));
+	if (!pipe)
+		return NULL;
+	memset(pipe, 0, sizeof(struct _uefi_pipeline));
+
+	for (pipe->depth = 0; pipe->depth < _depth; pipe->depth++) {
+		if (gBS->CreateEvent(0, TPL_NOTIFY, NULL, NULL, &pipe->tokens[pipe->depth].Event) != EFI_SUCCESS)
+			break;
+	}
+	if (pipe->depth == 0) {
+		ntfs_free(pipe);
+		return NULL;
+	}
+
+	fd->pipeline = pipe;
+	return pipe;
+}
+
+/**
+ * Close the events of the DiskIo2 tokens and free them. Tokens left pending
+ * by a cancel are checked once more; if the lower driver still owns one,
+ * the tokens are leaked rather than freed under it.
+ */
+static void ntfs_device_uefi_io_pipeline_free(struct _uefi_fd *fd)
+{
+	struct _uefi_pipeline *pipe = fd->pipeline;
+	UINT32 i;
+
+	if (!pipe)
+		return;
+	fd->pipeline = NULL;
+
+	for (i = 0; i < pipe->depth; i++) {
+		if (pipe->busy[i] && gBS->CheckEvent(pipe->tokens[i].Event) == EFI_SUCCESS) {
+			pipe->busy[i] = false;
+			pipe->stranded--;
+		}
+	}
+	if (pipe->stranded) {
+		ntfs_log_error("%u DiskIo2 requests never completed, leaking their tokens\n", pipe->stranded);
+		return;
+	}
+
+	for (i = 0; i < pipe->depth; i++)
+		gBS->CloseEvent(pipe->tokens[i].Event);
+	ntfs_free(pipe);
+}
+
+/**
+ * Read sectors through DiskIo2, keeping up to fd->queueDepth requests of
+ * fd->pipelineSectors in flight. A request only completes when its event
+ * is signalled. If a token cannot be waited for, the pipeline is turned off
+ * for the fd and the requests in flight are cancelled and drained; those the
+ * lower driver does not give back stay owned by it (fd->pipeline->stranded).
+ * Returns false if the read did not complete (*started tells whether any
+ * request was issued).
+ */
+static bool ntfs_device_uefi_io_readdisk_async(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, void *buffer, bool *started)
+{
+	EFI_DISK_IO2_PROTOCOL *DiskIo2 = fd->interface->DiskIo2;
+	struct _uefi_pipeline *pipe;
+	UINT32 _depth, _head = 0, _tail = 0, _inflight = 0;
+	EFI_STATUS _status = EFI_SUCCESS;
+	EFI_STATUS _wait;
+	sec_t _sectorRun;
+	UINT64 _bufferSize;
+
+	*started = false;
+
+	pipe = ntfs_device_uefi_io_pipeline(fd);
+	if (!pipe)
+		return false;
+	_depth = pipe->depth;
+
+	while (numSectors > 0 || _inflight > 0)
 	{
-		while(numSectors > 0)
+		// Fill the queue
+		while (numSectors > 0 && _inflight < _depth && !EFI_ERROR(_status))
 		{
-			_sectorStart = sector * fd->sectorSize;
-			_bufferSize = fd->sectorSize;
+			_sectorRun = MIN(numSectors, fd->pipelineSectors);
+			_bufferSize = _sectorRun * fd->sectorSize;
+
+			pipe->tokens[_tail].TransactionStatus = EFI_SUCCESS;
+			pipe->issued[_tail] = ntfs_device_uefi_io_now(fd);
+			pipe->sizes[_tail] = _bufferSize;
+			_status = DiskIo2->ReadDiskEx(DiskIo2, fd->interface->MediaId, sector * fd->sectorSize, &pipe->tokens[_tail], (UINTN) _bufferSize, buffer);
+			if (EFI_ERROR(_status)) {
+				ntfs_device_uefi_io_account(fd, false, _bufferSize, pipe->issued[_tail], _status);
+				break;
+			}
+
+			*started = true;
+			pipe->busy[_tail] = true;
+			_tail = (_tail + 1) % _depth;
+			_inflight++;
+
+			numSectors -= _sectorRun;
+			sector += _sectorRun;
+			buffer = CALC_OFFSET(void *, buffer, _bufferSize);
+		}
 
-			if (DiskIo->WriteDisk(DiskIo, fd->interface->MediaId, _sectorStart, _bufferSize, buffer) != EFI_SUCCESS)
-			{
-				return false;
+		if (_inflight == 0)
+			break;
+
+		// Retire the oldest request (completions are signalled from the lower driver)
+		_wait = ntfs_device_uefi_io_waittoken(&pipe->tokens[_head]);
+		if (_wait != EFI_SUCCESS) {
+			// Abort everything in flight and wait for the aborted tokens to be
+			// signalled; a token still pending keeps its request on the buffer
+			ntfs_log_debug("DiskIo2 token wait failed (%llx), cancelling %u requests\n", (u64) _wait, _inflight);
+			fd->pipelineOff = true;
+			DiskIo2->Cancel(DiskIo2);
+			for (; _inflight > 0; _inflight--) {
+				if (ntfs_device_uefi_io_waittoken(&pipe->tokens[_head]) == EFI_SUCCESS)
+					pipe->busy[_head] = false;
+				else
+					pipe->stranded++;
+				ntfs_device_uefi_io_account(fd, false, pipe->sizes[_head], pipe->issued[_head], EFI_ABORTED);
+				_head = (_head + 1) % _depth;
 			}
+			if (pipe->stranded)
+				ntfs_log_error("%u DiskIo2 requests still pending after cancel\n", pipe->stranded);
+			_status = EFI_ERROR(_wait) ? _wait : EFI_DEVICE_ERROR;
+			break;
+		}
+
+		pipe->busy[_head] = false;
+		ntfs_device_uefi_io_account(fd, false, pipe->sizes[_head], pipe->issued[_head], pipe->tokens[_head].TransactionStatus);
+		if (EFI_ERROR(pipe->tokens[_head].TransactionStatus) && !EFI_ERROR(_status))
+			_status = pipe->tokens[_head].TransactionStatus;
+
+		_head = (_head + 1) % _depth;
+		_inflight--;
+	}
+
+	if (EFI_ERROR(_status))
+		ntfs_log_trace("failed async I/O!");
+
+	return !EFI_ERROR(_status);
+}
+
+/**
+ * Read whole physical blocks straight from the DiskIo interface
+ */
+static bool ntfs_device_uefi_io_readdisk_direct(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, void *buffer)
+{
+	UINT64 _sectorStart, _bufferSize;
+	sec_t _sectorRun;
+	bool _started;
+
+	// Large reads are pipelined when DiskIo2 is available (and has not timed out)
+	if (fd->interface->DiskIo2 && !fd->pipelineOff && fd->queueDepth > 1 && numSectors > fd->pipelineSectors) {
+		if (ntfs_device_uefi_io_readdisk_async(fd, sector, numSectors, buffer, &_started))
+			return true;
+
+		// A request still pending may write to the buffer at any time, so the
+		// read fails rather than reusing it
+		if (fd->pipeline && fd->pipeline->stranded) {
+			ntfs_log_trace("failed async I/O, requests still pending!");
+			return false;
+		}
+
+		// A failed pipeline is retried once with plain synchronous requests
+		if (_started)
+			ntfs_device_uefi_io_counters(fd, false)->Retries++;
+	}
+
+	// One DiskIo request per contiguous run, split at the transfer limit
+	while(numSectors > 0)
+	{
+		_sectorRun = MIN(numSectors, (sec_t) fd->maxTransferSectors);
+		_sectorStart = sector * fd->sectorSize;
+		_bufferSize = _sectorRun * fd->sectorSize;
+
+		if (!ntfs_device_uefi_io_readdisk_raw(fd, _sectorStart, _bufferSize, buffer))
+		{
+			ntfs_log_trace("failed I/O!");
+			return false;
+		}
+
+		numSectors -= _sectorRun;	// decrease sector count
+		sector += _sectorRun;		// increase sector start
+		buffer = CALC_OFFSET(void *, buffer, _bufferSize);	// move ptr!
+	}
+
+	return true;
+}
+
+/**
+ * Read sectors that start or end inside a physical block: the whole block
+ * is read into the bounce block and the sectors wanted are copied out
+ */
+static bool ntfs_device_uefi_io_readpartial(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, void *buffer)
+{
+	sec_t _block = sector - (sector % fd->physicalSectors);
+	sec_t _count = (sec_t) MIN((u64) fd->physicalSectors, (u64) (fd->mediaSectors - _block));
+
+	// Past the end of the media there is no block to widen to
+	if (!fd->block || sector + numSectors > _block + _count)
+		return ntfs_device_uefi_io_readdisk_direct(fd, sector, numSectors, buffer);
+
+	if (!ntfs_device_uefi_io_readdisk_direct(fd, _block, _count, fd->block))
+		return false;
+
+	memcpy(buffer, fd->block + ((sector - _block) * fd->sectorSize), (size_t) (numSectors * fd->sectorSize));
+
+	return true;
+}
+
+/**
+ * Read sectors straight from the DiskIo interface, bypassing the cache.
+ * The partial physical blocks at either end are widened to whole blocks.
+ */
+bool ntfs_device_uefi_io_readdisk(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, void *buffer)
+{
+	sec_t _run;
 
-			numSectors--;	// decrease sector count
-			sector++;		// increase sector start
-			buffer = CALC_OFFSET(void *, buffer, fd->sectorSize);	// move ptr!
+	// Partial head block
+	if (sector % fd->physicalSectors) {
+		_run = MIN(numSectors, fd->physicalSectors - (sector % fd->physicalSectors));
+		if (!ntfs_device_uefi_io_readpartial(fd, sector, _run, buffer))
+			return false;
+
+		numSectors -= _run;
+		sector += _run;
+		buffer = CALC_OFFSET(void *, buffer, _run * fd->sectorSize);
+	}
+
+	// Whole blocks
+	_run = numSectors - (numSectors % fd->physicalSectors);
+	if (_run) {
+		if (!ntfs_device_uefi_io_readdisk_direct(fd, sector, _run, buffer))
+			return false;
+
+		numSectors -= _run;
+		sector += _run;
+		buffer = CALC_OFFSET(void *, buffer, _run * fd->sectorSize);
+	}
+
+	// Partial tail block
+	if (numSectors)
+		return ntfs_device_uefi_io_readpartial(fd, sector, numSectors, buffer);
+
+	return true;
+}
+
+/**
+ * Write sectors straight to the DiskIo interface, bypassing the cache
+ */
+bool ntfs_device_uefi_io_writedisk(struct _uefi_fd *fd, sec_t sector, sec_t numSectors, const void *buffer)
+{
+	UINT64	_sectorStart;
+	UINT64	_bufferSize;
+	sec_t	_sectorRun;
+
+	// One DiskIo request per contiguous run, split at the transfer limit
+	while(numSectors > 0)
+	{
+		_sectorRun = MIN(numSectors, (sec_t) fd->maxTransferSectors);
+		_sectorStart = sector * fd->sectorSize;
+		_bufferSize = _sectorRun * fd->sectorSize;
+
+		if (!ntfs_device_uefi_io_writedisk_raw(fd, _sectorStart, _bufferSize, buffer))
+		{
+			return false;
 		}
+
+		numSectors -= _sectorRun;	// decrease sector count
+		sector += _sectorRun;		// increase sector start
+		buffer = CALC_OFFSET(void *, buffer, _bufferSize);	// move ptr!
 	}
 
-    return true;
+	return true;
 }
 
 /**
@@ -577,15 +1252,24 @@ static int ntfs_device_uefi_io_sync(struct ntfs_device *dev)
         return -1;
     }
 
-    // Mark the device as clean
-    NDevClearDirty(dev);
-    NDevClearSync(dev);
+    // Write out any merged partial sector
+    if (!ntfs_device_uefi_io_flushpending(dev)) {
+        errno = EIO;
+        return -1;
+    }
 
     // Flush any sectors in the disc cache (if required)
     if (fd->cache) {
-		ntfs_log_trace("ntfs_device_uefi_io_sync cache enabled?!?!");
+        if (!_NTFS_cache_flush(fd->cache)) {
+            errno = EIO;
+            return -1;
+        }
     }
 
+    // Mark the device as clean
+    NDevClearDirty(dev);
+    NDevClearSync(dev);
+
     return 0;
 }
 
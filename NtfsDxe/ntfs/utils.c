@@ -65,8 +65,12 @@
 #include <ctype.h>
 #endif
 
+#ifndef LONG_MAX
 #define LONG_MAX 260
+#endif
+#ifndef isprint
 #define isprint(c) (c >= 32 && c <= 127) ? 1 : 0
+#endif
 #include "utils.h"
 #include "types.h"
 #include "volume.h"
@@ -84,6 +88,7 @@ const char *ntfs_gpl = "This program is free software, released under the GNU "
 	"\"COPYING\" distributed with this program, or online at:\n"
 	"http://www.gnu.org/copyleft/gpl.html\n";
 
+#ifdef DEBUG
 static const char *invalid_ntfs_msg =
 "The device '%s' doesn't have a valid NTFS.\n"
 "Maybe you selected the wrong device? Or the whole disk instead of a\n"
@@ -127,6 +132,7 @@ static const char *fakeraid_msg =
 "You seem to have a SoftRAID/FakeRAID hardware and must use an activated,\n"
 "different device under /dev/mapper, (e.g. /dev/mapper/nvidia_eahaabcc1)\n"
 "to mount NTFS. Please see the 'dmraid' documentation for help.\n";
+#endif
 
 /**
  * utils_set_locale
@@ -205,7 +211,7 @@ int ntfs_mbstoucs_libntfscompat(const char *ins,
 int utils_valid_device(const char *name, int force)
 {
 	unsigned long mnt_flags = 0;
-	struct stat st;
+	//struct stat st;
 
 #if defined(HAVE_WINDOWS_H) | defined(__CYGWIN32__) 
 	/* FIXME: This doesn't work for Cygwin, so just return success. */
@@ -279,7 +285,7 @@ ntfs_volume * utils_mount_volume(const char *device, unsigned long flags)
 	if (!utils_valid_device(device, flags & NTFS_MNT_RECOVER))
 		return NULL;
 
-	vol = ntfs_mount(device, flags);
+	vol = ntfs_mount(device, flags, NULL);
 	if (!vol) {
 		ntfs_log_perror("Failed to mount '%s'", device);
 		if (errno == EINVAL)
@@ -78,6 +78,7 @@
 const char *ntfs_home = 
 "News, support and information:  http://tuxera.com\n";
 
+#ifdef DEBUG
 static const char *invalid_ntfs_msg =
 "The device '%s' doesn't seem to have a valid NTFS.\n"
 "Maybe the wrong device is used? Or the whole disk instead of a\n"
@@ -116,6 +117,7 @@ static const char *access_denied_msg =
 "Please check '%s' and the ntfs-3g binary permissions,\n"
 "and the mounting user ID. More explanation is provided at\n"
 "http://tuxera.com/community/ntfs-3g-faq/#unprivileged\n";
+#endif
 
 /**
  * ntfs_volume_alloc - Create an NTFS volume object and initialise it
@@ -347,6 +349,7 @@ mft_has_no_attr_list:
 			goto error_exit;
 		}
 		vol->mft_na->rl = nrl;
+		ntfs_attr_forget_run_index(vol->mft_na);
 
 		/* Get the lowest vcn for the next extent. */
 		highest_vcn = sle64_to_cpu(a->highest_vcn);
@@ -952,6 +955,7 @@ ntfs_volume *ntfs_device_mount(struct ntfs_device *dev, ntfs_mount_flags flags)
 	ntfs_log_debug("Comparing $MFTMirr to $MFT...\n");
 	for (i = 0; i < vol->mftmirr_size; ++i) {
 		MFT_RECORD *mrec, *mrec2;
+#ifdef DEBUG
 		const char *ESTR[12] = { "$MFT", "$MFTMirr", "$LogFile",
 			"$Volume", "$AttrDef", "root directory", "$Bitmap",
 			"$Boot", "$BadClus", "$Secure", "$UpCase", "$Extend" };
@@ -963,6 +967,7 @@ ntfs_volume *ntfs_device_mount(struct ntfs_device *dev, ntfs_mount_flags flags)
 			s = "system file";
 		else
 			s = "mft record";
+#endif
 
 		mrec = (MFT_RECORD*)(m + i * vol->mft_record_size);
 		if (mrec->flags & MFT_RECORD_IN_USE) {
@@ -1357,7 +1362,7 @@ ntfs_volume *ntfs_mount(const char *name ,
 		ntfs_device_free(dev);
 		errno = eo;
 	} else
-		ntfs_create_lru_caches(vol);
+		ntfs_create_lru_caches(vol, (const struct CACHE_SIZES*)NULL);
 	return vol;
 #else
 	/*
@@ -269,6 +269,19 @@ struct _ntfs_volume {
 #if CACHE_LOOKUP_SIZE
 	struct CACHE_HEADER *lookup_cache;
 #endif
+#if CACHE_NEGATIVE_SIZE
+	struct CACHE_HEADER *negative_cache;
+	struct BLOOM_FILTER *negative_filter;
+#endif
+#if CACHE_MFTREC_SIZE
+	struct CACHE_HEADER *mftrec_cache;
+#endif
+#if CACHE_INDX_SIZE
+	struct CACHE_HEADER *indx_cache;
+#endif
+#if CACHE_RUNLIST_SIZE
+	struct CACHE_HEADER *runlist_cache;
+#endif
 #if CACHE_SECURID_SIZE
 	struct CACHE_HEADER *securid_cache;
 #endif
@@ -288,7 +301,8 @@ extern ntfs_volume *ntfs_volume_startup(struct ntfs_device *dev,
 extern ntfs_volume *ntfs_device_mount(struct ntfs_device *dev,
 		ntfs_mount_flags flags);
 
-extern ntfs_volume *ntfs_mount(const char *name, ntfs_mount_flags flags);
+extern ntfs_volume *ntfs_mount(const char *name, ntfs_mount_flags flags,
+		void *ptr);
 extern int ntfs_umount(ntfs_volume *vol, const BOOL force);
 
 extern int ntfs_version_is_supported(ntfs_volume *vol);
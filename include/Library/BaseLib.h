@@ -0,0 +1,62 @@
+/** @file
+  Provides string functions, linked list functions, math functions,
+  synchronization functions, file path functions, and CPU architecture-specific
+  functions. Only the string functions used by the driver glue are provided to
+  the host builds.
+
+  Copyright (c) 2006 - 2018, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __BASE_LIB__
+#define __BASE_LIB__
+
+/**
+  Returns the length of a Null-terminated Unicode string.
+
+  @param  String  A pointer to a Null-terminated Unicode string.
+
+  @return The length of String.
+
+**/
+UINTN
+EFIAPI
+StrLen (
+  IN CONST CHAR16  *String
+  );
+
+/**
+  Returns the size of a Null-terminated Unicode string in bytes, including the
+  Null terminator.
+
+  @param  String  A pointer to a Null-terminated Unicode string.
+
+  @return The size of String.
+
+**/
+UINTN
+EFIAPI
+StrSize (
+  IN CONST CHAR16  *String
+  );
+
+/**
+  Compares two Null-terminated Unicode strings, and returns the difference
+  between the first mismatched Unicode characters.
+
+  @param  FirstString   A pointer to a Null-terminated Unicode string.
+  @param  SecondString  A pointer to a Null-terminated Unicode string.
+
+  @retval 0      FirstString is identical to SecondString.
+  @return others FirstString is not identical to SecondString.
+
+**/
+INTN
+EFIAPI
+StrCmp (
+  IN CONST CHAR16  *FirstString,
+  IN CONST CHAR16  *SecondString
+  );
+
+#endif
@@ -0,0 +1,67 @@
+/** @file
+  Provides services to print debug and assert messages to a debug output
+  device. Only the print macro and the signature checked CR() used by the
+  driver glue are provided to the host builds.
+
+  Copyright (c) 2006 - 2018, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __DEBUG_LIB_H__
+#define __DEBUG_LIB_H__
+
+//
+// Declare bits for PcdDebugPrintErrorLevel and the ErrorLevel parameter of DebugPrint()
+//
+#define DEBUG_INIT      0x00000001  // Initialization
+#define DEBUG_WARN      0x00000002  // Warnings
+#define DEBUG_INFO      0x00000040  // Informational debug messages
+#define DEBUG_ERROR     0x80000000  // Error
+
+#define EFI_D_INIT      DEBUG_INIT
+#define EFI_D_WARN      DEBUG_WARN
+#define EFI_D_INFO      DEBUG_INFO
+#define EFI_D_ERROR     DEBUG_ERROR
+
+/**
+  Prints a debug message to the debug output device if the specified error level is enabled.
+
+  @param  ErrorLevel  The error level of the debug message.
+  @param  Format      The format string for the debug message to print.
+  @param  ...         The variable argument list whose contents are accessed
+                      based on the format string specified by Format.
+
+**/
+VOID
+EFIAPI
+DebugPrint (
+  IN  UINTN        ErrorLevel,
+  IN  CONST CHAR8  *Format,
+  ...
+  );
+
+/**
+  Macro that calls DebugPrint().
+
+  @param  Expression  Expression containing an error level, a format string,
+                      and a variable argument list based on the format string.
+
+**/
+#define DEBUG(Expression)  DebugPrint Expression
+
+/**
+  Macro that returns a pointer to the data structure that contains a specified field of
+  that data structure. The signature is not checked, as in a release build.
+
+  @param  Record         The pointer to the field specified by Field within a data
+                         structure of type TYPE.
+  @param  TYPE           The name of the data structure type to return.
+  @param  Field          The name of the field in the data structure specified by TYPE
+                         to which Record points.
+  @param  TestSignature  The 32-bit signature value to match.
+
+**/
+#define CR(Record, TYPE, Field, TestSignature)  BASE_CR (Record, TYPE, Field)
+
+#endif
@@ -0,0 +1,34 @@
+/** @file
+  Provides library functions for common UEFI operations. Only the lock type
+  used by the driver globals is provided to the host builds.
+
+  Copyright (c) 2006 - 2018, Intel Corporation. All rights reserved.<BR>
+  SPDX-License-Identifier: BSD-2-Clause-Patent
+
+**/
+
+#ifndef __UEFI_LIB_H__
+#define __UEFI_LIB_H__
+
+///
+/// EFI Lock Status
+///
+typedef enum {
+  EfiLockUninitialized = 0,
+  EfiLockReleased      = 1,
+  EfiLockAcquired      = 2
+} EFI_LOCK_STATE;
+
+///
+/// EFI Lock
+///
+typedef struct {
+  EFI_TPL           Tpl;
+  EFI_TPL           OwnerTpl;
+  EFI_LOCK_STATE    Lock;
+} EFI_LOCK;
+
+#define EFI_INITIALIZE_LOCK_VARIABLE(Priority) \
+  {Priority, TPL_APPLICATION, EfiLockReleased }
+
+#endif
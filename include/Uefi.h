@@ -1,7 +1,9 @@
 #pragma once
 
 #include <stdint.h>
+#ifdef _WIN32
 #include <basetsd.h>
+#endif
 
 #include "UefiBaseType.h"
 #include "UefiSpec.h"
@@ -21,5 +23,8 @@ typedef struct _list_entry {
 #include "Protocol/DriverBinding.h"
 #include "Protocol/BlockIo.h"
 #include "Protocol/DiskIo.h"
+#include "Protocol/DiskIo2.h"
 #include "Protocol/SimpleFileSystem.h"
+#include "Library/TimerLib.h"
+#include "Library/UefiLib.h"
 #include "FileInfo.h"
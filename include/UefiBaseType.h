@@ -19,10 +19,22 @@
 /* Some definitions for building */
 typedef uint32_t EFI_STATUS;
 
+typedef uint64_t	UINT64;
 typedef uint32_t	UINT32;
 typedef uint16_t	UINT16;
 typedef uint8_t		UINT8;
 
+#ifdef _LINUX_APPLICATION
+/* gcc/clang host build: natural width, built with -fshort-wchar */
+typedef uintptr_t	UINTN;
+typedef intptr_t	INTN;
+typedef int64_t		INT64;
+typedef int32_t		INT32;
+
+#define EFIAPI
+typedef char CHAR8;
+typedef unsigned short CHAR16;
+#else
 typedef unsigned int	UINTN;
 
 #define EFIAPI __stdcall
@@ -33,13 +45,54 @@ typedef wchar_t CHAR16;
 #else
 typedef short CHAR16;
 #endif
+#endif
 
 #define GLOBAL_REMOVE_IF_UNREFERENCED
 #define EFI_HANDLE void*
 #define EFI_EVENT void*
 
+#define CONST const
+
 #define EFI_SUCCESS		0x00000000
+#define EFI_INVALID_PARAMETER	0x80000002
 #define EFI_UNSUPPORTED 0x80000003
+#define EFI_BAD_BUFFER_SIZE	0x80000004
+#define EFI_BUFFER_TOO_SMALL	0x80000005
+#define EFI_NOT_READY	0x80000006
+#define EFI_DEVICE_ERROR	0x80000007
+#define EFI_WRITE_PROTECTED	0x80000008
+#define EFI_OUT_OF_RESOURCES	0x80000009
+#define EFI_VOLUME_CORRUPTED	0x8000000A
+#define EFI_VOLUME_FULL	0x8000000B
+#define EFI_NO_MEDIA	0x8000000C
+#define EFI_MEDIA_CHANGED	0x8000000D
+#define EFI_NOT_FOUND	0x8000000E
+#define EFI_ACCESS_DENIED	0x8000000F
+#define EFI_TIMEOUT		0x80000012
+#define EFI_ABORTED		0x80000015
+
+#define EFI_ERROR(a)	(((EFI_STATUS)(a) & 0x80000000) != 0)
+
+#define MIN(a, b)		(((a) < (b)) ? (a) : (b))
+#define MAX(a, b)		(((a) > (b)) ? (a) : (b))
+
+#define MAX_UINTN		((UINTN)-1)
+
+#define SIGNATURE_16(A, B)			((A) | ((B) << 8))
+#define SIGNATURE_32(A, B, C, D)	(SIGNATURE_16 (A, B) | (SIGNATURE_16 (C, D) << 16))
+
+#if defined(__GNUC__) || defined(__clang__)
+#define OFFSET_OF(TYPE, Field)	((UINTN) __builtin_offsetof (TYPE, Field))
+#else
+#define OFFSET_OF(TYPE, Field)	((UINTN) &(((TYPE *)0)->Field))
+#endif
+#define BASE_CR(Record, TYPE, Field)	((TYPE *) ((CHAR8 *) (Record) - OFFSET_OF (TYPE, Field)))
+
+typedef UINTN EFI_TPL;
+
+#define TPL_APPLICATION	4
+#define TPL_CALLBACK	8
+#define TPL_NOTIFY		16
 
 struct _EFI_COMPONENT_NAME_PROTOCOL;
 
@@ -59,10 +112,10 @@ typedef struct _EFI_COMPONENT_NAME_PROTOCOL {
 
 typedef struct _EFI_UNICODE_STRING_TABLE {
 	const char* ascii;
-	const wchar_t* unicode;
+	const CHAR16* unicode;
 } EFI_UNICODE_STRING_TABLE;
 
-typedef unsigned __int64	EFI_LBA;
+typedef UINT64	EFI_LBA;
 
 typedef struct _EFI_TIME {
 	char dummy;
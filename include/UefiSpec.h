@@ -3,3 +3,32 @@
 typedef struct _EFI_SYSTEM_TABLE {
 	char dummy;
 } EFI_SYSTEM_TABLE;
+
+/* Event and stall services used by the pipelined DiskIo2 path; the host harness supplies gBS */
+typedef VOID(EFIAPI* EFI_EVENT_NOTIFY)(IN EFI_EVENT Event, IN VOID* Context);
+
+typedef EFI_STATUS(EFIAPI* EFI_CREATE_EVENT)(
+	IN  UINT32				Type,
+	IN  EFI_TPL				NotifyTpl,
+	IN  EFI_EVENT_NOTIFY	NotifyFunction OPTIONAL,
+	IN  VOID*				NotifyContext OPTIONAL,
+	OUT EFI_EVENT*			Event
+	);
+typedef EFI_STATUS(EFIAPI* EFI_CHECK_EVENT)(IN EFI_EVENT Event);
+typedef EFI_STATUS(EFIAPI* EFI_CLOSE_EVENT)(IN EFI_EVENT Event);
+typedef EFI_STATUS(EFIAPI* EFI_STALL)(IN UINTN Microseconds);
+
+/* Protocol installation, used by the driver glue only */
+typedef EFI_STATUS(EFIAPI* EFI_INSTALL_MULTIPLE_PROTOCOL_INTERFACES)(IN OUT EFI_HANDLE* Handle, ...);
+typedef EFI_STATUS(EFIAPI* EFI_UNINSTALL_MULTIPLE_PROTOCOL_INTERFACES)(IN EFI_HANDLE Handle, ...);
+
+typedef struct _EFI_BOOT_SERVICES {
+	EFI_CREATE_EVENT	CreateEvent;
+	EFI_CHECK_EVENT		CheckEvent;
+	EFI_CLOSE_EVENT		CloseEvent;
+	EFI_STALL			Stall;
+	EFI_INSTALL_MULTIPLE_PROTOCOL_INTERFACES	InstallMultipleProtocolInterfaces;
+	EFI_UNINSTALL_MULTIPLE_PROTOCOL_INTERFACES	UninstallMultipleProtocolInterfaces;
+} EFI_BOOT_SERVICES;
+
+extern EFI_BOOT_SERVICES* gBS;
@@ -0,0 +1,1760 @@
+/**
+ * main.c - Host harness for the NTFS core.
+ *
+ * Mounts a raw NTFS volume image through the host image device
+ * (ntfs/image_io.c, plain or memory mapped) or through the UEFI device layer
+ * (ntfs/uefi_io.c) on top of a file backed DiskIo/DiskIo2/BlockIo stand-in,
+ * then walks the tree and reads every file so the whole read path can be
+ * profiled off firmware (ntfspkg-test.sln on Windows, Makefile on Linux).
+ * Under -u the DiskIo requests and bytes of every pass are printed, -n
+ * turns coalescing off by capping each request at one physical block, and -T
+ * stands in for the null TimerLib, so latencies must be reported unavailable.
+ * With -e every data stream is also checked against its extent map, and with
+ * -x the extent maps of known streams against a list (mkfixture.py builds an
+ * image with fixed contents and its list), and with -d every directory is
+ * listed through the resumable cursor of the driver as well, twice with a
+ * rewind in between, and compared. With -b it benchmarks the runlist
+ * lookups instead, with -t it checks that the UEFI device layer only sends
+ * whole physical blocks to 512n, 512e and 4Kn media, and with -a it checks
+ * the DiskIo2 pipeline against late, reordered and failed completions.
+ *
+ * This program/include file is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program/include file is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "Ntfs.h"
+#include "ntfs/ntfs.h"
+#include "ntfs/image_io.h"
+#include "ntfs/dir.h"
+#include "ntfs/ntfsdir.h"
+#include "ntfs/attrib.h"
+#include "ntfs/cache.h"
+#include "ntfs/gekko_io.h"
+#include "ntfs/mem_allocate.h"
+
+#define HOST_READ_CHUNK     0x100000
+
+#ifndef O_BINARY
+#define O_BINARY            0
+#endif
+
+#ifdef _WIN32
+#define host_open           _open
+#define host_close          _close
+#define host_seek           _lseeki64
+#define host_read           _read
+#define host_write          _write
+#else
+#define host_open           open
+#define host_close          close
+#define host_seek           lseek
+#define host_read           read
+#define host_write          write
+#endif
+
+/*
+ * TimerLib stand-in, the performance counter ticks in nanoseconds. With -T it
+ * behaves like the null TimerLib of NtfsPkg.dsc: the counter reads 0 and its
+ * range is left unset.
+ */
+static bool host_null_timer = false;
+
+UINT64 EFIAPI GetPerformanceCounter(VOID)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+
+    if (host_null_timer)
+        return 0;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (UINT64) ((double) count.QuadPart * 1e9 / (double) freq.QuadPart);
+#else
+    struct timespec ts;
+
+    if (host_null_timer)
+        return 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UINT64) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+UINT64 EFIAPI GetPerformanceCounterProperties(UINT64 *StartValue, UINT64 *EndValue)
+{
+    if (host_null_timer)
+        return (UINT64) -1;
+    if (StartValue)
+        *StartValue = 0;
+    if (EndValue)
+        *EndValue = (UINT64) -1;
+    return 1000000000ULL;
+}
+
+UINT64 EFIAPI GetTimeInNanoSecond(UINT64 Ticks)
+{
+    if (host_null_timer)
+        return 0;
+    return Ticks;
+}
+
+/*
+ * File or memory backed DiskIo/DiskIo2/BlockIo stand-in. Every request is
+ * recorded and checked against the physical block of the media: the device
+ * layer must only ask for whole physical blocks, aligned on the media.
+ */
+#define HOST_READ_DISK      0
+#define HOST_WRITE_DISK     1
+#define HOST_READ_DISK_EX   2
+
+#define HOST_QUEUE_MAX      32
+
+typedef struct _HOST_REQUEST {
+    UINT32                  Op;
+    UINT64                  Offset;
+    UINT64                  Size;
+} HOST_REQUEST;
+
+typedef struct _HOST_TOKEN {
+    EFI_DISK_IO2_TOKEN      *Token;
+    UINT64                  Offset;
+    UINTN                   Size;
+    VOID                    *Buffer;
+} HOST_TOKEN;
+
+typedef struct _HOST_DISK {
+    EFI_DISK_IO_PROTOCOL    DiskIo;
+    EFI_DISK_IO2_PROTOCOL   DiskIo2;
+    EFI_BLOCK_IO_PROTOCOL   BlockIo;
+    EFI_BLOCK_IO_MEDIA      Media;
+    int                     fd;
+    u8                      *Memory;        /* Memory backed image (no file) */
+    u64                     Size;
+    HOST_REQUEST            *Requests;      /* Every request, in the order issued */
+    UINTN                   RequestCount;
+    UINTN                   RequestMax;
+    u64                     Misshapen;      /* Requests not made of whole, aligned physical blocks */
+
+    // DiskIo2 behaviour (all off: requests complete before ReadDiskEx returns)
+    BOOLEAN                 Deferred;       /* Queue requests, they complete from the event loop */
+    BOOLEAN                 OutOfOrder;     /* Complete queued requests in random order */
+    BOOLEAN                 Stuck;          /* Queued requests only complete when cancelled */
+    BOOLEAN                 IgnoreCancel;   /* Cancel leaves the queued requests pending */
+    UINT32                  FailEvery;      /* Every n-th completion fails with EFI_DEVICE_ERROR */
+    UINT32                  SubmitFailAt;   /* The n-th ReadDiskEx call fails outright */
+    UINT32                  CheckFailAt;    /* The n-th CheckEvent call fails */
+    HOST_TOKEN              Queue[HOST_QUEUE_MAX];
+    UINTN                   Queued;
+    UINT32                  Submitted;
+    UINT32                  Completed;
+    UINT32                  CheckCalls;
+    UINT32                  Cancels;
+    u64                     Seed;
+} HOST_DISK;
+
+/*
+ * Media geometries of the -g option and of the request shape test
+ */
+typedef struct _HOST_GEOMETRY {
+    const char              *Name;
+    UINT32                  BlockSize;
+    UINT32                  LogicalBlocksPerPhysicalBlock;
+    UINT32                  IoAlign;
+    UINT32                  OptimalTransferLengthGranularity;
+} HOST_GEOMETRY;
+
+static const HOST_GEOMETRY host_geometries[] = {
+    { "512n",   512, 1,  4,  0 },
+    { "512e",   512, 8,  8, 64 },
+    { "4kn",   4096, 1, 16,  8 },
+};
+
+#define HOST_DISK_FROM_DISKIO(a)    ((HOST_DISK *) (a))
+#define HOST_DISK_FROM_DISKIO2(a)   ((HOST_DISK *) ((char *) (a) - offsetof(HOST_DISK, DiskIo2)))
+
+static UINT64 HostDiskPhysicalBlock(HOST_DISK *Disk)
+{
+    return (UINT64) Disk->Media.BlockSize * MAX(Disk->Media.LogicalBlocksPerPhysicalBlock, 1);
+}
+
+static void HostDiskRecord(HOST_DISK *Disk, UINT32 Op, UINT64 Offset, UINT64 Size)
+{
+    static const char *ops[] = { "ReadDisk", "WriteDisk", "ReadDiskEx" };
+    UINT64 block = HostDiskPhysicalBlock(Disk);
+    HOST_REQUEST *requests;
+
+    if (!Size || (Offset % block) || (Size % block)) {
+        if (Disk->Misshapen++ < 8)
+            fprintf(stderr, "%s @ %llu (%llu bytes) is not made of whole %llu byte blocks\n", ops[Op],
+                    (unsigned long long) Offset, (unsigned long long) Size, (unsigned long long) block);
+    }
+
+    if (Disk->RequestCount == Disk->RequestMax) {
+        UINTN max = Disk->RequestMax ? 2 * Disk->RequestMax : 1024;
+        requests = (HOST_REQUEST *) realloc(Disk->Requests, max * sizeof(HOST_REQUEST));
+        if (!requests)
+            return;
+        Disk->Requests = requests;
+        Disk->RequestMax = max;
+    }
+    Disk->Requests[Disk->RequestCount].Op = Op;
+    Disk->Requests[Disk->RequestCount].Offset = Offset;
+    Disk->Requests[Disk->RequestCount].Size = Size;
+    Disk->RequestCount++;
+}
+
+static EFI_STATUS HostDiskTransfer(HOST_DISK *Disk, UINT64 Offset, UINTN BufferSize, VOID *Buffer, BOOLEAN Write)
+{
+    UINTN done = 0;
+
+    if (Disk->Memory) {
+        if (Offset > Disk->Size || BufferSize > Disk->Size - Offset)
+            return EFI_DEVICE_ERROR;
+        if (Write)
+            memcpy(Disk->Memory + Offset, Buffer, BufferSize);
+        else
+            memcpy(Buffer, Disk->Memory + Offset, BufferSize);
+        return EFI_SUCCESS;
+    }
+
+    while (done < BufferSize) {
+        int ret;
+        if (host_seek(Disk->fd, Offset + done, SEEK_SET) < 0)
+            return EFI_DEVICE_ERROR;
+        ret = Write ? host_write(Disk->fd, (char *) Buffer + done, BufferSize - done)
+                    : host_read(Disk->fd, (char *) Buffer + done, BufferSize - done);
+        if (ret <= 0)
+            return EFI_DEVICE_ERROR;
+        done += ret;
+    }
+
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostReadDisk(EFI_DISK_IO_PROTOCOL *This, UINT32 MediaId, UINT64 Offset, UINTN BufferSize, VOID *Buffer)
+{
+    HostDiskRecord(HOST_DISK_FROM_DISKIO(This), HOST_READ_DISK, Offset, BufferSize);
+    return HostDiskTransfer(HOST_DISK_FROM_DISKIO(This), Offset, BufferSize, Buffer, FALSE);
+}
+
+static EFI_STATUS EFIAPI HostWriteDisk(EFI_DISK_IO_PROTOCOL *This, UINT32 MediaId, UINT64 Offset, UINTN BufferSize, VOID *Buffer)
+{
+    HostDiskRecord(HOST_DISK_FROM_DISKIO(This), HOST_WRITE_DISK, Offset, BufferSize);
+    return HostDiskTransfer(HOST_DISK_FROM_DISKIO(This), Offset, BufferSize, Buffer, TRUE);
+}
+
+/*
+ * Events are flags; the event loop runs whenever an event is checked or the
+ * caller stalls, and completes one queued DiskIo2 request of host_queue_disk
+ */
+typedef struct _HOST_EVENT {
+    BOOLEAN                 Signalled;
+} HOST_EVENT;
+
+static HOST_DISK *host_queue_disk;
+static int host_events;
+
+static void HostTokenSignal(EFI_DISK_IO2_TOKEN *Token, EFI_STATUS Status)
+{
+    Token->TransactionStatus = Status;
+    if (Token->Event)
+        ((HOST_EVENT *) Token->Event)->Signalled = TRUE;
+}
+
+static void HostDiskPoll(HOST_DISK *Disk)
+{
+    HOST_TOKEN token;
+    EFI_STATUS Status;
+    UINTN i = 0;
+
+    if (!Disk->Queued || Disk->Stuck)
+        return;
+
+    if (Disk->OutOfOrder) {
+        Disk->Seed = Disk->Seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        i = (UINTN) ((Disk->Seed >> 33) % Disk->Queued);
+    }
+    token = Disk->Queue[i];
+    memmove(&Disk->Queue[i], &Disk->Queue[i + 1], (Disk->Queued - i - 1) * sizeof(HOST_TOKEN));
+    Disk->Queued--;
+
+    Disk->Completed++;
+    if (Disk->FailEvery && !(Disk->Completed % Disk->FailEvery))
+        Status = EFI_DEVICE_ERROR;
+    else
+        Status = HostDiskTransfer(Disk, token.Offset, token.Size, token.Buffer, FALSE);
+    HostTokenSignal(token.Token, Status);
+}
+
+static EFI_STATUS EFIAPI HostCancelEx(EFI_DISK_IO2_PROTOCOL *This)
+{
+    HOST_DISK *Disk = HOST_DISK_FROM_DISKIO2(This);
+    UINTN i;
+
+    Disk->Cancels++;
+    if (Disk->IgnoreCancel)
+        return EFI_SUCCESS;
+    for (i = 0; i < Disk->Queued; i++)
+        HostTokenSignal(Disk->Queue[i].Token, EFI_ABORTED);
+    Disk->Queued = 0;
+
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostReadDiskEx(EFI_DISK_IO2_PROTOCOL *This, UINT32 MediaId, UINT64 Offset, EFI_DISK_IO2_TOKEN *Token, UINTN BufferSize, VOID *Buffer)
+{
+    HOST_DISK *Disk = HOST_DISK_FROM_DISKIO2(This);
+    EFI_STATUS Status;
+
+    HostDiskRecord(Disk, HOST_READ_DISK_EX, Offset, BufferSize);
+    if (++Disk->Submitted == Disk->SubmitFailAt)
+        return EFI_DEVICE_ERROR;
+
+    if (Disk->Deferred && Token && Token->Event) {
+        if (Disk->Queued == HOST_QUEUE_MAX)
+            return EFI_OUT_OF_RESOURCES;
+        Disk->Queue[Disk->Queued].Token = Token;
+        Disk->Queue[Disk->Queued].Offset = Offset;
+        Disk->Queue[Disk->Queued].Size = BufferSize;
+        Disk->Queue[Disk->Queued].Buffer = Buffer;
+        Disk->Queued++;
+        return EFI_SUCCESS;
+    }
+
+    Status = HostDiskTransfer(Disk, Offset, BufferSize, Buffer, FALSE);
+    if (Token)
+        HostTokenSignal(Token, Status);
+    return Status;
+}
+
+static EFI_STATUS EFIAPI HostWriteDiskEx(EFI_DISK_IO2_PROTOCOL *This, UINT32 MediaId, UINT64 Offset, EFI_DISK_IO2_TOKEN *Token, UINTN BufferSize, VOID *Buffer)
+{
+    EFI_STATUS Status;
+
+    HostDiskRecord(HOST_DISK_FROM_DISKIO2(This), HOST_WRITE_DISK, Offset, BufferSize);
+    Status = HostDiskTransfer(HOST_DISK_FROM_DISKIO2(This), Offset, BufferSize, Buffer, TRUE);
+    if (Token)
+        HostTokenSignal(Token, Status);
+    return Status;
+}
+
+static EFI_STATUS EFIAPI HostFlushDiskEx(EFI_DISK_IO2_PROTOCOL *This, EFI_DISK_IO2_TOKEN *Token)
+{
+    if (Token)
+        HostTokenSignal(Token, EFI_SUCCESS);
+    return EFI_SUCCESS;
+}
+
+static void HostDiskSetup(HOST_DISK *Disk, s64 size, UINT32 BlockSize, UINT32 LogicalBlocksPerPhysicalBlock,
+                          UINT32 IoAlign, UINT32 OptimalTransferLengthGranularity)
+{
+    Disk->Size = size;
+
+    Disk->DiskIo.Revision = EFI_DISK_IO_PROTOCOL_REVISION;
+    Disk->DiskIo.ReadDisk = HostReadDisk;
+    Disk->DiskIo.WriteDisk = HostWriteDisk;
+
+    Disk->DiskIo2.Revision = EFI_DISK_IO2_PROTOCOL_REVISION;
+    Disk->DiskIo2.Cancel = HostCancelEx;
+    Disk->DiskIo2.ReadDiskEx = HostReadDiskEx;
+    Disk->DiskIo2.WriteDiskEx = HostWriteDiskEx;
+    Disk->DiskIo2.FlushDiskEx = HostFlushDiskEx;
+
+    Disk->Media.MediaPresent = TRUE;
+    Disk->Media.LogicalPartition = TRUE;
+    Disk->Media.ReadOnly = Disk->Memory ? FALSE : TRUE;
+    Disk->Media.BlockSize = BlockSize;
+    Disk->Media.LastBlock = (size / BlockSize) - 1;
+    Disk->Media.IoAlign = IoAlign;
+    Disk->Media.LogicalBlocksPerPhysicalBlock = LogicalBlocksPerPhysicalBlock;
+    Disk->Media.OptimalTransferLengthGranularity = OptimalTransferLengthGranularity;
+    Disk->BlockIo.Revision = EFI_BLOCK_IO_PROTOCOL_REVISION3;
+    Disk->BlockIo.Media = &Disk->Media;
+}
+
+/*
+ * Open an image file read-only as a disk of the given geometry
+ */
+static HOST_DISK *HostDiskOpen(const char *path, UINT32 BlockSize, UINT32 LogicalBlocksPerPhysicalBlock,
+                               UINT32 IoAlign, UINT32 OptimalTransferLengthGranularity)
+{
+    HOST_DISK *Disk;
+
+    Disk = (HOST_DISK *) calloc(1, sizeof(HOST_DISK));
+    if (!Disk)
+        return NULL;
+
+    Disk->fd = host_open(path, O_RDONLY | O_BINARY);
+    if (Disk->fd < 0) {
+        free(Disk);
+        return NULL;
+    }
+
+    HostDiskSetup(Disk, host_seek(Disk->fd, 0, SEEK_END), BlockSize, LogicalBlocksPerPhysicalBlock,
+                  IoAlign, OptimalTransferLengthGranularity);
+    return Disk;
+}
+
+/*
+ * Create a zeroed, writable memory disk of the given geometry
+ */
+static HOST_DISK *HostDiskCreate(u64 size, UINT32 BlockSize, UINT32 LogicalBlocksPerPhysicalBlock,
+                                 UINT32 IoAlign, UINT32 OptimalTransferLengthGranularity)
+{
+    HOST_DISK *Disk;
+
+    Disk = (HOST_DISK *) calloc(1, sizeof(HOST_DISK));
+    if (!Disk)
+        return NULL;
+
+    Disk->fd = -1;
+    Disk->Memory = (u8 *) calloc(1, (size_t) size);
+    if (!Disk->Memory) {
+        free(Disk);
+        return NULL;
+    }
+
+    HostDiskSetup(Disk, size, BlockSize, LogicalBlocksPerPhysicalBlock, IoAlign, OptimalTransferLengthGranularity);
+    return Disk;
+}
+
+static void HostDiskClose(HOST_DISK *Disk)
+{
+    if (Disk->fd >= 0)
+        host_close(Disk->fd);
+    free(Disk->Memory);
+    free(Disk->Requests);
+    free(Disk);
+}
+
+/*
+ * Boot Services stand-in. Stalls do not sleep, they only run the event loop.
+ */
+static EFI_STATUS EFIAPI HostCreateEvent(UINT32 Type, EFI_TPL NotifyTpl, EFI_EVENT_NOTIFY NotifyFunction, VOID *NotifyContext, EFI_EVENT *Event)
+{
+    *Event = calloc(1, sizeof(HOST_EVENT));
+    if (!*Event)
+        return EFI_OUT_OF_RESOURCES;
+    host_events++;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostCheckEvent(EFI_EVENT Event)
+{
+    HOST_EVENT *event = (HOST_EVENT *) Event;
+
+    if (host_queue_disk) {
+        if (++host_queue_disk->CheckCalls == host_queue_disk->CheckFailAt)
+            return EFI_INVALID_PARAMETER;
+        HostDiskPoll(host_queue_disk);
+    }
+
+    if (!event->Signalled)
+        return EFI_NOT_READY;
+    event->Signalled = FALSE;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostCloseEvent(EFI_EVENT Event)
+{
+    free(Event);
+    host_events--;
+    return EFI_SUCCESS;
+}
+
+static EFI_STATUS EFIAPI HostStall(UINTN Microseconds)
+{
+    if (host_queue_disk)
+        HostDiskPoll(host_queue_disk);
+    return EFI_SUCCESS;
+}
+
+static EFI_BOOT_SERVICES HostBootServices = {
+    HostCreateEvent,
+    HostCheckEvent,
+    HostCloseEvent,
+    HostStall,
+};
+
+EFI_BOOT_SERVICES *gBS = &HostBootServices;
+
+/*
+ * Tree walk
+ */
+typedef struct _WALK_STATS {
+    u64 dirs;
+    u64 files;
+    u64 bytes;
+    u64 errors;
+} WALK_STATS;
+
+typedef struct _WALK_DIR {
+    char **names;
+    int count;
+    int size;
+} WALK_DIR;
+
+static int walk_filldir(void *dirent, const ntfschar *name, const int name_len, const int name_type, const s64 pos, const MFT_REF mref, const unsigned dt_type)
+{
+    WALK_DIR *dir = (WALK_DIR *) dirent;
+    char *mbs = NULL;
+
+    // Skip DOS aliases, the dot entries and the metadata files
+    if (name_type == FILE_NAME_DOS)
+        return 0;
+    if (name[0] == const_cpu_to_le16('.') && (name_len == 1 || (name_len == 2 && name[1] == const_cpu_to_le16('.'))))
+        return 0;
+    if (MREF(mref) < FILE_first_user)
+        return 0;
+
+    if (dir->count == dir->size) {
+        char **names = (char **) realloc(dir->names, (dir->size ? dir->size * 2 : 64) * sizeof(char *));
+        if (!names)
+            return -1;
+        dir->names = names;
+        dir->size = dir->size ? dir->size * 2 : 64;
+    }
+    if (ntfs_ucstombs(name, name_len, &mbs, 0) < 0)
+        return -1;
+    dir->names[dir->count++] = mbs;
+
+    return 0;
+}
+
+/* Read every file in one ntfs_attr_load() call instead of by chunks */
+static bool walk_load = false;
+
+/* Check the extent map of every data stream against its contents */
+static bool walk_extents = false;
+
+/* Check the listing of every directory through the driver's cursor */
+static bool walk_cursor = false;
+
+/*
+ * Directory cursor check
+ *
+ * With -d every directory is also listed the way the driver lists it for
+ * EFI_FILE_PROTOCOL.Read(): ntfs_diropen_r() and ntfs_dirnext_r() walk the
+ * index in batches, then ntfs_dirreset_r() rewinds and the walk is done
+ * again. Both listings must hold, in index order, the first name of every
+ * inode ntfs_readdir() reports (hard links are listed once, DOS aliases
+ * never), less the hidden and system files the volume does not show.
+ */
+typedef struct _CURSOR_LIST {
+    char **names;
+    u64 *mrefs;
+    int count;
+    int size;
+} CURSOR_LIST;
+
+static int cursor_filldir(void *dirent, const ntfschar *name, const int name_len, const int name_type, const s64 pos, const MFT_REF mref, const unsigned dt_type)
+{
+    CURSOR_LIST *list = (CURSOR_LIST *) dirent;
+    char *mbs = NULL;
+    int i;
+
+    if (name_type == FILE_NAME_DOS)
+        return 0;
+    if (name[0] == const_cpu_to_le16('.') && (name_len == 1 || (name_len == 2 && name[1] == const_cpu_to_le16('.'))))
+        return 0;
+    if (MREF(mref) < FILE_first_user)
+        return 0;
+    for (i = 0; i < list->count; i++)
+        if (list->mrefs[i] == MREF(mref))
+            return 0;
+
+    if (list->count == list->size) {
+        int size = list->size ? list->size * 2 : 64;
+        char **names = (char **) realloc(list->names, size * sizeof(char *));
+        u64 *mrefs = names ? (u64 *) realloc(list->mrefs, size * sizeof(u64)) : NULL;
+        if (names)
+            list->names = names;
+        if (!mrefs)
+            return -1;
+        list->mrefs = mrefs;
+        list->size = size;
+    }
+    if (ntfs_ucstombs(name, name_len, &mbs, 0) < 0)
+        return -1;
+    list->names[list->count] = mbs;
+    list->mrefs[list->count++] = MREF(mref);
+
+    return 0;
+}
+
+static u64 cursor_pass(ntfs_dir_state *dir, const CURSOR_LIST *expected, const char *path, const char *pass)
+{
+    struct _reent r;
+    char *mbs;
+    int i = 0;
+
+    memset(&r, 0, sizeof(r));
+    while (dir->current) {
+        mbs = NULL;
+        if (ntfs_ucstombs(dir->current->name, dir->current->nameLen, &mbs, 0) < 0)
+            return 1;
+        if (strcmp(mbs, ".") && strcmp(mbs, "..")) {
+            if (i >= expected->count || strcmp(mbs, expected->names[i])) {
+                fprintf(stderr, "%s: %s listing has %s at %d, expected %s\n", path, pass, mbs, i,
+                        i < expected->count ? expected->names[i] : "the end");
+                free(mbs);
+                return 1;
+            }
+            i++;
+        }
+        free(mbs);
+        if (ntfs_dirnext_r(&r, dir, NULL, NULL)) {
+            fprintf(stderr, "%s: %s listing stops after %d entries: %s\n", path, pass, i, strerror(r._errno));
+            return 1;
+        }
+    }
+    if (i != expected->count) {
+        fprintf(stderr, "%s: %s listing ends after %d of %d entries\n", path, pass, i, expected->count);
+        return 1;
+    }
+
+    return 0;
+}
+
+static u64 check_cursor(ntfs_vd *vd, ntfs_inode *dir_ni, const char *path)
+{
+    CURSOR_LIST expected = { NULL, NULL, 0, 0 };
+    ntfs_dir_state *dir;
+    struct _reent r;
+    ntfs_inode *ni;
+    s64 pos = 0;
+    u64 errors = 0;
+    int i, j;
+
+    if (ntfs_readdir(dir_ni, &pos, &expected, cursor_filldir))
+        errors++;
+
+    // Drop what the volume does not show
+    for (i = j = 0; i < expected.count; i++) {
+        ni = ntfs_inode_open(vd->vol, expected.mrefs[i]);
+        if (ni && !((ni->flags & FILE_ATTR_HIDDEN) && !vd->showHiddenFiles) &&
+            !((ni->flags & FILE_ATTR_SYSTEM) && !vd->showSystemFiles)) {
+            expected.names[j] = expected.names[i];
+            expected.mrefs[j++] = expected.mrefs[i];
+        } else {
+            free(expected.names[i]);
+        }
+        if (ni)
+            ntfs_inode_close(ni);
+    }
+    expected.count = j;
+
+    memset(&r, 0, sizeof(r));
+    dir = (ntfs_dir_state *) calloc(1, sizeof(ntfs_dir_state));
+    if (dir) {
+        dir->vd = vd;
+        dir->ni = ntfs_inode_open(vd->vol, dir_ni->mft_no);
+    }
+    if (!dir || !dir->ni || !ntfs_diropen_r(&r, dir, NULL)) {
+        fprintf(stderr, "%s: cannot open the directory cursor\n", path);
+        errors++;
+    } else {
+        errors += cursor_pass(dir, &expected, path, "first");
+        if (ntfs_dirreset_r(&r, dir))
+            errors++;
+        else
+            errors += cursor_pass(dir, &expected, path, "rewound");
+        ntfs_dirclose_r(&r, dir);
+    }
+    free(dir);
+
+    for (i = 0; i < expected.count; i++)
+        free(expected.names[i]);
+    free(expected.names);
+    free(expected.mrefs);
+    return errors;
+}
+
+/*
+ * Extent map check
+ *
+ * The extents returned by ntfs_attr_map_extents() must cover the stream
+ * exactly, and reading an extent straight from the volume at its physical
+ * offset must give what ntfs_attr_pread() gives, zeroes for holes and for
+ * the part beyond the initialized size. Compressed, encrypted and resident
+ * values are not stored as is on the volume, only their coverage is checked.
+ */
+static void check_extents(ntfs_attr *na, u8 *buf, WALK_STATS *stats)
+{
+    ntfs_volume *vol = na->ni->vol;
+    struct ntfs_extent *extents = NULL;
+    u8 *raw = NULL;
+    s64 offset = 0;
+    int count;
+    int i;
+
+    count = ntfs_attr_map_extents(na, NULL, 0);
+    if (count > 0) {
+        extents = (struct ntfs_extent *) malloc(count * sizeof(struct ntfs_extent));
+        raw = (u8 *) malloc(HOST_READ_CHUNK);
+        if (!extents || !raw || ntfs_attr_map_extents(na, extents, count) != count)
+            count = -1;
+    }
+    if (count < 0) {
+        fprintf(stderr, "inode %llu: cannot map extents\n", (unsigned long long) na->ni->mft_no);
+        stats->errors++;
+        goto out;
+    }
+
+    for (i = 0; i < count; i++) {
+        struct ntfs_extent *extent = &extents[i];
+        s64 pos;
+
+        if (extent->offset != offset || extent->length <= 0) {
+            fprintf(stderr, "inode %llu: extent %d at %lld, expected %lld\n",
+                    (unsigned long long) na->ni->mft_no, i, (long long) extent->offset, (long long) offset);
+            stats->errors++;
+            goto out;
+        }
+        offset += extent->length;
+        if (extent->flags & (NTFS_EXTENT_COMPRESSED | NTFS_EXTENT_ENCRYPTED | NTFS_EXTENT_RESIDENT))
+            continue;
+
+        for (pos = 0; pos < extent->length; pos += HOST_READ_CHUNK) {
+            s64 len = MIN(extent->length - pos, HOST_READ_CHUNK);
+
+            if (ntfs_attr_pread(na, extent->offset + pos, len, buf) != len) {
+                stats->errors++;
+                goto out;
+            }
+            if (extent->flags & (NTFS_EXTENT_HOLE | NTFS_EXTENT_UNWRITTEN)) {
+                memset(raw, 0, (size_t) len);
+            } else if (ntfs_pread(vol->dev, extent->physical + pos, len, raw) != len) {
+                stats->errors++;
+                goto out;
+            }
+            if (memcmp(buf, raw, (size_t) len)) {
+                fprintf(stderr, "inode %llu: extent %d differs from the stream at %lld\n",
+                        (unsigned long long) na->ni->mft_no, i, (long long) (extent->offset + pos));
+                stats->errors++;
+                goto out;
+            }
+        }
+    }
+    if (offset != na->data_size) {
+        fprintf(stderr, "inode %llu: extents cover %lld of %lld bytes\n",
+                (unsigned long long) na->ni->mft_no, (long long) offset, (long long) na->data_size);
+        stats->errors++;
+    }
+
+out:
+    free(raw);
+    free(extents);
+}
+
+/* Check the extent map of every named data stream of a file */
+static void check_named_extents(ntfs_inode *ni, u8 *buf, WALK_STATS *stats)
+{
+    ntfs_attr_search_ctx *ctx;
+    ntfs_attr *na;
+
+    ctx = ntfs_attr_get_search_ctx(ni, NULL);
+    if (!ctx) {
+        stats->errors++;
+        return;
+    }
+    while (!ntfs_attr_lookup(AT_DATA, NULL, 0, CASE_SENSITIVE, 0, NULL, 0, ctx)) {
+        ATTR_RECORD *a = ctx->attr;
+
+        if (!a->name_length || (a->non_resident && a->lowest_vcn))
+            continue;
+        na = ntfs_attr_open(ni, AT_DATA, (ntfschar *) ((u8 *) a + le16_to_cpu(a->name_offset)), a->name_length);
+        if (!na) {
+            stats->errors++;
+            continue;
+        }
+        check_extents(na, buf, stats);
+        ntfs_attr_close(na);
+    }
+    if (errno != ENOENT)
+        stats->errors++;
+    ntfs_attr_put_search_ctx(ctx);
+}
+
+static void walk_file(ntfs_inode *ni, u8 *buf, WALK_STATS *stats)
+{
+    ntfs_attr *na;
+    s64 pos = 0;
+
+    na = ntfs_attr_open(ni, AT_DATA, AT_UNNAMED, 0);
+    if (!na) {
+        stats->errors++;
+        return;
+    }
+
+    if (walk_load) {
+        void *data = malloc((size_t) (na->data_size ? na->data_size : 1));
+        pos = data ? ntfs_attr_load(na, data, na->data_size) : -1;
+        if (pos < 0) {
+            stats->errors++;
+            pos = 0;
+        }
+        free(data);
+    }
+    while (!walk_load && pos < na->data_size) {
+        s64 br = ntfs_attr_pread(na, pos, MIN(na->data_size - pos, HOST_READ_CHUNK), buf);
+        if (br <= 0) {
+            stats->errors++;
+            break;
+        }
+        pos += br;
+    }
+    if (walk_extents) {
+        check_extents(na, buf, stats);
+        check_named_extents(ni, buf, stats);
+    }
+
+    stats->files++;
+    stats->bytes += pos;
+    ntfs_attr_close(na);
+}
+
+/*
+ * Children are opened by their full path from the root, as the firmware
+ * does for EFI_FILE_PROTOCOL.Open(), so the walk goes through the same
+ * metadata caches.
+ */
+static void walk_dir(ntfs_vd *vd, ntfs_inode *dir_ni, const char *path, u8 *buf, WALK_STATS *stats)
+{
+    WALK_DIR dir = { NULL, 0, 0 };
+    s64 pos = 0;
+    int i;
+
+    stats->dirs++;
+    if (ntfs_readdir(dir_ni, &pos, &dir, walk_filldir)) {
+        stats->errors++;
+    }
+    if (walk_cursor)
+        stats->errors += check_cursor(vd, dir_ni, path);
+
+    for (i = 0; i < dir.count; i++) {
+        size_t len = strlen(path) + strlen(dir.names[i]) + 2;
+        char *child = (char *) malloc(len);
+        ntfs_inode *ni = NULL;
+        if (child) {
+            snprintf(child, len, "%s%c%s", strcmp(path, "\\") ? path : "", PATH_SEP, dir.names[i]);
+            ni = ntfs_pathname_to_inode(vd->vol, NULL, child);
+        }
+        if (!ni) {
+            stats->errors++;
+        } else {
+            if (ni->mrec->flags & MFT_RECORD_IS_DIRECTORY)
+                walk_dir(vd, ni, child, buf, stats);
+            else
+                walk_file(ni, buf, stats);
+            ntfs_inode_close(ni);
+        }
+        free(child);
+        free(dir.names[i]);
+    }
+
+    free(dir.names);
+}
+
+/*
+ * Expected extents
+ *
+ * With -x the extent maps of known streams are compared with a list such as
+ * the one mkfixture.py writes next to its image: one extent per line,
+ * "path[:stream] offset physical length flags", the extents of a stream on
+ * consecutive lines. Any difference, in the extents or in their number,
+ * counts as an error.
+ */
+static int expected_map(ntfs_volume *vol, char *stream, struct ntfs_extent **extents)
+{
+    char *colon = strchr(stream, ':');
+    ntfschar *name = NULL;
+    int name_len = 0;
+    ntfs_inode *ni;
+    ntfs_attr *na = NULL;
+    int count = -1;
+
+    if (colon)
+        *colon = '\0';
+    ni = ntfs_pathname_to_inode(vol, NULL, stream);
+    if (colon) {
+        *colon = ':';
+        name_len = ntfs_mbstoucs(colon + 1, &name);
+    }
+    if (ni && name_len >= 0)
+        na = ntfs_attr_open(ni, AT_DATA, name ? name : AT_UNNAMED, name ? name_len : 0);
+    if (na)
+        count = ntfs_attr_map_extents(na, NULL, 0);
+    if (count > 0) {
+        *extents = (struct ntfs_extent *) malloc(count * sizeof(struct ntfs_extent));
+        if (!*extents || ntfs_attr_map_extents(na, *extents, count) != count)
+            count = -1;
+    }
+    if (count < 0)
+        fprintf(stderr, "%s: cannot map extents: %s\n", stream, strerror(errno));
+
+    if (na)
+        ntfs_attr_close(na);
+    if (ni)
+        ntfs_inode_close(ni);
+    free(name);
+    return count;
+}
+
+static u64 expected_count(const char *stream, int count, int listed)
+{
+    if (!stream[0] || count < 0 || count == listed)
+        return 0;
+    fprintf(stderr, "%s: %d extents, expected %d\n", stream, count, listed);
+    return 1;
+}
+
+static u64 check_expected(ntfs_volume *vol, const char *list)
+{
+    struct ntfs_extent *extents = NULL;
+    char line[1024];
+    char stream[768];
+    char previous[768] = "";
+    long long offset, physical, length;
+    unsigned int flags;
+    int streams = 0, checked = 0;
+    int count = 0, listed = 0;
+    u64 errors = 0;
+    FILE *f;
+
+    f = fopen(list, "r");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", list, strerror(errno));
+        return 1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "%767s %lld %lld %lld %x", stream, &offset, &physical, &length, &flags) != 5) {
+            fprintf(stderr, "%s: cannot parse %s", list, line);
+            errors++;
+            continue;
+        }
+        if (strcmp(stream, previous)) {
+            errors += expected_count(previous, count, listed);
+            free(extents);
+            extents = NULL;
+            count = expected_map(vol, stream, &extents);
+            if (count < 0)
+                errors++;
+            listed = 0;
+            streams++;
+            strcpy(previous, stream);
+        }
+        if (listed < count) {
+            struct ntfs_extent *extent = &extents[listed];
+            if (extent->offset != offset || extent->physical != physical ||
+                extent->length != length || extent->flags != flags) {
+                fprintf(stderr, "%s: extent %d is %lld %lld %lld 0x%x, expected %lld %lld %lld 0x%x\n",
+                        stream, listed, (long long) extent->offset, (long long) extent->physical,
+                        (long long) extent->length, (unsigned int) extent->flags,
+                        offset, physical, length, flags);
+                errors++;
+            }
+            checked++;
+        }
+        listed++;
+    }
+    errors += expected_count(previous, count, listed);
+    free(extents);
+    fclose(f);
+
+    printf("%s: %d streams, %d extents checked, %llu errors\n", list, streams, checked, (unsigned long long) errors);
+    return errors;
+}
+
+/*
+ * Runlist lookup benchmark
+ *
+ * Synthetic runlists of 10^2 to 10^6 runs of 1 to 16 clusters, one run in
+ * four being a hole, are searched by ntfs_attr_find_vcn() sequentially and
+ * at random, and at random by the plain linear scan it used to do.
+ */
+static runlist_element *bench_linear_vcn(runlist_element *rl, VCN vcn)
+{
+    while (rl->length && vcn >= rl[1].vcn)
+        rl++;
+    return rl;
+}
+
+static u64 bench_random(u64 *seed)
+{
+    *seed = *seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return *seed >> 17;
+}
+
+static int bench_find_vcn(void)
+{
+    ntfs_inode ni;
+    ntfs_attr na;
+    runlist_element *rl, *found;
+    u64 seed = 1;
+    u64 errors = 0;
+    s64 lookups;
+    VCN vcn, end;
+    clock_t start;
+    double seqNs, randomNs, linearNs;
+    int runs, i;
+
+    printf("%10s %14s %14s %14s\n", "runs", "sequential", "random", "linear");
+    for (runs = 100; runs <= 1000000; runs *= 10) {
+        rl = (runlist_element *) malloc((runs + 1) * sizeof(runlist_element));
+        if (!rl)
+            return 1;
+        for (i = 0, vcn = 0; i < runs; i++) {
+            rl[i].vcn = vcn;
+            rl[i].length = 1 + (s64) (bench_random(&seed) % 16);
+            rl[i].lcn = (i % 4 == 3) ? (LCN) LCN_HOLE : (LCN) (16 * i);
+            vcn += rl[i].length;
+        }
+        rl[runs].vcn = end = vcn;
+        rl[runs].length = 0;
+        rl[runs].lcn = (LCN) LCN_ENOENT;
+
+        memset(&ni, 0, sizeof(ni));
+        memset(&na, 0, sizeof(na));
+        na.ni = &ni;
+        na.rl = rl;
+        NAttrSetNonResident(&na);
+
+        start = clock();
+        for (vcn = 0; vcn < end; vcn++) {
+            found = ntfs_attr_find_vcn(&na, vcn);
+            if (!found || vcn < found->vcn || vcn >= found[1].vcn)
+                errors++;
+        }
+        seqNs = 1e9 * (clock() - start) / CLOCKS_PER_SEC / end;
+
+        lookups = 1000000;
+        start = clock();
+        for (i = 0; i < lookups; i++) {
+            vcn = (VCN) (bench_random(&seed) % end);
+            found = ntfs_attr_find_vcn(&na, vcn);
+            if (!found || vcn < found->vcn || vcn >= found[1].vcn)
+                errors++;
+        }
+        randomNs = 1e9 * (clock() - start) / CLOCKS_PER_SEC / lookups;
+
+        // The linear scan is O(runs), keep its total work bounded
+        lookups = 100000000 / runs;
+        start = clock();
+        for (i = 0; i < lookups; i++) {
+            vcn = (VCN) (bench_random(&seed) % end);
+            if (bench_linear_vcn(rl, vcn) != ntfs_attr_find_vcn(&na, vcn))
+                errors++;
+        }
+        linearNs = 1e9 * (clock() - start) / CLOCKS_PER_SEC / lookups - randomNs;
+
+        printf("%10d %11.1f ns %11.1f ns %11.1f ns\n", runs, seqNs, randomNs, linearNs);
+        free(rl);
+    }
+    printf("%llu lookup errors\n", (unsigned long long) errors);
+
+    return errors ? 1 : 0;
+}
+
+/*
+ * Request shape test
+ *
+ * The UEFI device layer is opened straight over a memory disk holding a bare
+ * NTFS boot sector and a known pattern, for every media geometry, with and
+ * without the sector cache and readahead. Unaligned reads, unaligned writes
+ * and partial writes merged in the pending block go through the device
+ * operations; the data read back and left on the disk must match, and every
+ * DiskIo request must be made of whole physical blocks aligned on the media.
+ */
+#define SHAPE_DISK_SIZE     (8 * 1024 * 1024)
+#define SHAPE_MERGE_BLOCK   (1024 * 1024)
+
+static const struct {
+    s64 offset;
+    s64 count;
+} shape_reads[] = {
+    { 1, 10 }, { 511, 2 }, { 513, 4000 }, { 4095, 8194 }, { 700, 70000 }, { 12345, 300000 },
+    { 512, 512 }, { 4096, 4096 }, { SHAPE_DISK_SIZE - 513, 513 },
+}, shape_writes[] = {
+    { 100, 50 }, { 150, 300 }, { 4000, 200 }, { 8192 + 17, 20000 }, { 40960 + 512, 512 },
+    { 65536 - 7, 300000 }, { SHAPE_DISK_SIZE - 4096 - 100, 100 },
+};
+
+static u8 shape_pattern(u64 offset)
+{
+    return (u8) ((offset * 0x9E3779B97F4A7C15ULL) >> 56);
+}
+
+/*
+ * Memory disk of the self tests: a known pattern behind a bare NTFS boot
+ * sector, enough for the UEFI device layer to open it
+ */
+static HOST_DISK *test_disk_create(const HOST_GEOMETRY *geometry, u16 sectorSize)
+{
+    NTFS_BOOT_SECTOR *boot;
+    HOST_DISK *Disk;
+    u64 i;
+
+    Disk = HostDiskCreate(SHAPE_DISK_SIZE, geometry->BlockSize, geometry->LogicalBlocksPerPhysicalBlock,
+                          geometry->IoAlign, geometry->OptimalTransferLengthGranularity);
+    if (!Disk)
+        return NULL;
+
+    for (i = 0; i < SHAPE_DISK_SIZE; i++)
+        Disk->Memory[i] = shape_pattern(i);
+    boot = (NTFS_BOOT_SECTOR *) Disk->Memory;
+    memset(boot, 0, sizeof(NTFS_BOOT_SECTOR));
+    boot->oem_id = cpu_to_le64(0x202020205346544eULL);
+    boot->bpb.bytes_per_sector = cpu_to_le16(sectorSize);
+    boot->bpb.sectors_per_cluster = (u8) (4096 / sectorSize);
+    boot->number_of_sectors = cpu_to_sle64(SHAPE_DISK_SIZE / sectorSize - 1);
+    boot->clusters_per_mft_record = (s8) -10;
+    boot->clusters_per_index_record = 1;
+    boot->end_of_sector_marker = cpu_to_le16(0xaa55);
+
+    return Disk;
+}
+
+/*
+ * Open the UEFI device layer straight over a test disk
+ */
+static struct ntfs_device *test_device_open(NTFS_VOLUME *Volume, HOST_DISK *Disk, bool cached)
+{
+    struct ntfs_device *dev;
+    struct _uefi_fd *fd;
+
+    fd = (struct _uefi_fd *) ntfs_alloc(sizeof(struct _uefi_fd));
+    if (!fd)
+        return NULL;
+
+    memset(Volume, 0, sizeof(NTFS_VOLUME));
+    Volume->BlockIo = &Disk->BlockIo;
+    Volume->DiskIo = &Disk->DiskIo;
+    Volume->DiskIo2 = &Disk->DiskIo2;
+
+    // Set up as ntfsMount() does
+    memset(fd, 0, sizeof(struct _uefi_fd));
+    fd->interface = Volume;
+    fd->sectorSize = 0x200;
+    fd->sectorCount = 0x200;
+    fd->cachePageCount = cached ? CACHE_DEFAULT_PAGE_COUNT : 0;
+    fd->cachePageSize = CACHE_DEFAULT_PAGE_SIZE;
+    fd->readaheadStreams = cached ? READAHEAD_DEFAULT_STREAMS : 0;
+    fd->queueDepth = UEFI_IO_DEFAULT_QUEUE_DEPTH;
+
+    dev = ntfs_device_alloc("test", 0, &ntfs_device_uefi_io_ops, fd);
+    if (!dev) {
+        ntfs_free(fd);
+        return NULL;
+    }
+    if (dev->d_ops->open(dev, O_RDWR)) {
+        ntfs_device_free(dev);
+        ntfs_free(fd);
+        return NULL;
+    }
+
+    return dev;
+}
+
+static u64 shape_check_requests(HOST_DISK *Disk, UINTN first, UINTN count, UINT32 op, UINT64 offset, const char *what)
+{
+    UINTN i;
+
+    if (Disk->RequestCount - first != count)
+        goto mismatch;
+    for (i = first; i < Disk->RequestCount; i++) {
+        if ((Disk->Requests[i].Op == HOST_WRITE_DISK) != (op == HOST_WRITE_DISK) ||
+            Disk->Requests[i].Offset != offset || Disk->Requests[i].Size != HostDiskPhysicalBlock(Disk))
+            goto mismatch;
+    }
+    return 0;
+
+mismatch:
+    fprintf(stderr, "%s: %llu requests, expected %llu of one block @ %llu\n", what,
+            (unsigned long long) (Disk->RequestCount - first), (unsigned long long) count, (unsigned long long) offset);
+    return 1;
+}
+
+static u64 shape_test(const HOST_GEOMETRY *geometry, u16 sectorSize, bool cached)
+{
+    NTFS_VOLUME Volume;
+    HOST_DISK *Disk;
+    struct ntfs_device *dev;
+    u8 *expect, *buf;
+    u64 errors = 0;
+    UINTN mark;
+    s64 lo, hi;
+    u64 i, j;
+
+    Disk = test_disk_create(geometry, sectorSize);
+    expect = (u8 *) malloc(SHAPE_DISK_SIZE);
+    buf = (u8 *) malloc(SHAPE_DISK_SIZE);
+    if (!Disk || !expect || !buf) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    memcpy(expect, Disk->Memory, SHAPE_DISK_SIZE);
+
+    dev = test_device_open(&Volume, Disk, cached);
+    if (!dev) {
+        fprintf(stderr, "%s: device open failed: %s\n", geometry->Name, strerror(errno));
+        HostDiskClose(Disk);
+        free(expect);
+        free(buf);
+        return 1;
+    }
+
+    // Unaligned head and tail reads
+    for (i = 0; i < sizeof(shape_reads) / sizeof(shape_reads[0]); i++) {
+        if (dev->d_ops->pread(dev, buf, shape_reads[i].count, shape_reads[i].offset) != shape_reads[i].count ||
+            memcmp(buf, expect + shape_reads[i].offset, (size_t) shape_reads[i].count)) {
+            fprintf(stderr, "read @ %lld (%lld bytes) returned wrong data\n", (long long) shape_reads[i].offset, (long long) shape_reads[i].count);
+            errors++;
+        }
+    }
+
+    // Unaligned writes, read back before they reach the disk
+    for (i = 0; i < sizeof(shape_writes) / sizeof(shape_writes[0]); i++) {
+        for (j = 0; j < (u64) shape_writes[i].count; j++)
+            buf[j] = (u8) ~shape_pattern(shape_writes[i].offset + j + i);
+        memcpy(expect + shape_writes[i].offset, buf, (size_t) shape_writes[i].count);
+        if (dev->d_ops->pwrite(dev, buf, shape_writes[i].count, shape_writes[i].offset) != shape_writes[i].count) {
+            fprintf(stderr, "write @ %lld (%lld bytes) failed\n", (long long) shape_writes[i].offset, (long long) shape_writes[i].count);
+            errors++;
+        }
+        lo = MAX(shape_writes[i].offset - 512, 0);
+        hi = MIN(shape_writes[i].offset + shape_writes[i].count + 512, SHAPE_DISK_SIZE);
+        if (dev->d_ops->pread(dev, buf, hi - lo, lo) != hi - lo || memcmp(buf, expect + lo, (size_t) (hi - lo))) {
+            fprintf(stderr, "write @ %lld (%lld bytes) did not read back\n", (long long) shape_writes[i].offset, (long long) shape_writes[i].count);
+            errors++;
+        }
+    }
+    if (dev->d_ops->sync(dev))
+        errors++;
+
+    // Partial writes to one physical block are merged in the pending block:
+    // the block is read once, and written once when flushed
+    if (!cached) {
+        memset(buf, 0x5a, 512);
+        memset(expect + SHAPE_MERGE_BLOCK + 100, 0x5a, 50);
+        memset(expect + SHAPE_MERGE_BLOCK + 150, 0x5a, 300);
+        mark = Disk->RequestCount;
+        if (dev->d_ops->pwrite(dev, buf, 50, SHAPE_MERGE_BLOCK + 100) != 50 ||
+            dev->d_ops->pwrite(dev, buf, 300, SHAPE_MERGE_BLOCK + 150) != 300)
+            errors++;
+        errors += shape_check_requests(Disk, mark, 1, HOST_READ_DISK, SHAPE_MERGE_BLOCK, "merged partial writes");
+        mark = Disk->RequestCount;
+        if (dev->d_ops->sync(dev))
+            errors++;
+        errors += shape_check_requests(Disk, mark, 1, HOST_WRITE_DISK, SHAPE_MERGE_BLOCK, "pending block flush");
+    }
+
+    dev->d_ops->close(dev);
+    ntfs_device_free(dev);
+
+    if (memcmp(Disk->Memory, expect, SHAPE_DISK_SIZE)) {
+        fprintf(stderr, "disk contents differ from the writes issued\n");
+        errors++;
+    }
+
+    printf("%-6s %8u %8s %10llu %10llu %8llu\n", geometry->Name, sectorSize, cached ? "cached" : "direct",
+           (unsigned long long) Disk->RequestCount, (unsigned long long) Disk->Misshapen, (unsigned long long) errors);
+    errors += Disk->Misshapen;
+
+    HostDiskClose(Disk);
+    free(expect);
+    free(buf);
+
+    return errors;
+}
+
+static int shape_test_all(void)
+{
+    // Geometry and NTFS sector size; a 512 byte sector volume can sit on 4Kn media
+    static const struct {
+        int geometry;
+        u16 sectorSize;
+    } configs[] = { { 0, 512 }, { 1, 512 }, { 2, 4096 }, { 2, 512 } };
+    u64 errors = 0;
+    int i;
+
+    printf("%-6s %8s %8s %10s %10s %8s\n", "media", "sector", "cache", "requests", "misshapen", "errors");
+    for (i = 0; i < (int) (sizeof(configs) / sizeof(configs[0])); i++) {
+        errors += shape_test(&host_geometries[configs[i].geometry], configs[i].sectorSize, false);
+        errors += shape_test(&host_geometries[configs[i].geometry], configs[i].sectorSize, true);
+    }
+    printf("%llu shape errors\n", (unsigned long long) errors);
+
+    return errors ? 1 : 0;
+}
+
+/*
+ * DiskIo2 pipeline test
+ *
+ * A large read goes through the DiskIo2 pipeline of the device layer while
+ * the stand-in holds its requests back and completes them from the event
+ * loop: in order, out of order, with failed transfers, with a failed
+ * submission, with a failing CheckEvent(), never at all, and never even
+ * when cancelled. The data must come back whole (through the synchronous
+ * fallback when the pipeline fails), except when requests are left pending:
+ * then the read must fail without touching the disk again. A second read
+ * checks that the pipeline is reused, or off for good once it was cancelled,
+ * and no request may be left queued nor event left open after the close.
+ */
+#define PIPELINE_OFFSET     65536
+#define PIPELINE_COUNT      (2 * 1024 * 1024)
+
+static const struct {
+    const char *name;
+    BOOLEAN outOfOrder;
+    BOOLEAN stuck;
+    BOOLEAN ignoreCancel;
+    UINT32 failEvery;
+    UINT32 submitFailAt;
+    UINT32 checkFailAt;
+    bool fallback;                  /* The read must be retried synchronously */
+    bool cancel;                    /* The requests in flight must be cancelled */
+    bool fails;                     /* The read must fail (requests are left pending) */
+} pipeline_cases[] = {
+    { "in order",        FALSE, FALSE, FALSE, 0, 0, 0, false, false, false },
+    { "out of order",    TRUE,  FALSE, FALSE, 0, 0, 0, false, false, false },
+    { "failed transfer", TRUE,  FALSE, FALSE, 5, 0, 0, true,  false, false },
+    { "failed submit",   TRUE,  FALSE, FALSE, 0, 3, 0, true,  false, false },
+    { "CheckEvent error", TRUE, FALSE, FALSE, 0, 0, 3, true,  true,  false },
+    { "never completes", FALSE, TRUE,  FALSE, 0, 0, 0, true,  true,  false },
+    { "cancel ignored",  FALSE, TRUE,  TRUE,  0, 0, 0, false, true,  true  },
+};
+
+static void pipeline_count(HOST_DISK *Disk, UINTN first, u64 *asyncReads, u64 *syncReads)
+{
+    for (*asyncReads = *syncReads = 0; first < Disk->RequestCount; first++) {
+        if (Disk->Requests[first].Op == HOST_READ_DISK_EX)
+            (*asyncReads)++;
+        else
+            (*syncReads)++;
+    }
+}
+
+static int pipeline_test(void)
+{
+    NTFS_VOLUME Volume;
+    HOST_DISK *Disk;
+    struct ntfs_device *dev;
+    u64 errors = 0, caseErrors;
+    u64 retries, asyncReads, syncReads, asyncAgain, syncAgain;
+    UINT32 cancels;
+    UINTN first;
+    s64 ret;
+    u8 *buf;
+    int c, i;
+
+    buf = (u8 *) malloc(PIPELINE_COUNT);
+    if (!buf) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    printf("%-18s %10s %10s %8s %8s %8s\n", "completion", "ReadDiskEx", "ReadDisk", "cancels", "retries", "errors");
+    for (c = 0; c < (int) (sizeof(pipeline_cases) / sizeof(pipeline_cases[0])); c++) {
+        caseErrors = 0;
+        Disk = test_disk_create(&host_geometries[1], 512);
+        dev = Disk ? test_device_open(&Volume, Disk, false) : NULL;
+        if (!dev) {
+            fprintf(stderr, "%s: device open failed: %s\n", pipeline_cases[c].name, strerror(errno));
+            return 1;
+        }
+
+        Disk->Deferred = TRUE;
+        Disk->OutOfOrder = pipeline_cases[c].outOfOrder;
+        Disk->Stuck = pipeline_cases[c].stuck;
+        Disk->IgnoreCancel = pipeline_cases[c].ignoreCancel;
+        Disk->FailEvery = pipeline_cases[c].failEvery;
+        Disk->SubmitFailAt = pipeline_cases[c].submitFailAt;
+        Disk->CheckFailAt = pipeline_cases[c].checkFailAt;
+        Disk->Seed = c + 1;
+        host_queue_disk = Disk;
+        first = Disk->RequestCount;
+
+        memset(buf, 0, PIPELINE_COUNT);
+        ret = dev->d_ops->pread(dev, buf, PIPELINE_COUNT, PIPELINE_OFFSET);
+        if (pipeline_cases[c].fails) {
+            if (ret == PIPELINE_COUNT) {
+                fprintf(stderr, "%s: the read did not fail\n", pipeline_cases[c].name);
+                caseErrors++;
+            }
+        } else if (ret != PIPELINE_COUNT || memcmp(buf, Disk->Memory + PIPELINE_OFFSET, PIPELINE_COUNT)) {
+            fprintf(stderr, "%s: the data read is wrong\n", pipeline_cases[c].name);
+            caseErrors++;
+        }
+
+        pipeline_count(Disk, first, &asyncReads, &syncReads);
+        for (retries = 0, i = 0; i < NTFS_IO_ORIGIN_COUNT; i++)
+            retries += Volume.IoStatistics.Read[i].Retries;
+        cancels = Disk->Cancels;
+
+        if (asyncReads < 2) {
+            fprintf(stderr, "%s: the read was not pipelined\n", pipeline_cases[c].name);
+            caseErrors++;
+        }
+        if ((retries != 0 || syncReads != 0) != pipeline_cases[c].fallback) {
+            fprintf(stderr, "%s: %s synchronous fallback\n", pipeline_cases[c].name,
+                    pipeline_cases[c].fallback ? "missing" : "unexpected");
+            caseErrors++;
+        }
+        if ((cancels != 0) != pipeline_cases[c].cancel) {
+            fprintf(stderr, "%s: %u cancels\n", pipeline_cases[c].name, cancels);
+            caseErrors++;
+        }
+        if ((Disk->Queued != 0) != pipeline_cases[c].fails) {
+            fprintf(stderr, "%s: %u requests still queued\n", pipeline_cases[c].name, (unsigned) Disk->Queued);
+            caseErrors++;
+        }
+
+        // The lower driver gives the requests left pending back late
+        Disk->IgnoreCancel = FALSE;
+        HostCancelEx(&Disk->DiskIo2);
+
+        // Read again, from a pipeline that now completes every request
+        Disk->Stuck = FALSE;
+        Disk->FailEvery = 0;
+        Disk->CheckFailAt = 0;
+        first = Disk->RequestCount;
+        memset(buf, 0, PIPELINE_COUNT);
+        if (dev->d_ops->pread(dev, buf, PIPELINE_COUNT, PIPELINE_OFFSET) != PIPELINE_COUNT ||
+            memcmp(buf, Disk->Memory + PIPELINE_OFFSET, PIPELINE_COUNT)) {
+            fprintf(stderr, "%s: the data read again is wrong\n", pipeline_cases[c].name);
+            caseErrors++;
+        }
+        pipeline_count(Disk, first, &asyncAgain, &syncAgain);
+        if ((asyncAgain == 0) != pipeline_cases[c].cancel) {
+            fprintf(stderr, "%s: the pipeline is %s after the first read\n", pipeline_cases[c].name,
+                    pipeline_cases[c].cancel ? "still on" : "off");
+            caseErrors++;
+        }
+
+        host_queue_disk = NULL;
+        dev->d_ops->close(dev);
+        ntfs_device_free(dev);
+        if (Disk->Queued || host_events) {
+            fprintf(stderr, "%s: %u requests still queued, %d events open\n", pipeline_cases[c].name,
+                    (unsigned) Disk->Queued, host_events);
+            caseErrors++;
+        }
+
+        printf("%-18s %10llu %10llu %8u %8llu %8llu\n", pipeline_cases[c].name,
+               (unsigned long long) asyncReads, (unsigned long long) syncReads, cancels,
+               (unsigned long long) retries, (unsigned long long) caseErrors);
+        errors += caseErrors;
+
+        HostDiskClose(Disk);
+    }
+    printf("%llu pipeline errors\n", (unsigned long long) errors);
+
+    free(buf);
+    return errors ? 1 : 0;
+}
+
+static void io_totals(const NTFS_IO_STATISTICS *stats, u64 *calls, u64 *bytes)
+{
+    int i;
+
+    *calls = *bytes = 0;
+    for (i = 0; i < NTFS_IO_ORIGIN_COUNT; i++) {
+        *calls += stats->Read[i].Calls + stats->Write[i].Calls;
+        *bytes += stats->Read[i].Bytes + stats->Write[i].Bytes;
+    }
+}
+
+static void print_io_statistics(const NTFS_IO_STATISTICS *stats)
+{
+    static const char *origins[NTFS_IO_ORIGIN_COUNT] = { "other", "mft", "index", "bitmap", "data", "logfile" };
+    char latency[24];
+    int i;
+
+    printf("%-8s %10s %14s %10s %14s %8s %8s %10s\n", "origin", "reads", "read bytes", "writes", "write bytes", "retries",
+           "failures", "avg us");
+    for (i = 0; i < NTFS_IO_ORIGIN_COUNT; i++) {
+        const NTFS_IO_COUNTERS *r = &stats->Read[i];
+        const NTFS_IO_COUNTERS *w = &stats->Write[i];
+        if (!r->Calls && !w->Calls)
+            continue;
+        if (stats->Flags & NTFS_IO_STATISTICS_LATENCY)
+            snprintf(latency, sizeof(latency), "%.1f",
+                     (double) (r->LatencyNs + w->LatencyNs) / 1000.0 / (double) (r->Calls + w->Calls));
+        else
+            snprintf(latency, sizeof(latency), "n/a");
+        printf("%-8s %10llu %14llu %10llu %14llu %8llu %8llu %10s\n", origins[i],
+               (unsigned long long) r->Calls, (unsigned long long) r->Bytes,
+               (unsigned long long) w->Calls, (unsigned long long) w->Bytes,
+               (unsigned long long) (r->Retries + w->Retries),
+               (unsigned long long) (r->Failures + w->Failures), latency);
+    }
+}
+
+/*
+ * Latencies must be flagged as measured exactly when the performance counter
+ * runs, and left zero when it does not
+ */
+static u64 check_latency(const NTFS_IO_STATISTICS *stats)
+{
+    bool measured = (stats->Flags & NTFS_IO_STATISTICS_LATENCY) != 0;
+    u64 counted = 0;
+    int i, j;
+
+    for (i = 0; i < NTFS_IO_ORIGIN_COUNT; i++) {
+        counted |= stats->Read[i].LatencyNs | stats->Write[i].LatencyNs;
+        for (j = 0; j < NTFS_IO_LATENCY_BUCKETS; j++)
+            counted |= stats->Read[i].LatencyHistogram[j] | stats->Write[i].LatencyHistogram[j];
+    }
+
+    if (measured == !host_null_timer && (measured || !counted))
+        return 0;
+
+    fprintf(stderr, "latency %s with %s performance counter\n", measured ? "flagged as measured" :
+            (counted ? "counted but not flagged" : "not measured"), host_null_timer ? "a null" : "a running");
+    return 1;
+}
+
+static void print_run_reads(const struct ntfs_device *dev)
+{
+    static const char *origins[NTFS_IO_ORIGINS] = { "other", "mft", "index", "bitmap", "data", "logfile" };
+    int i;
+
+    printf("%-8s %12s %12s %12s\n", "origin", "runs", "transfers", "merged");
+    for (i = 0; i < NTFS_IO_ORIGINS; i++) {
+        const struct ntfs_run_reads *reads = &dev->d_run_reads[i];
+        if (!reads->transfers)
+            continue;
+        printf("%-8s %12llu %12llu %12llu\n", origins[i],
+               (unsigned long long) reads->runs, (unsigned long long) reads->transfers,
+               (unsigned long long) (reads->runs - reads->transfers));
+    }
+}
+
+static void print_cache_statistics(ntfs_volume *vol)
+{
+    const struct CACHE_HEADER *caches[] = {
+        vol->xinode_cache, vol->nidata_cache, vol->lookup_cache, vol->securid_cache, vol->legacy_cache,
+        vol->negative_cache, vol->mftrec_cache, vol->indx_cache, vol->runlist_cache
+    };
+    int i;
+
+    printf("%-8s %8s %10s %10s %10s %8s %10s %10s %10s\n", "cache", "entries", "lookups", "hits", "misses", "hit %", "inserts", "evicts", "protected");
+    for (i = 0; i < (int) (sizeof(caches) / sizeof(caches[0])); i++) {
+        const struct CACHE_HEADER *cache = caches[i];
+        if (!cache)
+            continue;
+        printf("%-8s %8d %10lu %10lu %10lu %7.1f%% %10lu %10lu %10d\n", cache->name, cache->item_count,
+               cache->reads, cache->hits, cache->misses,
+               cache->reads ? 100.0 * cache->hits / cache->reads : 0.0,
+               cache->inserts, cache->evicts, cache->protected_target);
+    }
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-u [-g media] [-n] [-T]|-m] [-l] [-e] [-d] [-x extents] [-c entries] [-r passes] <image> [path]\n", argv0);
+    fprintf(stderr, "       %s -b|-t|-a\n", argv0);
+    fprintf(stderr, "  -u  mount through the UEFI DiskIo device layer instead of the image device\n");
+    fprintf(stderr, "  -g  media geometry under -u: 512n, 512e (default) or 4kn\n");
+    fprintf(stderr, "  -n  under -u, one DiskIo request per physical block (no coalescing)\n");
+    fprintf(stderr, "  -T  under -u, a null performance counter: latencies must be reported as unavailable\n");
+    fprintf(stderr, "  -m  mount through the memory mapped image device\n");
+    fprintf(stderr, "  -l  read every file whole with ntfs_attr_load() instead of by chunks\n");
+    fprintf(stderr, "  -e  check the extent map of every data stream against its contents\n");
+    fprintf(stderr, "  -d  list every directory through the driver's cursor too, and compare\n");
+    fprintf(stderr, "  -x  check the extent maps of the streams listed in a file (see mkfixture.py)\n");
+    fprintf(stderr, "  -c  number of entries of every metadata cache (default: param.h sizes)\n");
+    fprintf(stderr, "  -r  number of walks over the tree (default: 1)\n");
+    fprintf(stderr, "  -b  benchmark runlist lookups on synthetic runlists\n");
+    fprintf(stderr, "  -t  check the DiskIo request shapes of the UEFI device layer on 512n/512e/4Kn media\n");
+    fprintf(stderr, "  -a  check the DiskIo2 pipeline against late, reordered and failed completions\n");
+}
+
+int main(int argc, char *argv[])
+{
+    NTFS_VOLUME *Volume = NULL;
+    HOST_DISK *Disk = NULL;
+    ntfs_vd *vd;
+    ntfs_inode *ni;
+    WALK_STATS stats;
+    const char *image;
+    const char *expected = NULL;
+    const char *path = "\\";      /* the core separates names with PATH_SEP, as UEFI does */
+    const HOST_GEOMETRY *geometry = &host_geometries[1];
+    bool uefi = false;
+    bool mapped = false;
+    bool coalesce = true;
+    u64 calls = 0, bytes = 0;
+    struct CACHE_SIZES cacheSizes;
+    struct CACHE_SIZES *sizes = NULL;
+    int passes = 1;
+    clock_t start;
+    double elapsed;
+    u8 *buf;
+    int arg = 1;
+    int i;
+
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (!strcmp(argv[arg], "-u")) {
+            uefi = true;
+        } else if (!strcmp(argv[arg], "-n")) {
+            coalesce = false;
+        } else if (!strcmp(argv[arg], "-T")) {
+            host_null_timer = true;
+        } else if (!strcmp(argv[arg], "-m")) {
+            mapped = true;
+        } else if (!strcmp(argv[arg], "-l")) {
+            walk_load = true;
+        } else if (!strcmp(argv[arg], "-e")) {
+            walk_extents = true;
+        } else if (!strcmp(argv[arg], "-d")) {
+            walk_cursor = true;
+        } else if (!strcmp(argv[arg], "-x") && arg + 1 < argc) {
+            expected = argv[++arg];
+        } else if (!strcmp(argv[arg], "-c") && arg + 1 < argc) {
+            cacheSizes.inode = cacheSizes.nidata = cacheSizes.lookup = atoi(argv[++arg]);
+            cacheSizes.securid = cacheSizes.legacy = cacheSizes.negative = cacheSizes.inode;
+            cacheSizes.mftrec = cacheSizes.indx = cacheSizes.runlist = cacheSizes.inode;
+            sizes = &cacheSizes;
+        } else if (!strcmp(argv[arg], "-g") && arg + 1 < argc) {
+            for (i = 0; i < (int) (sizeof(host_geometries) / sizeof(host_geometries[0])); i++)
+                if (!strcmp(argv[arg + 1], host_geometries[i].Name))
+                    geometry = &host_geometries[i];
+            if (strcmp(argv[++arg], geometry->Name)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (!strcmp(argv[arg], "-b")) {
+            return bench_find_vcn();
+        } else if (!strcmp(argv[arg], "-t")) {
+            return shape_test_all();
+        } else if (!strcmp(argv[arg], "-a")) {
+            return pipeline_test();
+        } else if (!strcmp(argv[arg], "-r") && arg + 1 < argc) {
+            passes = atoi(argv[++arg]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (arg >= argc || (uefi && mapped) || ((!coalesce || host_null_timer) && !uefi) || passes < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+    image = argv[arg++];
+    if (arg < argc)
+        path = argv[arg++];
+
+    start = clock();
+
+    if (uefi) {
+        Disk = HostDiskOpen(image, geometry->BlockSize, geometry->LogicalBlocksPerPhysicalBlock,
+                            geometry->IoAlign, geometry->OptimalTransferLengthGranularity);
+        Volume = (NTFS_VOLUME *) calloc(1, sizeof(NTFS_VOLUME));
+        if (!Disk || !Volume) {
+            fprintf(stderr, "%s: cannot open image: %s\n", image, strerror(errno));
+            return 1;
+        }
+        Volume->BlockIo = &Disk->BlockIo;
+        Volume->DiskIo = &Disk->DiskIo;
+        Volume->DiskIo2 = &Disk->DiskIo2;
+        Volume->ReadOnly = TRUE;
+        if (!coalesce)
+            Volume->MaxTransferSize = 1;
+        vd = ntfsMount("host", Volume, 0, CACHE_DEFAULT_PAGE_COUNT, CACHE_DEFAULT_PAGE_SIZE, sizes, NTFS_READ_ONLY);
+    } else if (mapped) {
+        vd = ntfsMountImageMapped("host", image, sizes, NTFS_READ_ONLY);
+    } else {
+        vd = ntfsMountImage("host", image, sizes, NTFS_READ_ONLY);
+    }
+
+    if (!vd) {
+        fprintf(stderr, "%s: mount failed: %s\n", image, strerror(errno));
+        return 1;
+    }
+
+    buf = (u8 *) malloc(HOST_READ_CHUNK);
+    memset(&stats, 0, sizeof(stats));
+    for (i = 0; i < passes; i++) {
+        if (Volume)
+            io_totals(&Volume->IoStatistics, &calls, &bytes);
+
+        ni = ntfs_pathname_to_inode(vd->vol, NULL, path);
+        if (!buf || !ni) {
+            fprintf(stderr, "%s: cannot open %s: %s\n", image, path, strerror(errno));
+            ntfsUnmount("host", true);
+            return 1;
+        }
+
+        if (ni->mrec->flags & MFT_RECORD_IS_DIRECTORY)
+            walk_dir(vd, ni, path, buf, &stats);
+        else
+            walk_file(ni, buf, &stats);
+        ntfs_inode_close(ni);
+
+        if (Volume) {
+            u64 passCalls, passBytes;
+            io_totals(&Volume->IoStatistics, &passCalls, &passBytes);
+            printf("pass %d: %llu DiskIo requests, %llu bytes\n", i + 1,
+                   (unsigned long long) (passCalls - calls), (unsigned long long) (passBytes - bytes));
+        }
+    }
+
+    elapsed = (double) (clock() - start) / CLOCKS_PER_SEC;
+    printf("%s (%s): %llu dirs, %llu files, %llu bytes, %llu errors in %.3fs",
+           image, uefi ? "uefi" : (mapped ? "mapped" : "image"),
+           (unsigned long long) stats.dirs, (unsigned long long) stats.files,
+           (unsigned long long) stats.bytes, (unsigned long long) stats.errors, elapsed);
+    if (elapsed > 0)
+        printf(" (%.1f MiB/s)", (double) stats.bytes / (1024.0 * 1024.0) / elapsed);
+    printf("\n");
+    if (Volume) {
+        print_io_statistics(&Volume->IoStatistics);
+        stats.errors += check_latency(&Volume->IoStatistics);
+    }
+
+    if (expected)
+        stats.errors += check_expected(vd->vol, expected);
+
+    print_run_reads(vd->vol->dev);
+    print_cache_statistics(vd->vol);
+
+    free(buf);
+    ntfsUnmount("host", false);
+    if (Disk) {
+        printf("%s media: %llu DiskIo requests, %llu not made of whole physical blocks\n", geometry->Name,
+               (unsigned long long) Disk->RequestCount, (unsigned long long) Disk->Misshapen);
+        stats.errors += Disk->Misshapen;
+        HostDiskClose(Disk);
+    }
+    free(Volume);
+
+    return stats.errors ? 1 : 0;
+}
@@ -0,0 +1,660 @@
+#!/usr/bin/env python3
+#
+# mkfixture.py - Build the NTFS fixture image of ntfspkg-test.
+#
+# Writes a small NTFS 3.1 volume with fixed contents and the extent maps its
+# data streams must have, so the extent map code can be checked against a
+# known layout without mkntfs or Windows:
+#
+#   python3 mkfixture.py fixture.img fixture.extents
+#   ntfspkg-test -e -x fixture.extents fixture.img
+#
+# The volume is 8 MiB with 512 byte sectors, 4 KiB clusters and 1 KiB mft
+# records. Besides the metadata files needed for a mount, the root directory
+# (a resident index) holds:
+#
+#   compress.bin   compressed: an LZNT1 compression unit stored in 2 clusters,
+#                  a plain one, then a sparse one
+#   fragment.bin   non resident, 4 runs out of order on the volume, the last
+#                  two adjacent; a named stream "alt" in one cluster
+#   resident.txt   resident, with a resident named stream "meta"
+#   sparse.bin     sparse: data, a hole, data with an unwritten tail
+#   many           a directory of 72 resident files and 8 more hard links
+#                  to some of them, in a two level index of 3 index blocks,
+#                  so it is listed in more than one batch; one more file has
+#                  a Chinese Win32 name and the DOS alias 8D4E~1.TXT, which
+#                  sorts first in the index
+#
+# The expected extents are one line per extent, "path[:stream] offset
+# physical length flags", paths separated by backslashes as in the core,
+# physical -1 where the data has no volume offset of its own and flags as
+# the NTFS_EXTENT_* bits of ntfs/attrib.h.
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the Free
+# Software Foundation; either version 2 of the License, or (at your option)
+# any later version.
+#
+
+import struct
+import sys
+
+SECTOR_SIZE = 512
+CLUSTER_SIZE = 4096
+MFT_RECORD_SIZE = 1024
+INDEX_BLOCK_SIZE = 4096
+VOLUME_SECTORS = 16384
+NR_CLUSTERS = (VOLUME_SECTORS - 1) * SECTOR_SIZE // CLUSTER_SIZE
+MFT_RECORDS = 128
+COMPRESSION_UNIT = 4
+
+# Fixed timestamp (2026-01-01 00:00:00 UTC) so the image is reproducible
+NT_TIME = (1767225600 + 11644473600) * 10000000
+
+# Cluster map of the volume
+LCN_BOOT = 0
+LCN_ATTRDEF = 2
+LCN_MFTMIRR = 10
+LCN_BITMAP = 11
+LCN_UPCASE = 16
+LCN_MFT = 700
+LCN_MANY_INDEX = 740
+
+# Attribute types and flags (layout.h)
+AT_STANDARD_INFORMATION = 0x10
+AT_FILE_NAME = 0x30
+AT_VOLUME_NAME = 0x60
+AT_VOLUME_INFORMATION = 0x70
+AT_DATA = 0x80
+AT_INDEX_ROOT = 0x90
+AT_INDEX_ALLOCATION = 0xa0
+AT_BITMAP = 0xb0
+AT_END = 0xffffffff
+
+ATTR_IS_COMPRESSED = 0x0001
+ATTR_IS_SPARSE = 0x8000
+
+FILE_ATTR_HIDDEN = 0x0002
+FILE_ATTR_SYSTEM = 0x0004
+FILE_ATTR_ARCHIVE = 0x0020
+FILE_ATTR_SPARSE_FILE = 0x0200
+FILE_ATTR_COMPRESSED = 0x0800
+FILE_ATTR_I30_INDEX_PRESENT = 0x10000000
+
+MFT_RECORD_IN_USE = 0x0001
+MFT_RECORD_IS_DIRECTORY = 0x0002
+
+FILE_NAME_WIN32 = 1
+FILE_NAME_DOS = 2
+FILE_NAME_WIN32_AND_DOS = 3
+COLLATION_FILE_NAME = 1
+INDEX_ENTRY_NODE = 1
+INDEX_ENTRY_END = 2
+LARGE_INDEX = 1
+
+# Extent flags (ntfs/attrib.h)
+NTFS_EXTENT_HOLE = 0x0001
+NTFS_EXTENT_UNWRITTEN = 0x0002
+NTFS_EXTENT_COMPRESSED = 0x0004
+NTFS_EXTENT_RESIDENT = 0x0010
+
+# A hole in a runlist
+HOLE = None
+
+
+def align(n, a):
+    return (n + a - 1) & ~(a - 1)
+
+
+def utf16(s):
+    return s.encode('utf-16-le')
+
+
+def pattern(seed, size):
+    """Deterministic incompressible bytes, different for every seed"""
+    out = bytearray(size)
+    x = seed * 2654435761 + 1
+    for i in range(size):
+        x = (x * 6364136223846793005 + 1442695040888963407) & 0xffffffffffffffff
+        out[i] = x >> 56
+    return bytes(out)
+
+
+#
+# LZNT1
+#
+def lznt1_compress_chunk(chunk):
+    """Compress one 4 KiB sub-block, greedy matching on 3 byte prefixes"""
+    out = bytearray()
+    pos = 0
+    recent = {}
+    while pos < len(chunk):
+        tag_at = len(out)
+        out.append(0)
+        tag = 0
+        for token in range(8):
+            if pos >= len(chunk):
+                break
+            # Offset and length split of a phrase token at this position
+            lg = 0
+            i = pos - 1
+            while i >= 0x10:
+                lg += 1
+                i >>= 1
+            max_offset = 1 << (4 + lg)
+            max_length = (0xfff >> lg) + 3
+            best_len = 0
+            best_ofs = 0
+            candidate = recent.get(chunk[pos:pos + 3])
+            if candidate is not None and pos - candidate <= max_offset:
+                length = 0
+                while (length < max_length and pos + length < len(chunk)
+                       and chunk[candidate + length] == chunk[pos + length]):
+                    length += 1
+                if length >= 3:
+                    best_len, best_ofs = length, pos - candidate
+            if best_len:
+                tag |= 1 << token
+                out += struct.pack('<H', ((best_ofs - 1) << (12 - lg)) | (best_len - 3))
+                step = best_len
+            else:
+                out.append(chunk[pos])
+                step = 1
+            for p in range(pos, pos + step):
+                if p + 3 <= len(chunk):
+                    recent[chunk[p:p + 3]] = p
+            pos += step
+        out[tag_at] = tag
+    if len(out) >= len(chunk):
+        return struct.pack('<H', 0x3000 | (len(chunk) + 2 - 3)) + chunk
+    return struct.pack('<H', 0x8000 | 0x3000 | (len(out) + 2 - 3)) + bytes(out)
+
+
+def lznt1_compress(data):
+    out = bytearray()
+    for i in range(0, len(data), 4096):
+        out += lznt1_compress_chunk(data[i:i + 4096])
+    return bytes(out)
+
+
+#
+# Runlists and attributes
+#
+def signed_bytes(value):
+    """Shortest little endian two's complement encoding of value"""
+    n = 1
+    while not -(1 << (8 * n - 1)) <= value < (1 << (8 * n - 1)):
+        n += 1
+    return (value & ((1 << (8 * n)) - 1)).to_bytes(n, 'little')
+
+
+def mapping_pairs(runs):
+    out = bytearray()
+    prev_lcn = 0
+    for lcn, length in runs:
+        lb = signed_bytes(length)
+        if lcn is HOLE:
+            ob = b''
+        else:
+            ob = signed_bytes(lcn - prev_lcn)
+            prev_lcn = lcn
+        out.append(len(lb) | (len(ob) << 4))
+        out += lb + ob
+    out.append(0)
+    return bytes(out)
+
+
+def resident_attr(atype, value, name='', instance=0, indexed=False):
+    name_bytes = utf16(name)
+    value_offset = align(24 + len(name_bytes), 8)
+    length = align(value_offset + len(value), 8)
+    hdr = struct.pack('<IIBBHHHIHBB', atype, length, 0, len(name),
+                      24 if name else 0, 0, instance, len(value),
+                      value_offset, 1 if indexed else 0, 0)
+    rec = bytearray(length)
+    rec[0:24] = hdr
+    rec[24:24 + len(name_bytes)] = name_bytes
+    rec[value_offset:value_offset + len(value)] = value
+    return bytes(rec)
+
+
+def nonresident_attr(atype, runs, data_size, initialized_size=None, name='',
+                     instance=0, flags=0):
+    if initialized_size is None:
+        initialized_size = data_size
+    clusters = sum(count for _, count in runs)
+    compressed = flags & (ATTR_IS_COMPRESSED | ATTR_IS_SPARSE)
+    header = 72 if compressed else 64
+    name_bytes = utf16(name)
+    pairs_offset = align(header + len(name_bytes), 8)
+    pairs = mapping_pairs(runs)
+    length = align(pairs_offset + len(pairs), 8)
+    allocated = sum(count for lcn, count in runs if lcn is not HOLE)
+    rec = bytearray(length)
+    struct.pack_into('<IIBBHHH', rec, 0, atype, length, 1, len(name),
+                     header if name else 0, flags, instance)
+    struct.pack_into('<qqHB', rec, 16, 0, clusters - 1, pairs_offset,
+                     COMPRESSION_UNIT if flags & ATTR_IS_COMPRESSED else 0)
+    struct.pack_into('<qqq', rec, 40, clusters * CLUSTER_SIZE, data_size,
+                     initialized_size)
+    if compressed:
+        struct.pack_into('<q', rec, 64, allocated * CLUSTER_SIZE)
+    rec[header:header + len(name_bytes)] = name_bytes
+    rec[pairs_offset:pairs_offset + len(pairs)] = pairs
+    return bytes(rec)
+
+
+def standard_information(file_attributes):
+    return struct.pack('<qqqqIIIIIIQQ', NT_TIME, NT_TIME, NT_TIME, NT_TIME,
+                       file_attributes, 0, 0, 0, 0, 0, 0, 0)
+
+
+def file_name(parent, name, file_attributes, allocated=0, size=0,
+              namespace=FILE_NAME_WIN32_AND_DOS):
+    return struct.pack('<QqqqqqqIIBB', parent, NT_TIME, NT_TIME, NT_TIME,
+                       NT_TIME, allocated, size, file_attributes, 0,
+                       len(name), namespace) + utf16(name)
+
+
+def name_key(key):
+    """Collation key of a FILE_NAME value, its name in upper case"""
+    return key[66:].decode('utf-16-le').upper()
+
+
+def index_entries(entries, end_child=None):
+    """Index entries of (mref, FILE_NAME value, child VCN or None) and the
+    end entry, the child VCN of a node entry in its last 8 bytes"""
+    body = bytearray()
+    for mref, key, child in entries + [(0, b'', end_child)]:
+        flags = INDEX_ENTRY_END if not key else 0
+        length = align(16 + len(key), 8)
+        if child is not None:
+            flags |= INDEX_ENTRY_NODE
+            length += 8
+        entry = bytearray(length)
+        struct.pack_into('<QHHHH', entry, 0, mref, length, len(key), flags, 0)
+        entry[16:16 + len(key)] = key
+        if child is not None:
+            struct.pack_into('<q', entry, length - 8, child)
+        body += entry
+    return bytes(body)
+
+
+def index_root(entries, end_child=None):
+    """Resident $I30 index of (mref, FILE_NAME value) sorted by name, with
+    child VCNs (see index_entries) when the index has blocks"""
+    if entries and len(entries[0]) == 2:
+        entries = [(mref, key, None) for mref, key in entries]
+    body = index_entries(entries, end_child)
+    header = struct.pack('<IIIB3x', 16, 16 + len(body), 16 + len(body),
+                         LARGE_INDEX if end_child is not None else 0)
+    root = struct.pack('<IIIB3x', AT_FILE_NAME, COLLATION_FILE_NAME,
+                       INDEX_BLOCK_SIZE, INDEX_BLOCK_SIZE // CLUSTER_SIZE)
+    return root + header + body
+
+
+def index_block(vcn, entries):
+    """An INDX leaf block of (mref, FILE_NAME value) with its update
+    sequence array applied"""
+    rec = bytearray(INDEX_BLOCK_SIZE)
+    usa_count = INDEX_BLOCK_SIZE // 512 + 1
+    entries_offset = align(0x28 + 2 * usa_count, 8) - 0x18
+    body = index_entries([(mref, key, None) for mref, key in entries])
+    if 0x18 + entries_offset + len(body) > INDEX_BLOCK_SIZE:
+        raise ValueError('index block %d overflows' % vcn)
+    struct.pack_into('<4sHHQQIIIB3x', rec, 0, b'INDX', 0x28, usa_count, 0, vcn,
+                     entries_offset, entries_offset + len(body),
+                     INDEX_BLOCK_SIZE - 0x18, 0)
+    rec[0x18 + entries_offset:0x18 + entries_offset + len(body)] = body
+    return mst_protect(rec, 0x28, usa_count)
+
+
+def mft_record(number, attrs, flags=MFT_RECORD_IN_USE, sequence=1, links=1):
+    """A FILE record with its update sequence array applied"""
+    rec = bytearray(MFT_RECORD_SIZE)
+    usa_count = MFT_RECORD_SIZE // 512 + 1
+    attrs_offset = align(0x30 + 2 * usa_count, 8)
+    pos = attrs_offset
+    for instance, attr in enumerate(attrs):
+        attr = bytearray(attr)
+        struct.pack_into('<H', attr, 14, instance)
+        rec[pos:pos + len(attr)] = attr
+        pos += len(attr)
+    struct.pack_into('<I', rec, pos, AT_END)
+    bytes_in_use = align(pos + 8, 8)
+    if bytes_in_use > MFT_RECORD_SIZE:
+        raise ValueError('mft record %d overflows' % number)
+    struct.pack_into('<4sHHQHHHHIIQHHI', rec, 0, b'FILE', 0x30, usa_count, 0,
+                     sequence, links if flags & MFT_RECORD_IN_USE else 0,
+                     attrs_offset, flags, bytes_in_use, MFT_RECORD_SIZE, 0,
+                     len(attrs), 0, number)
+    return mst_protect(rec, 0x30, usa_count)
+
+
+def mst_protect(rec, usa_ofs, usa_count):
+    usn = 1
+    struct.pack_into('<H', rec, usa_ofs, usn)
+    for i in range(1, usa_count):
+        end = i * 512 - 2
+        rec[usa_ofs + 2 * i:usa_ofs + 2 * i + 2] = rec[end:end + 2]
+        struct.pack_into('<H', rec, end, usn)
+    return bytes(rec)
+
+
+def upcase_table():
+    table = bytearray()
+    for c in range(0x10000):
+        u = c
+        if ord('a') <= c <= ord('z') or (0xe0 <= c <= 0xfe and c != 0xf7):
+            u = c - 0x20
+        elif c == 0xff:
+            u = 0x178
+        table += struct.pack('<H', u)
+    return bytes(table)
+
+
+def attrdef_table():
+    defs = [
+        ('$STANDARD_INFORMATION', 0x10, 0, 0x40, 0x30, 0x48),
+        ('$ATTRIBUTE_LIST', 0x20, 0, 0x80, 0, -1),
+        ('$FILE_NAME', 0x30, 0, 0x42, 0x44, 0x242),
+        ('$OBJECT_ID', 0x40, 0, 0x40, 0, 0x100),
+        ('$SECURITY_DESCRIPTOR', 0x50, 0, 0x80, 0, -1),
+        ('$VOLUME_NAME', 0x60, 0, 0x40, 2, 0x100),
+        ('$VOLUME_INFORMATION', 0x70, 0, 0x40, 0xc, 0xc),
+        ('$DATA', 0x80, 0, 0, 0, -1),
+        ('$INDEX_ROOT', 0x90, 0, 0x40, 0, -1),
+        ('$INDEX_ALLOCATION', 0xa0, 0, 0x80, 0, -1),
+        ('$BITMAP', 0xb0, 0, 0x80, 0, -1),
+        ('$REPARSE_POINT', 0xc0, 0, 0x80, 0, 0x4000),
+        ('$EA_INFORMATION', 0xd0, 0, 0x40, 8, 8),
+        ('$EA', 0xe0, 0, 0, 0, 0x10000),
+        ('$LOGGED_UTILITY_STREAM', 0x100, 0, 0x80, 0, 0x10000),
+    ]
+    table = bytearray(16 * 160)
+    for i, (name, atype, collation, flags, min_size, max_size) in enumerate(defs):
+        name_bytes = utf16(name)
+        table[i * 160:i * 160 + len(name_bytes)] = name_bytes
+        struct.pack_into('<IIIIqq', table, i * 160 + 128, atype, 0,
+                         collation, flags, min_size, max_size)
+    return bytes(table)
+
+
+class Volume:
+    def __init__(self):
+        self.image = bytearray(VOLUME_SECTORS * SECTOR_SIZE)
+        self.used = set()
+        self.records = {}
+        self.expected = []
+
+    def put(self, lcn, data):
+        """Store data at a cluster and mark the clusters it spans used"""
+        offset = lcn * CLUSTER_SIZE
+        self.image[offset:offset + len(data)] = data
+        self.use(lcn, align(len(data), CLUSTER_SIZE) // CLUSTER_SIZE)
+
+    def use(self, lcn, count):
+        self.used.update(range(lcn, lcn + count))
+
+    def put_runs(self, runs, data):
+        """Store data along a runlist, holes skipped"""
+        pos = 0
+        for lcn, length in runs:
+            size = length * CLUSTER_SIZE
+            if lcn is not HOLE:
+                self.use(lcn, length)
+                chunk = data[pos:pos + size]
+                self.image[lcn * CLUSTER_SIZE:lcn * CLUSTER_SIZE + len(chunk)] = chunk
+            pos += size
+
+    def expect(self, path, offset, physical, length, flags):
+        self.expected.append((path, offset, physical, length, flags))
+
+
+def build():
+    vol = Volume()
+    root_ref = 5 | (5 << 48)
+    sys_attrs = FILE_ATTR_HIDDEN | FILE_ATTR_SYSTEM
+    si_sys = resident_attr(AT_STANDARD_INFORMATION, standard_information(sys_attrs))
+    root_entries = []
+
+    def sys_name(name, flags=sys_attrs):
+        return resident_attr(AT_FILE_NAME, file_name(root_ref, name, flags), indexed=True)
+
+    # $Boot holds the boot sector, its backup is the last sector
+    boot = bytearray(SECTOR_SIZE)
+    boot[0:3] = b'\xeb\x52\x90'
+    boot[3:11] = b'NTFS    '
+    struct.pack_into('<HB', boot, 11, SECTOR_SIZE, CLUSTER_SIZE // SECTOR_SIZE)
+    boot[21] = 0xf8
+    struct.pack_into('<HHI', boot, 24, 63, 255, 0)
+    boot[36] = 0x80
+    boot[38] = 0x80
+    struct.pack_into('<qqq', boot, 40, VOLUME_SECTORS - 1, LCN_MFT, LCN_MFTMIRR)
+    boot[64] = (256 - (MFT_RECORD_SIZE.bit_length() - 1)) & 0xff
+    boot[68] = INDEX_BLOCK_SIZE // CLUSTER_SIZE
+    struct.pack_into('<Q', boot, 72, 0x0123456789abcdef)
+    struct.pack_into('<H', boot, 510, 0xaa55)
+    vol.put(LCN_BOOT, bytes(boot))
+    vol.use(LCN_BOOT, 2)
+    vol.image[(VOLUME_SECTORS - 1) * SECTOR_SIZE:] = boot
+
+    upcase = upcase_table()
+    vol.put(LCN_UPCASE, upcase)
+    attrdef = attrdef_table()
+    vol.put(LCN_ATTRDEF, attrdef)
+
+    # User files, from record 16 on
+    files = {}
+
+    data = b'Resident stream of the NTFS fixture.\n'
+    meta = b'named resident stream\n'
+    files['resident.txt'] = (16, FILE_ATTR_ARCHIVE, [
+        resident_attr(AT_DATA, data),
+        resident_attr(AT_DATA, meta, name='meta'),
+    ], len(data))
+    vol.expect('\\resident.txt', 0, -1, len(data), NTFS_EXTENT_RESIDENT)
+    vol.expect('\\resident.txt:meta', 0, -1, len(meta), NTFS_EXTENT_RESIDENT)
+
+    # Runs out of order on the volume, the last two adjacent so they merge
+    size = 48000
+    runs = [(100, 4), (300, 3), (200, 3), (203, 2)]
+    vol.put_runs(runs, pattern(1, size))
+    alt_runs = [(600, 1)]
+    alt = pattern(2, 100)
+    vol.put_runs(alt_runs, alt)
+    files['fragment.bin'] = (17, FILE_ATTR_ARCHIVE, [
+        nonresident_attr(AT_DATA, runs, size),
+        nonresident_attr(AT_DATA, alt_runs, len(alt), name='alt'),
+    ], size)
+    vol.expect('\\fragment.bin', 0, 100 * CLUSTER_SIZE, 4 * CLUSTER_SIZE, 0)
+    vol.expect('\\fragment.bin', 4 * CLUSTER_SIZE, 300 * CLUSTER_SIZE, 3 * CLUSTER_SIZE, 0)
+    vol.expect('\\fragment.bin', 7 * CLUSTER_SIZE, 200 * CLUSTER_SIZE, size - 7 * CLUSTER_SIZE, 0)
+    vol.expect('\\fragment.bin:alt', 0, 600 * CLUSTER_SIZE, len(alt), 0)
+
+    # Data, a hole, then data initialized for all but its last cluster; the
+    # unwritten tail holds garbage that must read back as zeroes
+    size = 10 * CLUSTER_SIZE
+    initialized = 9 * CLUSTER_SIZE
+    runs = [(400, 2), (HOLE, 4), (410, 4)]
+    sparse = bytearray(pattern(3, size))
+    sparse[2 * CLUSTER_SIZE:6 * CLUSTER_SIZE] = bytes(4 * CLUSTER_SIZE)
+    sparse[initialized:] = b'\xee' * (size - initialized)
+    vol.put_runs(runs, sparse)
+    files['sparse.bin'] = (18, FILE_ATTR_ARCHIVE | FILE_ATTR_SPARSE_FILE, [
+        nonresident_attr(AT_DATA, runs, size, initialized, flags=ATTR_IS_SPARSE),
+    ], size)
+    vol.expect('\\sparse.bin', 0, 400 * CLUSTER_SIZE, 2 * CLUSTER_SIZE, 0)
+    vol.expect('\\sparse.bin', 2 * CLUSTER_SIZE, -1, 4 * CLUSTER_SIZE, NTFS_EXTENT_HOLE)
+    vol.expect('\\sparse.bin', 6 * CLUSTER_SIZE, 410 * CLUSTER_SIZE, 3 * CLUSTER_SIZE, 0)
+    vol.expect('\\sparse.bin', initialized, 410 * CLUSTER_SIZE + 3 * CLUSTER_SIZE,
+               size - initialized, NTFS_EXTENT_UNWRITTEN)
+
+    # Compression units of 16 clusters: the first compressed into 2
+    # clusters, the second stored plain, the last (partial) one sparse
+    unit = CLUSTER_SIZE << COMPRESSION_UNIT
+    size = 2 * unit + 28928
+    text = b''.join(b'compression unit line %03d of the NTFS fixture\n' % (i % 16)
+                    for i in range(unit // 32))[:unit]
+    packed = lznt1_compress(text)
+    if len(packed) > 2 * CLUSTER_SIZE:
+        raise ValueError('compressed unit takes %d bytes' % len(packed))
+    vol.put(500, packed)
+    vol.use(500, 2)
+    vol.put(520, pattern(4, unit))
+    runs = [(500, 2), (HOLE, 14), (520, 16), (HOLE, 16)]
+    files['compress.bin'] = (19, FILE_ATTR_ARCHIVE | FILE_ATTR_COMPRESSED, [
+        nonresident_attr(AT_DATA, runs, size, flags=ATTR_IS_COMPRESSED),
+    ], size)
+    vol.expect('\\compress.bin', 0, 500 * CLUSTER_SIZE, 2 * CLUSTER_SIZE, NTFS_EXTENT_COMPRESSED)
+    vol.expect('\\compress.bin', 2 * CLUSTER_SIZE, -1, 14 * CLUSTER_SIZE, NTFS_EXTENT_COMPRESSED)
+    vol.expect('\\compress.bin', unit, 520 * CLUSTER_SIZE, unit, NTFS_EXTENT_COMPRESSED)
+    vol.expect('\\compress.bin', 2 * unit, -1, size - 2 * unit, NTFS_EXTENT_HOLE)
+
+    for name, (number, flags, attrs, data_size) in files.items():
+        fn = file_name(root_ref, name, flags, align(data_size, CLUSTER_SIZE), data_size)
+        vol.records[number] = mft_record(number, [
+            resident_attr(AT_STANDARD_INFORMATION, standard_information(flags)),
+            resident_attr(AT_FILE_NAME, fn, indexed=True),
+        ] + attrs)
+        root_entries.append((number | (1 << 48), fn))
+
+    # A directory listed in more than one batch: 72 files, 8 of them with a
+    # second name in the same directory, sorting before or after the first
+    many = 20
+    many_ref = many | (1 << 48)
+    many_entries = []
+    for i in range(72):
+        number = 32 + i
+        data = b'file %03d of the many directory\n' % i
+        names = ['file-%03d.txt' % i]
+        if i % 9 == 0:
+            names.append(('alias-%03d.txt' if i % 18 else 'link-%03d.txt') % i)
+        fns = [file_name(many_ref, name, FILE_ATTR_ARCHIVE, 0, len(data)) for name in names]
+        vol.records[number] = mft_record(number, [
+            resident_attr(AT_STANDARD_INFORMATION, standard_information(FILE_ATTR_ARCHIVE)),
+        ] + [resident_attr(AT_FILE_NAME, fn, indexed=True) for fn in fns] + [
+            resident_attr(AT_DATA, data),
+        ], links=len(fns))
+        many_entries += [(number | (1 << 48), fn) for fn in fns]
+
+    # A long name outside the DOS character set and its 8.3 alias, two names
+    # of one link; the alias comes first in the index and must not be listed
+    number = 30
+    data = b'File with a DOS alias.\n'
+    fns = [file_name(many_ref, name, FILE_ATTR_ARCHIVE, 0, len(data), namespace)
+           for name, namespace in (('\u914d\u7f6e\u6587\u4ef6.txt', FILE_NAME_WIN32),
+                                   ('8D4E~1.TXT', FILE_NAME_DOS))]
+    vol.records[number] = mft_record(number, [
+        resident_attr(AT_STANDARD_INFORMATION, standard_information(FILE_ATTR_ARCHIVE)),
+    ] + [resident_attr(AT_FILE_NAME, fn, indexed=True) for fn in fns] + [
+        resident_attr(AT_DATA, data),
+    ])
+    many_entries += [(number | (1 << 48), fn) for fn in fns]
+
+    # Two node entries in the root split the others over 3 leaf blocks
+    many_entries.sort(key=lambda entry: name_key(entry[1]))
+    third = len(many_entries) // 3
+    blocks = [many_entries[:third], many_entries[third + 1:2 * third + 1],
+              many_entries[2 * third + 2:]]
+    nodes = [many_entries[third] + (0,), many_entries[2 * third + 1] + (1,)]
+    for vcn, entries in enumerate(blocks):
+        vol.put(LCN_MANY_INDEX + vcn, index_block(vcn, entries))
+    dir_flags = FILE_ATTR_I30_INDEX_PRESENT
+    fn = file_name(root_ref, 'many', dir_flags)
+    vol.records[many] = mft_record(many, [
+        resident_attr(AT_STANDARD_INFORMATION, standard_information(0)),
+        resident_attr(AT_FILE_NAME, fn, indexed=True),
+        resident_attr(AT_INDEX_ROOT, index_root(nodes, end_child=2), name='$I30'),
+        nonresident_attr(AT_INDEX_ALLOCATION, [(LCN_MANY_INDEX, len(blocks))],
+                         len(blocks) * INDEX_BLOCK_SIZE, name='$I30'),
+        resident_attr(AT_BITMAP, struct.pack('<Q', (1 << len(blocks)) - 1), name='$I30'),
+    ], MFT_RECORD_IN_USE | MFT_RECORD_IS_DIRECTORY)
+    root_entries.append((many_ref, fn))
+
+    # Metadata files
+    mft_runs = [(LCN_MFT, MFT_RECORDS * MFT_RECORD_SIZE // CLUSTER_SIZE)]
+    mft_bitmap = bytearray(align(MFT_RECORDS // 8, 8))
+    for number in list(range(12)) + sorted(n for n in vol.records if n >= 16):
+        mft_bitmap[number >> 3] |= 1 << (number & 7)
+    vol.records[0] = mft_record(0, [
+        si_sys, sys_name('$MFT'),
+        nonresident_attr(AT_DATA, mft_runs, MFT_RECORDS * MFT_RECORD_SIZE),
+        resident_attr(AT_BITMAP, bytes(mft_bitmap)),
+    ])
+    vol.records[1] = mft_record(1, [
+        si_sys, sys_name('$MFTMirr'),
+        nonresident_attr(AT_DATA, [(LCN_MFTMIRR, 1)], 4 * MFT_RECORD_SIZE),
+    ])
+    vol.records[2] = mft_record(2, [si_sys, sys_name('$LogFile'), resident_attr(AT_DATA, b'')])
+    vol.records[3] = mft_record(3, [
+        si_sys, sys_name('$Volume'),
+        resident_attr(AT_VOLUME_NAME, utf16('fixture')),
+        resident_attr(AT_VOLUME_INFORMATION, struct.pack('<QBBH', 0, 3, 1, 0)),
+        resident_attr(AT_DATA, b''),
+    ])
+    vol.records[4] = mft_record(4, [
+        si_sys, sys_name('$AttrDef'),
+        nonresident_attr(AT_DATA, [(LCN_ATTRDEF, 1)], len(attrdef)),
+    ])
+    vol.records[6] = mft_record(6, [
+        si_sys, sys_name('$Bitmap'),
+        nonresident_attr(AT_DATA, [(LCN_BITMAP, 1)], align((NR_CLUSTERS + 7) // 8, 8)),
+    ])
+    vol.records[7] = mft_record(7, [
+        si_sys, sys_name('$Boot'),
+        nonresident_attr(AT_DATA, [(LCN_BOOT, 2)], 2 * CLUSTER_SIZE),
+    ])
+    vol.records[8] = mft_record(8, [si_sys, sys_name('$BadClus'), resident_attr(AT_DATA, b'')])
+    vol.records[9] = mft_record(9, [si_sys, sys_name('$Secure')])
+    vol.records[10] = mft_record(10, [
+        si_sys, sys_name('$UpCase'),
+        nonresident_attr(AT_DATA, [(LCN_UPCASE, len(upcase) // CLUSTER_SIZE)], len(upcase)),
+    ])
+    dir_attrs = sys_attrs | FILE_ATTR_I30_INDEX_PRESENT
+    vol.records[11] = mft_record(11, [
+        si_sys, sys_name('$Extend', dir_attrs),
+        resident_attr(AT_INDEX_ROOT, index_root([]), name='$I30'),
+    ], MFT_RECORD_IN_USE | MFT_RECORD_IS_DIRECTORY)
+
+    # The root directory indexes the user files by upper case name
+    root_entries.sort(key=lambda entry: name_key(entry[1]))
+    vol.records[5] = mft_record(5, [
+        si_sys, sys_name('.', dir_attrs),
+        resident_attr(AT_INDEX_ROOT, index_root(root_entries), name='$I30'),
+    ], MFT_RECORD_IN_USE | MFT_RECORD_IS_DIRECTORY, sequence=5)
+
+    mft = bytearray()
+    for number in range(MFT_RECORDS):
+        record = vol.records.get(number)
+        if record is None:
+            record = mft_record(number, [], flags=0)
+        mft += record
+    vol.put(LCN_MFT, bytes(mft))
+    vol.put(LCN_MFTMIRR, bytes(mft[:4 * MFT_RECORD_SIZE]))
+
+    bitmap = bytearray(CLUSTER_SIZE)
+    vol.use(LCN_BITMAP, 1)
+    for lcn in vol.used:
+        bitmap[lcn >> 3] |= 1 << (lcn & 7)
+    vol.put(LCN_BITMAP, bytes(bitmap))
+
+    return vol
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write('usage: %s <image> <extents>\n' % argv[0])
+        return 2
+    vol = build()
+    with open(argv[1], 'wb') as f:
+        f.write(vol.image)
+    with open(argv[2], 'w') as f:
+        f.write('# path[:stream] offset physical length flags\n')
+        for path, offset, physical, length, flags in vol.expected:
+            f.write('%s %d %d %d 0x%x\n' % (path, offset, physical, length, flags))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))